@@ -0,0 +1,1114 @@
+/*
+ *      libmp3lame encode benchmark
+ *
+ *      Encodes synthetic test signals with a set of presets and reports
+ *      the real time factor, the time per encoder stage (when libmp3lame
+ *      is built with LAME_PROFILE_STAGES) and the heap allocations made
+ *      by the library.  The signals come from a fixed seed, so runs on
+ *      the same build encode the same data and produce the same output,
+ *      which is hashed in the report.
+ *
+ *      With -S it measures encoder snapshots instead: their size, the
+ *      time to take and to load them, and whether an encoder that takes
+ *      over from a snapshot produces the same stream.
+ *
+ *      With -L it measures the delay from the input to the decoded
+ *      output, with frames sent as soon as they are complete, and
+ *      checks it against lame_get_latency.
+ *
+ *      With -G it runs the quality governor with a target below what
+ *      each preset needs at its full quality, reports where it settles
+ *      and checks that the stream still decodes to every frame.
+ *
+ *      With -R it times the resampler alone, per rate pair and quality.
+ *
+ *      See the Makefile for building on Linux.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "lame.h"
+
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
+#define SAMPLERATE  44100
+#define CHUNK       4096    /* samples per channel handed to each encode call */
+
+
+/***********************************************************************
+ *
+ *  allocation counting, the Makefile links with --wrap for these
+ *
+ ***********************************************************************/
+
+void   *__real_malloc(size_t size);
+void   *__real_calloc(size_t n, size_t size);
+void   *__real_realloc(void *p, size_t size);
+void    __real_free(void *p);
+
+static unsigned long alloc_count;
+static unsigned long alloc_bytes;
+
+void   *
+__wrap_malloc(size_t size)
+{
+    alloc_count++;
+    alloc_bytes += size;
+    return __real_malloc(size);
+}
+
+void   *
+__wrap_calloc(size_t n, size_t size)
+{
+    alloc_count++;
+    alloc_bytes += n * size;
+    return __real_calloc(n, size);
+}
+
+void   *
+__wrap_realloc(void *p, size_t size)
+{
+    alloc_count++;
+    alloc_bytes += size;
+    return __real_realloc(p, size);
+}
+
+void
+__wrap_free(void *p)
+{
+    __real_free(p);
+}
+
+
+/***********************************************************************
+ *
+ *  test signals, stereo float in [-1, 1]
+ *
+ ***********************************************************************/
+
+static unsigned long rng_state;
+
+static double
+rng(void)
+{
+    /* 32 bit LCG, good enough for noise and the same everywhere */
+    rng_state = (rng_state * 1664525UL + 1013904223UL) & 0xffffffffUL;
+    return rng_state / 2147483648.0 - 1.0;
+}
+
+/* logarithmic sweep 20 Hz .. 20 kHz, right channel a quarter period late */
+static void
+make_sweep(float *l, float *r, int n)
+{
+    double const k = log(20000.0 / 20.0) / n;
+    double  phase = 0;
+    int     i;
+
+    for (i = 0; i < n; i++) {
+        double const f = 20.0 * exp(k * i);
+        phase += 2 * M_PI * f / SAMPLERATE;
+        l[i] = (float) (0.5 * sin(phase));
+        r[i] = (float) (0.5 * cos(phase));
+    }
+}
+
+/* pink-ish noise, partly correlated between the channels */
+static void
+make_noise(float *l, float *r, int n)
+{
+    double  bl[3] = { 0, 0, 0 }, br[3] = { 0, 0, 0 };
+    int     i;
+
+    for (i = 0; i < n; i++) {
+        double const c = rng();
+        double const wl = 0.6 * c + 0.4 * rng();
+        double const wr = 0.6 * c + 0.4 * rng();
+        bl[0] = 0.99765 * bl[0] + wl * 0.0990460;
+        bl[1] = 0.96300 * bl[1] + wl * 0.2965164;
+        bl[2] = 0.57000 * bl[2] + wl * 1.0526913;
+        br[0] = 0.99765 * br[0] + wr * 0.0990460;
+        br[1] = 0.96300 * br[1] + wr * 0.2965164;
+        br[2] = 0.57000 * br[2] + wr * 1.0526913;
+        l[i] = (float) (0.12 * (bl[0] + bl[1] + bl[2] + wl * 0.1848));
+        r[i] = (float) (0.12 * (br[0] + br[1] + br[2] + wr * 0.1848));
+    }
+}
+
+/* castanet like bursts over a quiet tone, for the short block decisions */
+static void
+make_transients(float *l, float *r, int n)
+{
+    int const period = SAMPLERATE / 5;
+    int     i;
+
+    for (i = 0; i < n; i++) {
+        int const t = i % period;
+        double const burst = exp(-t / (0.004 * SAMPLERATE)) * rng();
+        double const tone = 0.02 * sin(2 * M_PI * 330.0 * i / SAMPLERATE);
+        double const pan = ((i / period) & 1) ? 0.8 : 0.3;
+        l[i] = (float) (tone + 0.9 * pan * burst);
+        r[i] = (float) (tone + 0.9 * (1 - pan) * burst);
+    }
+}
+
+/* pulse train with a wandering pitch through three formant resonators,
+ * in syllables with short pauses; the same on both channels */
+static void
+make_speech(float *l, float *r, int n)
+{
+    static const double formants[3][2] = { {700, 110}, {1220, 120}, {2600, 160} };
+    double  a1[3], a2[3], y1[3] = { 0, 0, 0 }, y2[3] = { 0, 0, 0 };
+    double  phase = 0;
+    int     i, k;
+
+    for (k = 0; k < 3; k++) {
+        double const rad = exp(-M_PI * formants[k][1] / SAMPLERATE);
+        a1[k] = 2 * rad * cos(2 * M_PI * formants[k][0] / SAMPLERATE);
+        a2[k] = -rad * rad;
+    }
+    for (i = 0; i < n; i++) {
+        double const t = (double) i / SAMPLERATE;
+        double const pitch = 140 + 40 * sin(2 * M_PI * 0.7 * t) + 15 * sin(2 * M_PI * 3.1 * t);
+        double const syllable = sin(2 * M_PI * 4.0 * t);
+        double const env = syllable > 0 && fmod(t, 2.5) < 2.0 ? syllable : 0;
+        double  x, y = 0;
+
+        phase += pitch / SAMPLERATE;
+        x = 0;
+        if (phase >= 1) {
+            phase -= 1;
+            x = 1;
+        }
+        x += 0.05 * rng();  /* breath */
+        for (k = 0; k < 3; k++) {
+            double const v = x + a1[k] * y1[k] + a2[k] * y2[k];
+            y2[k] = y1[k];
+            y1[k] = v;
+            y += v / (k + 1);
+        }
+        l[i] = r[i] = (float) (0.02 * env * y);
+    }
+}
+
+typedef struct {
+    char const *name;
+    void    (*make) (float *l, float *r, int n);
+} corpus_t;
+
+static const corpus_t corpora[] = {
+    {"sweep", make_sweep},
+    {"noise", make_noise},
+    {"transients", make_transients},
+    {"speech", make_speech},
+};
+
+
+/***********************************************************************
+ *
+ *  presets
+ *
+ ***********************************************************************/
+
+typedef struct {
+    char const *name;
+    int     channels;       /* channels of the input, mono takes the left one */
+    int     out_samplerate; /* 0 = same as input */
+    vbr_mode vbr;
+    int     kbps;           /* CBR/ABR bitrate */
+    int     vbr_quality;
+    int     quality;
+    int     replaygain;     /* also run the ReplayGain/loudness analysis */
+} preset_t;
+
+static const preset_t presets[] = {
+    {"cbr128", 2, 0, vbr_off, 128, 0, 5, 0},
+    {"cbr320-q2", 2, 0, vbr_off, 320, 0, 2, 0},
+    {"vbr-V2", 2, 0, vbr_default, 0, 2, 5, 0},
+    {"vbr-V5", 2, 0, vbr_default, 0, 5, 5, 0},
+    {"abr160", 2, 0, vbr_abr, 160, 0, 5, 0},
+    {"mono64-22k", 1, 22050, vbr_off, 64, 0, 5, 0},
+    {"cbr192-rg", 2, 0, vbr_off, 192, 0, 5, 1},
+};
+
+
+/***********************************************************************
+ *
+ *  benchmark
+ *
+ ***********************************************************************/
+
+static const char *const stage_names[LAME_STAGE_COUNT] = {
+    "input", "rgain", "psy", "mdct", "quant", "bits"
+};
+
+typedef struct {
+    double  seconds;        /* wall clock for the encode calls */
+    double  ticks[LAME_STAGE_COUNT];
+    int     have_ticks;
+    unsigned long init_allocs, encode_allocs, encode_bytes;
+    unsigned long mp3_bytes;
+    unsigned long hash;
+    int     frames;
+} result_t;
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned long
+fnv1a(unsigned long h, unsigned char const *p, int n)
+{
+    while (n-- > 0) {
+        h = ((h ^ *p++) * 16777619UL) & 0xffffffffUL;
+    }
+    return h;
+}
+
+/* low_latency, governor and cb: see lame_set_low_latency, lame_set_governor
+   and lame_set_frame_callback */
+static lame_global_flags *
+open_encoder(preset_t const *p, int low_latency, float governor, lame_frame_callback cb,
+             void *cb_data)
+{
+    lame_global_flags *gfp = lame_init();
+
+    if (gfp == NULL)
+        return NULL;
+    lame_set_in_samplerate(gfp, SAMPLERATE);
+    lame_set_num_channels(gfp, p->channels);
+    if (p->out_samplerate)
+        lame_set_out_samplerate(gfp, p->out_samplerate);
+    lame_set_quality(gfp, p->quality);
+    lame_set_VBR(gfp, p->vbr);
+    if (p->vbr == vbr_off)
+        lame_set_brate(gfp, p->kbps);
+    else if (p->vbr == vbr_abr)
+        lame_set_VBR_mean_bitrate_kbps(gfp, p->kbps);
+    else
+        lame_set_VBR_quality(gfp, (float) p->vbr_quality);
+    lame_set_bWriteVbrTag(gfp, 0);
+    lame_set_findReplayGain(gfp, p->replaygain);
+    lame_set_low_latency(gfp, low_latency);
+    lame_set_governor(gfp, governor);
+    lame_set_frame_callback(gfp, cb, cb_data);
+    if (lame_init_params(gfp) < 0) {
+        lame_close(gfp);
+        return NULL;
+    }
+    return gfp;
+}
+
+static int
+encode(preset_t const *p, float const *l, float const *r, int n,
+       unsigned char *mp3, int mp3_size, result_t * res)
+{
+    lame_global_flags *gfp;
+    unsigned long allocs0;
+    double  t0, t = 0;
+    int     i, ret, out = 0;
+
+    allocs0 = alloc_count;
+    gfp = open_encoder(p, -1, 0, NULL, NULL);
+    if (gfp == NULL)
+        return -1;
+    res->init_allocs = alloc_count - allocs0;
+
+    allocs0 = alloc_count;
+    res->encode_bytes = alloc_bytes;
+    for (i = 0; i < n; i += CHUNK) {
+        int const k = n - i < CHUNK ? n - i : CHUNK;
+        t0 = now();
+        ret = lame_encode_buffer_ieee_float(gfp, l + i, r + i, k, mp3 + out, mp3_size - out);
+        t += now() - t0;
+        if (ret < 0)
+            break;
+        out += ret;
+    }
+    t0 = now();
+    ret = lame_encode_flush(gfp, mp3 + out, mp3_size - out);
+    t += now() - t0;
+    if (ret >= 0)
+        out += ret;
+    res->encode_allocs = alloc_count - allocs0;
+    res->encode_bytes = alloc_bytes - res->encode_bytes;
+
+    res->seconds = t;
+    res->have_ticks = lame_stage_ticks(gfp, res->ticks) == 0;
+    res->frames = lame_get_frameNum(gfp);
+    res->mp3_bytes = out;
+    res->hash = fnv1a(2166136261UL, mp3, out);
+    lame_close(gfp);
+    return ret < 0 ? -1 : 0;
+}
+
+/***********************************************************************
+ *
+ *  snapshots: the encoder takes a full snapshot after the first
+ *  interval and deltas against it after the following ones.  Halfway
+ *  through, a second encoder loads the state and both encode the rest
+ *  of the signal, which has to come out the same.
+ *
+ ***********************************************************************/
+
+typedef struct {
+    size_t  full_bytes, delta_bytes; /* delta_bytes: average */
+    double  full_time, delta_time; /* per snapshot */
+    double  load_time;
+    int     deltas;
+    int     exact;
+} snap_result_t;
+
+static size_t
+take_snapshot(lame_global_flags const *gfp, unsigned char const *base, size_t base_len,
+              unsigned char **buf, size_t * cap, double *t)
+{
+    double  t0 = now();
+    size_t  len = lame_get_snapshot(gfp, base, base_len, *buf, *cap);
+
+    if (len > *cap) {
+        unsigned char *const p = realloc(*buf, len);
+        if (p == NULL)
+            return 0;
+        *buf = p;
+        *cap = len;
+        t0 = now();
+        len = lame_get_snapshot(gfp, base, base_len, *buf, *cap);
+    }
+    *t = now() - t0;
+    return len;
+}
+
+static int
+snapshot_test(preset_t const *p, float const *l, float const *r, int n,
+              unsigned char *mp3, int mp3_size, int interval, snap_result_t * res)
+{
+    lame_global_flags *a, *b = NULL;
+    unsigned char *base = NULL, *snap = NULL, *mp3b;
+    size_t  base_cap = 0, snap_cap = 0, base_len = 0, snap_len, delta_sum = 0;
+    int const step = interval * SAMPLERATE;
+    int const handover = n / 2 / CHUNK * CHUNK;
+    int     next = step, i, ret = 0, out_a = 0, out_b = 0, start_a = 0;
+    double  t;
+
+    memset(res, 0, sizeof(*res));
+    a = open_encoder(p, -1, 0, NULL, NULL);
+    mp3b = malloc(mp3_size);
+    if (a == NULL || mp3b == NULL)
+        goto fail;
+
+    for (i = 0; i <= n; i += CHUNK) {
+        int const k = n - i < CHUNK ? n - i : CHUNK;
+
+        if (i >= next || (i == handover && b == NULL)) {
+            if (base == NULL) {
+                base_len = take_snapshot(a, NULL, 0, &base, &base_cap, &t);
+                if (base_len == 0)
+                    goto fail;
+                res->full_bytes = base_len;
+                res->full_time = t;
+                snap_len = 0;
+            }
+            else {
+                snap_len = take_snapshot(a, base, base_len, &snap, &snap_cap, &t);
+                if (snap_len == 0)
+                    goto fail;
+                delta_sum += snap_len;
+                res->delta_time += t;
+                res->deltas++;
+            }
+            if (i >= next)
+                next += step;
+        }
+        if (i == handover && b == NULL) {
+            double  t0;
+            b = open_encoder(p, -1, 0, NULL, NULL);
+            if (b == NULL)
+                goto fail;
+            t0 = now();
+            ret = snap_len ? lame_set_snapshot(b, base, base_len, snap, snap_len)
+                : lame_set_snapshot(b, NULL, 0, base, base_len);
+            res->load_time = now() - t0;
+            if (ret != 0)
+                goto fail;
+            start_a = out_a;
+        }
+        if (k == 0)
+            break;
+
+        ret = lame_encode_buffer_ieee_float(a, l + i, r + i, k, mp3 + out_a, mp3_size - out_a);
+        if (ret < 0)
+            goto fail;
+        out_a += ret;
+        if (b != NULL) {
+            ret = lame_encode_buffer_ieee_float(b, l + i, r + i, k, mp3b + out_b,
+                                                mp3_size - out_b);
+            if (ret < 0)
+                goto fail;
+            out_b += ret;
+        }
+    }
+    ret = lame_encode_flush(a, mp3 + out_a, mp3_size - out_a);
+    if (ret < 0 || b == NULL)
+        goto fail;
+    out_a += ret;
+    ret = lame_encode_flush(b, mp3b + out_b, mp3_size - out_b);
+    if (ret < 0)
+        goto fail;
+    out_b += ret;
+
+    if (res->deltas > 0) {
+        res->delta_bytes = delta_sum / res->deltas;
+        res->delta_time /= res->deltas;
+    }
+    res->exact = out_b == out_a - start_a && memcmp(mp3 + start_a, mp3b, out_b) == 0;
+    ret = 0;
+    goto done;
+
+  fail:
+    ret = -1;
+  done:
+    if (a != NULL)
+        lame_close(a);
+    if (b != NULL)
+        lame_close(b);
+    free(base);
+    free(snap);
+    free(mp3b);
+    return ret;
+}
+
+
+static int
+snapshot_suite(float *l, float *r, int n, unsigned char *mp3, int mp3_size, int seconds,
+               int interval, char const *only_corpus, char const *only_preset)
+{
+    int     c, i, failed = 0;
+
+    printf("lame %s, %d s per signal, a snapshot every %d s\n\n", get_lame_version(),
+           seconds, interval);
+    printf("%-11s %-11s %8s %8s %8s %8s %8s %6s\n", "corpus", "preset", "full/KB", "full/us",
+           "delta/KB", "delta/us", "load/us", "exact");
+
+    for (c = 0; c < (int) (sizeof(corpora) / sizeof(corpora[0])); c++) {
+        if (only_corpus && strcmp(only_corpus, corpora[c].name) != 0)
+            continue;
+        rng_state = 1;
+        corpora[c].make(l, r, n);
+
+        for (i = 0; i < (int) (sizeof(presets) / sizeof(presets[0])); i++) {
+            preset_t const *p = &presets[i];
+            snap_result_t res;
+
+            if (only_preset && strcmp(only_preset, p->name) != 0)
+                continue;
+            if (snapshot_test(p, l, r, n, mp3, mp3_size, interval, &res) != 0) {
+                fprintf(stderr, "%s/%s: snapshot test failed\n", corpora[c].name, p->name);
+                failed = 1;
+                continue;
+            }
+            printf("%-11s %-11s %8.1f %8.0f", corpora[c].name, p->name,
+                   res.full_bytes / 1024., res.full_time * 1e6);
+            if (res.deltas > 0)
+                printf(" %8.1f %8.0f", res.delta_bytes / 1024., res.delta_time * 1e6);
+            else
+                printf(" %8s %8s", "-", "-");
+            printf(" %8.0f %6s\n", res.load_time * 1e6, res.exact ? "yes" : "NO");
+            if (!res.exact)
+                failed = 1;
+        }
+    }
+    printf("\ndelta: average size and time of the deltas against the first snapshot,\n"
+           "load: a new encoder loading the state halfway, exact: its output matches\n");
+
+    free(l);
+    free(r);
+    free(mp3);
+    return failed;
+}
+
+
+/***********************************************************************
+ *
+ *  latency: silence with a click, handed to the encoder one sample at
+ *  a time, every frame taken from a frame ring as soon as the encode
+ *  call returns.  A decoder playing
+ *  the frames back to back can start no earlier than the latest frame
+ *  arrived, counted back to its place in the stream; from that start
+ *  to the click in the decoded output is the delay the click went
+ *  through, which lame_get_latency predicts.
+ *
+ ***********************************************************************/
+
+#define CLICK_AT    (SAMPLERATE + 321)
+
+typedef struct {
+    int     fed;            /* samples handed to the encoder so far */
+    int     frames;
+    int     start;          /* earliest start of playback, in input samples */
+    unsigned char *mp3;
+    int     size, cap;
+    int     bad;            /* frames not matching their header */
+} latency_t;
+
+static void
+latency_frame(latency_t * lt, lame_frame const *frame)
+{
+    if (frame->samples > 0) {
+        if (frame->size < 4 || frame->data[2] >> 4 != frame->bitrate_index)
+            lt->bad++;
+        /* frame k plays from start + k * samples on */
+        int const start = lt->fed - lt->frames * frame->samples;
+        if (start > lt->start)
+            lt->start = start;
+        lt->frames++;
+    }
+    if (lt->size + (int) frame->size <= lt->cap)
+        memcpy(lt->mp3 + lt->size, frame->data, frame->size);
+    lt->size += frame->size;
+}
+
+static void
+latency_drain(latency_t * lt, lame_frame_ring * ring)
+{
+    lame_frame frame;
+
+    while (lame_frame_ring_peek(ring, &frame)) {
+        latency_frame(lt, &frame);
+        lame_frame_ring_release(ring);
+    }
+}
+
+/* returns the measured delay, or -1 */
+static int
+latency_test(preset_t const *p, int low_latency, float const *l, int n,
+             unsigned char *mp3, int mp3_size, short *pcm_l, short *pcm_r, int *predicted)
+{
+    lame_global_flags *gfp;
+    lame_frame_ring *ring;
+    hip_t   hip;
+    latency_t lt;
+    unsigned char dummy[1];
+    int     i, ret = 0, decoded = 0, peak = 0, idle;
+
+    *predicted = 0;
+    memset(&lt, 0, sizeof(lt));
+    lt.mp3 = mp3;
+    lt.cap = mp3_size;
+    ring = lame_frame_ring_open(16 * 1024);
+    gfp = open_encoder(p, low_latency, 0, lame_frame_ring_put, ring);
+    if (gfp == NULL || ring == NULL) {
+        if (gfp != NULL)
+            lame_close(gfp);
+        lame_frame_ring_close(ring);
+        return -1;
+    }
+    *predicted = lame_get_latency(gfp);
+    for (i = 0; i < n && ret >= 0; i++) {
+        lt.fed++;
+        ret = lame_encode_buffer_ieee_float(gfp, l + i, l + i, 1, dummy, 0);
+        latency_drain(&lt, ring);
+    }
+    /* the frames of the flush come after the end of the input */
+    lt.fed = -n;
+    if (ret >= 0)
+        ret = lame_encode_flush(gfp, dummy, 0);
+    latency_drain(&lt, ring);
+    lame_close(gfp);
+    if (lame_frame_ring_dropped(ring) > 0)
+        lt.bad++;
+    lame_frame_ring_close(ring);
+    if (ret < 0 || lt.size > lt.cap || lt.bad > 0)
+        return -1;
+
+    hip = hip_decode_init();
+    if (hip == NULL)
+        return -1;
+    /* the decoder may hold back a frame, so go on until it has nothing more */
+    ret = hip_decode(hip, mp3, lt.size, pcm_l, pcm_r);
+    for (idle = 0; ret >= 0 && idle < 2; ) {
+        decoded += ret;
+        idle = ret == 0 ? idle + 1 : 0;
+        ret = hip_decode(hip, mp3, 0, pcm_l + decoded, pcm_r + decoded);
+    }
+    hip_decode_exit(hip);
+    for (i = 1; i < decoded; i++) {
+        if (abs(pcm_l[i]) > abs(pcm_l[peak]))
+            peak = i;
+    }
+    return ret < 0 || decoded < CLICK_AT ? -1 : lt.start + peak - CLICK_AT;
+}
+
+static int
+latency_suite(float *l, float *r, int n, unsigned char *mp3, int mp3_size,
+              char const *only_preset)
+{
+    static const int levels[] = { 0, 1, 2, -1 };
+    /* the decoded output: the input plus up to three frames of padding */
+    short  *pcm_l = malloc((n + 4 * 1152) * sizeof(*pcm_l));
+    short  *pcm_r = malloc((n + 4 * 1152) * sizeof(*pcm_r));
+    int     i, k, failed = 0;
+
+    if (pcm_l == NULL || pcm_r == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    memset(l, 0, n * sizeof(*l));
+    l[CLICK_AT] = 0.5f;
+
+    printf("lame %s, a click after %.3f s\n\n", get_lame_version(),
+           (double) CLICK_AT / SAMPLERATE);
+    printf("%-11s %5s %9s %9s %7s %6s\n", "preset", "resv", "predicted", "measured", "ms",
+           "ok");
+    for (i = 0; i < (int) (sizeof(presets) / sizeof(presets[0])); i++) {
+        preset_t const *p = &presets[i];
+        int     lookahead = 0;
+
+        if (only_preset && strcmp(only_preset, p->name) != 0)
+            continue;
+        /* lame_get_latency counts at the output rate, without the resampler */
+        if (p->out_samplerate != 0)
+            continue;
+        for (k = 0; k < (int) (sizeof(levels) / sizeof(levels[0])); k++) {
+            int     predicted, measured, ok;
+
+            measured = latency_test(p, levels[k], l, n, mp3, mp3_size, pcm_l, pcm_r,
+                                    &predicted);
+            if (levels[k] == 0)
+                lookahead = measured;
+            /* without the reservoir the delay is exact, with it a bound */
+            ok = measured >= 0 && (levels[k] == 0 ? measured == predicted
+                                   : measured >= lookahead && measured <= predicted);
+            if (levels[k] < 0)
+                printf("%-11s %5s", p->name, "-");
+            else
+                printf("%-11s %5d", p->name, levels[k]);
+            printf(" %9d %9d %7.1f %6s\n", predicted, measured,
+                   1e3 * measured / SAMPLERATE, ok ? "yes" : "NO");
+            if (!ok)
+                failed = 1;
+        }
+    }
+    printf("\nresv: frames lame_set_low_latency allows the reservoir, - not limited,\n"
+           "predicted: lame_get_latency, measured: to the click in the decoded output\n");
+
+    free(pcm_l);
+    free(pcm_r);
+    free(l);
+    free(r);
+    free(mp3);
+    return failed;
+}
+
+/***********************************************************************
+ *
+ *  governor: each preset is first timed at its full quality, then
+ *  encoded with the quality governor aiming at a share of that load.
+ *  The governor has to step down to get there; the stream it writes
+ *  still has to decode to one frame of samples for every frame.
+ *
+ ***********************************************************************/
+
+typedef struct {
+    double  load;           /* encode time over audio time, at the end */
+    lame_governor_stats stats;
+    int     frames;
+    int     decoded;        /* frames' worth of samples the decoder put out */
+} gov_result_t;
+
+static int
+governor_test(preset_t const *p, float const *l, float const *r, int n,
+              unsigned char *mp3, int mp3_size, short *pcm_l, short *pcm_r, float target,
+              gov_result_t * res)
+{
+    lame_global_flags *gfp;
+    hip_t   hip;
+    double  t0;
+    int     i, ret = 0, out = 0, framesize, decoded = 0, idle;
+
+    gfp = open_encoder(p, -1, target, NULL, NULL);
+    if (gfp == NULL)
+        return -1;
+    t0 = now();
+    for (i = 0; i < n && ret >= 0; i += CHUNK) {
+        int const k = n - i < CHUNK ? n - i : CHUNK;
+        ret = lame_encode_buffer_ieee_float(gfp, l + i, r + i, k, mp3 + out, mp3_size - out);
+        if (ret >= 0)
+            out += ret;
+    }
+    if (ret >= 0)
+        ret = lame_encode_flush(gfp, mp3 + out, mp3_size - out);
+    res->load = (now() - t0) * SAMPLERATE / n;
+    if (ret >= 0)
+        out += ret;
+    if (lame_get_governor_stats(gfp, &res->stats) != 0)
+        ret = -1;
+    res->frames = lame_get_frameNum(gfp);
+    framesize = lame_get_framesize(gfp);
+    lame_close(gfp);
+    if (ret < 0)
+        return -1;
+
+    hip = hip_decode_init();
+    if (hip == NULL)
+        return -1;
+    ret = hip_decode(hip, mp3, out, pcm_l, pcm_r);
+    for (idle = 0; ret >= 0 && idle < 2; ) {
+        decoded += ret;
+        idle = ret == 0 ? idle + 1 : 0;
+        ret = hip_decode(hip, mp3, 0, pcm_l + decoded, pcm_r + decoded);
+    }
+    hip_decode_exit(hip);
+    res->decoded = decoded % framesize == 0 ? decoded / framesize : -1;
+    return ret < 0 ? -1 : 0;
+}
+
+static int
+governor_suite(float *l, float *r, int n, unsigned char *mp3, int mp3_size, int runs,
+               double share, char const *only_corpus, char const *only_preset)
+{
+    /* the decoded output: the input plus up to three frames of padding */
+    short  *pcm_l = malloc((n + 4 * 1152) * sizeof(*pcm_l));
+    short  *pcm_r = malloc((n + 4 * 1152) * sizeof(*pcm_r));
+    int     c, i, k, failed = 0;
+
+    if (pcm_l == NULL || pcm_r == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    printf("lame %s, %.0f s per signal, target %.0f%% of the full quality load\n\n",
+           get_lame_version(), (double) n / SAMPLERATE, 100 * share);
+    printf("%-11s %-11s %7s %7s %7s %5s %-24s %7s %5s %7s\n", "corpus", "preset", "full",
+           "target", "load", "level", "frames per level, %", "changes", "late", "decodes");
+
+    for (c = 0; c < (int) (sizeof(corpora) / sizeof(corpora[0])); c++) {
+        if (only_corpus && strcmp(only_corpus, corpora[c].name) != 0)
+            continue;
+        rng_state = 1;
+        corpora[c].make(l, r, n);
+
+        for (i = 0; i < (int) (sizeof(presets) / sizeof(presets[0])); i++) {
+            preset_t const *p = &presets[i];
+            result_t res;
+            gov_result_t gov;
+            double  full = 0;
+            char    spread[64];
+            int     run, len = 0, ok;
+
+            if (only_preset && strcmp(only_preset, p->name) != 0)
+                continue;
+            for (run = 0; run < runs; run++) {
+                if (encode(p, l, r, n, mp3, mp3_size, &res) != 0)
+                    break;
+                if (run == 0 || res.seconds * SAMPLERATE / n < full)
+                    full = res.seconds * SAMPLERATE / n;
+            }
+            if (run < runs
+                || governor_test(p, l, r, n, mp3, mp3_size, pcm_l, pcm_r,
+                                 (float) (share * full), &gov) != 0) {
+                fprintf(stderr, "%s/%s: governor test failed\n", corpora[c].name, p->name);
+                failed = 1;
+                continue;
+            }
+            for (k = 0; k < gov.stats.levels; k++)
+                len += snprintf(spread + len, sizeof(spread) - len, "%s%.0f", k ? "/" : "",
+                                100. * gov.stats.frames[k] / gov.frames);
+            ok = gov.decoded == gov.frames;
+            printf("%-11s %-11s %7.4f %7.4f %7.4f %2d/%-2d %-24s %7lu %5lu %7s\n",
+                   corpora[c].name, p->name, full, share * full, gov.load, gov.stats.level,
+                   gov.stats.levels, spread, gov.stats.changes, gov.stats.late,
+                   ok ? "yes" : "NO");
+            if (!ok)
+                failed = 1;
+        }
+    }
+    printf("\nfull, target, load: encode time over audio time, at full quality, asked\n"
+           "for and with the governor; level: where it ended, of the levels below the\n"
+           "preset's quality; decodes: the decoder gets a frame out of every frame\n");
+
+    free(pcm_l);
+    free(pcm_r);
+    free(l);
+    free(r);
+    free(mp3);
+    return failed;
+}
+
+/***********************************************************************
+ *
+ *  resampler: lame_resampler_process on its own, stereo, fed in
+ *  CHUNK sized blocks the way lame_encode_buffer feeds it, for the
+ *  rate pairs the encoder meets and the three filter lengths the
+ *  quality setting picks from.
+ *
+ ***********************************************************************/
+
+static const struct {
+    int     in, out;
+} rs_rates[] = {
+    {48000, 44100},
+    {44100, 48000},
+    {32000, 44100},
+    {44100, 32000},
+    {44100, 22050},
+    {48000, 16000},
+};
+
+static const int rs_qualities[] = { 0, 5, 9 };
+
+/* returns the time for all of in, or -1 */
+static double
+resample_test(int rate_in, int rate_out, int quality, float *const in[2], int n,
+              float *const out[2], int out_size, int *nout)
+{
+    lame_resampler_t rs = lame_resampler_init(rate_in, rate_out, 2, quality);
+    double  t0;
+    int     i = 0;
+
+    if (rs == NULL)
+        return -1;
+    *nout = 0;
+    t0 = now();
+    while (i < n) {
+        int const k = n - i < CHUNK ? n - i : CHUNK;
+        float const *const pin[2] = { in[0] + i, in[1] + i };
+        float *const pout[2] = { out[0] + *nout, out[1] + *nout };
+        int     used;
+
+        *nout += lame_resampler_process(rs, pin, k, &used, pout, out_size - *nout);
+        if (used <= 0)
+            break;
+        i += used;
+    }
+    t0 = now() - t0;
+    lame_resampler_close(rs);
+    return i < n ? -1 : t0;
+}
+
+static int
+resampler_suite(float *l, float *r, unsigned char *mp3, int seconds, int runs)
+{
+    int const n = seconds * 48000;
+    int const out_size = seconds * 48000 + CHUNK;
+    float  *in[2], *out[2];
+    int     i, q, failed = 0;
+
+    free(l);
+    free(r);
+    free(mp3);
+    in[0] = malloc(n * sizeof(float));
+    in[1] = malloc(n * sizeof(float));
+    out[0] = malloc(out_size * sizeof(float));
+    out[1] = malloc(out_size * sizeof(float));
+    if (in[0] == NULL || in[1] == NULL || out[0] == NULL || out[1] == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    rng_state = 1;
+    make_noise(in[0], in[1], n);
+
+    printf("lame %s, %d s of stereo noise per case, best of %d\n\n", get_lame_version(),
+           seconds, runs);
+    printf("%-13s %7s %9s %9s\n", "rates", "quality", "x real", "ns/sample");
+    for (i = 0; i < (int) (sizeof(rs_rates) / sizeof(rs_rates[0])); i++) {
+        for (q = 0; q < (int) (sizeof(rs_qualities) / sizeof(rs_qualities[0])); q++) {
+            int const n_in = seconds * rs_rates[i].in;
+            double  best = -1;
+            int     run, nout = 0;
+            char    rates[32];
+
+            for (run = 0; run < runs; run++) {
+                double const t = resample_test(rs_rates[i].in, rs_rates[i].out,
+                                               rs_qualities[q], in, n_in, out, out_size,
+                                               &nout);
+                if (t < 0) {
+                    best = -1;
+                    break;
+                }
+                if (best < 0 || t < best)
+                    best = t;
+            }
+            snprintf(rates, sizeof(rates), "%d>%d", rs_rates[i].in, rs_rates[i].out);
+            if (best < 0 || nout <= 0) {
+                fprintf(stderr, "%s q%d: resampler test failed\n", rates, rs_qualities[q]);
+                failed = 1;
+                continue;
+            }
+            printf("%-13s %7d %9.1f %9.2f\n", rates, rs_qualities[q], seconds / best,
+                   best * 1e9 / (2. * nout));
+        }
+    }
+    printf("\nx real: audio time over resampling time, ns/sample: per output sample\n"
+           "and channel\n");
+
+    free(in[0]);
+    free(in[1]);
+    free(out[0]);
+    free(out[1]);
+    return failed;
+}
+
+static void
+usage(char const *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-s seconds] [-r runs] [-c corpus] [-p preset] [-S interval] [-L]\n"
+            "       [-G share] [-R]\n"
+            "  -s  length of each test signal, default 20\n"
+            "  -r  encodes per case, the fastest is reported, default 3\n"
+            "  -c  only this corpus (sweep, noise, transients, speech)\n"
+            "  -p  only this preset\n"
+            "  -S  measure encoder snapshots taken every interval seconds instead\n"
+            "  -L  measure the latency of each preset, with and without low latency\n"
+            "  -G  run the quality governor with this share of the time each preset\n"
+            "      needs at full quality as its target\n"
+            "  -R  measure the resampler on its own\n", prog);
+}
+
+int
+main(int argc, char **argv)
+{
+    int     seconds = 20, runs = 3, snap_interval = 0, latency = 0, resampler = 0;
+    double  governor = 0;
+    char const *only_corpus = NULL, *only_preset = NULL;
+    float  *l, *r;
+    unsigned char *mp3;
+    int     n, mp3_size, c, i, k, failed = 0;
+    double  total_audio = 0, total_time = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+            seconds = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-r") == 0)
+            runs = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-c") == 0)
+            only_corpus = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-p") == 0)
+            only_preset = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-S") == 0)
+            snap_interval = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-L") == 0)
+            latency = 1;
+        else if (strcmp(argv[i], "-R") == 0)
+            resampler = 1;
+        else if (i + 1 < argc && strcmp(argv[i], "-G") == 0)
+            governor = atof(argv[++i]);
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (seconds < 1 || runs < 1 || snap_interval < 0 || governor < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    n = seconds * SAMPLERATE;
+    mp3_size = n + n / 4 + 7200;
+    l = malloc(n * sizeof(*l));
+    r = malloc(n * sizeof(*r));
+    mp3 = malloc(mp3_size);
+    if (l == NULL || r == NULL || mp3 == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    if (resampler)
+        return resampler_suite(l, r, mp3, seconds, runs);
+    if (latency)
+        return latency_suite(l, r, n, mp3, mp3_size, only_preset);
+    if (governor > 0)
+        return governor_suite(l, r, n, mp3, mp3_size, runs, governor, only_corpus,
+                              only_preset);
+    if (snap_interval > 0)
+        return snapshot_suite(l, r, n, mp3, mp3_size, seconds, snap_interval,
+                              only_corpus, only_preset);
+
+    printf("lame %s, %d s per signal, best of %d\n\n", get_lame_version(), seconds, runs);
+    printf("%-11s %-11s %7s %8s %8s", "corpus", "preset", "x real", "bytes", "hash");
+    for (k = 0; k < LAME_STAGE_COUNT; k++)
+        printf(" %5s", stage_names[k]);
+    printf(" %9s %6s %7s\n", "ticks/fr", "allocs", "enc/KB");
+
+    for (c = 0; c < (int) (sizeof(corpora) / sizeof(corpora[0])); c++) {
+        if (only_corpus && strcmp(only_corpus, corpora[c].name) != 0)
+            continue;
+        rng_state = 1;
+        corpora[c].make(l, r, n);
+
+        for (i = 0; i < (int) (sizeof(presets) / sizeof(presets[0])); i++) {
+            preset_t const *p = &presets[i];
+            result_t best, res;
+            double  sum = 0;
+            int     run;
+
+            if (only_preset && strcmp(only_preset, p->name) != 0)
+                continue;
+            memset(&best, 0, sizeof(best));
+            for (run = 0; run < runs; run++) {
+                if (encode(p, l, r, n, mp3, mp3_size, &res) != 0) {
+                    fprintf(stderr, "%s/%s: encoding failed\n", corpora[c].name, p->name);
+                    failed = 1;
+                    break;
+                }
+                if (run == 0 || res.seconds < best.seconds)
+                    best = res;
+            }
+            if (run < runs)
+                continue;
+
+            total_audio += seconds;
+            total_time += best.seconds;
+            printf("%-11s %-11s %7.1f %8lu %08lx", corpora[c].name, p->name,
+                   seconds / best.seconds, best.mp3_bytes, best.hash);
+            for (k = 0; k < LAME_STAGE_COUNT; k++)
+                sum += best.ticks[k];
+            for (k = 0; k < LAME_STAGE_COUNT; k++) {
+                if (best.have_ticks && sum > 0)
+                    printf(" %4.1f%%", 100 * best.ticks[k] / sum);
+                else
+                    printf(" %5s", "-");
+            }
+            if (best.have_ticks && best.frames > 0)
+                printf(" %9.0f", sum / best.frames);
+            else
+                printf(" %9s", "-");
+            printf(" %3lu+%-2lu %7lu\n", best.init_allocs, best.encode_allocs,
+                   best.encode_bytes / 1024);
+        }
+    }
+    if (total_time > 0)
+        printf("\noverall %.1f x real time\n", total_audio / total_time);
+    printf("\nstages in %% of the encoder time (- without LAME_PROFILE_STAGES),\n"
+           "ticks/fr: time stamp counter ticks per frame,\n"
+           "allocs: allocations in init + while encoding, enc/KB: size of the latter\n");
+
+    free(l);
+    free(r);
+    free(mp3);
+    return failed;
+}
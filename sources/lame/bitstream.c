@@ -129,6 +129,18 @@ get_max_frame_buffer_size_by_constraint(SessionConfig_t const * cfg, int constra
 }
 
 
+/* move all whole bytes of the bit cache into the buffer */
+inline static void
+putbits_sync(Bit_stream_struc * bs)
+{
+    while (bs->cache_bits >= 8) {
+        bs->cache_bits -= 8;
+        bs->buf[++bs->buf_byte_idx] = (unsigned char) (bs->cache >> bs->cache_bits);
+        assert(bs->buf_byte_idx < BUFFER_SIZE);
+    }
+}
+
+
 static void
 putheader_bits(lame_internal_flags * gfc)
 {
@@ -138,80 +150,66 @@ putheader_bits(lame_internal_flags * gfc)
 #ifdef DEBUG
     hogege += cfg->sideinfo_len * 8;
 #endif
-    memcpy(&bs->buf[bs->buf_byte_idx], esv->header[esv->w_ptr].buf, cfg->sideinfo_len);
+    putbits_sync(bs);
+    assert(bs->cache_bits == 0); /* headers always start on a byte boundary */
+    memcpy(&bs->buf[bs->buf_byte_idx + 1], esv->header[esv->w_ptr].buf, cfg->sideinfo_len);
     bs->buf_byte_idx += cfg->sideinfo_len;
     bs->totbit += cfg->sideinfo_len * 8;
     esv->w_ptr = (esv->w_ptr + 1) & (MAX_HEADER_BUF - 1);
+    bs->header_left = esv->header[esv->w_ptr].write_timing - bs->totbit;
+    assert(bs->header_left >= 0);
 }
 
 
+/* append j bits to the bit cache, storing them 32 bits at a time */
+inline static void
+putbits_cache(Bit_stream_struc * bs, unsigned int val, int j)
+{
+    assert(j < MAX_LENGTH - 2);
+    assert(val < (1u << j));
+
+    bs->cache = (bs->cache << j) | val;
+    bs->cache_bits += j;
+    bs->totbit += j;
+    if (bs->cache_bits >= 32) {
+        unsigned char *const p = &bs->buf[bs->buf_byte_idx + 1];
+        uint32_t const w = (uint32_t) (bs->cache >> (bs->cache_bits - 32));
+        assert(bs->buf_byte_idx + 4 < BUFFER_SIZE);
+        p[0] = (unsigned char) (w >> 24);
+        p[1] = (unsigned char) (w >> 16);
+        p[2] = (unsigned char) (w >> 8);
+        p[3] = (unsigned char) w;
+        bs->buf_byte_idx += 4;
+        bs->cache_bits -= 32;
+    }
+}
 
 
 /*write j bits into the bit stream */
 inline static void
 putbits2(lame_internal_flags * gfc, int val, int j)
 {
-    EncStateVar_t const *const esv = &gfc->sv_enc;
-    Bit_stream_struc *bs;
-    bs = &gfc->bs;
-
-    assert(j < MAX_LENGTH - 2);
-
-    while (j > 0) {
-        int     k;
-        if (bs->buf_bit_idx == 0) {
-            bs->buf_bit_idx = 8;
-            bs->buf_byte_idx++;
-            assert(bs->buf_byte_idx < BUFFER_SIZE);
-            assert(esv->header[esv->w_ptr].write_timing >= bs->totbit);
-            if (esv->header[esv->w_ptr].write_timing == bs->totbit) {
-                putheader_bits(gfc);
-            }
-            bs->buf[bs->buf_byte_idx] = 0;
-        }
+    Bit_stream_struc *const bs = &gfc->bs;
 
-        k = Min(j, bs->buf_bit_idx);
+    while (j > bs->header_left) {
+        /* the next frame header is due after header_left more bits */
+        int const k = bs->header_left;
         j -= k;
-
-        bs->buf_bit_idx -= k;
-
-        assert(j < MAX_LENGTH); /* 32 too large on 32 bit machines */
-        assert(bs->buf_bit_idx < MAX_LENGTH);
-
-        bs->buf[bs->buf_byte_idx] |= ((val >> j) << bs->buf_bit_idx);
-        bs->totbit += k;
+        putbits_cache(bs, (unsigned int) val >> j, k);
+        val &= (1 << j) - 1;
+        putheader_bits(gfc);
     }
+    putbits_cache(bs, (unsigned int) val, j);
+    bs->header_left -= j;
 }
 
 /*write j bits into the bit stream, ignoring frame headers */
 inline static void
 putbits_noheaders(lame_internal_flags * gfc, int val, int j)
 {
-    Bit_stream_struc *bs;
-    bs = &gfc->bs;
-
-    assert(j < MAX_LENGTH - 2);
-
-    while (j > 0) {
-        int     k;
-        if (bs->buf_bit_idx == 0) {
-            bs->buf_bit_idx = 8;
-            bs->buf_byte_idx++;
-            assert(bs->buf_byte_idx < BUFFER_SIZE);
-            bs->buf[bs->buf_byte_idx] = 0;
-        }
-
-        k = Min(j, bs->buf_bit_idx);
-        j -= k;
-
-        bs->buf_bit_idx -= k;
-
-        assert(j < MAX_LENGTH); /* 32 too large on 32 bit machines */
-        assert(bs->buf_bit_idx < MAX_LENGTH);
-
-        bs->buf[bs->buf_byte_idx] |= ((val >> j) << bs->buf_bit_idx);
-        bs->totbit += k;
-    }
+    /* callers shift all pending write_timing values by the bits written,
+     * so header_left stays as it is */
+    putbits_cache(&gfc->bs, (unsigned int) val, j);
 }
 
 
@@ -837,7 +835,7 @@ compute_flushbits(const lame_internal_flags * gfc, int *total_bytes_output)
         *total_bytes_output = 1 + (*total_bytes_output / 8);
     else
         *total_bytes_output = (*total_bytes_output / 8);
-    *total_bytes_output += gfc->bs.buf_byte_idx + 1;
+    *total_bytes_output += gfc->bs.buf_byte_idx + 1 + (gfc->bs.cache_bits + 7) / 8;
 
 
     if (flushbits < 0) {
@@ -1056,29 +1054,92 @@ static int
 do_copy_buffer(lame_internal_flags * gfc, unsigned char *buffer, int size)
 {
     Bit_stream_struc *const bs = &gfc->bs;
-    int const minimum = bs->buf_byte_idx + 1;
+    int     minimum;
+    putbits_sync(bs);
+    if (bs->cache_bits > 0) {
+        /* partial byte, padded with zero bits */
+        bs->buf[bs->buf_byte_idx + 1] = (unsigned char) (bs->cache << (8 - bs->cache_bits));
+    }
+    minimum = bs->buf_byte_idx + 1 + (bs->cache_bits > 0);
     if (minimum <= 0)
         return 0;
     if (minimum > size)
         return -1;      /* buffer is too small */
     memcpy(buffer, bs->buf, minimum);
     bs->buf_byte_idx = -1;
-    bs->buf_bit_idx = 0;
+    bs->cache_bits = 0;
     return minimum;
 }
 
+/* hand the bit buffer to the frame callback one frame at a time.  A
+   frame is complete once the bitstream has reached the header of the
+   next one; until then the main data of later frames may still go into
+   its slot.  Bytes ahead of a frame header that belong to no frame (ID3
+   tags, the Xing/LAME frame) are handed over as they are, the rest of
+   the buffer is kept for the frames to come. */
+static int
+emit_frames(lame_internal_flags * gfc)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    EncStateVar_t *const esv = &gfc->sv_enc;
+    Bit_stream_struc *const bs = &gfc->bs;
+    lame_frame frame;
+    int     bit0, pos = 0, end, ret = 0;
+
+    putbits_sync(bs);
+    /* bitstream position of bs->buf[0]; headers start on byte boundaries,
+       so a complete frame never ends in the bit cache */
+    bit0 = bs->totbit - 8 * (bs->buf_byte_idx + 1) - bs->cache_bits;
+    for (;;) {
+        int const e = esv->emit_ptr;
+        int const next = (e + 1) & (MAX_HEADER_BUF - 1);
+
+        end = Min((esv->header[e].write_timing - bit0) / 8, bs->buf_byte_idx + 1);
+        if (end > pos) {
+            frame.data = bs->buf + pos;
+            frame.size = end - pos;
+            frame.samples = 0;
+            frame.bitrate_index = 0;
+            gfc->frame_cb(gfc->frame_cb_data, &frame);
+            pos = end;
+        }
+        if (e == esv->h_ptr || esv->header[next].write_timing > bs->totbit)
+            break;
+
+        end = (esv->header[next].write_timing - bit0) / 8;
+        UpdateMusicCRC(&gfc->nMusicCRC, bs->buf + pos, end - pos);
+        gfc->VBR_seek_table.nBytesWritten += end - pos;
+        if (do_gain_analysis(gfc, bs->buf + pos, end - pos) < 0)
+            ret = -6;
+        frame.data = bs->buf + pos;
+        frame.size = end - pos;
+        frame.samples = 576 * cfg->mode_gr;
+        frame.bitrate_index = (unsigned char) esv->header[e].buf[2] >> 4;
+        gfc->frame_cb(gfc->frame_cb_data, &frame);
+        pos = end;
+        esv->emit_ptr = next;
+    }
+    bs->buf_byte_idx -= pos;
+    memmove(bs->buf, bs->buf + pos, bs->buf_byte_idx + 1);
+    return ret;
+}
+
 /* copy data out of the internal MP3 bit buffer into a user supplied
    unsigned char buffer.
 
    mp3data=0      indicates data in buffer is an id3tags and VBR tags
    mp3data=1      data is real mp3 frame data.
 
-
+   With a frame callback set, everything goes to the callback instead
+   and nothing is copied.
 */
 int
 copy_buffer(lame_internal_flags * gfc, unsigned char *buffer, int size, int mp3data)
 {
-    int const minimum = do_copy_buffer(gfc, buffer, size);
+    int     minimum;
+    if (gfc->frame_cb != NULL)
+        return emit_frames(gfc);
+    minimum = do_copy_buffer(gfc, buffer, size);
     if (minimum > 0 && mp3data) {
         UpdateMusicCRC(&gfc->nMusicCRC, buffer, minimum);
 
@@ -1098,13 +1159,15 @@ init_bit_stream_w(lame_internal_flags * gfc)
 {
     EncStateVar_t *const esv = &gfc->sv_enc;
 
-    esv->h_ptr = esv->w_ptr = 0;
+    esv->h_ptr = esv->w_ptr = esv->emit_ptr = 0;
     esv->header[esv->h_ptr].write_timing = 0;
 
     gfc->bs.buf = lame_calloc(unsigned char, BUFFER_SIZE);
     gfc->bs.buf_size = BUFFER_SIZE;
     gfc->bs.buf_byte_idx = -1;
-    gfc->bs.buf_bit_idx = 0;
+    gfc->bs.cache = 0;
+    gfc->bs.cache_bits = 0;
+    gfc->bs.header_left = 0;
     gfc->bs.totbit = 0;
 }
 
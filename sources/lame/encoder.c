@@ -395,6 +395,7 @@ lame_encode_mp3_frame(       /* Output */
 
     /* auto-adjust of ATH, useful for low volume */
     adjust_ATH(gfc);
+    PROFILE_LAP(gfc, LAME_STAGE_PSYMODEL);
 
 
     /****************************************
@@ -403,6 +404,7 @@ lame_encode_mp3_frame(       /* Output */
 
     /* polyphase filtering / mdct */
     mdct_sub48(gfc, inbuf[0], inbuf[1]);
+    PROFILE_LAP(gfc, LAME_STAGE_MDCT);
 
 
     /****************************************
@@ -533,6 +535,7 @@ lame_encode_mp3_frame(       /* Output */
         VBR_new_iteration_loop(gfc, (const FLOAT (*)[2])pe_use, ms_ener_ratio, masking);
         break;
     }
+    PROFILE_LAP(gfc, LAME_STAGE_QUANTIZE);
 
 
     /****************************************
@@ -569,6 +572,7 @@ lame_encode_mp3_frame(       /* Output */
     ++gfc->ov_enc.frame_number;
 
     updateStats(gfc);
+    PROFILE_LAP(gfc, LAME_STAGE_BITSTREAM);
 
     return mp3count;
 }
@@ -0,0 +1,200 @@
+/*
+ *      lock-free ring of encoded frames
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ *  The encoder thread puts frames in through lame_frame_ring_put (the
+ *  frame callback), one reader takes them out.  Each frame is stored as
+ *  a record, its description followed by the bytes, and a record never
+ *  wraps around the end of the buffer: where it does not fit, a wrap
+ *  mark sends the reader back to the start.  So the reader gets every
+ *  frame as one piece, straight from the ring.
+ *
+ *  Only the encoder moves head and only the reader moves tail, each
+ *  publishing its records with a release store that the other side
+ *  reads with an acquire load.  head == tail means empty, so the writer
+ *  always leaves a gap.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "lame.h"
+#include "machine.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+# define ring_load(p)       __atomic_load_n(p, __ATOMIC_ACQUIRE)
+# define ring_store(p, v)   __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#else
+/* MSVC gives volatile accesses acquire and release semantics */
+# define ring_load(p)       (*(size_t const volatile *) (p))
+# define ring_store(p, v)   (*(size_t volatile *) (p) = (v))
+#endif
+
+#define RING_ALIGN  16
+#define RING_WRAP   0xffffffffu /* size of the mark at the end of the used part */
+
+typedef struct {
+    uint32_t size;
+    int32_t samples;
+    int32_t bitrate_index;
+    uint32_t unused;
+} ring_record;
+
+struct lame_frame_ring_s {
+    unsigned char *buf;
+    size_t  size;            /* multiple of RING_ALIGN */
+    size_t  dropped;
+    size_t  head;
+    char    pad[64];         /* keep the two ends on their own cache lines */
+    size_t  tail;
+};
+
+
+static  size_t
+record_size(size_t bytes)
+{
+    return (sizeof(ring_record) + bytes + RING_ALIGN - 1) & ~(size_t) (RING_ALIGN - 1);
+}
+
+
+lame_frame_ring *
+lame_frame_ring_open(size_t size)
+{
+    lame_frame_ring *ring;
+
+    size &= ~(size_t) (RING_ALIGN - 1);
+    if (size < 2 * RING_ALIGN)
+        return NULL;
+    ring = lame_calloc(lame_frame_ring, 1);
+    if (ring == NULL)
+        return NULL;
+    ring->buf = lame_calloc(unsigned char, size);
+    if (ring->buf == NULL) {
+        free(ring);
+        return NULL;
+    }
+    ring->size = size;
+    return ring;
+}
+
+
+void
+lame_frame_ring_close(lame_frame_ring * ring)
+{
+    if (ring != NULL) {
+        free(ring->buf);
+        free(ring);
+    }
+}
+
+
+void
+lame_frame_ring_put(void *data, const lame_frame * frame)
+{
+    lame_frame_ring *const ring = data;
+    size_t const len = record_size(frame->size);
+    size_t const head = ring->head;
+    size_t const tail = ring_load(&ring->tail);
+    size_t  at = head;
+    ring_record rec;
+
+    if (head >= tail) {
+        /* free: head up to the end, and the start up to tail */
+        if (ring->size - head > len || (ring->size - head == len && tail > 0))
+            at = head;
+        else if (tail > len) {
+            rec.size = RING_WRAP;
+            memcpy(ring->buf + head, &rec.size, sizeof(rec.size));
+            at = 0;
+        }
+        else
+            at = ring->size;
+    }
+    else if (tail - head <= len)
+        at = ring->size;
+    if (at == ring->size) {
+        /* the reader fell behind, the encoder does not wait for it */
+        ring_store(&ring->dropped, ring->dropped + 1);
+        return;
+    }
+
+    rec.size = (uint32_t) frame->size;
+    rec.samples = frame->samples;
+    rec.bitrate_index = frame->bitrate_index;
+    rec.unused = 0;
+    memcpy(ring->buf + at, &rec, sizeof(rec));
+    memcpy(ring->buf + at + sizeof(rec), frame->data, frame->size);
+    at += len;
+    ring_store(&ring->head, at == ring->size ? 0 : at);
+}
+
+
+/* offset of the record at tail, past a wrap mark */
+static  size_t
+ring_next(lame_frame_ring const *ring, ring_record * rec)
+{
+    size_t  at = ring->tail;
+
+    memcpy(rec, ring->buf + at, sizeof(*rec));
+    if (rec->size == RING_WRAP) {
+        at = 0;
+        memcpy(rec, ring->buf, sizeof(*rec));
+    }
+    return at;
+}
+
+
+int
+lame_frame_ring_peek(lame_frame_ring * ring, lame_frame * frame)
+{
+    ring_record rec;
+    size_t  at;
+
+    if (ring->tail == ring_load(&ring->head))
+        return 0;
+    at = ring_next(ring, &rec);
+    frame->data = ring->buf + at + sizeof(rec);
+    frame->size = rec.size;
+    frame->samples = rec.samples;
+    frame->bitrate_index = rec.bitrate_index;
+    return 1;
+}
+
+
+void
+lame_frame_ring_release(lame_frame_ring * ring)
+{
+    ring_record rec;
+    size_t  at;
+
+    if (ring->tail == ring_load(&ring->head))
+        return;
+    at = ring_next(ring, &rec) + record_size(rec.size);
+    ring_store(&ring->tail, at == ring->size ? 0 : at);
+}
+
+
+unsigned long
+lame_frame_ring_dropped(lame_frame_ring const *ring)
+{
+    return (unsigned long) ring_load(&ring->dropped);
+}
+
+/* end of frame_ring.c */
@@ -56,6 +56,10 @@
  *  will return the recommended dB level change for all samples analyzed
  *  since InitGainAnalysis() was called and finalized with GetTitleGain().
  *
+ *    GetMomentaryLoudness(), GetShortTermLoudness(), GetTitleLoudness()
+ *
+ *  give the EBU R128 loudness of the same samples, see below.
+ *
  *  Pseudo-code to process an album:
  *
  *    Float_t       l_samples [4096];
@@ -141,54 +145,332 @@ static const Float_t ABButter[9][multiple_of(4, 2 * BUTTER_ORDER + 1)] = {
 #pragma warning ( default : 4305 )
 #endif
 
+/* The filters run on RG_LANES interleaved lanes: ReplayGain left and right,
+ * then the BS.1770 K-weighting of left and right.  The K-weighting stages
+ * are plain biquads and sit in the same kernel layout with zero taps, so one
+ * pass of each filter serves both analyses.  Each lane does the same
+ * operations in the same order as the one channel filters did, which keeps
+ * the ReplayGain results unchanged.
+ */
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+typedef __m128 lanes_t;
+#define LANES_LOAD(p)       _mm_loadu_ps(p)
+#define LANES_STORE(p, v)   _mm_storeu_ps(p, v)
+#define LANES_ZERO()        _mm_setzero_ps()
+#define LANES_ADD(a, b)     _mm_add_ps(a, b)
+#define LANES_SUB(a, b)     _mm_sub_ps(a, b)
+#define LANES_MUL(a, b)     _mm_mul_ps(a, b)
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+typedef float32x4_t lanes_t;
+#define LANES_LOAD(p)       vld1q_f32(p)
+#define LANES_STORE(p, v)   vst1q_f32(p, v)
+#define LANES_ZERO()        vdupq_n_f32(0.f)
+#define LANES_ADD(a, b)     vaddq_f32(a, b)
+#define LANES_SUB(a, b)     vsubq_f32(a, b)
+#define LANES_MUL(a, b)     vmulq_f32(a, b)
+#endif
+
 /* When calling this procedure, make sure that ip[-order] and op[-order] point to real data! */
 
+#ifdef LANES_LOAD
+
+static void
+filterYule(const Float_t (*input)[RG_LANES], Float_t (*output)[RG_LANES], size_t nSamples,
+           const Float_t (*kernel)[RG_LANES])
+{
+    lanes_t k[2 * YULE_ORDER + 1];
+    int     i;
+
+    for (i = 0; i < 2 * YULE_ORDER + 1; i++)
+        k[i] = LANES_LOAD(kernel[i]);
+
+    while (nSamples--) {
+        lanes_t y0 = LANES_MUL(LANES_LOAD(input[-10]), k[ 0]);
+        lanes_t y2 = LANES_MUL(LANES_LOAD(input[ -9]), k[ 1]);
+        lanes_t y4 = LANES_MUL(LANES_LOAD(input[ -8]), k[ 2]);
+        lanes_t y6 = LANES_MUL(LANES_LOAD(input[ -7]), k[ 3]);
+        lanes_t s00 = LANES_ADD(LANES_ADD(LANES_ADD(y0, y2), y4), y6);
+        lanes_t y8 = LANES_MUL(LANES_LOAD(input[ -6]), k[ 4]);
+        lanes_t yA = LANES_MUL(LANES_LOAD(input[ -5]), k[ 5]);
+        lanes_t yC = LANES_MUL(LANES_LOAD(input[ -4]), k[ 6]);
+        lanes_t yE = LANES_MUL(LANES_LOAD(input[ -3]), k[ 7]);
+        lanes_t s01 = LANES_ADD(LANES_ADD(LANES_ADD(y8, yA), yC), yE);
+        lanes_t yG = LANES_ADD(LANES_MUL(LANES_LOAD(input[-2]), k[8]),
+                               LANES_MUL(LANES_LOAD(input[-1]), k[9]));
+        lanes_t yK = LANES_MUL(LANES_LOAD(input[0]), k[10]);
+
+        lanes_t s1 = LANES_ADD(LANES_ADD(LANES_ADD(s00, s01), yG), yK);
+
+        lanes_t x1 = LANES_ADD(LANES_MUL(LANES_LOAD(output[-10]), k[11]),
+                               LANES_MUL(LANES_LOAD(output[ -9]), k[12]));
+        lanes_t x5 = LANES_ADD(LANES_MUL(LANES_LOAD(output[ -8]), k[13]),
+                               LANES_MUL(LANES_LOAD(output[ -7]), k[14]));
+        lanes_t x9 = LANES_ADD(LANES_MUL(LANES_LOAD(output[ -6]), k[15]),
+                               LANES_MUL(LANES_LOAD(output[ -5]), k[16]));
+        lanes_t xD = LANES_ADD(LANES_MUL(LANES_LOAD(output[ -4]), k[17]),
+                               LANES_MUL(LANES_LOAD(output[ -3]), k[18]));
+        lanes_t xH = LANES_ADD(LANES_MUL(LANES_LOAD(output[ -2]), k[19]),
+                               LANES_MUL(LANES_LOAD(output[ -1]), k[20]));
+
+        lanes_t s2 = LANES_ADD(LANES_ADD(LANES_ADD(LANES_ADD(x1, x5), x9), xD), xH);
+
+        LANES_STORE(output[0], LANES_SUB(s1, s2));
+
+        ++output;
+        ++input;
+    }
+}
+
 static void
-filterYule(const Float_t * input, Float_t * output, size_t nSamples, const Float_t * const kernel)
+filterButter(const Float_t (*input)[RG_LANES], Float_t (*output)[RG_LANES], size_t nSamples,
+             const Float_t (*kernel)[RG_LANES])
 {
+    lanes_t const k0 = LANES_LOAD(kernel[0]);
+    lanes_t const k1 = LANES_LOAD(kernel[1]);
+    lanes_t const k2 = LANES_LOAD(kernel[2]);
+    lanes_t const k3 = LANES_LOAD(kernel[3]);
+    lanes_t const k4 = LANES_LOAD(kernel[4]);
+
     while (nSamples--) {
-        Float_t y0 =  input[-10] * kernel[ 0];
-        Float_t y2 =  input[ -9] * kernel[ 1];
-        Float_t y4 =  input[ -8] * kernel[ 2];
-        Float_t y6 =  input[ -7] * kernel[ 3];
-        Float_t s00 = y0 + y2 + y4 + y6;
-        Float_t y8 =  input[ -6] * kernel[ 4];
-        Float_t yA =  input[ -5] * kernel[ 5];
-        Float_t yC =  input[ -4] * kernel[ 6];
-        Float_t yE =  input[ -3] * kernel[ 7];
-        Float_t s01 = y8 + yA + yC + yE;
-        Float_t yG =  input[ -2] * kernel[ 8] + input[ -1] * kernel[ 9];
-        Float_t yK =  input[  0] * kernel[10];
-
-        Float_t s1 = s00 + s01 + yG + yK;
-
-        Float_t x1 = output[-10] * kernel[11] + output[ -9] * kernel[12];
-        Float_t x5 = output[ -8] * kernel[13] + output[ -7] * kernel[14];
-        Float_t x9 = output[ -6] * kernel[15] + output[ -5] * kernel[16];
-        Float_t xD = output[ -4] * kernel[17] + output[ -3] * kernel[18];
-        Float_t xH = output[ -2] * kernel[19] + output[ -1] * kernel[20];
-
-        Float_t s2 = x1 + x5 + x9 + xD + xH;
-
-        output[0] = (Float_t)(s1 - s2);
+        lanes_t s1 = LANES_ADD(LANES_ADD(LANES_MUL(LANES_LOAD(input[-2]), k0),
+                                         LANES_MUL(LANES_LOAD(input[-1]), k2)),
+                               LANES_MUL(LANES_LOAD(input[0]), k4));
+        lanes_t s2 = LANES_ADD(LANES_MUL(LANES_LOAD(output[-2]), k1),
+                               LANES_MUL(LANES_LOAD(output[-1]), k3));
+        LANES_STORE(output[0], LANES_SUB(s1, s2));
+        ++output;
+        ++input;
+    }
+}
+
+/* sum of squares per lane, the tail first and then groups of four */
+
+static void
+sumSquares(const Float_t (*samples)[RG_LANES], long nSamples, Float_t sum[RG_LANES])
+{
+    lanes_t acc = LANES_ZERO();
+    long    i;
+
+    i = nSamples & 0x03;
+    while (i--) {
+        lanes_t const v = LANES_LOAD(samples[0]);
+        acc = LANES_ADD(acc, LANES_MUL(v, v));
+        ++samples;
+    }
+    i = nSamples / 4;
+    while (i--) {
+        lanes_t const v0 = LANES_LOAD(samples[0]);
+        lanes_t const v1 = LANES_LOAD(samples[1]);
+        lanes_t const v2 = LANES_LOAD(samples[2]);
+        lanes_t const v3 = LANES_LOAD(samples[3]);
+        lanes_t const s = LANES_ADD(LANES_ADD(LANES_ADD(LANES_MUL(v0, v0), LANES_MUL(v1, v1)),
+                                              LANES_MUL(v2, v2)), LANES_MUL(v3, v3));
+        acc = LANES_ADD(acc, s);
+        samples += 4;
+    }
+    LANES_STORE(sum, acc);
+}
+
+#else
 
+static void
+filterYule(const Float_t (*input)[RG_LANES], Float_t (*output)[RG_LANES], size_t nSamples,
+           const Float_t (*kernel)[RG_LANES])
+{
+    while (nSamples--) {
+        int     c;
+        for (c = 0; c < RG_LANES; c++) {
+            Float_t y0 =  input[-10][c] * kernel[ 0][c];
+            Float_t y2 =  input[ -9][c] * kernel[ 1][c];
+            Float_t y4 =  input[ -8][c] * kernel[ 2][c];
+            Float_t y6 =  input[ -7][c] * kernel[ 3][c];
+            Float_t s00 = y0 + y2 + y4 + y6;
+            Float_t y8 =  input[ -6][c] * kernel[ 4][c];
+            Float_t yA =  input[ -5][c] * kernel[ 5][c];
+            Float_t yC =  input[ -4][c] * kernel[ 6][c];
+            Float_t yE =  input[ -3][c] * kernel[ 7][c];
+            Float_t s01 = y8 + yA + yC + yE;
+            Float_t yG =  input[ -2][c] * kernel[ 8][c] + input[ -1][c] * kernel[ 9][c];
+            Float_t yK =  input[  0][c] * kernel[10][c];
+
+            Float_t s1 = s00 + s01 + yG + yK;
+
+            Float_t x1 = output[-10][c] * kernel[11][c] + output[ -9][c] * kernel[12][c];
+            Float_t x5 = output[ -8][c] * kernel[13][c] + output[ -7][c] * kernel[14][c];
+            Float_t x9 = output[ -6][c] * kernel[15][c] + output[ -5][c] * kernel[16][c];
+            Float_t xD = output[ -4][c] * kernel[17][c] + output[ -3][c] * kernel[18][c];
+            Float_t xH = output[ -2][c] * kernel[19][c] + output[ -1][c] * kernel[20][c];
+
+            Float_t s2 = x1 + x5 + x9 + xD + xH;
+
+            output[0][c] = (Float_t)(s1 - s2);
+        }
         ++output;
         ++input;
     }
 }
 
 static void
-filterButter(const Float_t * input, Float_t * output, size_t nSamples, const Float_t * const kernel)
+filterButter(const Float_t (*input)[RG_LANES], Float_t (*output)[RG_LANES], size_t nSamples,
+             const Float_t (*kernel)[RG_LANES])
 {
     while (nSamples--) {
-        Float_t s1 =  input[-2] * kernel[0] +  input[-1] * kernel[2] +  input[ 0] * kernel[4];
-        Float_t s2 = output[-2] * kernel[1] + output[-1] * kernel[3];
-        output[0] = (Float_t)(s1 - s2);
+        int     c;
+        for (c = 0; c < RG_LANES; c++) {
+            Float_t s1 =  input[-2][c] * kernel[0][c] +  input[-1][c] * kernel[2][c]
+                       +  input[ 0][c] * kernel[4][c];
+            Float_t s2 = output[-2][c] * kernel[1][c] + output[-1][c] * kernel[3][c];
+            output[0][c] = (Float_t)(s1 - s2);
+        }
         ++output;
         ++input;
     }
 }
 
+static void
+sumSquares(const Float_t (*samples)[RG_LANES], long nSamples, Float_t sum[RG_LANES])
+{
+    int     c;
+
+    for (c = 0; c < RG_LANES; c++) {
+        Float_t const (*cur)[RG_LANES] = samples;
+        Float_t s = 0;
+        long    i = nSamples & 0x03;
+        while (i--) {
+            Float_t const v = cur[0][c];
+            s += v * v;
+            ++cur;
+        }
+        i = nSamples / 4;
+        while (i--) {
+            Float_t v0 = cur[0][c] * cur[0][c];
+            Float_t v1 = cur[1][c] * cur[1][c];
+            Float_t v2 = cur[2][c] * cur[2][c];
+            Float_t v3 = cur[3][c] * cur[3][c];
+            s += v0 + v1 + v2 + v3;
+            cur += 4;
+        }
+        sum[c] = s;
+    }
+}
+
+#endif
+
+
+/* ITU-R BS.1770 K-weighting for samplefreq: a high shelf followed by a
+ * highpass, written into the last two lanes of the Yule and Butterworth
+ * kernels
+ */
+
+static void
+setKWeighting(replaygain_t * rgData, long samplefreq)
+{
+    double const fs = (double) samplefreq;
+    double  K, Vh, Vb, a0;
+    double  b[3], a[3];
+    int     i, c;
+
+    /* shelf: 1681.97 Hz, +4 dB */
+    K = tan(3.14159265358979323846 * 1681.974450955533 / fs);
+    Vh = pow(10.0, 3.999843853973347 / 20.0);
+    Vb = pow(Vh, 0.4996667741545416);
+    a0 = 1.0 + K / 0.7071752369554196 + K * K;
+    b[0] = (Vh + Vb * K / 0.7071752369554196 + K * K) / a0;
+    b[1] = 2.0 * (K * K - Vh) / a0;
+    b[2] = (Vh - Vb * K / 0.7071752369554196 + K * K) / a0;
+    a[1] = 2.0 * (K * K - 1.0) / a0;
+    a[2] = (1.0 - K / 0.7071752369554196 + K * K) / a0;
+
+    for (c = 2; c < RG_LANES; c++) {
+        for (i = 0; i < 2 * YULE_ORDER + 1; i++)
+            rgData->yule[i][c] = 0;
+        rgData->yule[YULE_ORDER - 2][c] = (Float_t) b[2];
+        rgData->yule[YULE_ORDER - 1][c] = (Float_t) b[1];
+        rgData->yule[YULE_ORDER][c] = (Float_t) b[0];
+        rgData->yule[2 * YULE_ORDER - 1][c] = (Float_t) a[2];
+        rgData->yule[2 * YULE_ORDER][c] = (Float_t) a[1];
+    }
+
+    /* highpass: 38.14 Hz */
+    K = tan(3.14159265358979323846 * 38.13547087602444 / fs);
+    a0 = 1.0 + K / 0.5003270373238773 + K * K;
+    a[1] = 2.0 * (K * K - 1.0) / a0;
+    a[2] = (1.0 - K / 0.5003270373238773 + K * K) / a0;
+
+    for (c = 2; c < RG_LANES; c++) {
+        rgData->butter[0][c] = 1.f;
+        rgData->butter[1][c] = (Float_t) a[2];
+        rgData->butter[2][c] = -2.f;
+        rgData->butter[3][c] = (Float_t) a[1];
+        rgData->butter[4][c] = 1.f;
+    }
+}
+
+static void
+resetLoudness(replaygain_t * rgData)
+{
+    rgData->ksum = 0.;
+    rgData->kacc = 0.;
+    rgData->kacc_samples = 0;
+    rgData->subpos = 0;
+    rgData->subcount = 0;
+    rgData->gated_sum = 0.;
+    rgData->gated_count = 0;
+    memset(rgData->G, 0, sizeof(rgData->G));
+}
+
+static double
+loudnessOf(double meansquare)
+{
+    return meansquare > 0 ? -0.691 + 10. * log10(meansquare) : -HUGE_VAL;
+}
+
+/* mean of the last n sub-blocks */
+
+static double
+subBlockMean(replaygain_t const * rgData, int n)
+{
+    double  sum = 0.;
+    int     i, pos;
+
+    if (n > rgData->subcount)
+        n = rgData->subcount;
+    if (n <= 0)
+        return 0.;
+    pos = rgData->subpos;
+    for (i = 0; i < n; i++) {
+        pos = (pos == 0 ? R128_SUBBLOCKS : pos) - 1;
+        sum += rgData->sub[pos];
+    }
+    return sum / n;
+}
+
+/* a full sub-block closes the 400 ms gating block that ends with it */
+
+static void
+addSubBlock(replaygain_t * rgData, double meansquare)
+{
+    rgData->sub[rgData->subpos] = meansquare;
+    rgData->subpos = (rgData->subpos + 1) % R128_SUBBLOCKS;
+    if (rgData->subcount < R128_SUBBLOCKS)
+        rgData->subcount++;
+
+    if (rgData->subcount >= R128_MOMENTARY) {
+        double const block = subBlockMean(rgData, R128_MOMENTARY);
+        double const lufs = loudnessOf(block);
+        if (lufs >= R128_ABS_GATE) {
+            size_t  ival = (size_t) ((lufs - R128_ABS_GATE) * R128_STEPS_per_LU);
+            if (ival >= sizeof(rgData->G) / sizeof(*(rgData->G)))
+                ival = sizeof(rgData->G) / sizeof(*(rgData->G)) - 1;
+            rgData->G[ival]++;
+            rgData->gated_sum += block;
+            rgData->gated_count++;
+        }
+    }
+}
 
 
 static int ResetSampleFrequency(replaygain_t * rgData, long samplefreq);
@@ -198,13 +480,12 @@ static int ResetSampleFrequency(replaygain_t * rgData, long samplefreq);
 int
 ResetSampleFrequency(replaygain_t * rgData, long samplefreq)
 {
+    int     i, c;
+
     /* zero out initial values, only first MAX_ORDER values */
-    memset(rgData->linprebuf, 0, MAX_ORDER * sizeof(*rgData->linprebuf));
-    memset(rgData->rinprebuf, 0, MAX_ORDER * sizeof(*rgData->rinprebuf));
-    memset(rgData->lstepbuf,  0, MAX_ORDER * sizeof(*rgData->lstepbuf));
-    memset(rgData->rstepbuf,  0, MAX_ORDER * sizeof(*rgData->rstepbuf));
-    memset(rgData->loutbuf,   0, MAX_ORDER * sizeof(*rgData->loutbuf));
-    memset(rgData->routbuf,   0, MAX_ORDER * sizeof(*rgData->routbuf));
+    memset(rgData->inbuf,   0, MAX_ORDER * sizeof(*rgData->inbuf));
+    memset(rgData->stepbuf, 0, MAX_ORDER * sizeof(*rgData->stepbuf));
+    memset(rgData->outbuf,  0, MAX_ORDER * sizeof(*rgData->outbuf));
 
     switch ((int) (samplefreq)) {
     case 48000:
@@ -238,6 +519,14 @@ ResetSampleFrequency(replaygain_t * rgData, long samplefreq)
         return INIT_GAIN_ANALYSIS_ERROR;
     }
 
+    for (c = 0; c < 2; c++) {
+        for (i = 0; i < 2 * YULE_ORDER + 1; i++)
+            rgData->yule[i][c] = ABYule[rgData->freqindex][i];
+        for (i = 0; i < 2 * BUTTER_ORDER + 1; i++)
+            rgData->butter[i][c] = ABButter[rgData->freqindex][i];
+    }
+    setKWeighting(rgData, samplefreq);
+
     rgData->sampleWindow =
         (samplefreq * RMS_WINDOW_TIME_NUMERATOR + RMS_WINDOW_TIME_DENOMINATOR -
          1) / RMS_WINDOW_TIME_DENOMINATOR;
@@ -247,6 +536,7 @@ ResetSampleFrequency(replaygain_t * rgData, long samplefreq)
     rgData->totsamp = 0;
 
     memset(rgData->A, 0, sizeof(rgData->A));
+    resetLoudness(rgData);
 
     return INIT_GAIN_ANALYSIS_OK;
 }
@@ -258,13 +548,6 @@ InitGainAnalysis(replaygain_t * rgData, long samplefreq)
         return INIT_GAIN_ANALYSIS_ERROR;
     }
 
-    rgData->linpre = rgData->linprebuf + MAX_ORDER;
-    rgData->rinpre = rgData->rinprebuf + MAX_ORDER;
-    rgData->lstep = rgData->lstepbuf + MAX_ORDER;
-    rgData->rstep = rgData->rstepbuf + MAX_ORDER;
-    rgData->lout = rgData->loutbuf + MAX_ORDER;
-    rgData->rout = rgData->routbuf + MAX_ORDER;
-
     memset(rgData->B, 0, sizeof(rgData->B));
 
     return INIT_GAIN_ANALYSIS_OK;
@@ -276,13 +559,14 @@ int
 AnalyzeSamples(replaygain_t * rgData, const Float_t * left_samples, const Float_t * right_samples,
                size_t num_samples, int num_channels)
 {
-    const Float_t *curleft;
-    const Float_t *curright;
+    Float_t (*const in)[RG_LANES] = rgData->inbuf + MAX_ORDER;
+    Float_t (*const step)[RG_LANES] = rgData->stepbuf + MAX_ORDER;
+    Float_t (*const out)[RG_LANES] = rgData->outbuf + MAX_ORDER;
     long    batchsamples;
     long    cursamples;
     long    cursamplepos;
-    int     i;
-    Float_t sum_l, sum_r;
+    long    i;
+    Float_t sum[RG_LANES];
 
     if (num_samples == 0)
         return GAIN_ANALYSIS_OK;
@@ -300,70 +584,34 @@ AnalyzeSamples(replaygain_t * rgData, const Float_t * left_samples, const Float_
         return GAIN_ANALYSIS_ERROR;
     }
 
-    if (num_samples < MAX_ORDER) {
-        memcpy(rgData->linprebuf + MAX_ORDER, left_samples, num_samples * sizeof(Float_t));
-        memcpy(rgData->rinprebuf + MAX_ORDER, right_samples, num_samples * sizeof(Float_t));
-    }
-    else {
-        memcpy(rgData->linprebuf + MAX_ORDER, left_samples, MAX_ORDER * sizeof(Float_t));
-        memcpy(rgData->rinprebuf + MAX_ORDER, right_samples, MAX_ORDER * sizeof(Float_t));
-    }
-
     while (batchsamples > 0) {
         cursamples = batchsamples > rgData->sampleWindow - rgData->totsamp ?
             rgData->sampleWindow - rgData->totsamp : batchsamples;
-        if (cursamplepos < MAX_ORDER) {
-            curleft = rgData->linpre + cursamplepos;
-            curright = rgData->rinpre + cursamplepos;
-            if (cursamples > MAX_ORDER - cursamplepos)
-                cursamples = MAX_ORDER - cursamplepos;
-        }
-        else {
-            curleft = left_samples + cursamplepos;
-            curright = right_samples + cursamplepos;
+        /* the first MAX_ORDER samples of a call always were a batch of their
+         * own, which the window sums depend on */
+        if (cursamplepos < MAX_ORDER && cursamples > MAX_ORDER - cursamplepos)
+            cursamples = MAX_ORDER - cursamplepos;
+
+        for (i = 0; i < cursamples; i++) {
+            in[i][0] = in[i][2] = left_samples[cursamplepos + i];
+            in[i][1] = in[i][3] = right_samples[cursamplepos + i];
         }
 
-        YULE_FILTER(curleft, rgData->lstep + rgData->totsamp, cursamples,
-                    ABYule[rgData->freqindex]);
-        YULE_FILTER(curright, rgData->rstep + rgData->totsamp, cursamples,
-                    ABYule[rgData->freqindex]);
+        YULE_FILTER((const Float_t (*)[RG_LANES]) in, step + rgData->totsamp, cursamples,
+                    (const Float_t (*)[RG_LANES]) rgData->yule);
+        BUTTER_FILTER((const Float_t (*)[RG_LANES]) step + rgData->totsamp,
+                      out + rgData->totsamp, cursamples,
+                      (const Float_t (*)[RG_LANES]) rgData->butter);
 
-        BUTTER_FILTER(rgData->lstep + rgData->totsamp, rgData->lout + rgData->totsamp, cursamples,
-                      ABButter[rgData->freqindex]);
-        BUTTER_FILTER(rgData->rstep + rgData->totsamp, rgData->rout + rgData->totsamp, cursamples,
-                      ABButter[rgData->freqindex]);
+        /* Get the squared values */
+        sumSquares((const Float_t (*)[RG_LANES]) out + rgData->totsamp, cursamples, sum);
+        rgData->lsum += sum[0];
+        rgData->rsum += sum[1];
+        rgData->ksum += sum[2];
+        if (num_channels == 2)
+            rgData->ksum += sum[3];
 
-        curleft = rgData->lout + rgData->totsamp; /* Get the squared values */
-        curright = rgData->rout + rgData->totsamp;
-
-        sum_l = 0;
-        sum_r = 0;
-        i = cursamples & 0x03;
-        while (i--) {
-            Float_t const l = *curleft++;
-            Float_t const r = *curright++;
-            sum_l += l * l;
-            sum_r += r * r;
-        }
-        i = cursamples / 4;
-        while (i--) {
-            Float_t l0 = curleft[0] * curleft[0];
-            Float_t l1 = curleft[1] * curleft[1];
-            Float_t l2 = curleft[2] * curleft[2];
-            Float_t l3 = curleft[3] * curleft[3];
-            Float_t sl = l0 + l1 + l2 + l3;
-            Float_t r0 = curright[0] * curright[0];
-            Float_t r1 = curright[1] * curright[1];
-            Float_t r2 = curright[2] * curright[2];
-            Float_t r3 = curright[3] * curright[3];
-            Float_t sr = r0 + r1 + r2 + r3;
-            sum_l += sl;
-            curleft += 4;
-            sum_r += sr;
-            curright += 4;
-        }
-        rgData->lsum += sum_l;
-        rgData->rsum += sum_r;
+        memmove(rgData->inbuf, rgData->inbuf + cursamples, MAX_ORDER * sizeof(*rgData->inbuf));
 
         batchsamples -= cursamples;
         cursamplepos += cursamples;
@@ -377,35 +625,26 @@ AnalyzeSamples(replaygain_t * rgData, const Float_t * left_samples, const Float_
                 ival = sizeof(rgData->A) / sizeof(*(rgData->A)) - 1;
             rgData->A[ival]++;
             rgData->lsum = rgData->rsum = 0.;
-            memmove(rgData->loutbuf, rgData->loutbuf + rgData->totsamp,
-                    MAX_ORDER * sizeof(Float_t));
-            memmove(rgData->routbuf, rgData->routbuf + rgData->totsamp,
-                    MAX_ORDER * sizeof(Float_t));
-            memmove(rgData->lstepbuf, rgData->lstepbuf + rgData->totsamp,
-                    MAX_ORDER * sizeof(Float_t));
-            memmove(rgData->rstepbuf, rgData->rstepbuf + rgData->totsamp,
-                    MAX_ORDER * sizeof(Float_t));
+
+            /* two RMS windows make a 100 ms loudness sub-block */
+            rgData->kacc += rgData->ksum;
+            rgData->kacc_samples += rgData->totsamp;
+            rgData->ksum = 0.;
+            if (rgData->kacc_samples >= 2 * rgData->sampleWindow) {
+                addSubBlock(rgData, rgData->kacc / rgData->kacc_samples / (32768. * 32768.));
+                rgData->kacc = 0.;
+                rgData->kacc_samples = 0;
+            }
+
+            memmove(rgData->outbuf, rgData->outbuf + rgData->totsamp,
+                    MAX_ORDER * sizeof(*rgData->outbuf));
+            memmove(rgData->stepbuf, rgData->stepbuf + rgData->totsamp,
+                    MAX_ORDER * sizeof(*rgData->stepbuf));
             rgData->totsamp = 0;
         }
         if (rgData->totsamp > rgData->sampleWindow) /* somehow I really screwed up: Error in programming! Contact author about totsamp > sampleWindow */
             return GAIN_ANALYSIS_ERROR;
     }
-    if (num_samples < MAX_ORDER) {
-        memmove(rgData->linprebuf, rgData->linprebuf + num_samples,
-                (MAX_ORDER - num_samples) * sizeof(Float_t));
-        memmove(rgData->rinprebuf, rgData->rinprebuf + num_samples,
-                (MAX_ORDER - num_samples) * sizeof(Float_t));
-        memcpy(rgData->linprebuf + MAX_ORDER - num_samples, left_samples,
-               num_samples * sizeof(Float_t));
-        memcpy(rgData->rinprebuf + MAX_ORDER - num_samples, right_samples,
-               num_samples * sizeof(Float_t));
-    }
-    else {
-        memcpy(rgData->linprebuf, left_samples + num_samples - MAX_ORDER,
-               MAX_ORDER * sizeof(Float_t));
-        memcpy(rgData->rinprebuf, right_samples + num_samples - MAX_ORDER,
-               MAX_ORDER * sizeof(Float_t));
-    }
 
     return GAIN_ANALYSIS_OK;
 }
@@ -451,15 +690,61 @@ GetTitleGain(replaygain_t * rgData)
         rgData->A[i] = 0;
     }
 
-    for (i = 0; i < MAX_ORDER; i++)
-        rgData->linprebuf[i] = rgData->lstepbuf[i]
-            = rgData->loutbuf[i]
-            = rgData->rinprebuf[i]
-            = rgData->rstepbuf[i]
-            = rgData->routbuf[i] = 0.f;
+    memset(rgData->inbuf,   0, MAX_ORDER * sizeof(*rgData->inbuf));
+    memset(rgData->stepbuf, 0, MAX_ORDER * sizeof(*rgData->stepbuf));
+    memset(rgData->outbuf,  0, MAX_ORDER * sizeof(*rgData->outbuf));
 
     rgData->totsamp = 0;
     rgData->lsum = rgData->rsum = 0.;
+    rgData->ksum = 0.;
+    return retval;
+}
+
+
+/* loudness in LUFS of the last 400 ms and the last 3 s; less than that
+ * while the title is shorter, -HUGE_VAL before the first 100 ms */
+
+double
+GetMomentaryLoudness(replaygain_t const * rgData)
+{
+    return loudnessOf(subBlockMean(rgData, R128_MOMENTARY));
+}
+
+double
+GetShortTermLoudness(replaygain_t const * rgData)
+{
+    return loudnessOf(subBlockMean(rgData, R128_SUBBLOCKS));
+}
+
+/* gated integrated loudness in LUFS of all samples analyzed SINCE THE LAST
+ * TIME you called GetTitleLoudness() OR InitGainAnalysis(), -HUGE_VAL if
+ * nothing got above the absolute gate.  The gating blocks are binned in
+ * 1/R128_STEPS_per_LU LU steps for the relative gate.
+ */
+
+double
+GetTitleLoudness(replaygain_t * rgData)
+{
+    double  retval = -HUGE_VAL;
+
+    if (rgData->gated_count > 0) {
+        double const gate = loudnessOf(rgData->gated_sum / rgData->gated_count) - 10.;
+        double  sum = 0.;
+        uint32_t elems = 0;
+        size_t  i;
+
+        for (i = 0; i < sizeof(rgData->G) / sizeof(*(rgData->G)); i++) {
+            double const lufs = R128_ABS_GATE + (i + 0.5) / R128_STEPS_per_LU;
+            if (rgData->G[i] == 0 || lufs < gate)
+                continue;
+            sum += rgData->G[i] * pow(10., (lufs + 0.691) / 10.);
+            elems += rgData->G[i];
+        }
+        if (elems > 0)
+            retval = loudnessOf(sum / elems);
+    }
+
+    resetLoudness(rgData);
     return retval;
 }
 
@@ -66,28 +66,38 @@ extern  "C" {
             , MAX_SAMPLES_PER_WINDOW = ((MAX_SAMP_FREQ * RMS_WINDOW_TIME_NUMERATOR) / RMS_WINDOW_TIME_DENOMINATOR + 1) /* max. Samples per Time slice */
     };
 
+#define RG_LANES            4 /* filter lanes: ReplayGain left/right, K-weighted left/right */
+#define R128_SUBBLOCKS     30 /* 100 ms sub-blocks (two RMS windows) in the 3 s short-term window */
+#define R128_MOMENTARY      4 /* sub-blocks in the 400 ms momentary window and gating block */
+#define R128_STEPS_per_LU 100 /* gating table entries per LU */
+#define R128_ABS_GATE     -70 /* LUFS */
+#define R128_MAX_LUFS       5 /* top of the gating table, louder blocks are counted there */
+
     struct replaygain_data {
-        Float_t linprebuf[MAX_ORDER * 2];
-        Float_t *linpre;     /* left input samples, with pre-buffer */
-        Float_t lstepbuf[MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
-        Float_t *lstep;      /* left "first step" (i.e. post first filter) samples */
-        Float_t loutbuf[MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
-        Float_t *lout;       /* left "out" (i.e. post second filter) samples */
-        Float_t rinprebuf[MAX_ORDER * 2];
-        Float_t *rinpre;     /* right input samples ... */
-        Float_t rstepbuf[MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
-        Float_t *rstep;
-        Float_t routbuf[MAX_SAMPLES_PER_WINDOW + MAX_ORDER];
-        Float_t *rout;
+        Float_t inbuf[MAX_SAMPLES_PER_WINDOW + MAX_ORDER][RG_LANES]; /* input samples, with pre-buffer */
+        Float_t stepbuf[MAX_SAMPLES_PER_WINDOW + MAX_ORDER][RG_LANES]; /* "first step" (i.e. post first filter) samples */
+        Float_t outbuf[MAX_SAMPLES_PER_WINDOW + MAX_ORDER][RG_LANES]; /* "out" (i.e. post second filter) samples */
+        Float_t yule[2 * YULE_ORDER + 1][RG_LANES]; /* per lane kernels, the K-weighting shelf */
+        Float_t butter[2 * BUTTER_ORDER + 1][RG_LANES]; /* and highpass padded to the same shape */
         long    sampleWindow; /* number of samples required to reach number of milliseconds required for RMS window */
         long    totsamp;
         double  lsum;
         double  rsum;
+        double  ksum;        /* K-weighted energy of all channels in the current window */
         int     freqindex;
         int     first;
         uint32_t A[STEPS_per_dB * MAX_dB];
         uint32_t B[STEPS_per_dB * MAX_dB];
 
+        /* EBU R128 / ITU-R BS.1770 loudness, fed from the K-weighted lanes */
+        double  kacc;        /* energy and length of the sub-block being collected */
+        long    kacc_samples;
+        double  sub[R128_SUBBLOCKS]; /* mean square of the last sub-blocks, 1.0 = full scale */
+        int     subpos;
+        int     subcount;
+        double  gated_sum;   /* gating blocks above the absolute gate */
+        uint32_t gated_count;
+        uint32_t G[R128_STEPS_per_LU * (R128_MAX_LUFS - R128_ABS_GATE)];
     };
 #ifndef replaygain_data_defined
 #define replaygain_data_defined
@@ -101,6 +111,9 @@ extern  "C" {
     int     AnalyzeSamples(replaygain_t * rgData, const Float_t * left_samples,
                            const Float_t * right_samples, size_t num_samples, int num_channels);
     Float_t GetTitleGain(replaygain_t * rgData);
+    double  GetMomentaryLoudness(replaygain_t const * rgData);
+    double  GetShortTermLoudness(replaygain_t const * rgData);
+    double  GetTitleLoudness(replaygain_t * rgData);
 
 
 #ifdef __cplusplus
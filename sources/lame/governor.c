@@ -0,0 +1,238 @@
+/*
+ *      quality governor
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ *  Level 0 runs the noise shaping and Huffman searches as lame_init_qval
+ *  set them up.  Each further level is what it sets up for the next
+ *  cheaper -q, down to -q 7 (no noise shaping).  These knobs are read
+ *  fresh by the iteration loops for every granule and decide only how
+ *  hard they search, not what the frame may contain: bitrates, block
+ *  types, the reservoir and the psymodel stay as they are, so moving
+ *  between levels from one frame to the next keeps the stream valid.
+ *
+ *  Every frame is timed on the wall clock against the time it plays.
+ *  The load, their ratio, is smoothed over about 8 frames.  Above the
+ *  target the governor steps one level down; it steps up again once the
+ *  load, times what the level above cost last time, still leaves some
+ *  headroom below the target.  After a step the level is held for a
+ *  while, which gives the smoothed load time to settle and the ratio
+ *  between the two levels to be measured.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#if defined(_WIN32)
+# include <windows.h>
+#endif
+#include <time.h>
+
+#include "lame.h"
+#include "machine.h"
+#include "encoder.h"
+#include "util.h"
+#include "lame_global_flags.h"
+#include "governor.h"
+
+#define GOVERNOR_SMOOTHING  0.125f  /* weight of the newest frame in the load */
+#define GOVERNOR_HOLD       16      /* frames a level is kept at least */
+#define GOVERNOR_HEADROOM   0.85f   /* step up only below this part of the target */
+#define GOVERNOR_RATIO      1.5f    /* cost of a level over the next, until measured */
+
+/* what lame_init_qval sets up for -q 1 to 5 and 7, each cheaper than the last */
+static const struct {
+    int     quality;
+    int     noise_shaping;   /* 0: off, 1: as set */
+    int     noise_shaping_amp;
+    int     noise_shaping_stop;
+    int     use_best_huffman;
+    int     substep_shaping; /* 0: without substep shaping 2 */
+} ladder[] = {
+    {1, 1, 2, 1, 1, 1},
+    {2, 1, 1, 1, 1, 1},
+    {3, 1, 1, 1, 1, 0},
+    {4, 1, 0, 0, 1, 0},
+    {5, 1, 0, 0, 0, 0},
+    {7, 0, 0, 0, 0, 0}
+};
+
+
+static double
+governor_clock(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER f, t;
+    QueryPerformanceFrequency(&f);
+    QueryPerformanceCounter(&t);
+    return (double) t.QuadPart / (double) f.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+
+void
+governor_init(lame_internal_flags * gfc, int quality)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    GovStateVar_t *const gov = &gfc->sv_gov;
+    GovKnobs_t *k = gov->knobs;
+    int     i;
+
+    memset(gov, 0, sizeof(*gov));
+    k->noise_shaping = cfg->noise_shaping;
+    k->noise_shaping_amp = cfg->noise_shaping_amp;
+    k->noise_shaping_stop = cfg->noise_shaping_stop;
+    k->use_best_huffman = cfg->use_best_huffman;
+    k->full_outer_loop = cfg->full_outer_loop;
+    k->substep_shaping = gfc->sv_qnt.substep_shaping;
+    gov->levels = 1;
+
+    for (i = 0; i < (int) dimension_of(ladder); ++i) {
+        if (ladder[i].quality <= quality)
+            continue;
+        k = &gov->knobs[gov->levels++];
+        k->noise_shaping = ladder[i].noise_shaping ? Max(gov->knobs[0].noise_shaping, 1) : 0;
+        k->noise_shaping_amp = ladder[i].noise_shaping_amp;
+        k->noise_shaping_stop = ladder[i].noise_shaping_stop;
+        k->use_best_huffman = ladder[i].use_best_huffman;
+        k->full_outer_loop = 0;
+        if (!ladder[i].noise_shaping && (cfg->vbr == vbr_mt || cfg->vbr == vbr_mtrh))
+            k->full_outer_loop = -1;
+        k->substep_shaping = gov->knobs[0].substep_shaping;
+        if (!ladder[i].substep_shaping)
+            k->substep_shaping &= ~2;
+    }
+    for (i = 0; i < LAME_GOVERNOR_LEVELS; ++i)
+        gov->ratio[i] = GOVERNOR_RATIO;
+    gov->frame_time = (float) (576 * cfg->mode_gr) / cfg->samplerate_out;
+    /* the first frames also set the encoder up */
+    gov->hold = GOVERNOR_HOLD;
+}
+
+
+void
+governor_apply(lame_internal_flags * gfc)
+{
+    SessionConfig_t *const cfg = (SessionConfig_t *) &gfc->cfg;
+    GovKnobs_t const *const k = &gfc->sv_gov.knobs[gfc->sv_gov.level];
+
+    cfg->noise_shaping = k->noise_shaping;
+    cfg->noise_shaping_amp = k->noise_shaping_amp;
+    cfg->noise_shaping_stop = k->noise_shaping_stop;
+    cfg->use_best_huffman = k->use_best_huffman;
+    cfg->full_outer_loop = k->full_outer_loop;
+    /* bit 0x80 is the reservoir's, see ResvFrameBegin */
+    gfc->sv_qnt.substep_shaping = (gfc->sv_qnt.substep_shaping & 0x80) | k->substep_shaping;
+}
+
+
+void
+governor_base_config(lame_internal_flags const *gfc, SessionConfig_t * cfg)
+{
+    GovKnobs_t const *const k = &gfc->sv_gov.knobs[0];
+
+    cfg->noise_shaping = k->noise_shaping;
+    cfg->noise_shaping_amp = k->noise_shaping_amp;
+    cfg->noise_shaping_stop = k->noise_shaping_stop;
+    cfg->use_best_huffman = k->use_best_huffman;
+    cfg->full_outer_loop = k->full_outer_loop;
+}
+
+
+void
+governor_frame_begin(lame_internal_flags * gfc)
+{
+    if (gfc->cfg.governor > 0)
+        gfc->sv_gov.start = governor_clock();
+}
+
+
+void
+governor_frame_end(lame_internal_flags * gfc)
+{
+    GovStateVar_t *const gov = &gfc->sv_gov;
+    float const target = gfc->cfg.governor;
+    float   load;
+
+    if (target <= 0)
+        return;
+    load = (float) ((governor_clock() - gov->start) / gov->frame_time);
+    gov->frames[gov->level]++;
+    if (load > 1)
+        gov->late++;
+    if (gov->peak_load < load)
+        gov->peak_load = load;
+    gov->load += (load - gov->load) * GOVERNOR_SMOOTHING;
+
+    if (gov->hold > 0) {
+        if (--gov->hold > 0 || gov->step == 0 || gov->load <= 0)
+            return;
+        /* settled: what the step saved or cost */
+        if (gov->step > 0)
+            gov->ratio[gov->level - 1] = Max(1.f, gov->load_before / gov->load);
+        else
+            gov->ratio[gov->level] = Max(1.f, gov->load / gov->load_before);
+    }
+
+    if (gov->load > target && gov->level + 1 < gov->levels)
+        gov->step = 1;
+    else if (gov->level > 0
+             && gov->load * gov->ratio[gov->level - 1] < target * GOVERNOR_HEADROOM)
+        gov->step = -1;
+    else
+        return;
+    gov->load_before = gov->load;
+    gov->level += gov->step;
+    gov->changes++;
+    gov->hold = GOVERNOR_HOLD;
+    governor_apply(gfc);
+}
+
+
+int
+lame_get_governor_stats(const lame_global_flags * gfp, lame_governor_stats * stats)
+{
+    lame_internal_flags const *gfc;
+    GovStateVar_t const *gov;
+    int     i;
+
+    if (!is_lame_global_flags_valid(gfp))
+        return -1;
+    gfc = gfp->internal_flags;
+    if (!is_lame_internal_flags_valid(gfc) || gfc->cfg.governor <= 0)
+        return -1;
+    gov = &gfc->sv_gov;
+    stats->level = gov->level;
+    stats->levels = gov->levels;
+    stats->load = gov->load;
+    stats->peak_load = gov->peak_load;
+    for (i = 0; i < LAME_GOVERNOR_LEVELS; ++i)
+        stats->frames[i] = gov->frames[i];
+    stats->late = gov->late;
+    stats->changes = gov->changes;
+    return 0;
+}
+
+/* end of governor.c */
@@ -0,0 +1,36 @@
+/*
+ *      quality governor
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef LAME_GOVERNOR_H
+#define LAME_GOVERNOR_H
+
+/* builds the levels from the knobs lame_init_qval set for quality */
+void    governor_init(lame_internal_flags * gfc, int quality);
+
+/* time one frame; lame_encode_mp3_frame runs in between */
+void    governor_frame_begin(lame_internal_flags * gfc);
+void    governor_frame_end(lame_internal_flags * gfc);
+
+/* sets the knobs of the current level, after it was restored from a snapshot */
+void    governor_apply(lame_internal_flags * gfc);
+
+/* puts the knobs of level 0 into a copy of the session config */
+void    governor_base_config(lame_internal_flags const *gfc, SessionConfig_t * cfg);
+
+#endif
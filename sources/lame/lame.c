@@ -46,6 +46,8 @@
 #include "version.h"
 #include "VbrTag.h"
 #include "tables.h"
+#include "reservoir.h"
+#include "governor.h"
 
 
 #if defined(__FreeBSD__) && !defined(__alpha__)
@@ -580,10 +582,16 @@ lame_init_params(lame_global_flags * gfp)
     if (gfc->pinfo != NULL)
         gfp->write_lame_tag = 0; /* disable Xing VBR tag */
 
+    /* a live stream has no start to put the final Xing/LAME frame into */
+    if (gfp->low_latency >= 0)
+        gfp->write_lame_tag = 0;
+
     /* report functions */
     gfc->report_msg = gfp->report.msgf;
     gfc->report_dbg = gfp->report.debugf;
     gfc->report_err = gfp->report.errorf;
+    gfc->frame_cb = gfp->frame_cb;
+    gfc->frame_cb_data = gfp->frame_cb_data;
 
     if (gfp->asm_optimizations.amd3dnow)
         gfc->CPU_features.AMD_3DNow = has_3DNow();
@@ -801,7 +809,9 @@ lame_init_params(lame_global_flags * gfp)
             gfp->samplerate_out * 16 * cfg->channels_out / (1.e3 * gfp->VBR_mean_bitrate_kbps);
     }
 
-    cfg->disable_reservoir = gfp->disable_reservoir;
+    cfg->disable_reservoir = gfp->disable_reservoir || gfp->low_latency == 0;
+    cfg->low_latency = gfp->low_latency;
+    cfg->governor = gfp->governor;
     cfg->lowpassfreq = gfp->lowpassfreq;
     cfg->highpassfreq = gfp->highpassfreq;
     cfg->samplerate_in = gfp->samplerate_in;
@@ -1284,6 +1294,9 @@ lame_init_params(lame_global_flags * gfp)
     cfg->findReplayGain = gfp->findReplayGain;
     cfg->decode_on_the_fly = gfp->decode_on_the_fly;
 
+    memset(&gfc->sv_prof, 0, sizeof(gfc->sv_prof));
+    governor_init(gfc, gfp->quality);
+
     if (cfg->decode_on_the_fly)
         cfg->findPeakSample = 1;
 
@@ -1297,6 +1310,19 @@ lame_init_params(lame_global_flags * gfp)
         }
     }
 
+    if (gfc->sv_enc.resampler) {
+        lame_resampler_close(gfc->sv_enc.resampler);
+        gfc->sv_enc.resampler = NULL;
+    }
+    if (isResamplingNecessary(cfg)) {
+        gfc->sv_enc.resampler = lame_resampler_init(cfg->samplerate_in, cfg->samplerate_out,
+                                                    cfg->channels_out, gfp->quality);
+        if (gfc->sv_enc.resampler == NULL) {
+            ERRORF(gfc, "Error: can't allocate resampler\n");
+            return -2;
+        }
+    }
+
 #ifdef DECODE_ON_THE_FLY
     if (cfg->decode_on_the_fly && !gfp->decode_only) {
         if (gfc->hip) {
@@ -1609,6 +1635,7 @@ save_gain_values(lame_internal_flags * gfc)
         else {
             rov->RadioGain = 0;
         }
+        rov->IntegratedLoudness = (FLOAT) GetTitleLoudness(rsv->rgdata);
     }
 
     /* find the gain and scale change required for no clipping */
@@ -1681,135 +1708,26 @@ calcNeeded(SessionConfig_t const * cfg)
 }
 
 
-/*
- * THE MAIN LAME ENCODING INTERFACE
- * mt 3/00
- *
- * input pcm data, output (maybe) mp3 frames.
- * This routine handles all buffering, resampling and filtering for you.
- * The required mp3buffer_size can be computed from num_samples,
- * samplerate and encoding rate, but here is a worst case estimate:
- *
- * mp3buffer_size in bytes = 1.25*num_samples + 7200
- *
- * return code = number of bytes output in mp3buffer.  can be 0
- *
- * NOTE: this routine uses LAME's internal PCM data representation,
- * 'sample_t'.  It should not be used by any application.
- * applications should use lame_encode_buffer(),
- *                         lame_encode_buffer_float()
- *                         lame_encode_buffer_int()
- * etc... depending on what type of data they are working with.
-*/
-static int
-lame_encode_buffer_sample_t(lame_internal_flags * gfc,
-                            int nsamples, unsigned char *mp3buf, const int mp3buf_size)
+int
+lame_get_latency(const lame_global_flags * gfp)
 {
-    SessionConfig_t const *const cfg = &gfc->cfg;
-    EncStateVar_t *const esv = &gfc->sv_enc;
-    int     pcm_samples_per_frame = 576 * cfg->mode_gr;
-    int     mp3size = 0, ret, i, ch, mf_needed;
-    int     mp3out;
-    sample_t *mfbuf[2];
-    sample_t *in_buffer[2];
-
-    if (gfc->class_id != LAME_ID)
-        return -3;
-
-    if (nsamples == 0)
-        return 0;
-
-    /* copy out any tags that may have been written into bitstream */
-    {   /* if user specifed buffer size = 0, dont check size */
-        int const buf_size = mp3buf_size == 0 ? INT_MAX : mp3buf_size;
-        mp3out = copy_buffer(gfc, mp3buf, buf_size, 0);
-    }
-    if (mp3out < 0)
-        return mp3out;  /* not enough buffer space */
-    mp3buf += mp3out;
-    mp3size += mp3out;
-
-    in_buffer[0] = esv->in_buffer_0;
-    in_buffer[1] = esv->in_buffer_1;
-
-    mf_needed = calcNeeded(cfg);
-
-    mfbuf[0] = esv->mfbuf[0];
-    mfbuf[1] = esv->mfbuf[1];
-
-    while (nsamples > 0) {
-        sample_t const *in_buffer_ptr[2];
-        int     n_in = 0;    /* number of input samples processed with fill_buffer */
-        int     n_out = 0;   /* number of samples output with fill_buffer */
-        /* n_in <> n_out if we are resampling */
-
-        in_buffer_ptr[0] = in_buffer[0];
-        in_buffer_ptr[1] = in_buffer[1];
-        /* copy in new samples into mfbuf, with resampling */
-        fill_buffer(gfc, mfbuf, &in_buffer_ptr[0], nsamples, &n_in, &n_out);
-
-        /* compute ReplayGain of resampled input if requested */
-        if (cfg->findReplayGain && !cfg->decode_on_the_fly)
-            if (AnalyzeSamples
-                (gfc->sv_rpg.rgdata, &mfbuf[0][esv->mf_size], &mfbuf[1][esv->mf_size], n_out,
-                 cfg->channels_out) == GAIN_ANALYSIS_ERROR)
-                return -6;
-
-
-
-        /* update in_buffer counters */
-        nsamples -= n_in;
-        in_buffer[0] += n_in;
-        if (cfg->channels_out == 2)
-            in_buffer[1] += n_in;
-
-        /* update mfbuf[] counters */
-        esv->mf_size += n_out;
-        assert(esv->mf_size <= MFSIZE);
-        
-        /* lame_encode_flush may have set gfc->mf_sample_to_encode to 0
-         * so we have to reinitialize it here when that happened.
-         */
-        if (esv->mf_samples_to_encode < 1) {
-            esv->mf_samples_to_encode = ENCDELAY + POSTDELAY;
-        }        
-        esv->mf_samples_to_encode += n_out;
-
-
-        if (esv->mf_size >= mf_needed) {
-            /* encode the frame.  */
-            /* mp3buf              = pointer to current location in buffer */
-            /* mp3buf_size         = size of original mp3 output buffer */
-            /*                     = 0 if we should not worry about the */
-            /*                       buffer size because calling program is  */
-            /*                       to lazy to compute it */
-            /* mp3size             = size of data written to buffer so far */
-            /* mp3buf_size-mp3size = amount of space avalable  */
-
-            int     buf_size = mp3buf_size - mp3size;
-            if (mp3buf_size == 0)
-                buf_size = INT_MAX;
-
-            ret = lame_encode_mp3_frame(gfc, mfbuf[0], mfbuf[1], mp3buf, buf_size);
-
-            if (ret < 0)
-                return ret;
-            mp3buf += ret;
-            mp3size += ret;
-
-            /* shift out old samples */
-            esv->mf_size -= pcm_samples_per_frame;
-            esv->mf_samples_to_encode -= pcm_samples_per_frame;
-            for (ch = 0; ch < cfg->channels_out; ch++)
-                for (i = 0; i < esv->mf_size; i++)
-                    mfbuf[ch][i] = mfbuf[ch][i + pcm_samples_per_frame];
+    if (is_lame_global_flags_valid(gfp)) {
+        lame_internal_flags const *const gfc = gfp->internal_flags;
+        if (is_lame_internal_flags_valid(gfc)) {
+            SessionConfig_t const *const cfg = &gfc->cfg;
+            /* the first frame is encoded once mf_needed samples are
+             * buffered, ENCDELAY-MDCTDELAY of them the zeros put in front,
+             * and it decodes to ENCDELAY+DECDELAY+1 samples of padding
+             * before the first input sample; every later frame follows
+             * one frame of input later */
+            return calcNeeded(cfg) + MDCTDELAY + DECDELAY + 1
+                + ResvMaxFrames(gfc) * 576 * cfg->mode_gr;
         }
     }
-    assert(nsamples == 0);
-
-    return mp3size;
+    return 0;
 }
 
+
 enum PCMSampleType 
 {   pcm_short_type
 ,   pcm_int_type
@@ -1818,15 +1736,14 @@ enum PCMSampleType
 ,   pcm_double_type
 };
 
+/* convert nsamples input samples, starting at input sample 'offset',
+ * to sample_t and store them in ib0[] and ib1[] */
 static void
-lame_copy_inbuffer(lame_internal_flags* gfc, 
-                   void const* l, void const* r, int nsamples,
+lame_copy_inbuffer(lame_internal_flags* gfc, sample_t* ib0, sample_t* ib1,
+                   void const* l, void const* r, int offset, int nsamples,
                    enum PCMSampleType pcm_type, int jump, FLOAT s)
 {
     SessionConfig_t const *const cfg = &gfc->cfg;
-    EncStateVar_t *const esv = &gfc->sv_enc;
-    sample_t* ib0 = esv->in_buffer_0;
-    sample_t* ib1 = esv->in_buffer_1;
     FLOAT   m[2][2];
 
     /* Apply user defined re-scaling */
@@ -1838,7 +1755,8 @@ lame_copy_inbuffer(lame_internal_flags* gfc,
     /* make a copy of input buffer, changing type to sample_t */
 #define COPY_AND_TRANSFORM(T) \
 { \
-    T const *bl = l, *br = r; \
+    T const *bl = (T const *) l + offset * jump; \
+    T const *br = (T const *) r + offset * jump; \
     int     i; \
     for (i = 0; i < nsamples; i++) { \
         sample_t const xl = *bl; \
@@ -1871,6 +1789,202 @@ lame_copy_inbuffer(lame_internal_flags* gfc,
 }
 
 
+/* n samples were just written to mfbuf at ring positions [pos, pos+n),
+ * 0 <= pos, pos+n <= 2*MFSIZE. Store them at their mirror positions too,
+ * so that any window of up to MFSIZE samples starting below MFSIZE
+ * is contiguous.
+ */
+void
+mirror_mfbuf(EncStateVar_t * esv, int nch, int pos, int n)
+{
+    int const end = pos + n;
+    int     ch;
+
+    assert(0 <= pos && end <= 2 * MFSIZE);
+    for (ch = 0; ch < nch; ch++) {
+        sample_t *const buf = esv->mfbuf[ch];
+        if (pos < MFSIZE) {
+            int const k = Min(end, MFSIZE);
+            memcpy(&buf[pos + MFSIZE], &buf[pos], (k - pos) * sizeof(buf[0]));
+        }
+        if (end > MFSIZE) {
+            int const k = Max(pos, MFSIZE);
+            memcpy(&buf[k - MFSIZE], &buf[k], (end - k) * sizeof(buf[0]));
+        }
+    }
+}
+
+
+/* n_out new samples were just stored in mfbuf at mf_start + mf_size:
+ * account for them and encode the frame they may have completed.
+ * mp3buf_size is the space left, INT_MAX if it should not be checked.
+ * returns the number of bytes written to mp3buf or an error code
+ */
+static int
+lame_encode_mfbuf(lame_internal_flags * gfc, int n_out, unsigned char *mp3buf, int mp3buf_size)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    EncStateVar_t *const esv = &gfc->sv_enc;
+    int const pcm_samples_per_frame = 576 * cfg->mode_gr;
+    int const mf_needed = calcNeeded(cfg);
+    int     mp3size = 0, ret;
+
+    mirror_mfbuf(esv, cfg->channels_out, esv->mf_start + esv->mf_size, n_out);
+
+    /* compute ReplayGain of resampled input if requested */
+    if (cfg->findReplayGain && !cfg->decode_on_the_fly)
+        if (AnalyzeSamples
+            (gfc->sv_rpg.rgdata, &esv->mfbuf[0][esv->mf_start + esv->mf_size],
+             &esv->mfbuf[1][esv->mf_start + esv->mf_size], n_out,
+             cfg->channels_out) == GAIN_ANALYSIS_ERROR)
+            return -6;
+    PROFILE_LAP(gfc, LAME_STAGE_REPLAYGAIN);
+
+    /* update mfbuf[] counters */
+    esv->mf_size += n_out;
+    assert(esv->mf_size <= MFSIZE);
+
+    /* lame_encode_flush may have set gfc->mf_sample_to_encode to 0
+     * so we have to reinitialize it here when that happened.
+     */
+    if (esv->mf_samples_to_encode < 1) {
+        esv->mf_samples_to_encode = ENCDELAY + POSTDELAY;
+    }
+    esv->mf_samples_to_encode += n_out;
+
+
+    while (esv->mf_size >= mf_needed) {
+        /* encode the frame.  */
+        /* mp3buf              = pointer to current location in buffer */
+        /* mp3buf_size         = amount of space avalable */
+        /* mp3size             = size of data written to buffer so far */
+
+        governor_frame_begin(gfc);
+        ret = lame_encode_mp3_frame(gfc, &esv->mfbuf[0][esv->mf_start],
+                                    &esv->mfbuf[1][esv->mf_start], mp3buf,
+                                    mp3buf_size == INT_MAX ? INT_MAX : mp3buf_size - mp3size);
+        governor_frame_end(gfc);
+
+        if (ret < 0)
+            return ret;
+        mp3buf += ret;
+        mp3size += ret;
+
+        /* drop old samples by advancing the ring start */
+        esv->mf_size -= pcm_samples_per_frame;
+        esv->mf_samples_to_encode -= pcm_samples_per_frame;
+        esv->mf_start += pcm_samples_per_frame;
+        if (esv->mf_start >= MFSIZE)
+            esv->mf_start -= MFSIZE;
+    }
+    return mp3size;
+}
+
+
+/*
+ * THE MAIN LAME ENCODING INTERFACE
+ * mt 3/00
+ *
+ * input pcm data, output (maybe) mp3 frames.
+ * This routine handles all buffering, resampling and filtering for you.
+ * The required mp3buffer_size can be computed from num_samples,
+ * samplerate and encoding rate, but here is a worst case estimate:
+ *
+ * mp3buffer_size in bytes = 1.25*num_samples + 7200
+ *
+ * return code = number of bytes output in mp3buffer.  can be 0
+ *
+ * Without resampling, the input is converted to LAME's internal PCM
+ * data representation 'sample_t' directly into the mfbuf ring.
+ * When resampling, it is converted into in_buffer_0/1 first and
+ * fill_buffer() resamples from there into mfbuf.
+ *
+ * NOTE: this routine is not part of the API.
+ * applications should use lame_encode_buffer(),
+ *                         lame_encode_buffer_float()
+ *                         lame_encode_buffer_int()
+ * etc... depending on what type of data they are working with.
+*/
+static int
+lame_encode_buffer_sample_t(lame_internal_flags * gfc,
+                            void const* buffer_l, void const* buffer_r, int nsamples,
+                            enum PCMSampleType pcm_type, int jump, FLOAT norm,
+                            unsigned char *mp3buf, const int mp3buf_size)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    EncStateVar_t *const esv = &gfc->sv_enc;
+    int     pcm_samples_per_frame = 576 * cfg->mode_gr;
+    int     mp3size = 0, ret;
+    int     mp3out;
+    int     n_done = 0;  /* number of input samples consumed so far */
+    int const is_resampling = isResamplingNecessary(cfg);
+
+    if (gfc->class_id != LAME_ID)
+        return -3;
+
+    if (nsamples == 0)
+        return 0;
+
+    /* copy out any tags that may have been written into bitstream */
+    {   /* if user specifed buffer size = 0, dont check size */
+        int const buf_size = mp3buf_size == 0 ? INT_MAX : mp3buf_size;
+        mp3out = copy_buffer(gfc, mp3buf, buf_size, 0);
+    }
+    if (mp3out < 0)
+        return mp3out;  /* not enough buffer space */
+    mp3buf += mp3out;
+    mp3size += mp3out;
+
+    PROFILE_MARK(gfc);
+    if (is_resampling) {
+        /* the resampler needs its input as sample_t, make a copy */
+        if (update_inbuffer_size(gfc, nsamples) != 0) {
+            return -2;
+        }
+        lame_copy_inbuffer(gfc, esv->in_buffer_0, esv->in_buffer_1,
+                           buffer_l, buffer_r, 0, nsamples, pcm_type, jump, norm);
+    }
+
+    while (nsamples > 0) {
+        sample_t *mfbuf[2];
+        int     n_in = 0;    /* number of input samples processed with fill_buffer */
+        int     n_out = 0;   /* number of samples output with fill_buffer */
+        /* n_in <> n_out if we are resampling */
+
+        mfbuf[0] = &esv->mfbuf[0][esv->mf_start];
+        mfbuf[1] = &esv->mfbuf[1][esv->mf_start];
+
+        if (is_resampling) {
+            sample_t const *in_buffer_ptr[2];
+            in_buffer_ptr[0] = esv->in_buffer_0 + n_done;
+            in_buffer_ptr[1] = esv->in_buffer_1 + n_done;
+            /* copy in new samples into mfbuf, with resampling */
+            fill_buffer(gfc, mfbuf, &in_buffer_ptr[0], nsamples, &n_in, &n_out);
+        }
+        else {
+            /* convert new samples straight into mfbuf */
+            n_in = n_out = Min(pcm_samples_per_frame, nsamples);
+            lame_copy_inbuffer(gfc, &mfbuf[0][esv->mf_size], &mfbuf[1][esv->mf_size],
+                               buffer_l, buffer_r, n_done, n_in, pcm_type, jump, norm);
+        }
+
+        /* update in_buffer counters */
+        nsamples -= n_in;
+        n_done += n_in;
+        PROFILE_LAP(gfc, LAME_STAGE_INPUT);
+
+        ret = lame_encode_mfbuf(gfc, n_out, mp3buf, mp3buf_size == 0 ? INT_MAX : mp3buf_size - mp3size);
+        if (ret < 0)
+            return ret;
+        mp3buf += ret;
+        mp3size += ret;
+    }
+    assert(nsamples == 0);
+
+    return mp3size;
+}
+
+
 static int
 lame_encode_buffer_template(lame_global_flags * gfp,
                             void const* buffer_l, void const* buffer_r, const int nsamples,
@@ -1884,24 +1998,20 @@ lame_encode_buffer_template(lame_global_flags * gfp,
             if (nsamples == 0)
                 return 0;
 
-            if (update_inbuffer_size(gfc, nsamples) != 0) {
-                return -2;
-            }
-            /* make a copy of input buffer, changing type to sample_t */
             if (cfg->channels_in > 1) {
                 if (buffer_l == 0 || buffer_r == 0) {
                     return 0;
                 }
-                lame_copy_inbuffer(gfc, buffer_l, buffer_r, nsamples, pcm_type, aa, norm);
             }
             else {
                 if (buffer_l == 0) {
                     return 0;
                 }
-                lame_copy_inbuffer(gfc, buffer_l, buffer_l, nsamples, pcm_type, aa, norm);
+                buffer_r = buffer_l;
             }
 
-            return lame_encode_buffer_sample_t(gfc, nsamples, mp3buf, mp3buf_size);
+            return lame_encode_buffer_sample_t(gfc, buffer_l, buffer_r, nsamples, pcm_type, aa, norm,
+                                               mp3buf, mp3buf_size);
         }
     }
     return -3;
@@ -2021,6 +2131,164 @@ lame_encode_buffer_interleaved_int(lame_t gfp,
 
 
 
+#ifdef HAVE_MPGLIB
+/* applies the user defined re-scaling to n decoded samples in place,
+ * as lame_copy_inbuffer does while copying.  For mono input x1 is
+ * still written, with x0 standing in for the missing channel. */
+static void
+lame_transform_inbuffer(SessionConfig_t const *cfg, sample_t * x0, sample_t * x1, int n)
+{
+    FLOAT const (*m)[2] = cfg->pcm_transform;
+    int     i;
+
+    if (cfg->channels_in == 2 && m[0][0] == 1 && m[0][1] == 0 && m[1][0] == 0 && m[1][1] == 1)
+        return;
+    for (i = 0; i < n; i++) {
+        sample_t const xl = x0[i];
+        sample_t const xr = cfg->channels_in == 2 ? x1[i] : xl;
+        x0[i] = xl * m[0][0] + xr * m[0][1];
+        x1[i] = xl * m[1][0] + xr * m[1][1];
+    }
+}
+
+
+/* resamples n samples from in_buffer_0/1 into mfbuf and encodes them */
+static int
+lame_encode_resampled(lame_internal_flags * gfc, int n, unsigned char *mp3buf, int mp3buf_size)
+{
+    EncStateVar_t *const esv = &gfc->sv_enc;
+    int     mp3size = 0, ret;
+    int     n_done = 0;
+
+    while (n > 0) {
+        sample_t *mfbuf[2];
+        sample_t const *in_buffer_ptr[2];
+        int     n_in = 0, n_out = 0;
+
+        mfbuf[0] = &esv->mfbuf[0][esv->mf_start];
+        mfbuf[1] = &esv->mfbuf[1][esv->mf_start];
+        in_buffer_ptr[0] = esv->in_buffer_0 + n_done;
+        in_buffer_ptr[1] = esv->in_buffer_1 + n_done;
+        fill_buffer(gfc, mfbuf, &in_buffer_ptr[0], n, &n_in, &n_out);
+        n -= n_in;
+        n_done += n_in;
+        PROFILE_LAP(gfc, LAME_STAGE_INPUT);
+
+        ret = lame_encode_mfbuf(gfc, n_out, mp3buf,
+                                mp3buf_size == INT_MAX ? INT_MAX : mp3buf_size - mp3size);
+        if (ret < 0)
+            return ret;
+        mp3buf += ret;
+        mp3size += ret;
+    }
+    return mp3size;
+}
+#endif
+
+
+/*
+ * Transcoding: input is MP3 (or any MPEG audio layer) data, decoded
+ * with an internal hip decoder straight into mfbuf, or into the
+ * resampler's input buffer when the output rate differs.  The decoded
+ * stream must have the configured input samplerate and number of
+ * channels.  A frame split across calls is kept until the next one.
+ */
+int
+lame_encode_mp3_buffer(lame_global_flags * gfp,
+                       unsigned char *mp3in, size_t mp3in_size,
+                       unsigned char *mp3buf, const int mp3buf_size)
+{
+#ifdef HAVE_MPGLIB
+    lame_internal_flags *gfc;
+    SessionConfig_t const *cfg;
+    EncStateVar_t *esv;
+    int     mp3size = 0, ret;
+    int     is_resampling;
+
+    if (!is_lame_global_flags_valid(gfp))
+        return -3;
+    gfc = gfp->internal_flags;
+    if (!is_lame_internal_flags_valid(gfc))
+        return -3;
+    cfg = &gfc->cfg;
+    esv = &gfc->sv_enc;
+    is_resampling = isResamplingNecessary(cfg);
+
+    if (gfc->hip_in == NULL) {
+        gfc->hip_in = hip_decode_init();
+        if (gfc->hip_in == NULL)
+            return -2;
+        hip_set_errorf(gfc->hip_in, gfp->report.errorf);
+        hip_set_debugf(gfc->hip_in, gfp->report.debugf);
+        hip_set_msgf(gfc->hip_in, gfp->report.msgf);
+    }
+    if (is_resampling && update_inbuffer_size(gfc, 1152) != 0)
+        return -2;
+
+    /* copy out any tags that may have been written into bitstream */
+    ret = copy_buffer(gfc, mp3buf, mp3buf_size == 0 ? INT_MAX : mp3buf_size, 0);
+    if (ret < 0)
+        return ret;
+    mp3buf += ret;
+    mp3size += ret;
+
+    if (hip_decode_borrow(gfc->hip_in, mp3in, mp3in_size) < 0)
+        return -2;
+    PROFILE_MARK(gfc);
+    for (;;) {
+        sample_t *pcm[2];
+        int     nsamples, stereo, samplerate;
+
+        if (is_resampling) {
+            pcm[0] = esv->in_buffer_0;
+            pcm[1] = esv->in_buffer_1;
+        }
+        else {
+            pcm[0] = &esv->mfbuf[0][esv->mf_start + esv->mf_size];
+            pcm[1] = &esv->mfbuf[1][esv->mf_start + esv->mf_size];
+        }
+        ret = hip_decode1_planar(gfc->hip_in, pcm, &nsamples, &stereo, &samplerate);
+        if (ret <= 0)
+            break;
+        if (nsamples == 0)
+            continue;
+        if (stereo != cfg->channels_in || samplerate != cfg->samplerate_in) {
+            ERRORF(gfc, "Error: transcoder input is %d Hz, %d channel(s); expected %d Hz, %d\n",
+                   samplerate, stereo, cfg->samplerate_in, cfg->channels_in);
+            ret = -1;
+            break;
+        }
+        lame_transform_inbuffer(cfg, pcm[0], pcm[1], nsamples);
+        if (!is_resampling)
+            PROFILE_LAP(gfc, LAME_STAGE_INPUT);
+
+        if (is_resampling)
+            ret = lame_encode_resampled(gfc, nsamples, mp3buf,
+                                        mp3buf_size == 0 ? INT_MAX : mp3buf_size - mp3size);
+        else
+            ret = lame_encode_mfbuf(gfc, nsamples, mp3buf,
+                                    mp3buf_size == 0 ? INT_MAX : mp3buf_size - mp3size);
+        if (ret < 0)
+            break;
+        mp3buf += ret;
+        mp3size += ret;
+    }
+    /* keeps the unused tail of mp3in for the next call */
+    if (hip_decode_release(gfc->hip_in) < 0 && ret >= 0)
+        ret = -2;
+    return ret < 0 ? ret : mp3size;
+#else
+    (void) gfp;
+    (void) mp3in;
+    (void) mp3in_size;
+    (void) mp3buf;
+    (void) mp3buf_size;
+    return -1;
+#endif
+}
+
+
+
 
 /*****************************************************************
  Flush mp3 buffer, pad with ancillary data so last frame is complete.
@@ -2070,6 +2338,7 @@ lame_init_bitstream(lame_global_flags * gfp)
                    sizeof(gfc->ov_enc.bitrate_blocktype_hist));
 
             gfc->ov_rpg.PeakSample = 0.0;
+            gfc->ov_rpg.IntegratedLoudness = (FLOAT) -HUGE_VAL;
 
             /* Write initial VBR Header to bitstream and init VBR data */
             if (gfc->cfg.write_lame_tag)
@@ -2132,8 +2401,8 @@ lame_encode_flush(lame_global_flags * gfp, unsigned char *mp3buffer, int mp3buff
     is_resampling_necessary = isResamplingNecessary(cfg);
     if (is_resampling_necessary) {
         resample_ratio = (double)cfg->samplerate_in / (double)cfg->samplerate_out;
-        /* delay due to resampling; needs to be fixed, if resampling code gets changed */
-        samples_to_encode += 16. / resample_ratio;
+        /* delay due to resampling: input held back as filter lookahead */
+        samples_to_encode += lame_resampler_delay(esv->resampler) / resample_ratio;
     }
     end_padding = pcm_samples_per_frame - (samples_to_encode % pcm_samples_per_frame);
     if (end_padding < 576)
@@ -2404,6 +2673,7 @@ lame_init_old(lame_global_flags * gfp)
     gfp->num_samples = MAX_U_32_NUM;
 
     gfp->write_lame_tag = 1;
+    gfp->low_latency = -1;
     gfp->quality = -1;
     gfp->short_blocks = short_block_not_set;
     gfp->subblock_gain = -1;
@@ -2662,4 +2932,25 @@ lame_bitrate_block_type_hist(const lame_global_flags * gfp, int bitrate_btype_co
     }
 }
 
+int
+lame_stage_ticks(const lame_global_flags * gfp, double ticks[LAME_STAGE_COUNT])
+{
+#ifdef LAME_PROFILE_STAGES
+    if (is_lame_global_flags_valid(gfp)) {
+        lame_internal_flags const *const gfc = gfp->internal_flags;
+        if (is_lame_internal_flags_valid(gfc)) {
+            int     i;
+            for (i = 0; i < LAME_STAGE_COUNT; ++i) {
+                ticks[i] = (double) gfc->sv_prof.ticks[i];
+            }
+            return 0;
+        }
+    }
+#else
+    (void) gfp;
+    (void) ticks;
+#endif
+    return -1;
+}
+
 /* end of lame.c */
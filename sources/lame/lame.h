@@ -37,6 +37,17 @@ extern "C" {
 
 typedef void (*lame_report_function)(const char *format, va_list ap);
 
+/* one frame of the encoded stream, see lame_set_frame_callback */
+typedef struct lame_frame_s {
+    const unsigned char *data;
+    size_t  size;           /* in bytes */
+    int     samples;        /* samples per channel it decodes to, 0 if it
+                               is not audio (ID3 tags, Xing/LAME frame) */
+    int     bitrate_index;  /* of the frame header, 0 for free format */
+} lame_frame;
+
+typedef void (*lame_frame_callback)(void *data, const lame_frame *frame);
+
 #if defined(WIN32) || defined(_WIN32)
 #undef CDECL
 #define CDECL __cdecl
@@ -347,6 +358,48 @@ int CDECL lame_set_errorf(lame_global_flags *, lame_report_function);
 int CDECL lame_set_debugf(lame_global_flags *, lame_report_function);
 int CDECL lame_set_msgf  (lame_global_flags *, lame_report_function);
 
+/*
+ * Set a function that gets the encoded stream frame by frame, each frame
+ * as soon as it is complete: right after it is encoded, or with the bit
+ * reservoir once the following frames have filled up its slot.  The
+ * lame_encode_* and flush calls then hand all their output to it instead
+ * of copying it to mp3buf, and return 0 bytes.  frame->data is only valid
+ * during the call, and the function must not call back into the encoder.
+ * 'data' is passed on to it.  Set before lame_init_params; default NULL.
+ */
+int CDECL lame_set_frame_callback(lame_global_flags *, lame_frame_callback, void *data);
+
+/*
+ * a lock-free ring of frames between the encoder and one reader thread,
+ * e.g. the one sending the stream, so that neither waits for the other:
+ *
+ *   ring = lame_frame_ring_open(64 * 1024);
+ *   lame_set_frame_callback(gfp, lame_frame_ring_put, ring);
+ *
+ * and on the reader's side, repeatedly
+ *
+ *   while (lame_frame_ring_peek(ring, &frame)) {
+ *       send frame.data, frame.size
+ *       lame_frame_ring_release(ring);
+ *   }
+ *
+ * 'size' is the room for frames in bytes, each takes 16 bytes more.
+ * peek returns 1 with the oldest frame, which stays valid until it is
+ * released, or 0 if the ring is empty.  When the ring is full the
+ * encoder drops the frame rather than wait; lame_frame_ring_dropped
+ * counts them.  Size it for the longest stall of the reader, and use
+ * lame_set_low_latency(gfp, 0) if a drop must not damage the frames
+ * after it (they may take main data from the dropped one otherwise).
+ */
+typedef struct lame_frame_ring_s lame_frame_ring;
+
+lame_frame_ring *CDECL lame_frame_ring_open(size_t size);
+void CDECL lame_frame_ring_close(lame_frame_ring *);
+void CDECL lame_frame_ring_put(void *ring, const lame_frame *frame);
+int CDECL lame_frame_ring_peek(lame_frame_ring *, lame_frame *frame);
+void CDECL lame_frame_ring_release(lame_frame_ring *);
+unsigned long CDECL lame_frame_ring_dropped(const lame_frame_ring *);
+
 
 
 /* set one of brate compression ratio.  default is compression ratio of 11.  */
@@ -400,6 +453,17 @@ int CDECL lame_get_strict_ISO(const lame_global_flags *);
 int CDECL lame_set_disable_reservoir(lame_global_flags *, int);
 int CDECL lame_get_disable_reservoir(const lame_global_flags *);
 
+/*
+ * low latency profile for live streams.  Limits the bit reservoir so that
+ * no frame waits for more than this many following frames before it can
+ * be sent, 0 turns the reservoir off, and leaves out the Xing/LAME frame.
+ * Together with lame_set_frame_callback every frame goes out as soon as
+ * it is complete; see lame_get_latency for the delay that remains.
+ * default=-1 (off)
+ */
+int CDECL lame_set_low_latency(lame_global_flags *, int);
+int CDECL lame_get_low_latency(const lame_global_flags *);
+
 /* select a different "best quantization" function. default=0  */
 int CDECL lame_set_quant_comp(lame_global_flags *, int);
 int CDECL lame_get_quant_comp(const lame_global_flags *);
@@ -570,6 +634,18 @@ int CDECL lame_get_version(const lame_global_flags *);
 /* encoder delay   */
 int CDECL lame_get_encoder_delay(const lame_global_flags *);
 
+/*
+ * algorithmic delay in samples (at the output sample rate, resampling
+ * adds the delay of its filter): from handing a sample to lame_encode_*
+ * until a decoder plays it, when every frame is sent as soon as it is
+ * complete and playback starts with the first one.  It is the lookahead
+ * of the psychoacoustic model and the MDCT, the decoder's synthesis
+ * delay, and the frames a frame may wait for the bit reservoir; without
+ * lame_set_low_latency the last part is the worst case at the smallest
+ * frame size in use.
+ */
+int CDECL lame_get_latency(const lame_global_flags *);
+
 /*
   padding appended to the input to make sure decoder can fully decode
   all input.  Note that this value can only be calculated during the
@@ -622,6 +698,15 @@ int CDECL lame_get_noclipGainChange(const lame_global_flags *);
    not clip or the value cannot be determined */
 float CDECL lame_get_noclipScale(const lame_global_flags *);
 
+/* EBU R128 loudness in LUFS, measured on the same samples as ReplayGain and
+   only when ReplayGain analysis is enabled. Momentary (last 400 ms) and
+   short-term (last 3 s) follow the encoding as it goes, integrated is the
+   gated loudness of the whole title and is available after lame_encode_flush.
+   All three are -HUGE_VAL when nothing was measured. */
+float CDECL lame_get_MomentaryLoudness(const lame_global_flags *);
+float CDECL lame_get_ShortTermLoudness(const lame_global_flags *);
+float CDECL lame_get_IntegratedLoudness(const lame_global_flags *);
+
 /* returns the limit of PCM samples, which one can pass in an encode call
    under the constrain of a provided buffer of size buffer_size */
 int CDECL lame_get_maximum_number_of_samples(lame_t gfp, size_t buffer_size);
@@ -858,6 +943,24 @@ lame_encode_buffer_interleaved_int(
         const int       mp3buf_size );     /* number of valid octets in this
                                               stream                        */
 
+/*
+ * as lame_encode_buffer, but the input is itself an MP3 (MPEG audio)
+ * stream, which is decoded straight into the encoder's input buffer
+ * and re-encoded with the current settings.  Any number of bytes can
+ * be passed per call; an incomplete frame is kept for the next call.
+ * in_samplerate and num_channels must match the input stream, the
+ * output samplerate can differ.
+ * Only available if libmp3lame is compiled with HAVE_MPGLIB, returns
+ * -1 otherwise, or if the input does not match the configuration.
+ */
+int CDECL lame_encode_mp3_buffer(
+        lame_global_flags*  gfp,           /* global context handle         */
+        unsigned char*      mp3in,         /* MP3 data to transcode         */
+        size_t              mp3in_size,    /* number of octets in mp3in     */
+        unsigned char*      mp3buf,        /* pointer to encoded MP3 stream */
+        const int           mp3buf_size ); /* number of valid octets in this
+                                              stream                        */
+
 
 
 /*
@@ -947,6 +1050,55 @@ void CDECL lame_bitrate_block_type_hist (
         const lame_global_flags * gfp,
         int bitrate_btype_count[14][6] );
 
+/*
+ * time spent in each encoder stage since lame_init_params, in CPU time
+ * stamp counter ticks on x86 and ARM64, clock() ticks elsewhere.  Only
+ * collected when the library is built with LAME_PROFILE_STAGES; returns
+ * -1 and leaves ticks alone otherwise.
+ */
+typedef enum lame_stage_e {
+    LAME_STAGE_INPUT,       /* sample conversion, resampling, mp3 decoding */
+    LAME_STAGE_REPLAYGAIN,
+    LAME_STAGE_PSYMODEL,
+    LAME_STAGE_MDCT,
+    LAME_STAGE_QUANTIZE,    /* MS/LR decision and the iteration loops */
+    LAME_STAGE_BITSTREAM,
+    LAME_STAGE_COUNT
+} lame_stage;
+
+int CDECL lame_stage_ticks (
+        const lame_global_flags * gfp,
+        double ticks[LAME_STAGE_COUNT] );
+
+/*
+ * quality governor for live encodes on a busy machine.  With a target
+ * load above 0 every frame is timed against the time it plays; while the
+ * encoder needs more than target_load of that, the noise shaping and
+ * Huffman searches step down between frames towards what -q 7 does, and
+ * back up when there is room again, never above lame_set_quality.  Only
+ * the effort spent on each frame changes, the stream stays as set.
+ * default=0 (off)
+ */
+int CDECL lame_set_governor(lame_global_flags *, float target_load);
+float CDECL lame_get_governor(const lame_global_flags *);
+
+#define LAME_GOVERNOR_LEVELS 7
+
+typedef struct lame_governor_stats_s {
+    int     level;          /* 0 = the quality set, higher levels are cheaper */
+    int     levels;         /* levels below that quality, plus one */
+    float   load;           /* encode time over play time, smoothed */
+    float   peak_load;      /* of a single frame */
+    unsigned long frames[LAME_GOVERNOR_LEVELS]; /* frames encoded at each level */
+    unsigned long late;     /* frames that took longer than they play */
+    unsigned long changes;  /* level changes */
+} lame_governor_stats;
+
+/* returns -1 and leaves stats alone while the governor is off */
+int CDECL lame_get_governor_stats(
+        const lame_global_flags * gfp,
+        lame_governor_stats * stats );
+
 #if (DEPRECATED_OR_OBSOLETE_CODE_REMOVED && 0)
 #else
 /*
@@ -989,6 +1141,45 @@ void CDECL lame_mp3_tags_fid(lame_global_flags *, FILE* fid);
 size_t CDECL lame_get_lametag_frame(
         const lame_global_flags *, unsigned char* buffer, size_t size);
 
+/*
+ * OPTIONAL:
+ * encoder state snapshots, for handing a running encode over to a standby
+ * encoder without a discontinuity.  lame_get_snapshot stores the runtime
+ * state of the encoder (sample buffers, bit reservoir, psymodel history,
+ * ReplayGain/loudness analysis, bitstream position and statistics) into
+ * 'buffer'.  Take it between two encode calls.
+ *
+ * With base == NULL it writes a full snapshot.  With base set to a full
+ * snapshot taken earlier from the same encoder, it writes only what
+ * changed since then, which needs that base to be restored.
+ *
+ * Returns the number of bytes written, or the required buffer size if
+ * 'buffer' is too small (as lame_get_lametag_frame), or 0 on failure.
+ *
+ * lame_set_snapshot loads a snapshot (and for a delta, its base) into an
+ * encoder initialized with lame_init_params and the same settings, and
+ * it continues exactly where the snapshot was taken; ID3/Xing data the
+ * new encoder queued at init is dropped.  Returns 0, or -1 if the
+ * snapshot is damaged or came from other settings or another build of
+ * the library; the encoder is unusable after a failed load.
+ *
+ * Snapshots use the native byte order and structure layout.  Encoders
+ * decoding mp3 (decode_on_the_fly, lame_encode_mp3_buffer) cannot be
+ * snapshot.
+ */
+size_t CDECL lame_get_snapshot(
+        const lame_global_flags *   gfp,
+        const unsigned char *       base,
+        size_t                      base_size,
+        unsigned char *             buffer,
+        size_t                      size );
+int CDECL lame_set_snapshot(
+        lame_global_flags *         gfp,
+        const unsigned char *       base,
+        size_t                      base_size,
+        const unsigned char *       snapshot,
+        size_t                      size );
+
 /*
  * REQUIRED:
  * final call to free all remaining buffers
@@ -1015,6 +1206,51 @@ int CDECL lame_encode_finish(
 
 
 
+/*********************************************************************
+ *
+ * sample rate conversion
+ *
+ * the polyphase resampler LAME uses when samplerate_in differs from
+ * samplerate_out.  It works on planar float channels and keeps its own
+ * history, so it can also feed other encoders (for example the float
+ * buffers returned by vorbis_analysis_buffer()).
+ *
+ *********************************************************************/
+
+struct lame_resampler_struct;
+typedef struct lame_resampler_struct lame_resampler;
+typedef lame_resampler *lame_resampler_t;
+
+/* quality: 0 = best, 9 = fastest (same scale as lame_set_quality)
+ * returns NULL on invalid parameters or allocation failure */
+lame_resampler_t CDECL lame_resampler_init(int samplerate_in, int samplerate_out,
+                                           int channels, int quality);
+
+void CDECL lame_resampler_close(lame_resampler_t rs);
+
+/* number of input samples the resampler holds back as filter lookahead.
+ * output sample k corresponds to input sample k * samplerate_in / samplerate_out,
+ * so feed this many samples of silence at the end of the stream to drain it */
+int CDECL lame_resampler_delay(lame_resampler_t rs);
+
+/*********************************************************************
+ * convert up to nsamples_in input samples per channel into at most
+ * nsamples_out output samples per channel.
+ *
+ *  nout = lame_resampler_process(rs, pcm_in, nsamples_in, &used, pcm_out, nsamples_out);
+ *
+ * used:  number of input samples consumed, may be less than nsamples_in
+ *        once nsamples_out output samples were produced
+ * nout:  number of samples written to pcm_out[ch]
+ *
+ *********************************************************************/
+int CDECL lame_resampler_process(lame_resampler_t rs,
+                                 const float *const pcm_in[], int nsamples_in,
+                                 int *nsamples_used,
+                                 float *const pcm_out[], int nsamples_out);
+
+
+
 /*********************************************************************
  *
  * decoding
@@ -89,6 +89,8 @@ struct lame_global_struct {
     int     strict_ISO;      /* enforce ISO spec as much as possible   */
 
     int     disable_reservoir; /* use bit reservoir?                     */
+    int     low_latency;     /* reservoir frames for live streams, -1 = off */
+    float   governor;        /* target load of the quality governor, 0 = off */
 
     /* quantization/noise shaping */
     int     quant_comp;
@@ -155,6 +157,9 @@ struct lame_global_struct {
         void    (*errorf) (const char *format, va_list ap);
     } report;
 
+    lame_frame_callback frame_cb;
+    void   *frame_cb_data;
+
   /************************************************************************/
     /* internal variables, do not set...                                    */
     /* provided because they may be of use to calling application           */
@@ -36,15 +36,124 @@
 
 #include "dct64_i386.h"
 #include "tabinit.h"
+#include "mpglib_simd.h"
 
 #ifdef WITH_DMALLOC
 #include <dmalloc.h>
 #endif
 
+#ifdef MPGLIB_SIMD
+
+/* The first two stages pair each value with its mirror image, which
+ * vectorizes along the array.  The last three work the same way on
+ * each group of eight, so the four groups go in the four lanes. */
+static void
+dct64_stages(real * b1, real * b2, real * samples)
+{
+    int     i;
+
+    {
+        real   *costab = pnts[0];
+        for (i = 0; i < 16; i += 4) {
+            v4real const x = v_load(samples + i);
+            v4real const y = v_reverse(v_load(samples + 28 - i));
+            v_store(b1 + i, v_add(x, y));
+            v_store(b1 + 28 - i, v_reverse(v_mul(v_sub(x, y), v_load(costab + i))));
+        }
+    }
+
+    {
+        real   *costab = pnts[1];
+        for (i = 0; i < 8; i += 4) {
+            v4real const c = v_load(costab + i);
+            v4real x = v_load(b1 + i);
+            v4real y = v_reverse(v_load(b1 + 12 - i));
+            v_store(b2 + i, v_add(x, y));
+            v_store(b2 + 12 - i, v_reverse(v_mul(v_sub(x, y), c)));
+            x = v_load(b1 + 16 + i);
+            y = v_reverse(v_load(b1 + 28 - i));
+            v_store(b2 + 16 + i, v_add(x, y));
+            v_store(b2 + 28 - i, v_reverse(v_mul(v_sub(y, x), c)));
+        }
+    }
+
+    {
+        /* lane g holds element k of group b2[8g..8g+7] */
+        v4real  x0 = v_load(b2 + 0x00), x1 = v_load(b2 + 0x08);
+        v4real  x2 = v_load(b2 + 0x10), x3 = v_load(b2 + 0x18);
+        v4real  x4 = v_load(b2 + 0x04), x5 = v_load(b2 + 0x0C);
+        v4real  x6 = v_load(b2 + 0x14), x7 = v_load(b2 + 0x1C);
+        v4real  y0, y1, y2, y3, y4, y5, y6, y7;
+        real    c[4];
+
+        v_transpose(x0, x1, x2, x3);
+        v_transpose(x4, x5, x6, x7);
+
+        /* odd groups take the difference the other way round */
+#define DCT64_ALT(v) (c[0] = c[2] = (v), c[1] = c[3] = -(v), v_load(c))
+        y0 = v_add(x0, x7);
+        y7 = v_mul(v_sub(x0, x7), DCT64_ALT(pnts[2][0]));
+        y1 = v_add(x1, x6);
+        y6 = v_mul(v_sub(x1, x6), DCT64_ALT(pnts[2][1]));
+        y2 = v_add(x2, x5);
+        y5 = v_mul(v_sub(x2, x5), DCT64_ALT(pnts[2][2]));
+        y3 = v_add(x3, x4);
+        y4 = v_mul(v_sub(x3, x4), DCT64_ALT(pnts[2][3]));
+#undef DCT64_ALT
+
+        {
+            v4real const cos0 = v_dup(pnts[3][0]);
+            v4real const cos1 = v_dup(pnts[3][1]);
+            x0 = v_add(y0, y3);
+            x3 = v_mul(v_sub(y0, y3), cos0);
+            x1 = v_add(y1, y2);
+            x2 = v_mul(v_sub(y1, y2), cos1);
+            x4 = v_add(y4, y7);
+            x7 = v_mul(v_sub(y7, y4), cos0);
+            x5 = v_add(y5, y6);
+            x6 = v_mul(v_sub(y6, y5), cos1);
+        }
+
+        {
+            v4real const cos0 = v_dup(pnts[4][0]);
+            y0 = v_add(x0, x1);
+            y1 = v_mul(v_sub(x0, x1), cos0);
+            y2 = v_add(x2, x3);
+            y3 = v_mul(v_sub(x3, x2), cos0);
+            y2 = v_add(y2, y3);
+
+            y4 = v_add(x4, x5);
+            y5 = v_mul(v_sub(x4, x5), cos0);
+            y6 = v_add(x6, x7);
+            y7 = v_mul(v_sub(x7, x6), cos0);
+            y6 = v_add(y6, y7);
+            y4 = v_add(y4, y6);
+            y6 = v_add(y6, y5);
+            y5 = v_add(y5, y7);
+        }
+
+        v_transpose(y0, y1, y2, y3);
+        v_transpose(y4, y5, y6, y7);
+        v_store(b1 + 0x00, y0);
+        v_store(b1 + 0x08, y1);
+        v_store(b1 + 0x10, y2);
+        v_store(b1 + 0x18, y3);
+        v_store(b1 + 0x04, y4);
+        v_store(b1 + 0x0C, y5);
+        v_store(b1 + 0x14, y6);
+        v_store(b1 + 0x1C, y7);
+    }
+}
+
+#endif
+
 static void
 dct64_1(real * out0, real * out1, real * b1, real * b2, real * samples)
 {
 
+#ifdef MPGLIB_SIMD
+    dct64_stages(b1, b2, samples);
+#else
     {
         real   *costab = pnts[0];
 
@@ -285,60 +394,64 @@ dct64_1(real * out0, real * out1, real * b1, real * b2, real * samples)
         b1[0x1D] += b1[0x1F];
     }
 
-    out0[0x10 * 16] = b1[0x00];
-    out0[0x10 * 12] = b1[0x04];
-    out0[0x10 * 8] = b1[0x02];
-    out0[0x10 * 4] = b1[0x06];
-    out0[0x10 * 0] = b1[0x01];
-    out1[0x10 * 0] = b1[0x01];
-    out1[0x10 * 4] = b1[0x05];
-    out1[0x10 * 8] = b1[0x03];
-    out1[0x10 * 12] = b1[0x07];
+#endif
+
+    out0[16] = b1[0x00];
+    out0[12] = b1[0x04];
+    out0[8] = b1[0x02];
+    out0[4] = b1[0x06];
+    out0[0] = b1[0x01];
+    out1[0] = b1[0x01];
+    out1[4] = b1[0x05];
+    out1[8] = b1[0x03];
+    out1[12] = b1[0x07];
 
     b1[0x08] += b1[0x0C];
-    out0[0x10 * 14] = b1[0x08];
+    out0[14] = b1[0x08];
     b1[0x0C] += b1[0x0a];
-    out0[0x10 * 10] = b1[0x0C];
+    out0[10] = b1[0x0C];
     b1[0x0A] += b1[0x0E];
-    out0[0x10 * 6] = b1[0x0A];
+    out0[6] = b1[0x0A];
     b1[0x0E] += b1[0x09];
-    out0[0x10 * 2] = b1[0x0E];
+    out0[2] = b1[0x0E];
     b1[0x09] += b1[0x0D];
-    out1[0x10 * 2] = b1[0x09];
+    out1[2] = b1[0x09];
     b1[0x0D] += b1[0x0B];
-    out1[0x10 * 6] = b1[0x0D];
+    out1[6] = b1[0x0D];
     b1[0x0B] += b1[0x0F];
-    out1[0x10 * 10] = b1[0x0B];
-    out1[0x10 * 14] = b1[0x0F];
+    out1[10] = b1[0x0B];
+    out1[14] = b1[0x0F];
 
     b1[0x18] += b1[0x1C];
-    out0[0x10 * 15] = b1[0x10] + b1[0x18];
-    out0[0x10 * 13] = b1[0x18] + b1[0x14];
+    out0[15] = b1[0x10] + b1[0x18];
+    out0[13] = b1[0x18] + b1[0x14];
     b1[0x1C] += b1[0x1a];
-    out0[0x10 * 11] = b1[0x14] + b1[0x1C];
-    out0[0x10 * 9] = b1[0x1C] + b1[0x12];
+    out0[11] = b1[0x14] + b1[0x1C];
+    out0[9] = b1[0x1C] + b1[0x12];
     b1[0x1A] += b1[0x1E];
-    out0[0x10 * 7] = b1[0x12] + b1[0x1A];
-    out0[0x10 * 5] = b1[0x1A] + b1[0x16];
+    out0[7] = b1[0x12] + b1[0x1A];
+    out0[5] = b1[0x1A] + b1[0x16];
     b1[0x1E] += b1[0x19];
-    out0[0x10 * 3] = b1[0x16] + b1[0x1E];
-    out0[0x10 * 1] = b1[0x1E] + b1[0x11];
+    out0[3] = b1[0x16] + b1[0x1E];
+    out0[1] = b1[0x1E] + b1[0x11];
     b1[0x19] += b1[0x1D];
-    out1[0x10 * 1] = b1[0x11] + b1[0x19];
-    out1[0x10 * 3] = b1[0x19] + b1[0x15];
+    out1[1] = b1[0x11] + b1[0x19];
+    out1[3] = b1[0x19] + b1[0x15];
     b1[0x1D] += b1[0x1B];
-    out1[0x10 * 5] = b1[0x15] + b1[0x1D];
-    out1[0x10 * 7] = b1[0x1D] + b1[0x13];
+    out1[5] = b1[0x15] + b1[0x1D];
+    out1[7] = b1[0x1D] + b1[0x13];
     b1[0x1B] += b1[0x1F];
-    out1[0x10 * 9] = b1[0x13] + b1[0x1B];
-    out1[0x10 * 11] = b1[0x1B] + b1[0x17];
-    out1[0x10 * 13] = b1[0x17] + b1[0x1F];
-    out1[0x10 * 15] = b1[0x1F];
+    out1[9] = b1[0x13] + b1[0x1B];
+    out1[11] = b1[0x1B] + b1[0x17];
+    out1[13] = b1[0x17] + b1[0x1F];
+    out1[15] = b1[0x1F];
 }
 
 /*
  * the call via dct64 is a trick to force GCC to use
  * (new) registers for the b1,b2 pointer to the bufs[xx] field
+ *
+ * a[0..16] and b[0..15] get the output, one after the other
  */
 void
 dct64(real * a, real * b, real * c)
@@ -57,6 +57,7 @@ char   *strchr(), *strrchr();
 #include "decode_i386.h"
 #include "dct64_i386.h"
 #include "tabinit.h"
+#include "mpglib_simd.h"
 
 #ifdef WITH_DMALLOC
 #include <dmalloc.h>
@@ -106,107 +107,188 @@ synth_1to1_mono_unclipped(PMPSTR mp, real * bandPtr, unsigned char *out, int *pn
     SYNTH_1TO1_MONO_CLIPCHOICE(real, synth_1to1_unclipped)
 }
 
+/*
+ * The synthesis history is kept with the 17 dct64 outputs of one step
+ * next to each other: b0[0x11*k + j] is output j from k steps back.
+ * synth_window() makes the 32 windowed sums of one step into sums[].
+ */
+#ifdef MPGLIB_SIMD
+
+static void
+synth_window(real const *b0, int bo1, real *sums)
+{
+    int     j, k;
+
+    /* four neighbouring outputs at a time, one per lane */
+    for (j = 0; j < 16; j += 4) {
+        real const *w = decwin_lanes[16 - bo1] + j;
+        real const *b = b0 + j;
+        v4real  sum = v_mul(v_load(w), v_load(b));
+        for (k = 1; k < 15; k += 2) {
+            sum = v_sub(sum, v_mul(v_load(w + 0x11 * k), v_load(b + 0x11 * k)));
+            sum = v_add(sum, v_mul(v_load(w + 0x11 * (k + 1)), v_load(b + 0x11 * (k + 1))));
+        }
+        sum = v_sub(sum, v_mul(v_load(w + 0x11 * 15), v_load(b + 0x11 * 15)));
+        v_store(sums + j, sum);
+    }
+
+    {
+        real const *window = decwin + 16 - bo1 + 0x200;
+        real const *b = b0 + 16;
+        real    sum;
+        sum  = window[0x0] * b[0x11 * 0x0];
+        sum += window[0x2] * b[0x11 * 0x2];
+        sum += window[0x4] * b[0x11 * 0x4];
+        sum += window[0x6] * b[0x11 * 0x6];
+        sum += window[0x8] * b[0x11 * 0x8];
+        sum += window[0xA] * b[0x11 * 0xA];
+        sum += window[0xC] * b[0x11 * 0xC];
+        sum += window[0xE] * b[0x11 * 0xE];
+        sums[16] = sum;
+    }
+
+    /* outputs 17..31 use rows 15 down to 1; the last group also
+       works out row 0, which is dropped */
+    for (j = 0; j < 16; j += 4) {
+        int const r0 = 12 - j;
+        real const *b = b0 + r0;
+        v4real  sum = v_neg(v_mul(v_load(decwin_lanes[15 + bo1] + r0), v_load(b)));
+        real    tmp[4];
+        for (k = 1; k < 15; k++)
+            sum = v_sub(sum, v_mul(v_load(decwin_lanes[15 + bo1 - k] + r0),
+                                   v_load(b + 0x11 * k)));
+        sum = v_sub(sum, v_mul(v_load(decwin_lanes[16 + bo1] + r0), v_load(b + 0x11 * 15)));
+        sum = v_reverse(sum);
+        if (j < 12)
+            v_store(sums + 17 + j, sum);
+        else {
+            v_store(tmp, sum);
+            sums[29] = tmp[0];
+            sums[30] = tmp[1];
+            sums[31] = tmp[2];
+        }
+    }
+}
+
+#else
+
+static void
+synth_window(real const *b0, int bo1, real *sums)
+{
+    int     j;
+    real const *window = decwin + 16 - bo1;
+
+    for (j = 0; j < 16; j++, b0++, window += 0x20) {
+        real    sum;
+        sum  = window[0x0] * b0[0x11 * 0x0];
+        sum -= window[0x1] * b0[0x11 * 0x1];
+        sum += window[0x2] * b0[0x11 * 0x2];
+        sum -= window[0x3] * b0[0x11 * 0x3];
+        sum += window[0x4] * b0[0x11 * 0x4];
+        sum -= window[0x5] * b0[0x11 * 0x5];
+        sum += window[0x6] * b0[0x11 * 0x6];
+        sum -= window[0x7] * b0[0x11 * 0x7];
+        sum += window[0x8] * b0[0x11 * 0x8];
+        sum -= window[0x9] * b0[0x11 * 0x9];
+        sum += window[0xA] * b0[0x11 * 0xA];
+        sum -= window[0xB] * b0[0x11 * 0xB];
+        sum += window[0xC] * b0[0x11 * 0xC];
+        sum -= window[0xD] * b0[0x11 * 0xD];
+        sum += window[0xE] * b0[0x11 * 0xE];
+        sum -= window[0xF] * b0[0x11 * 0xF];
+        sums[j] = sum;
+    }
+
+    {
+        real    sum;
+        sum  = window[0x0] * b0[0x11 * 0x0];
+        sum += window[0x2] * b0[0x11 * 0x2];
+        sum += window[0x4] * b0[0x11 * 0x4];
+        sum += window[0x6] * b0[0x11 * 0x6];
+        sum += window[0x8] * b0[0x11 * 0x8];
+        sum += window[0xA] * b0[0x11 * 0xA];
+        sum += window[0xC] * b0[0x11 * 0xC];
+        sum += window[0xE] * b0[0x11 * 0xE];
+        sums[16] = sum;
+        b0--, window -= 0x20;
+    }
+    window += bo1 << 1;
+
+    for (j = 17; j < 32; j++, b0--, window -= 0x20) {
+        real    sum;
+        sum = -window[-0x1] * b0[0x11 * 0x0];
+        sum -= window[-0x2] * b0[0x11 * 0x1];
+        sum -= window[-0x3] * b0[0x11 * 0x2];
+        sum -= window[-0x4] * b0[0x11 * 0x3];
+        sum -= window[-0x5] * b0[0x11 * 0x4];
+        sum -= window[-0x6] * b0[0x11 * 0x5];
+        sum -= window[-0x7] * b0[0x11 * 0x6];
+        sum -= window[-0x8] * b0[0x11 * 0x7];
+        sum -= window[-0x9] * b0[0x11 * 0x8];
+        sum -= window[-0xA] * b0[0x11 * 0x9];
+        sum -= window[-0xB] * b0[0x11 * 0xA];
+        sum -= window[-0xC] * b0[0x11 * 0xB];
+        sum -= window[-0xD] * b0[0x11 * 0xC];
+        sum -= window[-0xE] * b0[0x11 * 0xD];
+        sum -= window[-0xF] * b0[0x11 * 0xE];
+        sum -= window[-0x0] * b0[0x11 * 0xF];
+        sums[j] = sum;
+    }
+}
+
+#endif
+
+/* one synthesis step for one channel: the 32 output samples go to sums[] */
+static void
+synth_sums(PMPSTR mp, real * bandPtr, int channel, real * sums)
+{
+    real   *b0, (*buf)[0x110];
+    int     bo, bo1;
+
+    bo = mp->synth_bo;
+
+    if (!channel) {
+        bo--;
+        bo &= 0xf;
+        buf = mp->synth_buffs[0];
+    }
+    else {
+        buf = mp->synth_buffs[1];
+    }
+
+    if (bo & 0x1) {
+        b0 = buf[0];
+        bo1 = bo;
+        dct64(buf[1] + 0x11 * ((bo + 1) & 0xf), buf[0] + 0x11 * bo, bandPtr);
+    }
+    else {
+        b0 = buf[1];
+        bo1 = bo + 1;
+        dct64(buf[0] + 0x11 * bo, buf[1] + 0x11 * (bo + 1), bandPtr);
+    }
+
+    mp->synth_bo = bo;
+
+    synth_window(b0, bo1, sums);
+}
+
     /* *INDENT-OFF* */
 /* versions: clipped (when TYPE == short) and unclipped (when TYPE == real) of synth_1to1* functions */
 #define SYNTH_1TO1_CLIPCHOICE(TYPE,WRITE_SAMPLE)         \
   static const int step = 2;                             \
-  int bo;                                                \
   TYPE *samples = (TYPE *) (out + *pnt);                 \
                                                          \
-  real *b0,(*buf)[0x110];                                \
+  real sums[32];                                         \
   int clip = 0;                                          \
-  int bo1;                                               \
-                                                         \
-  bo = mp->synth_bo;                                     \
+  int j;                                                 \
                                                          \
-  if(!channel) {                                         \
-    bo--;                                                \
-    bo &= 0xf;                                           \
-    buf = mp->synth_buffs[0];                            \
-  }                                                      \
-  else {                                                 \
+  if(channel)                                            \
     samples++;                                           \
-    buf = mp->synth_buffs[1];                            \
-  }                                                      \
-                                                         \
-  if(bo & 0x1) {                                         \
-    b0 = buf[0];                                         \
-    bo1 = bo;                                            \
-    dct64(buf[1]+((bo+1)&0xf),buf[0]+bo,bandPtr);        \
-  }                                                      \
-  else {                                                 \
-    b0 = buf[1];                                         \
-    bo1 = bo+1;                                          \
-    dct64(buf[0]+bo,buf[1]+bo+1,bandPtr);                \
-  }                                                      \
-                                                         \
-  mp->synth_bo = bo;                                     \
-                                                         \
-  {                                                      \
-    int j;                                               \
-    real *window = decwin + 16 - bo1;                    \
-                                                         \
-    for (j=16;j;j--,b0+=0x10,window+=0x20,samples+=step) \
-    {                                                    \
-      real sum;                                          \
-      sum  = window[0x0] * b0[0x0];                      \
-      sum -= window[0x1] * b0[0x1];                      \
-      sum += window[0x2] * b0[0x2];                      \
-      sum -= window[0x3] * b0[0x3];                      \
-      sum += window[0x4] * b0[0x4];                      \
-      sum -= window[0x5] * b0[0x5];                      \
-      sum += window[0x6] * b0[0x6];                      \
-      sum -= window[0x7] * b0[0x7];                      \
-      sum += window[0x8] * b0[0x8];                      \
-      sum -= window[0x9] * b0[0x9];                      \
-      sum += window[0xA] * b0[0xA];                      \
-      sum -= window[0xB] * b0[0xB];                      \
-      sum += window[0xC] * b0[0xC];                      \
-      sum -= window[0xD] * b0[0xD];                      \
-      sum += window[0xE] * b0[0xE];                      \
-      sum -= window[0xF] * b0[0xF];                      \
-                                                         \
-      WRITE_SAMPLE (TYPE,samples,sum,clip);              \
-    }                                                    \
                                                          \
-    {                                                    \
-      real sum;                                          \
-      sum  = window[0x0] * b0[0x0];                      \
-      sum += window[0x2] * b0[0x2];                      \
-      sum += window[0x4] * b0[0x4];                      \
-      sum += window[0x6] * b0[0x6];                      \
-      sum += window[0x8] * b0[0x8];                      \
-      sum += window[0xA] * b0[0xA];                      \
-      sum += window[0xC] * b0[0xC];                      \
-      sum += window[0xE] * b0[0xE];                      \
-      WRITE_SAMPLE (TYPE,samples,sum,clip);              \
-      b0-=0x10,window-=0x20,samples+=step;               \
-    }                                                    \
-    window += bo1<<1;                                    \
+  synth_sums(mp, bandPtr, channel, sums);                \
+  for (j=0;j<32;j++,samples+=step)                       \
+    WRITE_SAMPLE (TYPE,samples,sums[j],clip);            \
                                                          \
-    for (j=15;j;j--,b0-=0x10,window-=0x20,samples+=step) \
-    {                                                    \
-      real sum;                                          \
-      sum = -window[-0x1] * b0[0x0];                     \
-      sum -= window[-0x2] * b0[0x1];                     \
-      sum -= window[-0x3] * b0[0x2];                     \
-      sum -= window[-0x4] * b0[0x3];                     \
-      sum -= window[-0x5] * b0[0x4];                     \
-      sum -= window[-0x6] * b0[0x5];                     \
-      sum -= window[-0x7] * b0[0x6];                     \
-      sum -= window[-0x8] * b0[0x7];                     \
-      sum -= window[-0x9] * b0[0x8];                     \
-      sum -= window[-0xA] * b0[0x9];                     \
-      sum -= window[-0xB] * b0[0xA];                     \
-      sum -= window[-0xC] * b0[0xB];                     \
-      sum -= window[-0xD] * b0[0xC];                     \
-      sum -= window[-0xE] * b0[0xD];                     \
-      sum -= window[-0xF] * b0[0xE];                     \
-      sum -= window[-0x0] * b0[0xF];                     \
-                                                         \
-      WRITE_SAMPLE (TYPE,samples,sum,clip);              \
-    }                                                    \
-  }                                                      \
   *pnt += 64*sizeof(TYPE);                               \
                                                          \
   return clip;                                           
@@ -222,3 +304,25 @@ synth_1to1_unclipped(PMPSTR mp, real * bandPtr, int channel, unsigned char *out,
 {
     SYNTH_1TO1_CLIPCHOICE(real, WRITE_SAMPLE_UNCLIPPED)
 }
+
+/* out is a real *[2] of channel planes and *pnt counts bytes per
+   channel; samples are stored unclipped with no intermediate copy */
+int
+synth_1to1_planar(PMPSTR mp, real * bandPtr, int channel, unsigned char *out, int *pnt)
+{
+    real  **planes = (real **) out;
+
+    synth_sums(mp, bandPtr, channel, planes[channel] + *pnt / sizeof(real));
+    *pnt += 32 * sizeof(real);
+    return 0;
+}
+
+int
+synth_1to1_mono_planar(PMPSTR mp, real * bandPtr, unsigned char *out, int *pnt)
+{
+    real  **planes = (real **) out;
+
+    synth_sums(mp, bandPtr, 0, planes[0] + *pnt / sizeof(real));
+    *pnt += 32 * sizeof(real);
+    return 0;
+}
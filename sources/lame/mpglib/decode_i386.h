@@ -30,4 +30,7 @@ int     synth_1to1(PMPSTR mp, real * bandPtr, int channel, unsigned char *out, i
 int     synth_1to1_mono_unclipped(PMPSTR mp, real * bandPtr, unsigned char *out, int *pnt);
 int     synth_1to1_unclipped(PMPSTR mp, real * bandPtr, int channel, unsigned char *out, int *pnt);
 
+int     synth_1to1_mono_planar(PMPSTR mp, real * bandPtr, unsigned char *out, int *pnt);
+int     synth_1to1_planar(PMPSTR mp, real * bandPtr, int channel, unsigned char *out, int *pnt);
+
 #endif
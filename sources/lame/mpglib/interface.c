@@ -73,7 +73,8 @@ InitMP3(PMPSTR mp)
         mp->dsize = 0;
         mp->fsizeold = -1;
         mp->bsize = 0;
-        mp->head = mp->tail = NULL;
+        mp->ring = NULL;
+        mp->borrow = NULL;
         mp->fr.single = -1;
         mp->bsnum = 0;
         mp->wordpointer = mp->bsspace[mp->bsnum] + 512;
@@ -94,138 +95,174 @@ void
 ExitMP3(PMPSTR mp)
 {
     if (mp) {
-        struct buf *b, *bn;
-
-        b = mp->tail;
-        while (b) {
-            free(b->pnt);
-            bn = b->next;
-            free(b);
-            b = bn;
-        }
+        free(mp->ring);
+        mp->ring = NULL;
+        mp->ring_size = mp->ring_pos = mp->ring_len = 0;
+        mp->borrow = NULL;
+        mp->bsize = 0;
     }
 }
 
-static struct buf *
-addbuf(PMPSTR mp, unsigned char *buf, int size)
-{
-    struct buf *nbuf;
+/*
+ * Input handling.  Unconsumed input is the ring, which holds bytes
+ * kept between calls, followed by the borrowed buffer, which is the
+ * caller's memory and is parsed in place.  Only what is left of the
+ * borrowed buffer when it is released gets copied into the ring, so a
+ * caller passing whole frames never has its data copied twice.
+ */
 
-    nbuf = (struct buf *) malloc(sizeof(struct buf));
-    if (!nbuf) {
-        lame_report_fnc(mp->report_err, "hip: addbuf() Out of memory!\n");
-        return NULL;
+static int
+ring_append(PMPSTR mp, unsigned char const *buf, int size)
+{
+    int     pos, n;
+
+    if (mp->ring_len + size > mp->ring_size) {
+        unsigned char *nring;
+        int     nsize = mp->ring_size ? mp->ring_size : 4096;
+
+        while (nsize < mp->ring_len + size)
+            nsize *= 2;
+        nring = (unsigned char *) malloc((size_t) nsize);
+        if (!nring) {
+            lame_report_fnc(mp->report_err, "hip: ring_append() Out of memory!\n");
+            return -1;
+        }
+        if (mp->ring_len) {
+            /* unwrap the old contents to the front */
+            n = mp->ring_size - mp->ring_pos;
+            if (n > mp->ring_len)
+                n = mp->ring_len;
+            memcpy(nring, mp->ring + mp->ring_pos, (size_t) n);
+            memcpy(nring + n, mp->ring, (size_t) (mp->ring_len - n));
+        }
+        free(mp->ring);
+        mp->ring = nring;
+        mp->ring_size = nsize;
+        mp->ring_pos = 0;
     }
-    nbuf->pnt = (unsigned char *) malloc((size_t) size);
-    if (!nbuf->pnt) {
-        free(nbuf);
-        return NULL;
+
+    pos = (mp->ring_pos + mp->ring_len) & (mp->ring_size - 1);
+    n = mp->ring_size - pos;
+    if (n > size)
+        n = size;
+    memcpy(mp->ring + pos, buf, (size_t) n);
+    memcpy(mp->ring, buf + n, (size_t) (size - n));
+    mp->ring_len += size;
+    return 0;
+}
+
+/* points p at the contiguous input starting off bytes in and returns
+   its length, 0 past the end */
+static int
+input_span(PMPSTR mp, int off, unsigned char const **p)
+{
+    if (off < mp->ring_len) {
+        int const pos = (mp->ring_pos + off) & (mp->ring_size - 1);
+        int     len = mp->ring_size - pos;
+        if (len > mp->ring_len - off)
+            len = mp->ring_len - off;
+        *p = mp->ring + pos;
+        return len;
     }
-    nbuf->size = size;
-    memcpy(nbuf->pnt, buf, (size_t) size);
-    nbuf->next = NULL;
-    nbuf->prev = mp->head;
-    nbuf->pos = 0;
-
-    if (!mp->tail) {
-        mp->tail = nbuf;
+    off -= mp->ring_len;
+    if (mp->borrow && off < mp->borrow_len - mp->borrow_pos) {
+        *p = mp->borrow + mp->borrow_pos + off;
+        return mp->borrow_len - mp->borrow_pos - off;
     }
-    else {
-        mp->head->next = nbuf;
+    return 0;
+}
+
+int
+borrow_buf(PMPSTR mp, unsigned char *in, int isize)
+{
+    if (release_buf(mp) != MP3_OK)
+        return MP3_ERR;
+    if (in && isize > 0) {
+        mp->borrow = in;
+        mp->borrow_len = isize;
+        mp->borrow_pos = 0;
+        mp->borrow_held = 1;
+        mp->bsize += isize;
     }
+    return MP3_OK;
+}
 
-    mp->head = nbuf;
-    mp->bsize += size;
+int
+release_buf(PMPSTR mp)
+{
+    int const rest = mp->borrow ? mp->borrow_len - mp->borrow_pos : 0;
+    int     ret = MP3_OK;
 
-    return nbuf;
+    if (rest > 0 && ring_append(mp, mp->borrow + mp->borrow_pos, rest) < 0) {
+        mp->bsize -= rest;
+        ret = MP3_ERR;
+    }
+    mp->borrow = NULL;
+    mp->borrow_len = mp->borrow_pos = 0;
+    mp->borrow_held = 0;
+    return ret;
 }
 
 void
 remove_buf(PMPSTR mp)
 {
-    struct buf *buf = mp->tail;
-
-    mp->tail = buf->next;
-    if (mp->tail)
-        mp->tail->prev = NULL;
-    else {
-        mp->tail = mp->head = NULL;
-    }
-
-    free(buf->pnt);
-    free(buf);
-
+    mp->ring_pos = mp->ring_len = 0;
+    mp->borrow = NULL;
+    mp->borrow_len = mp->borrow_pos = 0;
+    mp->borrow_held = 0;
+    mp->bsize = 0;
 }
 
-static int
-read_buf_byte(PMPSTR mp)
+/* drops size bytes of input */
+static void
+skip_mp(PMPSTR mp, int size)
 {
-    unsigned int b;
-
-    int     pos;
-
+    int     n = size < mp->ring_len ? size : mp->ring_len;
 
-    pos = mp->tail->pos;
-    while (pos >= mp->tail->size) {
-        remove_buf(mp);
-        if (!mp->tail) {
-            lame_report_fnc(mp->report_err, "hip: Fatal error! tried to read past mp buffer\n");
-            exit(1);
-        }
-        pos = mp->tail->pos;
+    if (size > mp->bsize) {
+        lame_report_fnc(mp->report_err, "hip: Fatal error! tried to read past mp buffer\n");
+        exit(1);
     }
-
-    b = mp->tail->pnt[pos];
-    mp->bsize--;
-    mp->tail->pos++;
-
-
-    return b;
+    if (n > 0) {
+        mp->ring_pos = (mp->ring_pos + n) & (mp->ring_size - 1);
+        mp->ring_len -= n;
+        if (!mp->ring_len)
+            mp->ring_pos = 0;
+    }
+    mp->borrow_pos += size - n;
+    mp->bsize -= size;
 }
 
-
-
 static void
 read_head(PMPSTR mp)
 {
-    unsigned long head;
-
-    head = read_buf_byte(mp);
-    head <<= 8;
-    head |= read_buf_byte(mp);
-    head <<= 8;
-    head |= read_buf_byte(mp);
-    head <<= 8;
-    head |= read_buf_byte(mp);
+    unsigned char const *p;
+    unsigned long head = 0;
+    int     i;
+
+    for (i = 0; i < 4; i++) {
+        head <<= 8;
+        if (input_span(mp, i, &p))
+            head |= *p;
+    }
+    skip_mp(mp, 4);
 
     mp->header = head;
 }
 
-
-
-
 static void
 copy_mp(PMPSTR mp, int size, unsigned char *ptr)
 {
-    int     len = 0;
-
-    while (len < size && mp->tail) {
-        int     nlen;
-        int     blen = mp->tail->size - mp->tail->pos;
-        if ((size - len) <= blen) {
-            nlen = size - len;
-        }
-        else {
-            nlen = blen;
-        }
-        memcpy(ptr + len, mp->tail->pnt + mp->tail->pos, (size_t) nlen);
-        len += nlen;
-        mp->tail->pos += nlen;
-        mp->bsize -= nlen;
-        if (mp->tail->pos == mp->tail->size) {
-            remove_buf(mp);
-        }
+    unsigned char const *p;
+    int     len = 0, n;
+
+    while (len < size && (n = input_span(mp, len, &p)) > 0) {
+        if (n > size - len)
+            n = size - len;
+        memcpy(ptr + len, p, (size_t) n);
+        len += n;
     }
+    skip_mp(mp, len);
 }
 
 /* number of bytes needed by GetVbrTag to parse header */
@@ -246,36 +283,29 @@ return value: number of bytes in VBR header, including syncword
 static int
 check_vbr_header(PMPSTR mp, int bytes)
 {
-    int     i, pos;
-    struct buf *buf = mp->tail;
+    unsigned char const *p;
     unsigned char xing[XING_HEADER_SIZE];
     VBRTAGDATA pTagData;
-
-    pos = buf->pos;
-    /* skip to valid header */
-    for (i = 0; i < bytes; ++i) {
-        while (pos >= buf->size) {
-            buf = buf->next;
-            if (!buf)
-                return -1; /* fatal error */
-            pos = buf->pos;
+    int     len = 0, n;
+
+    if (bytes < 0)
+        bytes = 0;
+    /* skip to valid header, and read it in place if it is contiguous */
+    n = input_span(mp, bytes, &p);
+    if (n < XING_HEADER_SIZE) {
+        while (len < XING_HEADER_SIZE && (n = input_span(mp, bytes + len, &p)) > 0) {
+            if (n > XING_HEADER_SIZE - len)
+                n = XING_HEADER_SIZE - len;
+            memcpy(xing + len, p, (size_t) n);
+            len += n;
         }
-        ++pos;
-    }
-    /* now read header */
-    for (i = 0; i < XING_HEADER_SIZE; ++i) {
-        while (pos >= buf->size) {
-            buf = buf->next;
-            if (!buf)
-                return -1; /* fatal error */
-            pos = buf->pos;
-        }
-        xing[i] = buf->pnt[pos];
-        ++pos;
+        if (len < XING_HEADER_SIZE)
+            return -1; /* fatal error */
+        p = xing;
     }
 
     /* check first bytes for Xing header */
-    mp->vbr_header = GetVbrTag(&pTagData, xing);
+    mp->vbr_header = GetVbrTag(&pTagData, p);
     if (mp->vbr_header) {
         mp->num_frames = pTagData.frames;
         mp->enc_delay = pTagData.enc_delay;
@@ -305,28 +335,22 @@ sync_buffer(PMPSTR mp, int free_match)
      * return -1 if header is not found
      */
     unsigned int b[4] = { 0, 0, 0, 0 };
-    int     i, h, pos;
-    struct buf *buf = mp->tail;
-    if (!buf)
-        return -1;
+    unsigned char const *p = NULL;
+    int     i, h, n = 0;
 
-    pos = buf->pos;
     for (i = 0; i < mp->bsize; i++) {
         /* get 4 bytes */
 
         b[0] = b[1];
         b[1] = b[2];
         b[2] = b[3];
-        while (pos >= buf->size) {
-            buf = buf->next;
-            if (!buf) {
-                return -1;
-                /* not enough data to read 4 bytes */
-            }
-            pos = buf->pos;
+        if (!n) {
+            n = input_span(mp, i, &p);
+            if (!n)
+                return -1; /* not enough data to read 4 bytes */
         }
-        b[3] = buf->pnt[pos];
-        ++pos;
+        b[3] = *p++;
+        --n;
 
         if (i >= 3) {
             struct frame *fr = &mp->fr;
@@ -389,6 +413,7 @@ decode_reset(PMPSTR mp)
     mp->data_parsed = 0;
     mp->sync_bitstream = 1; /* TODO check if this is right */
 #else
+    ExitMP3(mp);
     InitMP3(mp);        /* Less error prone to just to reinitialise. */
 #endif
 }
@@ -403,15 +428,12 @@ audiodata_precedesframes(PMPSTR mp)
 }
 
 static int
-decodeMP3_clipchoice(PMPSTR mp, unsigned char *in, int isize, char *out, int *done,
-                     int (*synth_1to1_mono_ptr) (PMPSTR, real *, unsigned char *, int *),
-                     int (*synth_1to1_ptr) (PMPSTR, real *, int, unsigned char *, int *))
+decode_frame(PMPSTR mp, char *out, int *done,
+             int (*synth_1to1_mono_ptr) (PMPSTR, real *, unsigned char *, int *),
+             int (*synth_1to1_ptr) (PMPSTR, real *, int, unsigned char *, int *))
 {
     int     i, iret, bits, bytes;
 
-    if (in && isize && addbuf(mp, in, isize) == NULL)
-        return MP3_ERR;
-
     /* First decode header */
     if (!mp->header_parsed) {
 
@@ -449,8 +471,7 @@ decodeMP3_clipchoice(PMPSTR mp, unsigned char *in, int isize, char *out, int *do
 #ifdef HIP_DEBUG
                 lame_report_fnc(mp->report_dbg, "hip: found xing header, skipping %i bytes\n", vbrbytes + bytes);
 #endif
-                for (i = 0; i < vbrbytes + bytes; ++i)
-                    read_buf_byte(mp);
+                skip_mp(mp, vbrbytes + bytes);
                 /* now we need to find another syncword */
                 /* just return and make user send in more data */
 
@@ -498,9 +519,9 @@ decodeMP3_clipchoice(PMPSTR mp, unsigned char *in, int isize, char *out, int *do
                we want to add 'bytes' worth of data, but do not 
                exceed MAXFRAMESIZE, so we through away 'i' bytes */
             i = (size + bytes) - MAXFRAMESIZE;
-            for (; i > 0; --i) {
-                --bytes;
-                read_buf_byte(mp);
+            if (i > 0) {
+                bytes -= i;
+                skip_mp(mp, i);
             }
 
             copy_mp(mp, bytes, mp->wordpointer);
@@ -607,7 +628,8 @@ decodeMP3_clipchoice(PMPSTR mp, unsigned char *in, int isize, char *out, int *do
             if (mp->fr.error_protection)
                 getbits(mp, 16);
 
-            if (decode_layer1_frame(mp, (unsigned char *) out, done) < 0)
+            if (decode_layer1_frame(mp, (unsigned char *) out, done,
+                                    synth_1to1_mono_ptr, synth_1to1_ptr) < 0)
                 return MP3_ERR;
             break;
 
@@ -615,7 +637,7 @@ decodeMP3_clipchoice(PMPSTR mp, unsigned char *in, int isize, char *out, int *do
             if (mp->fr.error_protection)
                 getbits(mp, 16);
 
-            decode_layer2_frame(mp, (unsigned char *) out, done);
+            decode_layer2_frame(mp, (unsigned char *) out, done, synth_1to1_mono_ptr, synth_1to1_ptr);
             break;
 
         case 3:
@@ -664,10 +686,10 @@ decodeMP3_clipchoice(PMPSTR mp, unsigned char *in, int isize, char *out, int *do
         int     size;
 #if 1
         /* FIXME: while loop OK ??? */
-        while (bytes > 512) {
-            read_buf_byte(mp);
-            bytes--;
-            mp->framesize--;
+        if (bytes > 512) {
+            skip_mp(mp, bytes - 512);
+            mp->framesize -= bytes - 512;
+            bytes = 512;
         }
 #endif
         copy_mp(mp, bytes, mp->wordpointer);
@@ -691,6 +713,27 @@ decodeMP3_clipchoice(PMPSTR mp, unsigned char *in, int isize, char *out, int *do
     return iret;
 }
 
+static int
+decodeMP3_clipchoice(PMPSTR mp, unsigned char *in, int isize, char *out, int *done,
+                     int (*synth_1to1_mono_ptr) (PMPSTR, real *, unsigned char *, int *),
+                     int (*synth_1to1_ptr) (PMPSTR, real *, int, unsigned char *, int *))
+{
+    int     iret;
+
+    /* input passed here is only borrowed for this call */
+    if (in && isize > 0) {
+        if (borrow_buf(mp, in, isize) != MP3_OK)
+            return MP3_ERR;
+        mp->borrow_held = 0;
+    }
+
+    iret = decode_frame(mp, out, done, synth_1to1_mono_ptr, synth_1to1_ptr);
+
+    if (mp->borrow && !mp->borrow_held && release_buf(mp) != MP3_OK)
+        return MP3_ERR;
+    return iret;
+}
+
 int
 decodeMP3(PMPSTR mp, unsigned char *in, int isize, char *out, int osize, int *done)
 {
@@ -716,3 +759,11 @@ decodeMP3_unclipped(PMPSTR mp, unsigned char *in, int isize, char *out, int osiz
     return decodeMP3_clipchoice(mp, in, isize, out, done, synth_1to1_mono_unclipped,
                                 synth_1to1_unclipped);
 }
+
+int
+decodeMP3_planar(PMPSTR mp, unsigned char *in, int isize, real *out[2], int *done)
+{
+    /* the synthesis writes each channel straight into its plane */
+    return decodeMP3_clipchoice(mp, in, isize, (char *) out, done, synth_1to1_mono_planar,
+                                synth_1to1_planar);
+}
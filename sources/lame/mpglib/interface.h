@@ -39,9 +39,23 @@ extern  "C" {
     int     decodeMP3_unclipped(PMPSTR mp, unsigned char *inmemory, int inmemsize, char *outmemory,
                                 int outmemsize, int *done);
 
-/* added remove_buf to support mpglib seeking */
+/* decodes unclipped like decodeMP3_unclipped, but into the separate
+   channel planes out[0] and out[1] (out[1] unused for mono), at most
+   1152 samples each; done is set to the number of bytes per channel */
+    int     decodeMP3_planar(PMPSTR mp, unsigned char *inmemory, int inmemsize, real *out[2],
+                             int *done);
+
+/* added remove_buf to support mpglib seeking, drops all buffered input */
     void    remove_buf(PMPSTR mp);
 
+/* borrow_buf hands the decoder the caller's memory to parse in place
+   across any number of decodeMP3(mp, NULL, 0, ...) calls; the caller
+   keeps it valid until release_buf, which copies the unconsumed part
+   into the decoder's own buffer.  Input passed to decodeMP3 directly
+   is borrowed the same way for the duration of that call. */
+    int     borrow_buf(PMPSTR mp, unsigned char *in, int isize);
+    int     release_buf(PMPSTR mp);
+
 /* added audiodata_precedesframes to return the number of bitstream frames the audio data will precede the 
    current frame by for Layer 3 data. Aids seeking.
  */
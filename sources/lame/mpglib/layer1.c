@@ -197,7 +197,9 @@ decode_layer1_sideinfo(PMPSTR mp)
 }
 
 int
-decode_layer1_frame(PMPSTR mp, unsigned char *pcm_sample, int *pcm_point)
+decode_layer1_frame(PMPSTR mp, unsigned char *pcm_sample, int *pcm_point,
+                     int (*synth_1to1_mono_ptr) (PMPSTR, real *, unsigned char *, int *),
+                     int (*synth_1to1_ptr) (PMPSTR, real *, int, unsigned char *, int *))
 {
     real    fraction[2][SBLIMIT]; /* FIXME: change real -> double ? */
     sideinfo_layer_I si;
@@ -216,15 +218,15 @@ decode_layer1_frame(PMPSTR mp, unsigned char *pcm_sample, int *pcm_point)
         /* decoding one of possibly two channels */
         for (i = 0; i < SCALE_BLOCK; i++) {
             I_step_two(mp, &si, fraction);
-            clip += synth_1to1_mono(mp, (real *) fraction[single], pcm_sample, pcm_point);
+            clip += (*synth_1to1_mono_ptr) (mp, (real *) fraction[single], pcm_sample, pcm_point);
         }
     }
     else {
         for (i = 0; i < SCALE_BLOCK; i++) {
             int     p1 = *pcm_point;
             I_step_two(mp, &si, fraction);
-            clip += synth_1to1(mp, (real *) fraction[0], 0, pcm_sample, &p1);
-            clip += synth_1to1(mp, (real *) fraction[1], 1, pcm_sample, pcm_point);
+            clip += (*synth_1to1_ptr) (mp, (real *) fraction[0], 0, pcm_sample, &p1);
+            clip += (*synth_1to1_ptr) (mp, (real *) fraction[1], 1, pcm_sample, pcm_point);
         }
     }
 
@@ -24,6 +24,8 @@
 
 void    hip_init_tables_layer1(void);
 int     decode_layer1_sideinfo(PMPSTR mp);
-int     decode_layer1_frame(PMPSTR mp, unsigned char *pcm_sample, int *pcm_point);
+int     decode_layer1_frame(PMPSTR mp, unsigned char *pcm_sample, int *pcm_point,
+                  int (*synth_1to1_mono_ptr) (PMPSTR, real *, unsigned char *, int *),
+                  int (*synth_1to1_ptr) (PMPSTR, real *, int, unsigned char *, int *));
 
 #endif
@@ -366,7 +366,9 @@ decode_layer2_sideinfo(PMPSTR mp)
 }
 
 int
-decode_layer2_frame(PMPSTR mp, unsigned char *pcm_sample, int *pcm_point)
+decode_layer2_frame(PMPSTR mp, unsigned char *pcm_sample, int *pcm_point,
+                     int (*synth_1to1_mono_ptr) (PMPSTR, real *, unsigned char *, int *),
+                     int (*synth_1to1_ptr) (PMPSTR, real *, int, unsigned char *, int *))
 {
     real    fraction[2][4][SBLIMIT]; /* pick_table clears unused subbands */
     sideinfo_layer_II si;
@@ -384,7 +386,7 @@ decode_layer2_frame(PMPSTR mp, unsigned char *pcm_sample, int *pcm_point)
         for (i = 0; i < SCALE_BLOCK; i++) {
             II_step_two(mp, &si, fr, i >> 2, fraction);
             for (j = 0; j < 3; j++) {
-                clip += synth_1to1_mono(mp, fraction[single][j], pcm_sample, pcm_point);
+                clip += (*synth_1to1_mono_ptr) (mp, fraction[single][j], pcm_sample, pcm_point);
             }
         }
     }
@@ -393,8 +395,8 @@ decode_layer2_frame(PMPSTR mp, unsigned char *pcm_sample, int *pcm_point)
             II_step_two(mp, &si, fr, i >> 2, fraction);
             for (j = 0; j < 3; j++) {
                 int     p1 = *pcm_point;
-                clip += synth_1to1(mp, fraction[0][j], 0, pcm_sample, &p1);
-                clip += synth_1to1(mp, fraction[1][j], 1, pcm_sample, pcm_point);
+                clip += (*synth_1to1_ptr) (mp, fraction[0][j], 0, pcm_sample, &p1);
+                clip += (*synth_1to1_ptr) (mp, fraction[1][j], 1, pcm_sample, pcm_point);
             }
         }
     }
@@ -33,7 +33,9 @@ struct al_table2 {
 
 void    hip_init_tables_layer2(void);
 int     decode_layer2_sideinfo(PMPSTR mp);
-int     decode_layer2_frame(PMPSTR mp, unsigned char *pcm_sample, int *pcm_point);
+int     decode_layer2_frame(PMPSTR mp, unsigned char *pcm_sample, int *pcm_point,
+                  int (*synth_1to1_mono_ptr) (PMPSTR, real *, unsigned char *, int *),
+                  int (*synth_1to1_ptr) (PMPSTR, real *, int, unsigned char *, int *));
 
 
 #endif
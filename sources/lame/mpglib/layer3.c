@@ -35,6 +35,7 @@
 #include "lame-analysis.h"
 #include "decode_i386.h"
 #include "layer3.h"
+#include "mpglib_simd.h"
 
 #ifdef WITH_DMALLOC
 #include <dmalloc.h>
@@ -48,6 +49,9 @@ static real aa_ca[8], aa_cs[8];
 static real COS1[12][6];
 static real win[4][36];
 static real win1[4][36];
+#ifdef MPGLIB_SIMD
+static real win_lanes[4][36][4]; /* win, win1, win, win1 side by side */
+#endif
 static real gainpow2[256 + 118 + 4];
 static real COS9[9];
 static real COS6_1, COS6_2;
@@ -228,6 +232,14 @@ hip_init_tables_layer3(void)
             win1[j][i] = -win[j][i];
     }
 
+#ifdef MPGLIB_SIMD
+    for (j = 0; j < 4; j++)
+        for (i = 0; i < 36; i++) {
+            win_lanes[j][i][0] = win_lanes[j][i][2] = win[j][i];
+            win_lanes[j][i][1] = win_lanes[j][i][3] = win1[j][i];
+        }
+#endif
+
     for (i = 0; i < 16; i++) {
         double  t = tan((double) i * M_PI / 12.0);
         tan1_1[i] = t / (1.0 + t);
@@ -1490,6 +1502,147 @@ static void dct36(real *inbuf,real *o1,real *o2,real *wintab,real *tsbuf)
 }
 
 
+#ifdef MPGLIB_SIMD
+
+/* dct36() for four neighbouring subbands at once, one per lane, with
+ * the same operations in the same order.  The subbands' inputs and
+ * outputs are 18 apart; ts is written four at a time. */
+static void
+dct36_lanes(real *inbuf, real *o1, real *o2, real (*wl)[4], real *ts)
+{
+    v4real  in[18], out1[18], out2[18];
+    int     i;
+
+    for (i = 0; i < 16; i += 4) {
+        v4real  a = v_load(inbuf + i), b = v_load(inbuf + 18 + i);
+        v4real  c = v_load(inbuf + 36 + i), d = v_load(inbuf + 54 + i);
+        v_transpose(a, b, c, d);
+        in[i] = a, in[i + 1] = b, in[i + 2] = c, in[i + 3] = d;
+        a = v_load(o1 + i), b = v_load(o1 + 18 + i);
+        c = v_load(o1 + 36 + i), d = v_load(o1 + 54 + i);
+        v_transpose(a, b, c, d);
+        out1[i] = a, out1[i + 1] = b, out1[i + 2] = c, out1[i + 3] = d;
+    }
+    for (i = 16; i < 18; i++) {
+        real    x[4], y[4];
+        x[0] = inbuf[i], x[1] = inbuf[18 + i], x[2] = inbuf[36 + i], x[3] = inbuf[54 + i];
+        y[0] = o1[i], y[1] = o1[18 + i], y[2] = o1[36 + i], y[3] = o1[54 + i];
+        in[i] = v_load(x);
+        out1[i] = v_load(y);
+    }
+
+    for (i = 17; i > 0; i--)
+        in[i] = v_add(in[i], in[i - 1]);
+    for (i = 17; i > 1; i -= 2)
+        in[i] = v_add(in[i], in[i - 2]);
+
+    {
+#define VC(k) v_dup(COS9[k])
+#define LANES0(v) { \
+    v4real const tmp = v_add(sum0, sum1); \
+    out2[9+(v)] = v_mul(tmp, v_load(wl[27+(v)])); \
+    out2[8-(v)] = v_mul(tmp, v_load(wl[26-(v)])); \
+    sum0 = v_sub(sum0, sum1); \
+    v_store(ts + SBLIMIT*(8-(v)), v_add(out1[8-(v)], v_mul(sum0, v_load(wl[8-(v)])))); \
+    v_store(ts + SBLIMIT*(9+(v)), v_add(out1[9+(v)], v_mul(sum0, v_load(wl[9+(v)])))); }
+#define LANES1(v) { \
+    v4real sum0 = v_add(tmp1a, tmp2a); \
+    v4real sum1 = v_mul(v_add(tmp1b, tmp2b), v_dup(tfcos36[(v)])); \
+    LANES0(v); }
+#define LANES2(v) { \
+    v4real sum0 = v_sub(tmp2a, tmp1a); \
+    v4real sum1 = v_mul(v_sub(tmp2b, tmp1b), v_dup(tfcos36[(v)])); \
+    LANES0(v); }
+
+        v4real const ta33 = v_mul(in[2 * 3 + 0], VC(3));
+        v4real const ta66 = v_mul(in[2 * 6 + 0], VC(6));
+        v4real const tb33 = v_mul(in[2 * 3 + 1], VC(3));
+        v4real const tb66 = v_mul(in[2 * 6 + 1], VC(6));
+        v4real  tmp1a, tmp2a, tmp1b, tmp2b;
+
+        /* o is 0 for the a terms, 1 for the b terms */
+#define T1_0(o,t33) v_add(v_add(v_add(v_mul(in[2*1+o], VC(1)), t33), \
+                                v_mul(in[2*5+o], VC(5))), v_mul(in[2*7+o], VC(7)))
+#define T2_0(o,t66) v_add(v_add(v_add(v_add(in[2*0+o], v_mul(in[2*2+o], VC(2))), \
+                                      v_mul(in[2*4+o], VC(4))), t66), v_mul(in[2*8+o], VC(8)))
+        tmp1a = T1_0(0, ta33);
+        tmp1b = T1_0(1, tb33);
+        tmp2a = T2_0(0, ta66);
+        tmp2b = T2_0(1, tb66);
+        LANES1(0);
+        LANES2(8);
+
+#define T1_1(o) v_mul(v_sub(v_sub(in[2*1+o], in[2*5+o]), in[2*7+o]), VC(3))
+#define T2_1(o) v_add(v_sub(v_mul(v_sub(v_sub(in[2*2+o], in[2*4+o]), in[2*8+o]), VC(6)), \
+                            in[2*6+o]), in[2*0+o])
+        tmp1a = T1_1(0);
+        tmp1b = T1_1(1);
+        tmp2a = T2_1(0);
+        tmp2b = T2_1(1);
+        LANES1(1);
+        LANES2(7);
+
+#define T1_2(o,t33) v_add(v_sub(v_sub(v_mul(in[2*1+o], VC(5)), t33), \
+                                v_mul(in[2*5+o], VC(7))), v_mul(in[2*7+o], VC(1)))
+#define T2_2(o,t66) v_add(v_add(v_sub(v_sub(in[2*0+o], v_mul(in[2*2+o], VC(8))), \
+                                      v_mul(in[2*4+o], VC(2))), t66), v_mul(in[2*8+o], VC(4)))
+        tmp1a = T1_2(0, ta33);
+        tmp1b = T1_2(1, tb33);
+        tmp2a = T2_2(0, ta66);
+        tmp2b = T2_2(1, tb66);
+        LANES1(2);
+        LANES2(6);
+
+#define T1_3(o,t33) v_sub(v_add(v_sub(v_mul(in[2*1+o], VC(7)), t33), \
+                                v_mul(in[2*5+o], VC(1))), v_mul(in[2*7+o], VC(5)))
+#define T2_3(o,t66) v_sub(v_add(v_add(v_sub(in[2*0+o], v_mul(in[2*2+o], VC(4))), \
+                                      v_mul(in[2*4+o], VC(8))), t66), v_mul(in[2*8+o], VC(2)))
+        tmp1a = T1_3(0, ta33);
+        tmp1b = T1_3(1, tb33);
+        tmp2a = T2_3(0, ta66);
+        tmp2b = T2_3(1, tb66);
+        LANES1(3);
+        LANES2(5);
+
+        {
+            v4real  sum0 = v_add(v_sub(v_add(v_sub(in[2 * 0 + 0], in[2 * 2 + 0]), in[2 * 4 + 0]),
+                                       in[2 * 6 + 0]), in[2 * 8 + 0]);
+            v4real  sum1 = v_mul(v_add(v_sub(v_add(v_sub(in[2 * 0 + 1], in[2 * 2 + 1]),
+                                                   in[2 * 4 + 1]), in[2 * 6 + 1]), in[2 * 8 + 1]),
+                                 v_dup(tfcos36[4]));
+            LANES0(4);
+        }
+#undef T1_0
+#undef T2_0
+#undef T1_1
+#undef T2_1
+#undef T1_2
+#undef T2_2
+#undef T1_3
+#undef T2_3
+#undef LANES0
+#undef LANES1
+#undef LANES2
+#undef VC
+    }
+
+    for (i = 0; i < 16; i += 4) {
+        v4real  a = out2[i], b = out2[i + 1], c = out2[i + 2], d = out2[i + 3];
+        v_transpose(a, b, c, d);
+        v_store(o2 + i, a);
+        v_store(o2 + 18 + i, b);
+        v_store(o2 + 36 + i, c);
+        v_store(o2 + 54 + i, d);
+    }
+    for (i = 16; i < 18; i++) {
+        real    y[4];
+        v_store(y, out2[i]);
+        o2[i] = y[0], o2[18 + i] = y[1], o2[36 + i] = y[2], o2[54 + i] = y[3];
+    }
+}
+
+#endif
+
 /*
  * new DCT12
  */
@@ -1671,6 +1824,10 @@ III_hybrid(PMPSTR mp, real fsIn[SBLIMIT][SSLIMIT], real tsOut[SSLIMIT][SBLIMIT],
         }
     }
     else {
+#ifdef MPGLIB_SIMD
+        for (; sb + 4 <= (int) gr_infos->maxb; sb += 4, tspnt += 4, rawout1 += 72, rawout2 += 72)
+            dct36_lanes(fsIn[sb], rawout1, rawout2, win_lanes[bt], tspnt);
+#endif
         for (; sb < (int) gr_infos->maxb; sb += 2, tspnt += 2, rawout1 += 36, rawout2 += 36) {
             dct36(fsIn[sb], rawout1, rawout2, win[bt], tspnt);
             dct36(fsIn[sb + 1], rawout1 + 18, rawout2 + 18, win1[bt], tspnt + 1);
@@ -32,23 +32,17 @@ typedef struct plotting_data plotting_data;
 
 extern void lame_report_fnc(lame_report_function f, const char *format, ...);
 
-struct buf {
-    unsigned char *pnt;
-    long    size;
-    long    pos;
-    struct buf *next;
-    struct buf *prev;
-};
-
-struct framebuf {
-    struct buf *buf;
-    long    pos;
-    struct frame *next;
-    struct frame *prev;
-};
-
 typedef struct mpstr_tag {
-    struct buf *head, *tail; /* buffer linked list pointers, tail points to oldest buffer */
+    /* input not yet consumed is the ring followed by the borrowed
+       buffer; bsize counts both */
+    unsigned char *ring;     /* owned copy of input kept between calls */
+    int     ring_size;       /* allocated size, a power of two */
+    int     ring_pos;        /* offset of the oldest byte */
+    int     ring_len;        /* bytes held */
+    unsigned char const *borrow; /* caller memory parsed in place, or NULL */
+    int     borrow_len;
+    int     borrow_pos;
+    int     borrow_held;     /* 1 = borrow_buf(), kept until release_buf() */
     int     vbr_header;      /* 1 if valid Xing vbr header detected */
     int     num_frames;      /* set if vbr header present */
     int     enc_delay;       /* set if vbr header present */
@@ -0,0 +1,77 @@
+/*
+ * mpglib_simd.h: four lane helpers for the synthesis filterbank
+ *
+ * Copyright (C) 1999-2010 The L.A.M.E. project
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef MPGLIB_SIMD_H_INCLUDED
+#define MPGLIB_SIMD_H_INCLUDED
+
+#include "mpg123.h"
+
+/* Each lane does exactly the operations the scalar code does for one
+ * value, in the same order, so the vector paths decode bit for bit
+ * like the C ones.  Only for real == float. */
+
+#if defined(REAL_IS_FLOAT) && defined(__SSE__)
+# include <xmmintrin.h>
+# define MPGLIB_SIMD
+
+typedef __m128 v4real;
+# define v_load(p)      _mm_loadu_ps(p)
+# define v_store(p,v)   _mm_storeu_ps(p,v)
+# define v_dup(x)       _mm_set1_ps(x)
+# define v_add(a,b)     _mm_add_ps(a,b)
+# define v_sub(a,b)     _mm_sub_ps(a,b)
+# define v_mul(a,b)     _mm_mul_ps(a,b)
+# define v_neg(a)       _mm_xor_ps(a,_mm_set1_ps(-0.f))
+# define v_reverse(v)   _mm_shuffle_ps(v,v,_MM_SHUFFLE(0,1,2,3))
+# define v_transpose(a,b,c,d) _MM_TRANSPOSE4_PS(a,b,c,d)
+
+#elif defined(REAL_IS_FLOAT) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+# include <arm_neon.h>
+# define MPGLIB_SIMD
+
+typedef float32x4_t v4real;
+# define v_load(p)      vld1q_f32(p)
+# define v_store(p,v)   vst1q_f32(p,v)
+# define v_dup(x)       vdupq_n_f32(x)
+# define v_add(a,b)     vaddq_f32(a,b)
+# define v_sub(a,b)     vsubq_f32(a,b)
+# define v_mul(a,b)     vmulq_f32(a,b)
+# define v_neg(a)       vnegq_f32(a)
+
+inline static v4real
+v_reverse(v4real v)
+{
+    v = vrev64q_f32(v);
+    return vcombine_f32(vget_high_f32(v), vget_low_f32(v));
+}
+
+# define v_transpose(a,b,c,d) do {                        \
+    float32x4x2_t const t0_ = vzipq_f32((a), (c));       \
+    float32x4x2_t const t1_ = vzipq_f32((b), (d));       \
+    float32x4x2_t const u0_ = vzipq_f32(t0_.val[0], t1_.val[0]); \
+    float32x4x2_t const u1_ = vzipq_f32(t0_.val[1], t1_.val[1]); \
+    (a) = u0_.val[0]; (b) = u0_.val[1];                  \
+    (c) = u1_.val[0]; (d) = u1_.val[1];                  \
+  } while (0)
+
+#endif
+
+#endif
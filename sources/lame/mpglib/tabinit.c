@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include "tabinit.h"
 #include "mpg123.h"
+#include "mpglib_simd.h"
 
 #ifdef WITH_DMALLOC
 #include <dmalloc.h>
@@ -37,6 +38,9 @@
 static int table_init_called = 0;
 
 real    decwin[512 + 32];
+#ifdef MPGLIB_SIMD
+real    decwin_lanes[33][17];
+#endif
 static real cos64[16], cos32[8], cos16[4], cos8[2], cos4[1];
 real   *pnts[] = { cos64, cos32, cos16, cos8, cos4 };
 
@@ -149,4 +153,10 @@ make_decode_tables(long scaleval)
         if (i % 64 == 63)
             scaleval = -scaleval;
     }
+
+#ifdef MPGLIB_SIMD
+    for (i = 0; i < 33; i++)
+        for (j = 0; j < 17; j++)
+            decwin_lanes[i][j] = 32 * j + i < 512 + 32 ? decwin[32 * j + i] : 0;
+#endif
 }
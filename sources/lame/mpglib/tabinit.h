@@ -25,6 +25,9 @@
 #include "mpg123.h"
 
 extern real decwin[512 + 32];
+/* decwin_lanes[m][j] = decwin[32 * j + m], the window of neighbouring
+   synthesis outputs side by side */
+extern real decwin_lanes[33][17];
 extern real *pnts[5];
 
 void    make_decode_tables(long scale);
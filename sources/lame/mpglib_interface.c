@@ -302,15 +302,18 @@ lame_decode_headers(unsigned char *buffer,
     int     ret;
     int     totsize = 0;     /* number of decoded samples per channel */
 
+    /* decode straight from buffer, keeping only the unused tail */
+    if (borrow_buf(&mp, buffer, len) != MP3_OK)
+        return -1;
     for (;;) {
-        switch (ret = lame_decode1_headers(buffer, len, pcm_l + totsize, pcm_r + totsize, mp3data)) {
+        switch (ret = lame_decode1_headers(NULL, 0, pcm_l + totsize, pcm_r + totsize, mp3data)) {
         case -1:
+            release_buf(&mp);
             return ret;
         case 0:
-            return totsize;
+            return release_buf(&mp) == MP3_OK ? totsize : -1;
         default:
             totsize += ret;
-            len = 0;    /* future calls to decodeMP3 are just to flush buffers */
             break;
         }
     }
@@ -403,15 +406,20 @@ hip_decode_headers(hip_t hip, unsigned char *buffer,
     int     ret;
     int     totsize = 0;     /* number of decoded samples per channel */
 
+    if (!hip)
+        return -1;
+    /* decode straight from buffer, keeping only the unused tail */
+    if (borrow_buf(hip, buffer, len < INT_MAX ? (int) len : INT_MAX) != MP3_OK)
+        return -1;
     for (;;) {
-        switch (ret = hip_decode1_headers(hip, buffer, len, pcm_l + totsize, pcm_r + totsize, mp3data)) {
+        switch (ret = hip_decode1_headers(hip, NULL, 0, pcm_l + totsize, pcm_r + totsize, mp3data)) {
         case -1:
+            release_buf(hip);
             return ret;
         case 0:
-            return totsize;
+            return release_buf(hip) == MP3_OK ? totsize : -1;
         default:
             totsize += ret;
-            len = 0;    /* future calls to decodeMP3 are just to flush buffers */
             break;
         }
     }
@@ -442,6 +450,48 @@ hip_decode1_headersB(hip_t hip, unsigned char *buffer,
 }
 
 
+int
+hip_decode_borrow(hip_t hip, unsigned char *buffer, size_t len)
+{
+    if (hip) {
+        return borrow_buf(hip, buffer, len < INT_MAX ? (int) len : INT_MAX) == MP3_OK ? 0 : -1;
+    }
+    return -1;
+}
+
+
+int
+hip_decode_release(hip_t hip)
+{
+    if (hip) {
+        return release_buf(hip) == MP3_OK ? 0 : -1;
+    }
+    return -1;
+}
+
+
+int
+hip_decode1_planar(hip_t hip, sample_t *pcm[2], int *nsamples, int *stereo, int *samplerate)
+{
+    int     processed_bytes = 0;
+
+    if (hip) {
+        switch (decodeMP3_planar(hip, NULL, 0, pcm, &processed_bytes)) {
+        case MP3_OK:
+            *nsamples = processed_bytes / (int) sizeof(sample_t);
+            *stereo = hip->fr.stereo;
+            *samplerate = freqs[hip->fr.sampling_frequency];
+            return 1;
+        case MP3_NEED_MORE:
+            return 0;
+        default:
+            break;
+        }
+    }
+    return -1;
+}
+
+
 void hip_set_pinfo(hip_t hip, plotting_data* pinfo)
 {
     if (hip) {
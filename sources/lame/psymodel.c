@@ -155,6 +155,12 @@ blocktype_d[2]        block type to use for previous granule
 #include "fft.h"
 #include "lame-analysis.h"
 
+#if defined(__SSE__)
+# include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+#endif
+
 
 #define NSFIRLEN 21
 
@@ -563,6 +569,130 @@ pecalc_l(III_psy_ratio const *mr, FLOAT masking_lower)
 }
 
 
+/* Power spectrum of the FHT output w[0..n-1]:
+ *   energy[0] = w[0]^2, energy[i] = (w[i]^2 + w[n-i]^2) / 2 for 0 < i <= n/2
+ * With ms set, w and w2 hold the left and right FHT and are turned into mid
+ * and side first, in the same pass; the energy is then the one of mid.
+ */
+static void
+fht_energy(FLOAT * w, FLOAT * w2, int ms, FLOAT * energy, int n)
+{
+    FLOAT const sqrt2_half = SQRT2 * 0.5f;
+    int     i = 1;
+
+    if (ms) {
+        FLOAT const l = w[0];
+        FLOAT const r = w2[0];
+        w[0] = (l + r) * sqrt2_half;
+        w2[0] = (l - r) * sqrt2_half;
+    }
+    energy[0] = w[0];
+    energy[0] *= energy[0];
+
+#if defined(__SSE__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+    /* w[i..i+3] against the mirrored w[n-i-3..n-i]; the two blocks only
+     * share w[n/2] in the last step, both load it before either stores */
+    assert((n / 2) % 4 == 0);
+    for (; i + 3 <= n / 2; i += 4) {
+# if defined(__SSE__)
+        __m128 const c = _mm_set1_ps(sqrt2_half);
+        __m128  re = _mm_loadu_ps(w + i);
+        __m128  im = _mm_loadu_ps(w + n - i - 3);
+        if (ms) {
+            __m128 const re2 = _mm_loadu_ps(w2 + i);
+            __m128 const im2 = _mm_loadu_ps(w2 + n - i - 3);
+            _mm_storeu_ps(w2 + i, _mm_mul_ps(_mm_sub_ps(re, re2), c));
+            _mm_storeu_ps(w2 + n - i - 3, _mm_mul_ps(_mm_sub_ps(im, im2), c));
+            re = _mm_mul_ps(_mm_add_ps(re, re2), c);
+            im = _mm_mul_ps(_mm_add_ps(im, im2), c);
+            _mm_storeu_ps(w + i, re);
+            _mm_storeu_ps(w + n - i - 3, im);
+        }
+        im = _mm_shuffle_ps(im, im, _MM_SHUFFLE(0, 1, 2, 3));
+        _mm_storeu_ps(energy + i, _mm_mul_ps(_mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im)),
+                                             _mm_set1_ps(0.5f)));
+# else
+        float32x4_t const c = vdupq_n_f32(sqrt2_half);
+        float32x4_t re = vld1q_f32(w + i);
+        float32x4_t im = vld1q_f32(w + n - i - 3);
+        if (ms) {
+            float32x4_t const re2 = vld1q_f32(w2 + i);
+            float32x4_t const im2 = vld1q_f32(w2 + n - i - 3);
+            vst1q_f32(w2 + i, vmulq_f32(vsubq_f32(re, re2), c));
+            vst1q_f32(w2 + n - i - 3, vmulq_f32(vsubq_f32(im, im2), c));
+            re = vmulq_f32(vaddq_f32(re, re2), c);
+            im = vmulq_f32(vaddq_f32(im, im2), c);
+            vst1q_f32(w + i, re);
+            vst1q_f32(w + n - i - 3, im);
+        }
+        im = vrev64q_f32(im);
+        im = vcombine_f32(vget_high_f32(im), vget_low_f32(im));
+        vst1q_f32(energy + i, vmulq_f32(vaddq_f32(vmulq_f32(re, re), vmulq_f32(im, im)),
+                                        vdupq_n_f32(0.5f)));
+# endif
+    }
+#else
+    if (ms) {
+        for (i = n - 1; i > 0; --i) {
+            FLOAT const l = w[i];
+            FLOAT const r = w2[i];
+            w[i] = (l + r) * sqrt2_half;
+            w2[i] = (l - r) * sqrt2_half;
+        }
+    }
+    for (i = 1; i <= n / 2; i++) {
+        FLOAT const re = w[i];
+        FLOAT const im = w[n - i];
+        energy[i] = (re * re + im * im) * 0.5f;
+    }
+#endif
+}
+
+
+/* x[i] = s3[i] * eb[i] * tab_x[i] for i < n, over a zero padded s3 row.
+ * The vector loop runs to n rounded up to 4, so x, eb and tab_x need that
+ * much room.
+ */
+static void
+s3_products(FLOAT const *s3, FLOAT const *eb, FLOAT const *tab_x, FLOAT * x, int n)
+{
+    int     i;
+#if defined(__SSE__)
+    for (i = 0; i < n; i += 4)
+        _mm_storeu_ps(x + i, _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(s3 + i), _mm_loadu_ps(eb + i)),
+                                        _mm_loadu_ps(tab_x + i)));
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (i = 0; i < n; i += 4)
+        vst1q_f32(x + i, vmulq_f32(vmulq_f32(vld1q_f32(s3 + i), vld1q_f32(eb + i)),
+                                   vld1q_f32(tab_x + i)));
+#else
+    for (i = 0; i < n; i++)
+        x[i] = s3[i] * eb[i] * tab_x[i];
+#endif
+}
+
+
+/* per partition inputs of the spreading: the energies and tab[] factors,
+ * zero padded for s3_products, and running sums of the mask indices */
+static void
+calc_s3_inputs(int npart, FLOAT const *eb, unsigned char const *mask_idx,
+               FLOAT * eb_x, FLOAT * tab_x, int *idx_sum)
+{
+    int     b;
+
+    idx_sum[0] = 0;
+    for (b = 0; b < npart; b++) {
+        eb_x[b] = eb[b];
+        tab_x[b] = tab[mask_idx[b]];
+        idx_sum[b + 1] = idx_sum[b] + mask_idx[b];
+    }
+    for (; b < npart + 3; b++) {
+        eb_x[b] = 0;
+        tab_x[b] = 0;
+    }
+}
+
+
 static void
 calc_energy(PsyConst_CB2SB_t const *l, FLOAT const *fftenergy, FLOAT * eb, FLOAT * max, FLOAT * avg)
 {
@@ -674,28 +804,12 @@ vbrpsy_compute_fft_l(lame_internal_flags * gfc, const sample_t * const buffer[2]
     if (chn < 2) {
         fft_long(gfc, *wsamp_l, chn, buffer);
     }
-    else if (chn == 2) {
-        FLOAT const sqrt2_half = SQRT2 * 0.5f;
-        /* FFT data for mid and side channel is derived from L & R */
-        for (j = BLKSIZE - 1; j >= 0; --j) {
-            FLOAT const l = wsamp_l[0][j];
-            FLOAT const r = wsamp_l[1][j];
-            wsamp_l[0][j] = (l + r) * sqrt2_half;
-            wsamp_l[1][j] = (l - r) * sqrt2_half;
-        }
-    }
 
     /*********************************************************************
     *  compute energies
+    *  FFT data for mid and side channel is derived from L & R
     *********************************************************************/
-    fftenergy[0] = wsamp_l[0][0];
-    fftenergy[0] *= fftenergy[0];
-
-    for (j = BLKSIZE / 2 - 1; j >= 0; --j) {
-        FLOAT const re = (*wsamp_l)[BLKSIZE / 2 - j];
-        FLOAT const im = (*wsamp_l)[BLKSIZE / 2 + j];
-        fftenergy[BLKSIZE / 2 - j] = (re * re + im * im) * 0.5f;
-    }
+    fht_energy(wsamp_l[0], wsamp_l[1], chn == 2, fftenergy, BLKSIZE);
     /* total energy */
     {
         FLOAT   totalenergy = 0.0f;
@@ -718,32 +832,15 @@ static void
 vbrpsy_compute_fft_s(lame_internal_flags const *gfc, const sample_t * const buffer[2], int chn,
                      int sblock, FLOAT(*fftenergy_s)[HBLKSIZE_s], FLOAT(*wsamp_s)[3][BLKSIZE_s])
 {
-    int     j;
-
     if (sblock == 0 && chn < 2) {
         fft_short(gfc, *wsamp_s, chn, buffer);
     }
-    if (chn == 2) {
-        FLOAT const sqrt2_half = SQRT2 * 0.5f;
-        /* FFT data for mid and side channel is derived from L & R */
-        for (j = BLKSIZE_s - 1; j >= 0; --j) {
-            FLOAT const l = wsamp_s[0][sblock][j];
-            FLOAT const r = wsamp_s[1][sblock][j];
-            wsamp_s[0][sblock][j] = (l + r) * sqrt2_half;
-            wsamp_s[1][sblock][j] = (l - r) * sqrt2_half;
-        }
-    }
 
     /*********************************************************************
     *  compute energies
+    *  FFT data for mid and side channel is derived from L & R
     *********************************************************************/
-    fftenergy_s[sblock][0] = (*wsamp_s)[sblock][0];
-    fftenergy_s[sblock][0] *= fftenergy_s[sblock][0];
-    for (j = BLKSIZE_s / 2 - 1; j >= 0; --j) {
-        FLOAT const re = (*wsamp_s)[sblock][BLKSIZE_s / 2 - j];
-        FLOAT const im = (*wsamp_s)[sblock][BLKSIZE_s / 2 + j];
-        fftenergy_s[sblock][BLKSIZE_s / 2 - j] = (re * re + im * im) * 0.5f;
-    }
+    fht_energy(wsamp_s[0][sblock], wsamp_s[1][sblock], chn == 2, fftenergy_s[sblock], BLKSIZE_s);
 }
 
 
@@ -1045,6 +1142,8 @@ vbrpsy_compute_masking_s(lame_internal_flags * gfc, const FLOAT(*fftenergy_s)[HB
     PsyStateVar_t *const psv = &gfc->sv_psy;
     PsyConst_CB2SB_t const *const gds = &gfc->cd_psy->s;
     FLOAT   max[CBANDS], avg[CBANDS];
+    FLOAT   eb_x[CBANDS + 3], tab_x[CBANDS + 3], x3[CBANDS + 3];
+    int     idx_sum[CBANDS + 1];
     int     i, j, b;
     unsigned char mask_idx_s[CBANDS];
 
@@ -1070,25 +1169,22 @@ vbrpsy_compute_masking_s(lame_internal_flags * gfc, const FLOAT(*fftenergy_s)[HB
     assert(b == gds->npart);
     assert(j == 129);
     vbrpsy_calc_mask_index_s(gfc, max, avg, mask_idx_s);
-    for (j = b = 0; b < gds->npart; b++) {
-        int     kk = gds->s3ind[b][0];
+    calc_s3_inputs(gds->npart, eb, mask_idx_s, eb_x, tab_x, idx_sum);
+    for (b = 0; b < gds->npart; b++) {
+        int const first = gds->s3ind[b][0];
         int const last = gds->s3ind[b][1];
         int const delta = mask_add_delta(mask_idx_s[b]);
-        int     dd, dd_n;
+        int const dd_n = last - first + 1;
+        int     dd;
         FLOAT   x, ecb, avg_mask;
         FLOAT const masking_lower = gds->masking_lower[b] * gfc->sv_qnt.masking_lower;
 
-        dd = mask_idx_s[kk];
-        dd_n = 1;
-        ecb = gds->s3[j] * eb[kk] * tab[mask_idx_s[kk]];
-        ++j, ++kk;
-        while (kk <= last) {
-            dd += mask_idx_s[kk];
-            dd_n += 1;
-            x = gds->s3[j] * eb[kk] * tab[mask_idx_s[kk]];
-            ecb = vbrpsy_mask_add(ecb, x, kk - b, delta);
-            ++j, ++kk;
+        s3_products(gds->s3 + gds->s3off[b], eb_x + first, tab_x + first, x3, dd_n);
+        ecb = x3[0];
+        for (i = 1; i < dd_n; i++) {
+            ecb = vbrpsy_mask_add(ecb, x3[i], first + i - b, delta);
         }
+        dd = idx_sum[last + 1] - idx_sum[first];
         dd = (1 + 2 * dd) / (2 * dd_n);
         avg_mask = tab[dd] * 0.5f;
         ecb *= avg_mask;
@@ -1148,6 +1244,8 @@ vbrpsy_compute_masking_l(lame_internal_flags * gfc, const FLOAT fftenergy[HBLKSI
     PsyStateVar_t *const psv = &gfc->sv_psy;
     PsyConst_CB2SB_t const *const gdl = &gfc->cd_psy->l;
     FLOAT   max[CBANDS], avg[CBANDS];
+    FLOAT   eb_x[CBANDS + 3], tab_x[CBANDS + 3], x3[CBANDS + 3];
+    int     idx_sum[CBANDS + 1];
     unsigned char mask_idx_l[CBANDS + 2];
     int     k, b;
 
@@ -1156,40 +1254,28 @@ vbrpsy_compute_masking_l(lame_internal_flags * gfc, const FLOAT fftenergy[HBLKSI
  *********************************************************************/
     calc_energy(gdl, fftenergy, eb_l, max, avg);
     calc_mask_index_l(gfc, max, avg, mask_idx_l);
+    calc_s3_inputs(gdl->npart, eb_l, mask_idx_l, eb_x, tab_x, idx_sum);
 
  /*********************************************************************
     *      convolve the partitioned energy and unpredictability
     *      with the spreading function, s3_l[b][k]
  ********************************************************************/
-    k = 0;
     for (b = 0; b < gdl->npart; b++) {
-        FLOAT   x, ecb, avg_mask, t;
+        FLOAT   x, ecb, avg_mask;
         FLOAT const masking_lower = gdl->masking_lower[b] * gfc->sv_qnt.masking_lower;
         /* convolve the partitioned energy with the spreading function */
-        int     kk = gdl->s3ind[b][0];
+        int const first = gdl->s3ind[b][0];
         int const last = gdl->s3ind[b][1];
         int const delta = mask_add_delta(mask_idx_l[b]);
-        int     dd = 0, dd_n = 0;
-
-        dd = mask_idx_l[kk];
-        dd_n += 1;
-        ecb = gdl->s3[k] * eb_l[kk] * tab[mask_idx_l[kk]];
-        ++k, ++kk;
-        while (kk <= last) {
-            dd += mask_idx_l[kk];
-            dd_n += 1;
-            x = gdl->s3[k] * eb_l[kk] * tab[mask_idx_l[kk]];
-            t = vbrpsy_mask_add(ecb, x, kk - b, delta);
-#if 0
-            ecb += eb_l[kk];
-            if (ecb > t) {
-                ecb = t;
-            }
-#else
-            ecb = t;
-#endif
-            ++k, ++kk;
+        int const dd_n = last - first + 1;
+        int     dd;
+
+        s3_products(gdl->s3 + gdl->s3off[b], eb_x + first, tab_x + first, x3, dd_n);
+        ecb = x3[0];
+        for (k = 1; k < dd_n; k++) {
+            ecb = vbrpsy_mask_add(ecb, x3[k], first + k - b, delta);
         }
+        dd = idx_sum[last + 1] - idx_sum[first];
         dd = (1 + 2 * dd) / (2 * dd_n);
         avg_mask = tab[dd] * 0.5f;
         ecb *= avg_mask;
@@ -1824,7 +1910,7 @@ compute_bark_values(PsyConst_CB2SB_t const *gd, FLOAT sfreq, int fft_size,
 }
 
 static int
-init_s3_values(FLOAT ** p, int (*s3ind)[2], int npart,
+init_s3_values(FLOAT ** p, int (*s3ind)[2], int *s3off, int npart,
                FLOAT const *bval, FLOAT const *bval_width, FLOAT const *norm)
 {
     FLOAT   s3[CBANDS][CBANDS];
@@ -1860,15 +1946,16 @@ init_s3_values(FLOAT ** p, int (*s3ind)[2], int npart,
                 break;
         }
         s3ind[i][1] = j;
-        numberOfNoneZero += (s3ind[i][1] - s3ind[i][0] + 1);
+        s3off[i] = numberOfNoneZero;
+        /* each row padded with zeros to a multiple of 4, see s3_products */
+        numberOfNoneZero += (s3ind[i][1] - s3ind[i][0] + 4) & ~3;
     }
     *p = lame_calloc(FLOAT, numberOfNoneZero);
     if (!*p)
         return -1;
 
-    k = 0;
     for (i = 0; i < npart; i++)
-        for (j = s3ind[i][0]; j <= s3ind[i][1]; j++)
+        for (k = s3off[i], j = s3ind[i][0]; j <= s3ind[i][1]; j++)
             (*p)[k++] = s3[i][j];
 
     return 0;
@@ -1950,7 +2037,7 @@ psymodel_init(lame_global_flags const *gfp)
         }
         norm[i] = pow(10.0, snr / 10.0);
     }
-    i = init_s3_values(&gd->l.s3, gd->l.s3ind, gd->l.npart, bval, bval_width, norm);
+    i = init_s3_values(&gd->l.s3, gd->l.s3ind, gd->l.s3off, gd->l.npart, bval, bval_width, norm);
     if (i)
         return i;
 
@@ -2049,7 +2136,7 @@ psymodel_init(lame_global_flags const *gfp)
         gd->s.minval[i] = pow(10.0, x / 10) * gd->s.numlines[i];
     }
 
-    i = init_s3_values(&gd->s.s3, gd->s.s3ind, gd->s.npart, bval, bval_width, norm);
+    i = init_s3_values(&gd->s.s3, gd->s.s3ind, gd->s.s3off, gd->s.npart, bval, bval_width, norm);
     if (i)
         return i;
 
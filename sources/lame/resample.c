@@ -0,0 +1,440 @@
+/*
+ *      polyphase sample rate converter
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ *  The converter steps through the input in exact rational increments:
+ *  output sample k sits at input time k * num / den, with num/den the
+ *  reduced ratio samplerate_in / samplerate_out.  The fractional part of
+ *  that time selects one of the precomputed phases of a Kaiser windowed
+ *  sinc lowpass.  If den phases fit into RS_MAX_COEFFS coefficients every
+ *  phase is exact, otherwise RS_INTERP_PHASES phases are stored and the
+ *  converter interpolates linearly between the two neighbouring ones.
+ *
+ *  Each output sample is a dot product over 'taps' input samples.  The
+ *  dot products are computed for two channels at a time, so every filter
+ *  coefficient is loaded once per channel pair.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "lame.h"
+#include "machine.h"
+#include "encoder.h"
+#include "util.h"
+#include "snapshot.h"
+
+#if defined(__SSE__)
+# include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+#endif
+
+
+#define RS_MAX_COEFFS     65536 /* max. size of an exact polyphase table */
+#define RS_INTERP_PHASES  256   /* phases stored when interpolating */
+#define RS_BLOCK          1024  /* input samples buffered per refill */
+
+
+struct lame_resampler_struct {
+    int     channels;
+    int     num, den;        /* samplerate_in / samplerate_out, reduced */
+    int     step_int;        /* num / den */
+    int     step_frac;       /* num % den */
+    int     taps;            /* filter length, a multiple of 4 */
+    int     phases;          /* number of precomputed filter phases */
+    int     interpolate;     /* phases != den, interpolate between phases */
+    float  *filter;          /* (phases + interpolate) rows of 'taps' coefficients */
+
+    int     pos;             /* buffer index of the first tap of the next output */
+    int     frac;            /* fractional input time of the next output, in 1/den */
+    int     filled;          /* samples held in buf[ch] */
+    int     bufsize;
+    float **buf;
+};
+
+
+/* quality 0 (best) ... 9 (fastest), same scale as lame_set_quality() */
+static const struct {
+    int     taps;            /* filter length when upsampling */
+    double  cutoff;          /* passband edge relative to the lower Nyquist frequency */
+    double  beta;            /* Kaiser window shape */
+} rs_quality[3] = {
+    { 64, 0.95, 9.0 },       /* q 0..2: ~ -90 dB stopband */
+    { 32, 0.92, 7.0 },       /* q 3..6: ~ -70 dB stopband */
+    { 16, 0.88, 5.0 }        /* q 7..9: ~ -50 dB stopband */
+};
+
+
+static int
+rs_gcd(int i, int j)
+{
+    while (j) {
+        int const t = i % j;
+        i = j;
+        j = t;
+    }
+    return i;
+}
+
+/* modified Bessel function of the first kind, order 0 */
+static double
+bessel_i0(double x)
+{
+    double  sum = 1, term = 1;
+    int     k;
+    for (k = 1; term > sum * 1e-12; ++k) {
+        double const t = x / (2 * k);
+        term *= t * t;
+        sum += term;
+    }
+    return sum;
+}
+
+/* one filter phase: the output is 'phase' input samples after tap taps/2-1 */
+static void
+make_phase(float *h, int taps, double phase, double fc, double beta)
+{
+    double const half = taps / 2;
+    double const norm = bessel_i0(beta);
+    double  sum = 0;
+    int     i;
+
+    for (i = 0; i < taps; ++i) {
+        double const t = i - (half - 1) - phase;
+        double const w = t / half;
+        double  y = fc;
+        if (fabs(t) > 1e-9)
+            y = sin(PI * fc * t) / (PI * t);
+        if (w * w < 1)
+            y *= bessel_i0(beta * sqrt(1 - w * w)) / norm;
+        else
+            y = 0;
+        h[i] = (float) y;
+        sum += y;
+    }
+    /* unity gain at DC for every phase */
+    for (i = 0; i < taps; ++i)
+        h[i] = (float) (h[i] / sum);
+}
+
+
+#if defined(__SSE__)
+
+static void
+fir_2(float const *h, float const *x0, float const *x1, int taps, float *y0, float *y1)
+{
+    __m128  s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+    float   r0[4], r1[4];
+    int     i;
+    for (i = 0; i < taps; i += 4) {
+        __m128 const c = _mm_loadu_ps(h + i);
+        s0 = _mm_add_ps(s0, _mm_mul_ps(c, _mm_loadu_ps(x0 + i)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(c, _mm_loadu_ps(x1 + i)));
+    }
+    _mm_storeu_ps(r0, s0);
+    _mm_storeu_ps(r1, s1);
+    *y0 = (r0[0] + r0[1]) + (r0[2] + r0[3]);
+    *y1 = (r1[0] + r1[1]) + (r1[2] + r1[3]);
+}
+
+static float
+fir_1(float const *h, float const *x, int taps)
+{
+    __m128  s = _mm_setzero_ps();
+    float   r[4];
+    int     i;
+    for (i = 0; i < taps; i += 4)
+        s = _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(h + i), _mm_loadu_ps(x + i)));
+    _mm_storeu_ps(r, s);
+    return (r[0] + r[1]) + (r[2] + r[3]);
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+static void
+fir_2(float const *h, float const *x0, float const *x1, int taps, float *y0, float *y1)
+{
+    float32x4_t s0 = vdupq_n_f32(0), s1 = vdupq_n_f32(0);
+    float32x2_t t0, t1;
+    int     i;
+    for (i = 0; i < taps; i += 4) {
+        float32x4_t const c = vld1q_f32(h + i);
+        s0 = vmlaq_f32(s0, c, vld1q_f32(x0 + i));
+        s1 = vmlaq_f32(s1, c, vld1q_f32(x1 + i));
+    }
+    t0 = vadd_f32(vget_low_f32(s0), vget_high_f32(s0));
+    t1 = vadd_f32(vget_low_f32(s1), vget_high_f32(s1));
+    *y0 = vget_lane_f32(vpadd_f32(t0, t0), 0);
+    *y1 = vget_lane_f32(vpadd_f32(t1, t1), 0);
+}
+
+static float
+fir_1(float const *h, float const *x, int taps)
+{
+    float32x4_t s = vdupq_n_f32(0);
+    float32x2_t t;
+    int     i;
+    for (i = 0; i < taps; i += 4)
+        s = vmlaq_f32(s, vld1q_f32(h + i), vld1q_f32(x + i));
+    t = vadd_f32(vget_low_f32(s), vget_high_f32(s));
+    return vget_lane_f32(vpadd_f32(t, t), 0);
+}
+
+#else
+
+static void
+fir_2(float const *h, float const *x0, float const *x1, int taps, float *y0, float *y1)
+{
+    float   a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+    float   b0 = 0, b1 = 0, b2 = 0, b3 = 0;
+    int     i;
+    for (i = 0; i < taps; i += 4) {
+        a0 += h[i] * x0[i];
+        a1 += h[i + 1] * x0[i + 1];
+        a2 += h[i + 2] * x0[i + 2];
+        a3 += h[i + 3] * x0[i + 3];
+        b0 += h[i] * x1[i];
+        b1 += h[i + 1] * x1[i + 1];
+        b2 += h[i + 2] * x1[i + 2];
+        b3 += h[i + 3] * x1[i + 3];
+    }
+    *y0 = (a0 + a1) + (a2 + a3);
+    *y1 = (b0 + b1) + (b2 + b3);
+}
+
+static float
+fir_1(float const *h, float const *x, int taps)
+{
+    float   a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+    int     i;
+    for (i = 0; i < taps; i += 4) {
+        a0 += h[i] * x[i];
+        a1 += h[i + 1] * x[i + 1];
+        a2 += h[i + 2] * x[i + 2];
+        a3 += h[i + 3] * x[i + 3];
+    }
+    return (a0 + a1) + (a2 + a3);
+}
+
+#endif
+
+
+lame_resampler_t
+lame_resampler_init(int samplerate_in, int samplerate_out, int channels, int quality)
+{
+    lame_resampler_t rs;
+    double  ratio, fc;
+    int     q, g, ch, p, ncoef;
+
+    if (samplerate_in <= 0 || samplerate_out <= 0 || channels <= 0)
+        return NULL;
+
+    q = quality <= 2 ? 0 : quality <= 6 ? 1 : 2;
+    rs = lame_calloc(struct lame_resampler_struct, 1);
+    if (rs == NULL)
+        return NULL;
+
+    g = rs_gcd(samplerate_in, samplerate_out);
+    rs->channels = channels;
+    rs->num = samplerate_in / g;
+    rs->den = samplerate_out / g;
+    rs->step_int = rs->num / rs->den;
+    rs->step_frac = rs->num % rs->den;
+
+    /* when downsampling, stretch the filter to keep the transition band
+     * the same width relative to the output samplerate */
+    ratio = (double) rs->num / rs->den;
+    fc = rs_quality[q].cutoff;
+    rs->taps = rs_quality[q].taps;
+    if (ratio > 1) {
+        fc /= ratio;
+        rs->taps = (int) ceil(rs->taps * ratio);
+        rs->taps = (rs->taps + 3) & ~3;
+    }
+
+    if ((double) rs->den * rs->taps <= RS_MAX_COEFFS) {
+        rs->phases = rs->den;
+        rs->interpolate = 0;
+    }
+    else {
+        rs->phases = RS_INTERP_PHASES;
+        rs->interpolate = 1;
+    }
+    ncoef = (rs->phases + rs->interpolate) * rs->taps;
+    rs->filter = lame_calloc(float, ncoef);
+
+    /* input is buffered with taps/2-1 samples of leading silence, which
+     * puts the first output sample right on the first input sample */
+    rs->bufsize = rs->taps + RS_BLOCK;
+    rs->filled = rs->taps / 2 - 1;
+    rs->buf = lame_calloc(float *, channels);
+    if (rs->filter == NULL || rs->buf == NULL) {
+        lame_resampler_close(rs);
+        return NULL;
+    }
+    for (ch = 0; ch < channels; ++ch) {
+        rs->buf[ch] = lame_calloc(float, rs->bufsize);
+        if (rs->buf[ch] == NULL) {
+            lame_resampler_close(rs);
+            return NULL;
+        }
+    }
+
+    for (p = 0; p < rs->phases + rs->interpolate; ++p)
+        make_phase(&rs->filter[p * rs->taps], rs->taps, (double) p / rs->phases, fc,
+                   rs_quality[q].beta);
+
+    return rs;
+}
+
+
+void
+lame_resampler_close(lame_resampler_t rs)
+{
+    if (rs == NULL)
+        return;
+    if (rs->buf) {
+        int     ch;
+        for (ch = 0; ch < rs->channels; ++ch)
+            free(rs->buf[ch]);
+        free(rs->buf);
+    }
+    free(rs->filter);
+    free(rs);
+}
+
+
+int
+lame_resampler_delay(lame_resampler_t rs)
+{
+    return rs ? rs->taps / 2 : 0;
+}
+
+
+/* compute one output sample for every channel */
+static void
+rs_output(lame_resampler_t rs, float *const out[], int k)
+{
+    int const taps = rs->taps;
+    int const nch = rs->channels;
+    float const *h;
+    float   f = 0;
+    int     ch;
+
+    if (rs->interpolate) {
+        double const t = (double) rs->frac * rs->phases / rs->den;
+        int const p = (int) t;
+        f = (float) (t - p);
+        h = &rs->filter[p * taps];
+    }
+    else {
+        h = &rs->filter[rs->frac * taps];
+    }
+
+    for (ch = 0; ch + 1 < nch; ch += 2) {
+        float const *const x0 = &rs->buf[ch][rs->pos];
+        float const *const x1 = &rs->buf[ch + 1][rs->pos];
+        float   y0, y1;
+        fir_2(h, x0, x1, taps, &y0, &y1);
+        if (rs->interpolate) {
+            float   z0, z1;
+            fir_2(h + taps, x0, x1, taps, &z0, &z1);
+            y0 += f * (z0 - y0);
+            y1 += f * (z1 - y1);
+        }
+        out[ch][k] = y0;
+        out[ch + 1][k] = y1;
+    }
+    if (ch < nch) {
+        float const *const x = &rs->buf[ch][rs->pos];
+        float   y = fir_1(h, x, taps);
+        if (rs->interpolate)
+            y += f * (fir_1(h + taps, x, taps) - y);
+        out[ch][k] = y;
+    }
+}
+
+
+int
+lame_resampler_process(lame_resampler_t rs, const float *const pcm_in[], int nsamples_in,
+                       int *nsamples_used, float *const pcm_out[], int nsamples_out)
+{
+    int     used = 0, k = 0, ch;
+
+    for (;;) {
+        int     m;
+        double  need;
+
+        while (k < nsamples_out && rs->pos + rs->taps <= rs->filled) {
+            rs_output(rs, pcm_out, k++);
+            rs->pos += rs->step_int;
+            rs->frac += rs->step_frac;
+            if (rs->frac >= rs->den) {
+                rs->frac -= rs->den;
+                rs->pos++;
+            }
+        }
+        if (k >= nsamples_out || used >= nsamples_in)
+            break;
+
+        /* drop input no longer needed */
+        if (rs->pos > 0) {
+            /* taps > step, so pos never passes the end of the buffer */
+            int const keep = rs->filled - rs->pos;
+            assert(keep >= 0);
+            for (ch = 0; ch < rs->channels; ++ch)
+                memmove(rs->buf[ch], rs->buf[ch] + rs->pos, keep * sizeof(float));
+            rs->filled -= rs->pos;
+            rs->pos = 0;
+        }
+
+        /* take only as much input as the requested output needs, so that
+         * no more than the filter lookahead stays buffered */
+        need = rs->pos + rs->taps - rs->filled
+            + floor((rs->frac + (double) (nsamples_out - k - 1) * rs->num) / rs->den);
+        m = Min(nsamples_in - used, rs->bufsize - rs->filled);
+        if (m > need)
+            m = (int) need;
+        for (ch = 0; ch < rs->channels; ++ch)
+            memcpy(rs->buf[ch] + rs->filled, pcm_in[ch] + used, m * sizeof(float));
+        rs->filled += m;
+        used += m;
+    }
+    *nsamples_used = used;
+    return k;
+}
+
+
+void
+resampler_snapshot(lame_resampler_t rs, snapshot_io * io)
+{
+    int     ch;
+
+    snapshot_bytes(io, &rs->pos, sizeof(rs->pos));
+    snapshot_bytes(io, &rs->frac, sizeof(rs->frac));
+    snapshot_bytes(io, &rs->filled, sizeof(rs->filled));
+    if (rs->filled < 0 || rs->filled > rs->bufsize || rs->pos < 0 || rs->pos > rs->filled) {
+        io->error = 1;
+        return;
+    }
+    for (ch = 0; ch < rs->channels; ++ch)
+        snapshot_bytes(io, rs->buf[ch], rs->filled * sizeof(float));
+}
@@ -35,6 +35,54 @@
 #include "bitstream.h"
 #include "lame-analysis.h"
 #include "lame_global_flags.h"
+#include "tables.h"
+
+
+/* main data bits in a frame of the smallest size the encoder may write */
+static int
+ResvMinSlotBits(lame_internal_flags const *gfc)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    int     kbps = cfg->avg_bitrate;
+
+    if (cfg->vbr != vbr_off) {
+        /* analog silence goes down to the lowest bitrate, unless the
+           minimum bitrate is enforced */
+        int const index = cfg->enforce_min_bitrate ? cfg->vbr_min_bitrate_index : 1;
+        kbps = bitrate_table[cfg->version][Max(index, 1)];
+    }
+    return 8 * ((cfg->version + 1) * 72000 * kbps / cfg->samplerate_out)
+        - 8 * cfg->sideinfo_len;
+}
+
+
+/*
+  ResvMaxFrames:
+  The number of following frames a frame may have to wait for before
+  its slot is complete and it can be sent.  The main data of a frame
+  starts main_data_begin bytes back, in the slots of earlier frames, so
+  a slot is only filled up once the frame that starts behind its end
+  has been written.  With the reservoir kept to N slots of the smallest
+  frame (the low latency profile), that is at most N frames.
+*/
+int
+ResvMaxFrames(lame_internal_flags const *gfc)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    int const slot = ResvMinSlotBits(gfc);
+    int     resvMax;
+
+    if (cfg->disable_reservoir)
+        return 0;
+    /* as ResvFrameBegin, for the smallest frame */
+    resvMax = Min(cfg->buffer_constraint - (slot + 8 * cfg->sideinfo_len),
+                  (8 * 256) * cfg->mode_gr - 8);
+    if (cfg->low_latency > 0)
+        resvMax = Min(resvMax, cfg->low_latency * slot);
+    if (resvMax <= 0 || slot <= 0)
+        return 0;
+    return (resvMax + slot - 1) / slot;
+}
 
 
 /*
@@ -143,6 +191,12 @@ ResvFrameBegin(lame_internal_flags * gfc, int *mean_bits)
     esv->ResvMax = maxmp3buf - frameLength;
     if (esv->ResvMax > resvLimit)
         esv->ResvMax = resvLimit;
+    if (cfg->low_latency > 0) {
+        /* keep the back-reference within low_latency slots, see ResvMaxFrames */
+        int const lowLatencyMax = cfg->low_latency * ResvMinSlotBits(gfc);
+        if (esv->ResvMax > lowLatencyMax)
+            esv->ResvMax = lowLatencyMax;
+    }
     if (esv->ResvMax < 0 || cfg->disable_reservoir)
         esv->ResvMax = 0;
     
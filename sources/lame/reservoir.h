@@ -27,5 +27,6 @@ void    ResvMaxBits(lame_internal_flags * gfc, int mean_bits, int *targ_bits, in
                     int cbr);
 void    ResvAdjust(lame_internal_flags * gfc, gr_info const *gi);
 void    ResvFrameEnd(lame_internal_flags * gfc, int mean_bits);
+int     ResvMaxFrames(lame_internal_flags const *gfc);
 
 #endif /* LAME_RESERVOIR_H */
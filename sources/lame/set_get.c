@@ -33,6 +33,7 @@
 #include "bitstream.h"  /* because of compute_flushbits */
 
 #include "set_get.h"
+#include "gain_analysis.h"
 #include "lame_global_flags.h"
 
 /*
@@ -701,6 +702,17 @@ lame_set_msgf(lame_global_flags * gfp, void (*func) (const char *, va_list))
     return -1;
 }
 
+int
+lame_set_frame_callback(lame_global_flags * gfp, lame_frame_callback func, void *data)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        gfp->frame_cb = func;
+        gfp->frame_cb_data = data;
+        return 0;
+    }
+    return -1;
+}
+
 
 /*
  * Set one of
@@ -965,6 +977,53 @@ lame_get_disable_reservoir(const lame_global_flags * gfp)
     return 0;
 }
 
+/* Low latency profile: reservoir limited to this many frames, -1 = off. */
+int
+lame_set_low_latency(lame_global_flags * gfp, int low_latency)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        /* default = -1 (off) */
+        if (-1 > low_latency)
+            return -1;
+        gfp->low_latency = low_latency;
+        return 0;
+    }
+    return -1;
+}
+
+int
+lame_get_low_latency(const lame_global_flags * gfp)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        assert(-1 <= gfp->low_latency);
+        return gfp->low_latency;
+    }
+    return -1;
+}
+
+/* Quality governor: share of real time a frame may take, 0 = off. */
+int
+lame_set_governor(lame_global_flags * gfp, float target_load)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        /* default = 0 (off) */
+        if (0 > target_load)
+            return -1;
+        gfp->governor = target_load;
+        return 0;
+    }
+    return -1;
+}
+
+float
+lame_get_governor(const lame_global_flags * gfp)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        return gfp->governor;
+    }
+    return 0;
+}
+
 
 
 
@@ -2119,6 +2178,42 @@ lame_get_noclipScale(const lame_global_flags * gfp)
     return 0;
 }
 
+float
+lame_get_MomentaryLoudness(const lame_global_flags * gfp)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        lame_internal_flags const *const gfc = gfp->internal_flags;
+        if (is_lame_internal_flags_valid(gfc) && gfc->cfg.findReplayGain) {
+            return (float) GetMomentaryLoudness(gfc->sv_rpg.rgdata);
+        }
+    }
+    return (float) -HUGE_VAL;
+}
+
+float
+lame_get_ShortTermLoudness(const lame_global_flags * gfp)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        lame_internal_flags const *const gfc = gfp->internal_flags;
+        if (is_lame_internal_flags_valid(gfc) && gfc->cfg.findReplayGain) {
+            return (float) GetShortTermLoudness(gfc->sv_rpg.rgdata);
+        }
+    }
+    return (float) -HUGE_VAL;
+}
+
+float
+lame_get_IntegratedLoudness(const lame_global_flags * gfp)
+{
+    if (is_lame_global_flags_valid(gfp)) {
+        lame_internal_flags const *const gfc = gfp->internal_flags;
+        if (is_lame_internal_flags_valid(gfc) && gfc->cfg.findReplayGain) {
+            return (float) gfc->ov_rpg.IntegratedLoudness;
+        }
+    }
+    return (float) -HUGE_VAL;
+}
+
 
 /*
  * LAME's estimate of the total number of frames to be encoded.
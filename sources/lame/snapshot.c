@@ -0,0 +1,496 @@
+/*
+ *      encoder state snapshots
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ *  A snapshot holds only what changes while encoding.  Everything that
+ *  lame_init_params derives from the settings (tables, psymodel
+ *  constants, ATH curves, filters) is rebuilt by the encoder that loads
+ *  it, and the settings themselves are checked through a hash of the
+ *  session config.
+ *
+ *  The state is first serialized into a body by walk_state().  The body
+ *  is then stored as the runs of bytes that differ from a reference:
+ *  all zeros for a full snapshot, which packs the mostly empty
+ *  histograms and buffers, or the body of an earlier full snapshot for
+ *  a delta.  The encoder keeps the body of its last full snapshot, so
+ *  deltas against it cost a walk, a hash and a compare.
+ *
+ *  Layout:   header, then repeated  [keep:u32] [zero:u32] [count:u32] count bytes
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stddef.h>
+
+#include "lame.h"
+#include "machine.h"
+#include "encoder.h"
+#include "util.h"
+#include "gain_analysis.h"
+#include "lame_global_flags.h"
+#include "snapshot.h"
+#include "governor.h"
+
+
+#define SNAPSHOT_MAGIC    0x504e534cu /* "LSNP" */
+#define SNAPSHOT_VERSION  1
+#define SNAPSHOT_MIN_SKIP 8          /* equal bytes worth ending a run for */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t layout;         /* snapshot_layout() of the encoder */
+    uint32_t delta;          /* 0: against zeros, 1: against the base */
+    uint32_t base_hash;      /* body_hash of the base */
+    uint32_t body_size;
+    uint32_t body_hash;
+} snapshot_header;
+
+
+/* FNV-1a, on 32 bit words */
+static  uint32_t
+snapshot_hash(uint32_t h, void const *data, size_t n)
+{
+    unsigned char const *p = data;
+    for (; n >= 4; n -= 4, p += 4) {
+        uint32_t w;
+        memcpy(&w, p, 4);
+        h = (h ^ w) * 16777619u;
+    }
+    while (n-- > 0)
+        h = (h ^ *p++) * 16777619u;
+    return h;
+}
+
+/* settings and build the state belongs to */
+static  uint32_t
+snapshot_layout(lame_internal_flags const *gfc)
+{
+    uint32_t const sizes[4] = {
+        SNAPSHOT_VERSION, sizeof(lame_internal_flags), sizeof(FLOAT), sizeof(sample_t)
+    };
+    uint32_t const h = snapshot_hash(2166136261u, sizes, sizeof(sizes));
+    SessionConfig_t cfg;
+
+    /* the quality governor moves some knobs while encoding */
+    memcpy(&cfg, &gfc->cfg, sizeof(cfg));
+    governor_base_config(gfc, &cfg);
+    return snapshot_hash(h, &cfg, sizeof(cfg));
+}
+
+
+void
+snapshot_bytes(snapshot_io * io, void *data, size_t size)
+{
+    if (io->error)
+        return;
+    if (io->body != NULL) {
+        if (size > io->size - io->pos) {
+            io->error = 1;
+            return;
+        }
+        if (io->load)
+            memcpy(data, io->body + io->pos, size);
+        else
+            memcpy(io->body + io->pos, data, size);
+    }
+    io->pos += size;
+}
+
+#define SNAP(io, x) snapshot_bytes(io, &(x), sizeof(x))
+
+
+/* the runtime state, fixed size parts first, so that a delta lines up */
+static void
+walk_state(lame_internal_flags * gfc, snapshot_io * io)
+{
+    SessionConfig_t const *const cfg = &gfc->cfg;
+    EncStateVar_t *const esv = &gfc->sv_enc;
+    Bit_stream_struc *const bs = &gfc->bs;
+    VBR_seek_info_t *const vbr = &gfc->VBR_seek_table;
+    replaygain_t *const rg = cfg->findReplayGain ? gfc->sv_rpg.rgdata : NULL;
+    int     gr, ch, k;
+
+    SNAP(io, gfc->lame_encode_frame_init);
+    SNAP(io, gfc->iteration_init_init);
+
+    /* side info of the last frame, without the spectrum and quantized
+     * values, which every granule computes anew.  The partition table is
+     * looked up again before it is used, keep this process' pointer */
+    for (gr = 0; gr < 2; gr++) {
+        for (ch = 0; ch < 2; ch++) {
+            gr_info *const gi = &gfc->l3_side.tt[gr][ch];
+            const int *const partition_table = gi->sfb_partition_table;
+            snapshot_bytes(io, gi->scalefac, sizeof(*gi) - offsetof(gr_info, scalefac));
+            gi->sfb_partition_table = partition_table;
+        }
+    }
+    snapshot_bytes(io, &gfc->l3_side.main_data_begin,
+                   sizeof(gfc->l3_side) - offsetof(III_side_info_t, main_data_begin));
+
+    SNAP(io, gfc->sv_psy);
+    SNAP(io, gfc->ov_psy);
+    SNAP(io, esv->sb_sample);
+    SNAP(io, esv->pefirbuf);
+    SNAP(io, esv->frac_SpF);
+    SNAP(io, esv->slot_lag);
+    SNAP(io, esv->h_ptr);
+    SNAP(io, esv->w_ptr);
+    SNAP(io, esv->emit_ptr);
+    SNAP(io, esv->ancillary_flag);
+    SNAP(io, esv->ResvSize);
+    SNAP(io, esv->ResvMax);
+    SNAP(io, esv->mf_samples_to_encode);
+    SNAP(io, esv->mf_size);
+    SNAP(io, esv->mf_start);
+    SNAP(io, gfc->ov_enc);
+    SNAP(io, gfc->sv_qnt);
+    SNAP(io, gfc->sv_gov);
+    SNAP(io, gfc->ov_rpg);
+    SNAP(io, gfc->ATH->adjust_factor);
+    SNAP(io, gfc->ATH->adjust_limit);
+    SNAP(io, gfc->nMusicCRC);
+
+    SNAP(io, bs->totbit);
+    SNAP(io, bs->buf_byte_idx);
+    SNAP(io, bs->cache);
+    SNAP(io, bs->cache_bits);
+    SNAP(io, bs->header_left);
+
+    SNAP(io, vbr->sum);
+    SNAP(io, vbr->seen);
+    SNAP(io, vbr->want);
+    SNAP(io, vbr->pos);
+    SNAP(io, vbr->nVbrNumFrames);
+    SNAP(io, vbr->nBytesWritten);
+    SNAP(io, vbr->TotalFrameSize);
+
+    if (rg != NULL) {
+        /* filter history: the first MAX_ORDER input rows, and the MAX_ORDER
+         * filtered rows before the current position in the RMS window */
+        snapshot_bytes(io, rg->yule, sizeof(*rg) - offsetof(replaygain_t, yule));
+        if (rg->totsamp < 0 || rg->totsamp >= rg->sampleWindow) {
+            io->error = 1;
+            return;
+        }
+        snapshot_bytes(io, rg->inbuf, MAX_ORDER * sizeof(rg->inbuf[0]));
+        snapshot_bytes(io, rg->stepbuf[rg->totsamp], MAX_ORDER * sizeof(rg->stepbuf[0]));
+        snapshot_bytes(io, rg->outbuf[rg->totsamp], MAX_ORDER * sizeof(rg->outbuf[0]));
+    }
+
+    if (esv->h_ptr < 0 || esv->h_ptr >= MAX_HEADER_BUF
+        || esv->w_ptr < 0 || esv->w_ptr >= MAX_HEADER_BUF
+        || esv->emit_ptr < 0 || esv->emit_ptr >= MAX_HEADER_BUF
+        || bs->buf_byte_idx < -1 || bs->buf_byte_idx >= bs->buf_size
+        || vbr->pos < 0 || vbr->pos > vbr->size
+        || esv->mf_start < 0 || esv->mf_start >= MFSIZE
+        || esv->mf_size < 0 || esv->mf_size > MFSIZE
+        || gfc->sv_gov.level < 0 || gfc->sv_gov.level >= gfc->sv_gov.levels
+        || gfc->sv_gov.levels > LAME_GOVERNOR_LEVELS) {
+        io->error = 1;
+        return;
+    }
+    /* frame headers still to be written, from the last one written (its
+     * write_timing ends the stream when flushing) to the next one due */
+    for (k = 0; k < ((esv->h_ptr - esv->w_ptr) & (MAX_HEADER_BUF - 1)) + 2; k++)
+        SNAP(io, esv->header[(esv->w_ptr - 1 + k) & (MAX_HEADER_BUF - 1)]);
+    snapshot_bytes(io, bs->buf, bs->buf_byte_idx + 1);
+    if (vbr->bag != NULL)
+        snapshot_bytes(io, vbr->bag, vbr->pos * sizeof(vbr->bag[0]));
+    if (esv->resampler != NULL)
+        resampler_snapshot(esv->resampler, io);
+    for (ch = 0; ch < cfg->channels_out; ch++)
+        snapshot_bytes(io, &esv->mfbuf[ch][esv->mf_start], esv->mf_size * sizeof(sample_t));
+    if (io->load)
+        mirror_mfbuf(esv, cfg->channels_out, esv->mf_start, esv->mf_size);
+}
+
+
+static  size_t
+zero_run(unsigned char const *body, size_t n, size_t i)
+{
+    uint64_t w;
+    while (i + 8 <= n && (memcpy(&w, body + i, 8), w == 0))
+        i += 8;
+    while (i < n && body[i] == 0)
+        i++;
+    return i;
+}
+
+/* end of the run of bytes from i on that equal the reference, which is
+ * zero past ref_size */
+static  size_t
+same_run(unsigned char const *body, size_t n, unsigned char const *ref, size_t ref_size,
+         size_t i)
+{
+    size_t const m = Min(n, ref_size);
+    while (i + 8 <= m && memcmp(body + i, ref + i, 8) == 0)
+        i += 8;
+    while (i < m && body[i] == ref[i])
+        i++;
+    return i < m ? i : zero_run(body, n, i);
+}
+
+/* stores body as runs of bytes kept from ref, zeroed and literal; writes
+ * what fits into out and returns the size of the whole encoding */
+static  size_t
+encode_runs(unsigned char const *body, size_t n, unsigned char const *ref, size_t ref_size,
+            unsigned char *out, size_t out_size)
+{
+    size_t  i = 0, len = 0;
+
+    while (i < n) {
+        size_t  keep = i, zero, start, end, same = 0, zeros = 0;
+        uint32_t run[3];
+
+        i = same_run(body, n, ref, ref_size, i);
+        keep = i - keep;
+        zero = i;
+        i = zero_run(body, n, i);
+        zero = i - zero;
+        start = end = i;
+        /* extend the literal run until SNAPSHOT_MIN_SKIP kept or zero
+         * bytes follow it */
+        while (end < n) {
+            unsigned char const b = body[end];
+            same = b == (end < ref_size ? ref[end] : 0) ? same + 1 : 0;
+            zeros = b == 0 ? zeros + 1 : 0;
+            end++;
+            if (same >= SNAPSHOT_MIN_SKIP || zeros >= SNAPSHOT_MIN_SKIP) {
+                end -= SNAPSHOT_MIN_SKIP;
+                break;
+            }
+        }
+        if (i >= n && zero == 0)
+            break;      /* only kept bytes are left */
+        i = end;
+
+        run[0] = (uint32_t) keep;
+        run[1] = (uint32_t) zero;
+        run[2] = (uint32_t) (end - start);
+        if (len + sizeof(run) + (end - start) <= out_size) {
+            memcpy(out + len, run, sizeof(run));
+            memcpy(out + len + sizeof(run), body + start, end - start);
+        }
+        len += sizeof(run) + (end - start);
+    }
+    return len;
+}
+
+static int
+decode_runs(unsigned char *body, size_t n, unsigned char const *in, size_t in_size)
+{
+    size_t  pos = 0, k = 0;
+
+    while (k < in_size) {
+        uint32_t run[3];
+        if (in_size - k < sizeof(run))
+            return -1;
+        memcpy(run, in + k, sizeof(run));
+        k += sizeof(run);
+        if (run[0] > n - pos)
+            return -1;
+        pos += run[0];
+        if (run[1] > n - pos)
+            return -1;
+        memset(body + pos, 0, run[1]);
+        pos += run[1];
+        if (run[2] > n - pos || run[2] > in_size - k)
+            return -1;
+        memcpy(body + pos, in + k, run[2]);
+        pos += run[2];
+        k += run[2];
+    }
+    return 0;
+}
+
+
+static int
+read_header(lame_internal_flags const *gfc, unsigned char const *blob, size_t size,
+            snapshot_header * hdr)
+{
+    if (blob == NULL || size < sizeof(*hdr))
+        return -1;
+    memcpy(hdr, blob, sizeof(*hdr));
+    if (hdr->magic != SNAPSHOT_MAGIC || hdr->layout != snapshot_layout(gfc))
+        return -1;
+    return 0;
+}
+
+static int
+reserve(unsigned char **p, size_t * alloc, size_t n)
+{
+    if (n > *alloc) {
+        unsigned char *const q = realloc(*p, n + n / 4);
+        if (q == NULL)
+            return -1;
+        *p = q;
+        *alloc = n + n / 4;
+    }
+    return 0;
+}
+
+/* decodes the full snapshot blob into *body, zero padded to at least n bytes */
+static int
+load_base(unsigned char **body, size_t * alloc, size_t n, unsigned char const *blob, size_t size,
+          snapshot_header const *hdr)
+{
+    size_t const len = Max(n, hdr->body_size);
+
+    if (hdr->delta != 0 || reserve(body, alloc, len) != 0)
+        return -1;
+    memset(*body, 0, len);
+    if (decode_runs(*body, hdr->body_size, blob + sizeof(*hdr), size - sizeof(*hdr)) != 0)
+        return -1;
+    if (snapshot_hash(2166136261u, *body, hdr->body_size) != hdr->body_hash)
+        return -1;
+    return 0;
+}
+
+static lame_internal_flags *
+snapshot_encoder(lame_global_flags const *gfp)
+{
+    lame_internal_flags *gfc;
+
+    if (!is_lame_global_flags_valid(gfp))
+        return NULL;
+    gfc = gfp->internal_flags;
+    if (!is_lame_internal_flags_valid(gfc))
+        return NULL;
+    /* the mpglib decoders have no snapshot */
+    if (gfc->hip != NULL || gfc->hip_in != NULL)
+        return NULL;
+    return gfc;
+}
+
+
+size_t
+lame_get_snapshot(const lame_global_flags * gfp, const unsigned char *base, size_t base_size,
+                  unsigned char *buffer, size_t size)
+{
+    lame_internal_flags *const gfc = snapshot_encoder(gfp);
+    SnapStateVar_t *sv;
+    snapshot_io io;
+    snapshot_header hdr, base_hdr;
+    unsigned char const *ref = NULL;
+    size_t  ref_size = 0, len;
+
+    if (gfc == NULL)
+        return 0;
+    sv = &gfc->sv_snap;
+
+    memset(&io, 0, sizeof(io));
+    walk_state(gfc, &io);
+    if (io.error || reserve(&sv->body, &sv->body_alloc, io.pos) != 0)
+        return 0;
+    io.body = sv->body;
+    io.size = io.pos;
+    io.pos = 0;
+    walk_state(gfc, &io);
+    if (io.error)
+        return 0;
+
+    hdr.magic = SNAPSHOT_MAGIC;
+    hdr.layout = snapshot_layout(gfc);
+    hdr.delta = 0;
+    hdr.base_hash = 0;
+    hdr.body_size = (uint32_t) io.size;
+    hdr.body_hash = snapshot_hash(2166136261u, sv->body, io.size);
+
+    if (base != NULL) {
+        if (read_header(gfc, base, base_size, &base_hdr) != 0)
+            return 0;
+        if (sv->base_size == 0 || sv->base_hash != base_hdr.body_hash
+            || sv->base_size != base_hdr.body_size) {
+            sv->base_size = 0;
+            if (load_base(&sv->base, &sv->base_alloc, 0, base, base_size, &base_hdr) != 0)
+                return 0;
+            sv->base_size = base_hdr.body_size;
+            sv->base_hash = base_hdr.body_hash;
+        }
+        ref = sv->base;
+        ref_size = sv->base_size;
+        hdr.delta = 1;
+        hdr.base_hash = sv->base_hash;
+    }
+
+    if (buffer == NULL || size < sizeof(hdr))
+        size = 0;
+    else
+        memcpy(buffer, &hdr, sizeof(hdr));
+    len = sizeof(hdr) + encode_runs(sv->body, io.size, ref, ref_size,
+                                    size ? buffer + sizeof(hdr) : NULL,
+                                    size ? size - sizeof(hdr) : 0);
+
+    if (base == NULL && len <= size) {
+        /* keep the body as the reference for deltas */
+        unsigned char *const p = sv->base;
+        size_t const alloc = sv->base_alloc;
+        sv->base = sv->body;
+        sv->base_alloc = sv->body_alloc;
+        sv->base_size = io.size;
+        sv->base_hash = hdr.body_hash;
+        sv->body = p;
+        sv->body_alloc = alloc;
+    }
+    return len;
+}
+
+
+int
+lame_set_snapshot(lame_global_flags * gfp, const unsigned char *base, size_t base_size,
+                  const unsigned char *snapshot, size_t size)
+{
+    lame_internal_flags *const gfc = snapshot_encoder(gfp);
+    SnapStateVar_t *sv;
+    snapshot_io io;
+    snapshot_header hdr, base_hdr;
+
+    if (gfc == NULL || read_header(gfc, snapshot, size, &hdr) != 0)
+        return -1;
+    sv = &gfc->sv_snap;
+
+    if (hdr.delta) {
+        if (read_header(gfc, base, base_size, &base_hdr) != 0
+            || base_hdr.body_hash != hdr.base_hash)
+            return -1;
+        if (load_base(&sv->body, &sv->body_alloc, hdr.body_size, base, base_size, &base_hdr) != 0)
+            return -1;
+    }
+    else {
+        if (reserve(&sv->body, &sv->body_alloc, hdr.body_size) != 0)
+            return -1;
+        memset(sv->body, 0, hdr.body_size);
+    }
+    if (decode_runs(sv->body, hdr.body_size, snapshot + sizeof(hdr), size - sizeof(hdr)) != 0)
+        return -1;
+    if (snapshot_hash(2166136261u, sv->body, hdr.body_size) != hdr.body_hash)
+        return -1;
+
+    memset(&io, 0, sizeof(io));
+    io.body = sv->body;
+    io.size = hdr.body_size;
+    io.load = 1;
+    walk_state(gfc, &io);
+    if (io.error || io.pos != io.size)
+        return -1;
+    governor_apply(gfc);
+    return 0;
+}
@@ -0,0 +1,41 @@
+/*
+ *      encoder state snapshots
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef LAME_SNAPSHOT_H
+#define LAME_SNAPSHOT_H
+
+/* Walks the runtime state of an encoder in a fixed order.  While saving,
+   snapshot_bytes copies each item into the body of the snapshot (or only
+   counts its size when body is NULL); while loading it copies the body
+   back into the item.  Counts are always walked before the data they
+   size, so a loader already sees the restored count. */
+typedef struct snapshot_io {
+    unsigned char *body;
+    size_t  size;            /* size of body */
+    size_t  pos;             /* bytes walked so far */
+    int     load;
+    int     error;
+} snapshot_io;
+
+void    snapshot_bytes(snapshot_io * io, void *data, size_t size);
+
+/* the resampler's position and pending input, in resample.c */
+void    resampler_snapshot(lame_resampler_t rs, snapshot_io * io);
+
+#endif
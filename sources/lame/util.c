@@ -33,11 +33,20 @@
 #include "util.h"
 #include "tables.h"
 
-#define PRECOMPUTE
 #if defined(__FreeBSD__) && !defined(__alpha__)
 # include <machine/floatingpoint.h>
 #endif
 
+#ifdef LAME_PROFILE_STAGES
+# if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#  include <intrin.h>
+# elif defined(__i386__) || defined(__x86_64__)
+#  include <x86intrin.h>
+# elif !defined(__aarch64__)
+#  include <time.h>
+# endif
+#endif
+
 
 /***********************************************************************
 *
@@ -111,22 +120,11 @@ free_global_data(lame_internal_flags * gfc)
 void
 freegfc(lame_internal_flags * const gfc)
 {                       /* bit stream structure */
-    int     i;
-
     if (gfc == 0) return;
 
-    for (i = 0; i <= 2 * BPC; i++)
-        if (gfc->sv_enc.blackfilt[i] != NULL) {
-            free(gfc->sv_enc.blackfilt[i]);
-            gfc->sv_enc.blackfilt[i] = NULL;
-        }
-    if (gfc->sv_enc.inbuf_old[0]) {
-        free(gfc->sv_enc.inbuf_old[0]);
-        gfc->sv_enc.inbuf_old[0] = NULL;
-    }
-    if (gfc->sv_enc.inbuf_old[1]) {
-        free(gfc->sv_enc.inbuf_old[1]);
-        gfc->sv_enc.inbuf_old[1] = NULL;
+    if (gfc->sv_enc.resampler) {
+        lame_resampler_close(gfc->sv_enc.resampler);
+        gfc->sv_enc.resampler = NULL;
     }
 
     if (gfc->bs.buf != NULL) {
@@ -151,6 +149,8 @@ freegfc(lame_internal_flags * const gfc)
     if (gfc->sv_enc.in_buffer_1) {
         free(gfc->sv_enc.in_buffer_1);
     }
+    free(gfc->sv_snap.body);
+    free(gfc->sv_snap.base);
     free_id3tag(gfc);
 
 #ifdef DECODE_ON_THE_FLY
@@ -159,6 +159,12 @@ freegfc(lame_internal_flags * const gfc)
         gfc->hip = 0;
     }
 #endif
+#ifdef HAVE_MPGLIB
+    if (gfc->hip_in) {
+        hip_decode_exit(gfc->hip_in);
+        gfc->hip_in = 0;
+    }
+#endif
 
     free_global_data(gfc);
 
@@ -492,171 +498,6 @@ SmpFrqIndex(int sample_freq, int *const version)
 
 
 
-/* resampling via FIR filter, blackman window */
-inline static FLOAT
-blackman(FLOAT x, FLOAT fcn, int l)
-{
-    /* This algorithm from:
-       SIGNAL PROCESSING ALGORITHMS IN FORTRAN AND C
-       S.D. Stearns and R.A. David, Prentice-Hall, 1992
-     */
-    FLOAT   bkwn, x2;
-    FLOAT const wcn = (PI * fcn);
-
-    x /= l;
-    if (x < 0)
-        x = 0;
-    if (x > 1)
-        x = 1;
-    x2 = x - .5;
-
-    bkwn = 0.42 - 0.5 * cos(2 * x * PI) + 0.08 * cos(4 * x * PI);
-    if (fabs(x2) < 1e-9)
-        return wcn / PI;
-    else
-        return (bkwn * sin(l * wcn * x2) / (PI * l * x2));
-
-
-}
-
-
-
-
-/* gcd - greatest common divisor */
-/* Joint work of Euclid and M. Hendry */
-
-static int
-gcd(int i, int j)
-{
-    /*    assert ( i > 0  &&  j > 0 ); */
-    return j ? gcd(j, i % j) : i;
-}
-
-
-
-static int
-fill_buffer_resample(lame_internal_flags * gfc,
-                     sample_t * outbuf,
-                     int desired_len, sample_t const *inbuf, int len, int *num_used, int ch)
-{
-    SessionConfig_t const *const cfg = &gfc->cfg;
-    EncStateVar_t *esv = &gfc->sv_enc;
-    double  resample_ratio = (double)cfg->samplerate_in / (double)cfg->samplerate_out;
-    int     BLACKSIZE;
-    FLOAT   offset, xvalue;
-    int     i, j = 0, k;
-    int     filter_l;
-    FLOAT   fcn, intratio;
-    FLOAT  *inbuf_old;
-    int     bpc;             /* number of convolution functions to pre-compute */
-    bpc = cfg->samplerate_out / gcd(cfg->samplerate_out, cfg->samplerate_in);
-    if (bpc > BPC)
-        bpc = BPC;
-
-    intratio = (fabs(resample_ratio - floor(.5 + resample_ratio)) < FLT_EPSILON);
-    fcn = 1.00 / resample_ratio;
-    if (fcn > 1.00)
-        fcn = 1.00;
-    filter_l = 31;     /* must be odd */
-    filter_l += intratio; /* unless resample_ratio=int, it must be even */
-
-
-    BLACKSIZE = filter_l + 1; /* size of data needed for FIR */
-
-    if (gfc->fill_buffer_resample_init == 0) {
-        esv->inbuf_old[0] = lame_calloc(sample_t, BLACKSIZE);
-        esv->inbuf_old[1] = lame_calloc(sample_t, BLACKSIZE);
-        for (i = 0; i <= 2 * bpc; ++i)
-            esv->blackfilt[i] = lame_calloc(sample_t, BLACKSIZE);
-
-        esv->itime[0] = 0;
-        esv->itime[1] = 0;
-
-        /* precompute blackman filter coefficients */
-        for (j = 0; j <= 2 * bpc; j++) {
-            FLOAT   sum = 0.;
-            offset = (j - bpc) / (2. * bpc);
-            for (i = 0; i <= filter_l; i++)
-                sum += esv->blackfilt[j][i] = blackman(i - offset, fcn, filter_l);
-            for (i = 0; i <= filter_l; i++)
-                esv->blackfilt[j][i] /= sum;
-        }
-        gfc->fill_buffer_resample_init = 1;
-    }
-
-    inbuf_old = esv->inbuf_old[ch];
-
-    /* time of j'th element in inbuf = itime + j/ifreq; */
-    /* time of k'th element in outbuf   =  j/ofreq */
-    for (k = 0; k < desired_len; k++) {
-        double  time0 = k * resample_ratio; /* time of k'th output sample */
-        int     joff;
-
-        j = floor(time0 - esv->itime[ch]);
-
-        /* check if we need more input data */
-        if ((filter_l + j - filter_l / 2) >= len)
-            break;
-
-        /* blackman filter.  by default, window centered at j+.5(filter_l%2) */
-        /* but we want a window centered at time0.   */
-        offset = (time0 - esv->itime[ch] - (j + .5 * (filter_l % 2)));
-        assert(fabs(offset) <= .501);
-
-        /* find the closest precomputed window for this offset: */
-        joff = floor((offset * 2 * bpc) + bpc + .5);
-
-        xvalue = 0.;
-        for (i = 0; i <= filter_l; ++i) {
-            int const j2 = i + j - filter_l / 2;
-            sample_t y;
-            assert(j2 < len);
-            assert(j2 + BLACKSIZE >= 0);
-            y = (j2 < 0) ? inbuf_old[BLACKSIZE + j2] : inbuf[j2];
-#ifdef PRECOMPUTE
-            xvalue += y * esv->blackfilt[joff][i];
-#else
-            xvalue += y * blackman(i - offset, fcn, filter_l); /* very slow! */
-#endif
-        }
-        outbuf[k] = xvalue;
-    }
-
-
-    /* k = number of samples added to outbuf */
-    /* last k sample used data from [j-filter_l/2,j+filter_l-filter_l/2]  */
-
-    /* how many samples of input data were used:  */
-    *num_used = Min(len, filter_l + j - filter_l / 2);
-
-    /* adjust our input time counter.  Incriment by the number of samples used,
-     * then normalize so that next output sample is at time 0, next
-     * input buffer is at time itime[ch] */
-    esv->itime[ch] += *num_used - k * resample_ratio;
-
-    /* save the last BLACKSIZE samples into the inbuf_old buffer */
-    if (*num_used >= BLACKSIZE) {
-        for (i = 0; i < BLACKSIZE; i++)
-            inbuf_old[i] = inbuf[*num_used + i - BLACKSIZE];
-    }
-    else {
-        /* shift in *num_used samples into inbuf_old  */
-        int const n_shift = BLACKSIZE - *num_used; /* number of samples to shift */
-
-        /* shift n_shift samples by *num_used, to make room for the
-         * num_used new samples */
-        for (i = 0; i < n_shift; ++i)
-            inbuf_old[i] = inbuf_old[i + *num_used];
-
-        /* shift in the *num_used samples */
-        for (j = 0; i < BLACKSIZE; ++i, ++j)
-            inbuf_old[i] = inbuf[j];
-
-        assert(j == *num_used);
-    }
-    return k;           /* return the number samples created at the new samplerate */
-}
-
 int
 isResamplingNecessary(SessionConfig_t const* cfg)
 {
@@ -681,12 +522,11 @@ fill_buffer(lame_internal_flags * gfc,
 
     /* copy in new samples into mfbuf, with resampling if necessary */
     if (isResamplingNecessary(cfg)) {
-        do {
-            nout =
-                fill_buffer_resample(gfc, &mfbuf[ch][mf_size],
-                                     framesize, in_buffer[ch], nsamples, n_in, ch);
-        } while (++ch < nch);
-        *n_out = nout;
+        sample_t *out[2];
+        out[0] = &mfbuf[0][mf_size];
+        out[1] = &mfbuf[1][mf_size];
+        *n_out = lame_resampler_process(gfc->sv_enc.resampler, in_buffer, nsamples, n_in,
+                                        out, framesize);
     }
     else {
         nout = Min(framesize, nsamples);
@@ -775,6 +615,47 @@ lame_errorf(const lame_internal_flags* gfc, const char *format, ...)
  *
  ***********************************************************************/
 
+#ifdef LAME_PROFILE_STAGES
+
+/***********************************************************************
+ *
+ *  encoder stage probes, see PROFILE_LAP in util.h
+ *
+ ***********************************************************************/
+
+static  uint64_t
+profile_ticks(void)
+{
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+    return __rdtsc();
+#elif defined(__i386__) || defined(__x86_64__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t t;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(t));
+    return t;
+#else
+    return (uint64_t) clock();
+#endif
+}
+
+void
+lame_profile_mark(lame_internal_flags * gfc)
+{
+    gfc->sv_prof.mark = profile_ticks();
+}
+
+void
+lame_profile_lap(lame_internal_flags * gfc, int stage)
+{
+    uint64_t const now = profile_ticks();
+    gfc->sv_prof.ticks[stage] += now - gfc->sv_prof.mark;
+    gfc->sv_prof.mark = now;
+}
+
+#endif
+
+
 #ifdef HAVE_NASM
 extern int has_MMX_nasm(void);
 extern int has_3DNow_nasm(void);
@@ -139,7 +139,9 @@ extern  "C" {
         int     buf_size;    /* size of buffer (in number of bytes) */
         int     totbit;      /* bit counter of bit stream */
         int     buf_byte_idx; /* pointer to top byte in buffer */
-        int     buf_bit_idx; /* pointer to top bit of top byte in buffer */
+        uint64_t cache;      /* bits not yet stored in buf, right aligned */
+        int     cache_bits;  /* number of valid bits in cache */
+        int     header_left; /* bits to write before the next frame header is due */
 
         /* format of file in rd mode (BINARY/ASCII) */
     } Bit_stream_struc;
@@ -195,6 +197,7 @@ extern  "C" {
         FLOAT   bo_weight[Max(SBMAX_l,SBMAX_s)]; /* band weight long scalefactor bands, at transition */
         FLOAT   attack_threshold; /* short block tuning */
         int     s3ind[CBANDS][2];
+        int     s3off[CBANDS]; /* start of row b in s3, rows are zero padded to 4 */
         int     numlines[CBANDS];
         int     bm[Max(SBMAX_l,SBMAX_s)];
         int     bo[Max(SBMAX_l,SBMAX_s)];
@@ -251,11 +254,7 @@ extern  "C" {
         FLOAT   amp_filter[32];
 
         /* variables used by util.c */
-        /* BPC = maximum number of filter convolution windows to precompute */
-#define BPC 320
-        double  itime[2]; /* float precision seems to be not enough */
-        sample_t *inbuf_old[2];
-        sample_t *blackfilt[2 * BPC + 1];
+        lame_resampler_t resampler; /* only when samplerate_in != samplerate_out */
 
         FLOAT   pefirbuf[19];
         
@@ -281,6 +280,7 @@ extern  "C" {
 
         int     h_ptr;
         int     w_ptr;
+        int     emit_ptr;    /* next frame for the frame callback */
         int     ancillary_flag;
 
         /* variables for reservoir.c */
@@ -294,10 +294,15 @@ extern  "C" {
 #ifndef  MFSIZE
 # define MFSIZE  ( 3*1152 + ENCDELAY - MDCTDELAY )
 #endif
-        sample_t mfbuf[2][MFSIZE];
+        /* mfbuf is a mirrored ring of MFSIZE samples: every sample stored
+         * at position i is also stored at i+MFSIZE (or i-MFSIZE), so the
+         * mf_size samples starting at mf_start are always contiguous and
+         * consumed frames are dropped by advancing mf_start, not by shifting */
+        sample_t mfbuf[2][2 * MFSIZE];
 
         int     mf_samples_to_encode;
         int     mf_size;
+        int     mf_start;    /* ring position of mfbuf[ch][0], 0 <= mf_start < MFSIZE */
 
     } EncStateVar_t;
 
@@ -351,9 +356,53 @@ extern  "C" {
         sample_t PeakSample;
         int     RadioGain;
         int     noclipGainChange; /* gain change required for preventing clipping */
+        FLOAT   IntegratedLoudness; /* EBU R128 loudness of the title, LUFS */
     } RpgResult_t;
 
 
+    typedef struct {
+        uint64_t ticks[LAME_STAGE_COUNT]; /* time per encoder stage, see PROFILE_LAP */
+        uint64_t mark;       /* end of the last stage measured */
+    } ProfStateVar_t;
+
+
+    typedef struct {
+        int     noise_shaping;
+        int     noise_shaping_amp;
+        int     noise_shaping_stop;
+        int     use_best_huffman;
+        int     full_outer_loop;
+        int     substep_shaping;
+    } GovKnobs_t;
+
+    typedef struct {
+        GovKnobs_t knobs[LAME_GOVERNOR_LEVELS]; /* level 0 is what lame_init_qval set */
+        float   ratio[LAME_GOVERNOR_LEVELS]; /* load at level l over load at l+1 */
+        double  start;       /* clock when the frame began */
+        float   frame_time;  /* seconds a frame plays */
+        float   load;        /* encode time over frame_time, smoothed */
+        float   load_before; /* smoothed load before the last step */
+        float   peak_load;
+        int     level;       /* 0 = quality as set, higher is cheaper */
+        int     levels;
+        int     hold;        /* frames before the level may move again */
+        int     step;        /* direction of the last step, 0 = none yet */
+        unsigned long frames[LAME_GOVERNOR_LEVELS];
+        unsigned long late;  /* frames that took longer than they play */
+        unsigned long changes;
+    } GovStateVar_t;
+
+
+    typedef struct {
+        unsigned char *body; /* scratch for the serialized state, see snapshot.c */
+        unsigned char *base; /* body of the last full snapshot, deltas are taken against it */
+        size_t  body_alloc;
+        size_t  base_alloc;
+        size_t  base_size;
+        uint32_t base_hash;
+    } SnapStateVar_t;
+
+
     typedef struct {
         int     version;     /* 0=MPEG-2/2.5  1=MPEG-1               */
         int     samplerate_index;
@@ -411,6 +460,8 @@ extern  "C" {
         int     decode_on_the_fly; /* decode on the fly? default=0                */
         int     analysis;
         int     disable_reservoir;
+        int     low_latency; /* reservoir frames in the low latency profile, -1 = off */
+        float   governor;    /* target load of the quality governor, 0 = off */
         int     buffer_constraint;  /* enforce ISO spec as much as possible   */
         int     free_format;
         int     write_lame_tag; /* add Xing VBR tag?                           */
@@ -487,7 +538,6 @@ extern  "C" {
         int     lame_init_params_successful;
         int     lame_encode_frame_init;
         int     iteration_init_init;
-        int     fill_buffer_resample_init;
 
         SessionConfig_t cfg;
 
@@ -506,6 +556,10 @@ extern  "C" {
         RpgStateVar_t sv_rpg;
         RpgResult_t ov_rpg;
 
+        ProfStateVar_t sv_prof;
+        GovStateVar_t sv_gov;
+        SnapStateVar_t sv_snap;
+
         /* optional ID3 tags, used in id3tag.c  */
         struct id3tag_spec tag_spec;
         uint16_t nMusicCRC;
@@ -532,6 +586,7 @@ extern  "C" {
         /* used by the frame analyzer */
         plotting_data *pinfo;
         hip_t hip;
+        hip_t hip_in;        /* decodes the input of lame_encode_mp3_buffer() */
 
         /* functions to replace with CPU feature optimized versions in takehiro.c */
         int     (*choose_table) (const int *ix, const int *const end, int *const s);
@@ -542,6 +597,9 @@ extern  "C" {
         lame_report_function report_msg;
         lame_report_function report_dbg;
         lame_report_function report_err;
+
+        lame_frame_callback frame_cb; /* gets each frame once complete, or NULL */
+        void   *frame_cb_data;
     };
 
 #ifndef lame_internal_flags_defined
@@ -575,6 +633,7 @@ extern  "C" {
     void    fill_buffer(lame_internal_flags * gfc,
                         sample_t *const mfbuf[2],
                         sample_t const *const in_buffer[2], int nsamples, int *n_in, int *n_out);
+    void    mirror_mfbuf(EncStateVar_t * esv, int nch, int pos, int n);
 
 /* same as lame_decode1 (look in lame.h), but returns
    unclipped raw floating-point samples. It is declared
@@ -584,6 +643,31 @@ extern  "C" {
     int     hip_decode1_unclipped(hip_t hip, unsigned char *mp3buf,
                                    size_t len, sample_t pcm_l[], sample_t pcm_r[]);
 
+/* for the transcoder: hip_decode_borrow lets the decoder read mp3buf
+   in place until hip_decode_release, which keeps a copy of whatever
+   is left.  hip_decode1_planar decodes the next frame straight into
+   pcm[0] and pcm[1] (pcm[0] only for mono), at most 1152 samples per
+   channel; it returns -1 on error, 0 if it needs more data and 1 if
+   a frame was decoded */
+    int     hip_decode_borrow(hip_t hip, unsigned char *mp3buf, size_t len);
+    int     hip_decode_release(hip_t hip);
+    int     hip_decode1_planar(hip_t hip, sample_t *pcm[2], int *nsamples,
+                               int *stereo, int *samplerate);
+
+
+/* encoder stage probes, compiled in with LAME_PROFILE_STAGES: PROFILE_MARK
+   starts the clock when entering the encoder, each PROFILE_LAP charges the
+   time since the previous mark or lap to one stage */
+#ifdef LAME_PROFILE_STAGES
+    void    lame_profile_mark(lame_internal_flags * gfc);
+    void    lame_profile_lap(lame_internal_flags * gfc, int stage);
+#define PROFILE_MARK(gfc)           lame_profile_mark(gfc)
+#define PROFILE_LAP(gfc, stage)     lame_profile_lap(gfc, stage)
+#else
+#define PROFILE_MARK(gfc)           ((void) 0)
+#define PROFILE_LAP(gfc, stage)     ((void) 0)
+#endif
+
 
     extern int has_MMX(void);
     extern int has_3DNow(void);
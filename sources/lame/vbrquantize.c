@@ -34,6 +34,14 @@
 #include "vbrquantize.h"
 #include "quantize_pvt.h"
 
+#if !defined(TAKEHIRO_IEEE754_HACK) && defined(__SSE2__)
+# include <emmintrin.h>
+# define VBRQ_SSE2
+#elif !defined(TAKEHIRO_IEEE754_HACK) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+# include <arm_neon.h>
+# define VBRQ_NEON
+#endif
+
 
 
 
@@ -119,6 +127,25 @@ vec_max_c(const float * xr34, unsigned int bw)
     unsigned int i = bw >> 2u;
     unsigned int const remaining = (bw & 0x03u);
 
+#if defined(VBRQ_SSE2)
+    __m128  m = _mm_setzero_ps();
+    while (i-- > 0) {
+        m = _mm_max_ps(m, _mm_loadu_ps(xr34));
+        xr34 += 4;
+    }
+    m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+    m = _mm_max_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1)));
+    xfsf = _mm_cvtss_f32(m);
+#elif defined(VBRQ_NEON)
+    float32x4_t m = vdupq_n_f32(0);
+    float32x2_t t;
+    while (i-- > 0) {
+        m = vmaxq_f32(m, vld1q_f32(xr34));
+        xr34 += 4;
+    }
+    t = vmax_f32(vget_low_f32(m), vget_high_f32(m));
+    xfsf = vget_lane_f32(vpmax_f32(t, t), 0);
+#else
     while (i-- > 0) {
         if (xfsf < xr34[0]) {
             xfsf = xr34[0];
@@ -134,6 +161,7 @@ vec_max_c(const float * xr34, unsigned int bw)
         }
         xr34 += 4;
     }
+#endif
     switch( remaining ) {
     case 3: if (xfsf < xr34[2]) xfsf = xr34[2];
     case 2: if (xfsf < xr34[1]) xfsf = xr34[1];
@@ -207,15 +235,47 @@ k_34_4(DOUBLEX x[4], int l3[4])
 }
 
 
+/*  the same as k_34_4, for four values held in a vector register.
+ *  only the table lookups are done one by one
+ */
+#if defined(VBRQ_SSE2)
+inline static __m128i
+k_34_4_v(__m128 x)
+{
+    int     l3[4];
+    _mm_storeu_si128((__m128i *) l3, _mm_cvttps_epi32(x));
+    x = _mm_add_ps(x, _mm_setr_ps(adj43[l3[0]], adj43[l3[1]], adj43[l3[2]], adj43[l3[3]]));
+    return _mm_cvttps_epi32(x);
+}
+#elif defined(VBRQ_NEON)
+inline static int32x4_t
+k_34_4_v(float32x4_t x)
+{
+    int     l3[4];
+    float   adj[4];
+    vst1q_s32(l3, vcvtq_s32_f32(x));
+    adj[0] = adj43[l3[0]];
+    adj[1] = adj43[l3[1]];
+    adj[2] = adj43[l3[2]];
+    adj[3] = adj43[l3[3]];
+    return vcvtq_s32_f32(vaddq_f32(x, vld1q_f32(adj)));
+}
+#endif
+
+
 
 
 
 /*  do call the calc_sfb_noise_* functions only with sf values
  *  for which holds: sfpow34*xr34 <= IXMAX_VAL
+ *
+ *  the summation stops as soon as the noise exceeds l3_xmin, the
+ *  returned value is then only good for comparing against l3_xmin
  */
 
 static  FLOAT
-calc_sfb_noise_x34(const FLOAT * xr, const FLOAT * xr34, unsigned int bw, uint8_t sf)
+calc_sfb_noise_x34(const FLOAT * xr, const FLOAT * xr34, unsigned int bw, uint8_t sf,
+                   FLOAT l3_xmin)
 {
     DOUBLEX x[4];
     int     l3[4];
@@ -226,6 +286,49 @@ calc_sfb_noise_x34(const FLOAT * xr, const FLOAT * xr34, unsigned int bw, uint8_
     unsigned int i = bw >> 2u;
     unsigned int const remaining = (bw & 0x03u);
 
+#if defined(VBRQ_SSE2)
+    __m128 const vsfpow = _mm_set1_ps(sfpow);
+    __m128 const vsfpow34 = _mm_set1_ps(sfpow34);
+    __m128 const vabs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+    while (i-- > 0) {
+        __m128  d;
+        _mm_storeu_si128((__m128i *) l3, k_34_4_v(_mm_mul_ps(vsfpow34, _mm_loadu_ps(xr34))));
+        d = _mm_mul_ps(vsfpow, _mm_setr_ps(pow43[l3[0]], pow43[l3[1]], pow43[l3[2]], pow43[l3[3]]));
+        d = _mm_sub_ps(_mm_and_ps(vabs, _mm_loadu_ps(xr)), d);
+        d = _mm_mul_ps(d, d);
+        /* (d0 + d1) + (d2 + d3), summed in the same order as the plain C code */
+        d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+        xfsf += _mm_cvtss_f32(_mm_add_ss(d, _mm_movehl_ps(d, d)));
+        if (xfsf > l3_xmin) {
+            return xfsf;
+        }
+        xr += 4;
+        xr34 += 4;
+    }
+#elif defined(VBRQ_NEON)
+    float32x4_t const vsfpow34 = vdupq_n_f32(sfpow34);
+
+    while (i-- > 0) {
+        float   p[4];
+        float32x4_t d;
+        float32x2_t t;
+        vst1q_s32(l3, k_34_4_v(vmulq_f32(vsfpow34, vld1q_f32(xr34))));
+        p[0] = pow43[l3[0]];
+        p[1] = pow43[l3[1]];
+        p[2] = pow43[l3[2]];
+        p[3] = pow43[l3[3]];
+        d = vsubq_f32(vabsq_f32(vld1q_f32(xr)), vmulq_n_f32(vld1q_f32(p), sfpow));
+        d = vmulq_f32(d, d);
+        t = vpadd_f32(vget_low_f32(d), vget_high_f32(d));
+        xfsf += vget_lane_f32(vpadd_f32(t, t), 0);
+        if (xfsf > l3_xmin) {
+            return xfsf;
+        }
+        xr += 4;
+        xr34 += 4;
+    }
+#else
     while (i-- > 0) {
         x[0] = sfpow34 * xr34[0];
         x[1] = sfpow34 * xr34[1];
@@ -239,10 +342,14 @@ calc_sfb_noise_x34(const FLOAT * xr, const FLOAT * xr34, unsigned int bw, uint8_
         x[2] = fabsf(xr[2]) - sfpow * pow43[l3[2]];
         x[3] = fabsf(xr[3]) - sfpow * pow43[l3[3]];
         xfsf += (x[0] * x[0] + x[1] * x[1]) + (x[2] * x[2] + x[3] * x[3]);
+        if (xfsf > l3_xmin) {
+            return xfsf;
+        }
 
         xr += 4;
         xr34 += 4;
     }
+#endif
     if (remaining) {
         x[0] = x[1] = x[2] = x[3] = 0;
         switch( remaining ) {
@@ -266,44 +373,43 @@ calc_sfb_noise_x34(const FLOAT * xr, const FLOAT * xr34, unsigned int bw, uint8_
 
 
 
-struct calc_noise_cache {
-    int     valid;
-    FLOAT   value;
+/*  noise verdicts of one scalefactor band, indexed by sf. the search
+ *  visits sf, sf+1 and sf-1 on each bisection step, so neighbouring
+ *  steps share most of their work
+ */
+enum calc_noise_state {
+    NOISE_UNKNOWN = 0,
+    NOISE_OK,
+    NOISE_TOO_HIGH
 };
 
-typedef struct calc_noise_cache calc_noise_cache_t;
+typedef uint8_t calc_noise_cache_t;
+
+
+inline static int
+sfb_noise_too_high(const FLOAT * xr, const FLOAT * xr34, FLOAT l3_xmin, unsigned int bw,
+                   uint8_t sf, calc_noise_cache_t * did_it)
+{
+    if (did_it[sf] == NOISE_UNKNOWN) {
+        FLOAT const noise = calc_sfb_noise_x34(xr, xr34, bw, sf, l3_xmin);
+        did_it[sf] = (l3_xmin < noise) ? NOISE_TOO_HIGH : NOISE_OK;
+    }
+    return did_it[sf] == NOISE_TOO_HIGH;
+}
 
 
 static  uint8_t
 tri_calc_sfb_noise_x34(const FLOAT * xr, const FLOAT * xr34, FLOAT l3_xmin, unsigned int bw,
                        uint8_t sf, calc_noise_cache_t * did_it)
 {
-    if (did_it[sf].valid == 0) {
-        did_it[sf].valid = 1;
-        did_it[sf].value = calc_sfb_noise_x34(xr, xr34, bw, sf);
-    }
-    if (l3_xmin < did_it[sf].value) {
+    if (sfb_noise_too_high(xr, xr34, l3_xmin, bw, sf, did_it)) {
         return 1;
     }
-    if (sf < 255) {
-        uint8_t const sf_x = sf + 1;
-        if (did_it[sf_x].valid == 0) {
-            did_it[sf_x].valid = 1;
-            did_it[sf_x].value = calc_sfb_noise_x34(xr, xr34, bw, sf_x);
-        }
-        if (l3_xmin < did_it[sf_x].value) {
-            return 1;
-        }
+    if (sf < 255 && sfb_noise_too_high(xr, xr34, l3_xmin, bw, sf + 1, did_it)) {
+        return 1;
     }
-    if (sf > 0) {
-        uint8_t const sf_x = sf - 1;
-        if (did_it[sf_x].valid == 0) {
-            did_it[sf_x].valid = 1;
-            did_it[sf_x].value = calc_sfb_noise_x34(xr, xr34, bw, sf_x);
-        }
-        if (l3_xmin < did_it[sf_x].value) {
-            return 1;
-        }
+    if (sf > 0 && sfb_noise_too_high(xr, xr34, l3_xmin, bw, sf - 1, did_it)) {
+        return 1;
     }
     return 0;
 }
@@ -531,12 +637,19 @@ quantize_x34(const algo_t * that)
         i >>= 2u;
 
         while (i-- > 0) {
+#if defined(VBRQ_SSE2)
+            _mm_storeu_si128((__m128i *) l3,
+                             k_34_4_v(_mm_mul_ps(_mm_set1_ps(sfpow34), _mm_loadu_ps(xr34_orig))));
+#elif defined(VBRQ_NEON)
+            vst1q_s32(l3, k_34_4_v(vmulq_n_f32(vld1q_f32(xr34_orig), sfpow34)));
+#else
             x[0] = sfpow34 * xr34_orig[0];
             x[1] = sfpow34 * xr34_orig[1];
             x[2] = sfpow34 * xr34_orig[2];
             x[3] = sfpow34 * xr34_orig[3];
 
             k_34_4(x, l3);
+#endif
 
             l3 += 4;
             xr34_orig += 4;
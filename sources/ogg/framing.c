@@ -191,6 +191,11 @@ static int _os_body_expand(ogg_stream_state *os,long needed){
     }
     body_storage=os->body_storage+needed;
     if(body_storage<LONG_MAX-1024)body_storage+=1024;
+    /* at least half again, so a growing backlog reallocs a few times
+       rather than once per packet */
+    if(body_storage-os->body_storage<os->body_storage/2 &&
+       os->body_storage<LONG_MAX/3*2)
+      body_storage=os->body_storage+os->body_storage/2;
     ret=_ogg_realloc(os->body_data,body_storage*sizeof(*os->body_data));
     if(!ret){
       ogg_stream_clear(os);
@@ -212,6 +217,9 @@ static int _os_lacing_expand(ogg_stream_state *os,long needed){
     }
     lacing_storage=os->lacing_storage+needed;
     if(lacing_storage<LONG_MAX-32)lacing_storage+=32;
+    if(lacing_storage-os->lacing_storage<os->lacing_storage/2 &&
+       os->lacing_storage<LONG_MAX/3*2)
+      lacing_storage=os->lacing_storage+os->lacing_storage/2;
     ret=_ogg_realloc(os->lacing_vals,lacing_storage*sizeof(*os->lacing_vals));
     if(!ret){
       ogg_stream_clear(os);
@@ -234,7 +242,7 @@ static int _os_lacing_expand(ogg_stream_state *os,long needed){
 /* Direct table CRC; note that this will be faster in the future if we
    perform the checksum simultaneously with other copies */
 
-static ogg_uint32_t _os_update_crc(ogg_uint32_t crc, unsigned char *buffer, int size){
+static ogg_uint32_t _os_table_crc(ogg_uint32_t crc, unsigned char *buffer, int size){
   while (size>=8){
     crc^=((ogg_uint32_t)buffer[0]<<24)|((ogg_uint32_t)buffer[1]<<16)|((ogg_uint32_t)buffer[2]<<8)|((ogg_uint32_t)buffer[3]);
 
@@ -252,6 +260,127 @@ static ogg_uint32_t _os_update_crc(ogg_uint32_t crc, unsigned char *buffer, int
   return crc;
 }
 
+/* Carry-less multiply folding, after Gopal et al., "Fast CRC
+   Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+
+   The CRC only depends on the buffer as a polynomial mod P, most
+   significant bit first.  A 128 bit block X = X_hi*x^64 + X_lo with d
+   more bits after it contributes X*x^d, which can be replaced by
+   X_hi*(x^(d+64) mod P) + X_lo*(x^d mod P), a product of at most 96
+   bits, xored into the block d bits further on.  Four blocks are
+   folded 512 bits ahead at a time, then into each other; the last
+   block and the tail go through the table.
+
+   Selected at compile time like the rest of the SIMD code in the
+   tree (-mpclmul -mssse3 on x86, +crypto on ARMv8). */
+
+#if defined(__PCLMUL__) && defined(__SSSE3__)
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+#define OGG_CRC_FOLD
+
+typedef __m128i crc_block;
+
+/* bytes 0..15 as a big endian 128 bit number */
+static crc_block crc_load(const unsigned char *p){
+  return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p),
+                          _mm_set_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15));
+}
+
+static void crc_store(unsigned char *p,crc_block x){
+  _mm_storeu_si128((__m128i *)p,
+                   _mm_shuffle_epi8(x,_mm_set_epi8(0,1,2,3,4,5,6,7,
+                                                   8,9,10,11,12,13,14,15)));
+}
+
+#define crc_const(hi,lo) _mm_set_epi64x(hi,lo)
+#define crc_top(c)       _mm_set_epi32((int)(c),0,0,0)
+#define crc_xor(a,b)     _mm_xor_si128(a,b)
+
+static crc_block crc_fold(crc_block x,crc_block k){
+  return _mm_xor_si128(_mm_clmulepi64_si128(x,k,0x11),
+                       _mm_clmulepi64_si128(x,k,0x00));
+}
+
+#elif defined(__aarch64__) && \
+  (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_AES))
+#include <arm_neon.h>
+#define OGG_CRC_FOLD
+
+/* lane 1 is the high half */
+typedef uint64x2_t crc_block;
+
+static crc_block crc_load(const unsigned char *p){
+  uint64x2_t v=vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(p)));
+  return vextq_u64(v,v,1);
+}
+
+static void crc_store(unsigned char *p,crc_block x){
+  vst1q_u8(p,vrev64q_u8(vreinterpretq_u8_u64(vextq_u64(x,x,1))));
+}
+
+#define crc_const(hi,lo) vcombine_u64(vcreate_u64(lo),vcreate_u64(hi))
+#define crc_top(c)       crc_const((ogg_uint64_t)(c)<<32,0)
+#define crc_xor(a,b)     veorq_u64(a,b)
+
+static crc_block crc_fold(crc_block x,crc_block k){
+  poly128_t hi=vmull_high_p64(vreinterpretq_p64_u64(x),
+                              vreinterpretq_p64_u64(k));
+  poly128_t lo=vmull_p64((poly64_t)vgetq_lane_u64(x,0),
+                         (poly64_t)vgetq_lane_u64(k,0));
+  return veorq_u64(vreinterpretq_u64_p128(hi),vreinterpretq_u64_p128(lo));
+}
+#endif
+
+#ifdef OGG_CRC_FOLD
+/* size >= 64 */
+static ogg_uint32_t _os_fold_crc(ogg_uint32_t crc, unsigned char *buffer, int size){
+  /* x^576, x^512, x^192 and x^128 mod P */
+  const crc_block k512=crc_const(0x8833794c,0xe6228b11);
+  const crc_block k128=crc_const(0xc5b9cd4c,0xe8a45605);
+  unsigned char last[16];
+  crc_block x0,x1,x2,x3;
+
+  /* the running crc adds into the first four bytes */
+  x0=crc_xor(crc_load(buffer),crc_top(crc));
+  x1=crc_load(buffer+16);
+  x2=crc_load(buffer+32);
+  x3=crc_load(buffer+48);
+  buffer+=64;
+  size-=64;
+
+  while(size>=64){
+    x0=crc_xor(crc_fold(x0,k512),crc_load(buffer));
+    x1=crc_xor(crc_fold(x1,k512),crc_load(buffer+16));
+    x2=crc_xor(crc_fold(x2,k512),crc_load(buffer+32));
+    x3=crc_xor(crc_fold(x3,k512),crc_load(buffer+48));
+    buffer+=64;
+    size-=64;
+  }
+
+  x1=crc_xor(crc_fold(x0,k128),x1);
+  x2=crc_xor(crc_fold(x1,k128),x2);
+  x3=crc_xor(crc_fold(x2,k128),x3);
+  while(size>=16){
+    x3=crc_xor(crc_fold(x3,k128),crc_load(buffer));
+    buffer+=16;
+    size-=16;
+  }
+
+  crc_store(last,x3);
+  crc=_os_table_crc(0,last,16);
+  return _os_table_crc(crc,buffer,size);
+}
+#endif
+
+static ogg_uint32_t _os_update_crc(ogg_uint32_t crc, unsigned char *buffer, int size){
+#ifdef OGG_CRC_FOLD
+  if(size>=64)
+    return _os_fold_crc(crc,buffer,size);
+#endif
+  return _os_table_crc(crc,buffer,size);
+}
+
 void ogg_page_checksum_set(ogg_page *og){
   if(og){
     ogg_uint32_t crc_reg=0;
@@ -343,29 +472,27 @@ int ogg_stream_packetin(ogg_stream_state *os,ogg_packet *op){
   return ogg_stream_iovecin(os, &iov, 1, op->e_o_s, op->granulepos);
 }
 
-/* Conditionally flush a page; force==0 will only flush nominal-size
-   pages, force==1 forces us to flush a page regardless of page size
-   so long as there's any data available at all. */
-static int ogg_stream_flush_i(ogg_stream_state *os,ogg_page *og, int force, int nfill){
-  int i;
+/* Decides how many of the buffered segments from lacing value 'base'
+   on go into the next page.  force==0 will only take a nominal-size
+   page, force==1 takes a page regardless of size so long as there's
+   any data available at all.  Returns 0 if no page is due. */
+static int _os_page_vals(ogg_stream_state *os,long base,int force,int nfill,
+                         ogg_int64_t *granule_pos){
+  int *lacing_vals=os->lacing_vals+base;
+  long lacing_fill=os->lacing_fill-base;
   int vals=0;
-  int maxvals=(os->lacing_fill>255?255:os->lacing_fill);
-  int bytes=0;
+  int maxvals=(lacing_fill>255?255:lacing_fill);
   long acc=0;
-  ogg_int64_t granule_pos=-1;
 
-  if(ogg_stream_check(os)) return(0);
+  *granule_pos=-1;
   if(maxvals==0) return(0);
 
-  /* construct a page */
-  /* decide how many segments to include */
-
   /* If this is the initial header case, the first page must only include
      the initial header packet */
   if(os->b_o_s==0){  /* 'initial header page' case */
-    granule_pos=0;
+    *granule_pos=0;
     for(vals=0;vals<maxvals;vals++){
-      if((os->lacing_vals[vals]&0x0ff)<255){
+      if((lacing_vals[vals]&0x0ff)<255){
         vals++;
         break;
       }
@@ -388,9 +515,9 @@ static int ogg_stream_flush_i(ogg_stream_state *os,ogg_page *og, int force, int
         force=1;
         break;
       }
-      acc+=os->lacing_vals[vals]&0x0ff;
-      if((os->lacing_vals[vals]&0xff)<255){
-        granule_pos=os->granule_vals[vals];
+      acc+=lacing_vals[vals]&0x0ff;
+      if((lacing_vals[vals]&0xff)<255){
+        *granule_pos=os->granule_vals[base+vals];
         packet_just_done=++packets_done;
       }else
         packet_just_done=0;
@@ -399,25 +526,40 @@ static int ogg_stream_flush_i(ogg_stream_state *os,ogg_page *og, int force, int
   }
 
   if(!force) return(0);
+  return(vals);
+}
 
-  /* construct the header in temp storage */
-  memcpy(os->header,"OggS",4);
+/* pageout's own reasons to force a page out of the segments from 'base' */
+static int _os_page_force(ogg_stream_state *os,long base){
+  long lacing_fill=os->lacing_fill-base;
+  return((os->e_o_s&&lacing_fill) ||          /* 'were done, now flush' case */
+         (lacing_fill&&!os->b_o_s));          /* 'initial header page' case */
+}
+
+/* Writes the header of a page of 'vals' segments from lacing value
+   'base' into 'header', checksum zeroed.  Returns the body length. */
+static long _os_page_header(ogg_stream_state *os,unsigned char *header,
+                            long base,int vals,ogg_int64_t granule_pos){
+  int i;
+  long bytes=0;
+
+  memcpy(header,"OggS",4);
 
   /* stream structure version */
-  os->header[4]=0x00;
+  header[4]=0x00;
 
   /* continued packet flag? */
-  os->header[5]=0x00;
-  if((os->lacing_vals[0]&0x100)==0)os->header[5]|=0x01;
+  header[5]=0x00;
+  if((os->lacing_vals[base]&0x100)==0)header[5]|=0x01;
   /* first page flag? */
-  if(os->b_o_s==0)os->header[5]|=0x02;
+  if(os->b_o_s==0)header[5]|=0x02;
   /* last page flag? */
-  if(os->e_o_s && os->lacing_fill==vals)os->header[5]|=0x04;
+  if(os->e_o_s && os->lacing_fill-base==vals)header[5]|=0x04;
   os->b_o_s=1;
 
   /* 64 bits of PCM position */
   for(i=6;i<14;i++){
-    os->header[i]=(unsigned char)(granule_pos&0xff);
+    header[i]=(unsigned char)(granule_pos&0xff);
     granule_pos>>=8;
   }
 
@@ -425,7 +567,7 @@ static int ogg_stream_flush_i(ogg_stream_state *os,ogg_page *og, int force, int
   {
     long serialno=os->serialno;
     for(i=14;i<18;i++){
-      os->header[i]=(unsigned char)(serialno&0xff);
+      header[i]=(unsigned char)(serialno&0xff);
       serialno>>=8;
     }
   }
@@ -440,21 +582,49 @@ static int ogg_stream_flush_i(ogg_stream_state *os,ogg_page *og, int force, int
   {
     long pageno=os->pageno++;
     for(i=18;i<22;i++){
-      os->header[i]=(unsigned char)(pageno&0xff);
+      header[i]=(unsigned char)(pageno&0xff);
       pageno>>=8;
     }
   }
 
   /* zero for computation; filled in later */
-  os->header[22]=0;
-  os->header[23]=0;
-  os->header[24]=0;
-  os->header[25]=0;
+  header[22]=0;
+  header[23]=0;
+  header[24]=0;
+  header[25]=0;
 
   /* segment table */
-  os->header[26]=(unsigned char)(vals&0xff);
+  header[26]=(unsigned char)(vals&0xff);
   for(i=0;i<vals;i++)
-    bytes+=os->header[i+27]=(unsigned char)(os->lacing_vals[i]&0xff);
+    bytes+=header[i+27]=(unsigned char)(os->lacing_vals[base+i]&0xff);
+
+  return(bytes);
+}
+
+/* drops the first 'vals' lacing values once their pages are out */
+static void _os_lacing_advance(ogg_stream_state *os,long vals){
+  os->lacing_fill-=vals;
+  memmove(os->lacing_vals,os->lacing_vals+vals,os->lacing_fill*sizeof(*os->lacing_vals));
+  memmove(os->granule_vals,os->granule_vals+vals,os->lacing_fill*sizeof(*os->granule_vals));
+}
+
+/* Conditionally flush a page; force==0 will only flush nominal-size
+   pages, force==1 forces us to flush a page regardless of page size
+   so long as there's any data available at all. */
+static int ogg_stream_flush_i(ogg_stream_state *os,ogg_page *og, int force, int nfill){
+  int vals;
+  long bytes;
+  ogg_int64_t granule_pos;
+
+  if(ogg_stream_check(os)) return(0);
+
+  /* construct a page */
+  /* decide how many segments to include */
+  vals=_os_page_vals(os,0,force,nfill,&granule_pos);
+  if(vals==0) return(0);
+
+  /* construct the header in temp storage */
+  bytes=_os_page_header(os,os->header,0,vals,granule_pos);
 
   /* set pointers in the ogg_page struct */
   og->header=os->header;
@@ -464,9 +634,7 @@ static int ogg_stream_flush_i(ogg_stream_state *os,ogg_page *og, int force, int
 
   /* advance the lacing data and set the body_returned pointer */
 
-  os->lacing_fill-=vals;
-  memmove(os->lacing_vals,os->lacing_vals+vals,os->lacing_fill*sizeof(*os->lacing_vals));
-  memmove(os->granule_vals,os->granule_vals+vals,os->lacing_fill*sizeof(*os->granule_vals));
+  _os_lacing_advance(os,vals);
   os->body_returned+=bytes;
 
   /* calculate the checksum */
@@ -508,14 +676,8 @@ returned are to static buffers; do not free. The returned buffers are
 good only until the next call (using the same ogg_stream_state) */
 
 int ogg_stream_pageout(ogg_stream_state *os, ogg_page *og){
-  int force=0;
   if(ogg_stream_check(os)) return 0;
-
-  if((os->e_o_s&&os->lacing_fill) ||          /* 'were done, now flush' case */
-     (os->lacing_fill&&!os->b_o_s))           /* 'initial header page' case */
-    force=1;
-
-  return(ogg_stream_flush_i(os,og,force,4096));
+  return(ogg_stream_flush_i(os,og,_os_page_force(os,0),4096));
 }
 
 /* Like the above, but an argument is provided to adjust the nominal
@@ -523,14 +685,162 @@ page size for applications which are smart enough to provide their
 own delay based flushing */
 
 int ogg_stream_pageout_fill(ogg_stream_state *os, ogg_page *og, int nfill){
-  int force=0;
   if(ogg_stream_check(os)) return 0;
+  return(ogg_stream_flush_i(os,og,_os_page_force(os,0),nfill));
+}
+
+/* Page batches hold completed pages back to back, each header
+   followed by its body, so a run of pages goes out in a single write.
+   A batch either owns its storage, which grows as needed and is kept
+   across ogg_page_batch_reset() for the next run, or wraps storage the
+   caller provides, which never grows. */
+
+int ogg_page_batch_init(ogg_page_batch *ob,long storage){
+  if(ob){
+    memset(ob,0,sizeof(*ob));
+    if(storage<=0)storage=65536;
+    ob->data=_ogg_malloc(storage);
+    if(!ob->data)return -1;
+    ob->storage=storage;
+    ob->owned=1;
+  }
+  return 0;
+}
+
+int ogg_page_batch_wrap(ogg_page_batch *ob,unsigned char *data,long storage){
+  if(ob){
+    memset(ob,0,sizeof(*ob));
+    if(!data || storage<0)return -1;
+    ob->data=data;
+    ob->storage=storage;
+  }
+  return 0;
+}
+
+void ogg_page_batch_reset(ogg_page_batch *ob){
+  if(ob){
+    ob->bytes=0;
+    ob->pages=0;
+  }
+}
+
+int ogg_page_batch_clear(ogg_page_batch *ob){
+  if(ob){
+    if(ob->owned && ob->data)_ogg_free(ob->data);
+    memset(ob,0,sizeof(*ob));
+  }
+  return 0;
+}
+
+/* points og at the page starting at *pos and moves *pos past it;
+   returns 0 at the end of the batch */
+int ogg_page_batch_next(const ogg_page_batch *ob,long *pos,ogg_page *og){
+  unsigned char *header;
+  long body_len=0;
+  int i;
+
+  if(!ob || *pos<0 || ob->bytes-*pos<27)return 0;
+  header=ob->data+*pos;
+  for(i=0;i<header[26];i++)
+    body_len+=header[27+i];
+  og->header=header;
+  og->header_len=27+header[26];
+  og->body=header+og->header_len;
+  og->body_len=body_len;
+  *pos+=og->header_len+body_len;
+  return 1;
+}
+
+static int _os_batch_expand(ogg_page_batch *ob,long needed){
+  if(ob->storage-ob->bytes<needed){
+    long storage=ob->storage;
+    void *ret;
+    if(!ob->owned || ob->bytes>LONG_MAX-needed)return -1;
+    if(storage<=0)storage=needed;
+    while(storage-ob->bytes<needed)
+      storage=(storage>LONG_MAX/2?LONG_MAX:storage*2);
+    ret=_ogg_realloc(ob->data,storage);
+    if(!ret)return -1;
+    ob->data=ret;
+    ob->storage=storage;
+  }
+  return 0;
+}
+
+/* Builds every page pageout (flush==0) or flush (flush==1) would
+   return in turn, straight into the batch.  The lacing fifo is
+   advanced and the body buffer compacted once for the whole run
+   rather than per page. */
+static int ogg_stream_batch_i(ogg_stream_state *os,ogg_page_batch *ob,
+                              int flush,int nfill){
+  long base=0;
+  int pages=0;
+  int ret=0;
+
+  if(ogg_stream_check(os) || !ob) return 0;
 
-  if((os->e_o_s&&os->lacing_fill) ||          /* 'were done, now flush' case */
-     (os->lacing_fill&&!os->b_o_s))           /* 'initial header page' case */
-    force=1;
+  for(;;){
+    ogg_int64_t granule_pos;
+    int force=flush || _os_page_force(os,base);
+    int vals=_os_page_vals(os,base,force,nfill,&granule_pos);
+    unsigned char *page;
+    ogg_uint32_t crc_reg;
+    long bytes=0,len;
+    int i;
+
+    if(vals==0)break;
+    for(i=0;i<vals;i++)
+      bytes+=os->lacing_vals[base+i]&0xff;
+    len=27+vals+bytes;
+    if(_os_batch_expand(ob,len)){
+      /* a full caller buffer just ends the run; the rest stays queued */
+      if(ob->owned)ret=-1;
+      break;
+    }
+
+    page=ob->data+ob->bytes;
+    _os_page_header(os,page,base,vals,granule_pos);
+    memcpy(page+27+vals,os->body_data+os->body_returned,bytes);
+    crc_reg=_os_update_crc(0,page,len);
+    page[22]=(unsigned char)(crc_reg&0xff);
+    page[23]=(unsigned char)((crc_reg>>8)&0xff);
+    page[24]=(unsigned char)((crc_reg>>16)&0xff);
+    page[25]=(unsigned char)((crc_reg>>24)&0xff);
+
+    os->body_returned+=bytes;
+    base+=vals;
+    ob->bytes+=len;
+    ob->pages++;
+    pages++;
+  }
+
+  if(base){
+    _os_lacing_advance(os,base);
+    /* the bodies were copied out, so nothing points into body_data */
+    os->body_fill-=os->body_returned;
+    if(os->body_fill)
+      memmove(os->body_data,os->body_data+os->body_returned,os->body_fill);
+    os->body_returned=0;
+  }
+
+  return(ret?ret:pages);
+}
+
+/* Appends all the pages ogg_stream_pageout() would return to the
+   batch and returns their count.  With caller storage, the run stops
+   at the first page that doesn't fit and the rest stays queued in the
+   stream; storage for the largest possible page (65307 bytes) always
+   makes progress.  Returns -1 if an owned batch couldn't grow; the
+   pages already in it are still good. */
+
+int ogg_stream_pageout_batch(ogg_stream_state *os,ogg_page_batch *ob){
+  return(ogg_stream_batch_i(os,ob,0,4096));
+}
+
+/* the same for ogg_stream_flush(): everything buffered goes out */
 
-  return(ogg_stream_flush_i(os,og,force,nfill));
+int ogg_stream_flush_batch(ogg_stream_state *os,ogg_page_batch *ob){
+  return(ogg_stream_batch_i(os,ob,1,4096));
 }
 
 int ogg_stream_eos(ogg_stream_state *os){
@@ -1003,6 +1313,7 @@ void ogg_packet_clear(ogg_packet *op) {
 
 #ifdef _V_SELFTEST
 #include <stdio.h>
+#include <time.h>
 
 ogg_stream_state os_en, os_de;
 ogg_sync_state oy;
@@ -1658,8 +1969,207 @@ void test_pack(const int *pl, const int **headers, int byteskip,
   fprintf(stderr,"ok.\n");
 }
 
+/* the folded crc against the table, then throughput across page sizes */
+void test_crc(void){
+  static unsigned char buf[65307];
+  static const int sizes[]={27,64,256,1024,4096,65307};
+  unsigned long seed=1;
+  int i,j;
+
+  for(i=0;i<(int)sizeof(buf);i++){
+    seed=seed*1103515245+12345;
+    buf[i]=(unsigned char)(seed>>16);
+  }
+
+  fprintf(stderr,"testing crc against the table... ");
+  for(i=0;i<1200;i++)
+    for(j=0;j<4;j++){
+      ogg_uint32_t crc=(ogg_uint32_t)(i*0x9e3779b9U+j);
+      if(_os_update_crc(crc,buf+j,i)!=_os_table_crc(crc,buf+j,i)){
+        fprintf(stderr,"crc mismatch at size %d offset %d\n",i,j);
+        exit(1);
+      }
+    }
+  fprintf(stderr,"ok.\n");
+
+  for(i=0;i<(int)(sizeof(sizes)/sizeof(*sizes));i++){
+    long bytes=0,reps=(1<<25)/sizes[i];
+    ogg_uint32_t crc=0;
+    clock_t start;
+    double tsecs,fsecs;
+
+    start=clock();
+    for(j=0;j<reps;j++)crc^=_os_table_crc(crc,buf,sizes[i]);
+    tsecs=(double)(clock()-start)/CLOCKS_PER_SEC;
+    start=clock();
+    for(j=0;j<reps;j++)crc^=_os_update_crc(crc,buf,sizes[i]);
+    fsecs=(double)(clock()-start)/CLOCKS_PER_SEC;
+    bytes=reps*sizes[i];
+
+    fprintf(stderr,"crc %5d byte pages: table %6.0f MB/s, update %6.0f MB/s (%x)\n",
+            sizes[i],bytes/(tsecs>0?tsecs:1e-9)/1e6,
+            bytes/(fsecs>0?fsecs:1e-9)/1e6,crc&1);
+  }
+}
+
+/* appends pageout's pages to buf the way a caller writing them out
+   would */
+static long pageout_copy(ogg_stream_state *os,unsigned char *buf,long fill,
+                         int flush){
+  ogg_page og;
+  while(flush?ogg_stream_flush(os,&og):ogg_stream_pageout(os,&og)){
+    memcpy(buf+fill,og.header,og.header_len);
+    memcpy(buf+fill+og.header_len,og.body,og.body_len);
+    fill+=og.header_len+og.body_len;
+  }
+  return fill;
+}
+
+void test_batch(void){
+  static unsigned char packet[70000];
+  static unsigned char wrapped[65307];
+  long total=0,copyfill=0,bytes=0,pos=0,reps;
+  unsigned char *copybuf,*batchbuf;
+  ogg_stream_state oa,ob,oc;
+  ogg_page_batch pool,fixed;
+  ogg_page og;
+  unsigned long seed=7;
+  clock_t start;
+  double csecs,bsecs;
+  int i,pages=0;
+
+  for(i=0;i<(int)sizeof(packet);i++)packet[i]=(unsigned char)(i*31+7);
+
+  fprintf(stderr,"testing batched pageout against pageout... ");
+  ogg_stream_init(&oa,0x11223344);
+  ogg_stream_init(&ob,0x11223344);
+  ogg_stream_init(&oc,0x11223344);
+  ogg_page_batch_init(&pool,1024);
+  ogg_page_batch_wrap(&fixed,wrapped,sizeof(wrapped));
+  copybuf=_ogg_malloc(40000000);
+  batchbuf=_ogg_malloc(40000000);
+
+  for(i=0;i<6000;i++){
+    ogg_packet op;
+    seed=seed*1103515245+12345;
+    op.packet=packet;
+    op.bytes=(seed>>16)%(i%500==0?sizeof(packet):3000);
+    op.b_o_s=(i==0);
+    op.e_o_s=(i==5999);
+    op.granulepos=i*1024;
+    op.packetno=i;
+    total+=op.bytes;
+    ogg_stream_packetin(&oa,&op);
+    ogg_stream_packetin(&ob,&op);
+    ogg_stream_packetin(&oc,&op);
+
+    copyfill=pageout_copy(&oa,copybuf,copyfill,i%1000==999);
+
+    /* drain in runs of several packets into the pooled batch */
+    if(i%7==6 || i%1000==999 || i==5999){
+      int ret=(i%1000==999?ogg_stream_flush_batch(&ob,&pool):
+               ogg_stream_pageout_batch(&ob,&pool));
+      if(ret<0 || ret!=pool.pages){
+        fprintf(stderr,"batch pageout failed\n");
+        exit(1);
+      }
+      memcpy(batchbuf+bytes,pool.data,pool.bytes);
+      bytes+=pool.bytes;
+      pages+=pool.pages;
+      ogg_page_batch_reset(&pool);
+    }
+
+    /* a fixed buffer only takes what fits; the rest waits */
+    while(ogg_stream_pageout_batch(&oc,&fixed)>0){
+      if(memcmp(fixed.data,copybuf+pos,fixed.bytes)){
+        fprintf(stderr,"wrapped batch page mismatch\n");
+        exit(1);
+      }
+      pos+=fixed.bytes;
+      ogg_page_batch_reset(&fixed);
+    }
+    if(i%1000==999){
+      while(ogg_stream_flush_batch(&oc,&fixed)>0){
+        if(memcmp(fixed.data,copybuf+pos,fixed.bytes)){
+          fprintf(stderr,"wrapped batch flush mismatch\n");
+          exit(1);
+        }
+        pos+=fixed.bytes;
+        ogg_page_batch_reset(&fixed);
+      }
+    }
+  }
+  if(bytes!=copyfill || pos!=copyfill || memcmp(batchbuf,copybuf,bytes)){
+    fprintf(stderr,"batched pages differ from pageout (%ld %ld %ld)\n",
+            bytes,pos,copyfill);
+    exit(1);
+  }
+  {
+    long at=0;
+    int n=0;
+    ogg_page_batch all;
+    ogg_page_batch_wrap(&all,batchbuf,bytes);
+    all.bytes=bytes;
+    while(ogg_page_batch_next(&all,&at,&og))n++;
+    if(n!=pages || at!=bytes){
+      fprintf(stderr,"batch walk found %d pages, expected %d\n",n,pages);
+      exit(1);
+    }
+  }
+  fprintf(stderr,"ok.\n");
+
+  /* the same packets paged out one at a time and copied together,
+     against batches, a few packets per run */
+  reps=20;
+  start=clock();
+  for(i=0;i<reps*6000;i++){
+    ogg_packet op;
+    op.packet=packet;
+    op.bytes=200+(i*37)%400;
+    op.b_o_s=0;
+    op.e_o_s=0;
+    op.granulepos=i*1024;
+    op.packetno=i;
+    ogg_stream_packetin(&oa,&op);
+    if(i%4==3)copyfill=pageout_copy(&oa,copybuf,0,0);
+  }
+  csecs=(double)(clock()-start)/CLOCKS_PER_SEC;
+  start=clock();
+  for(i=0;i<reps*6000;i++){
+    ogg_packet op;
+    op.packet=packet;
+    op.bytes=200+(i*37)%400;
+    op.b_o_s=0;
+    op.e_o_s=0;
+    op.granulepos=i*1024;
+    op.packetno=i;
+    ogg_stream_packetin(&ob,&op);
+    if(i%4==3){
+      ogg_stream_pageout_batch(&ob,&pool);
+      ogg_page_batch_reset(&pool);
+    }
+  }
+  bsecs=(double)(clock()-start)/CLOCKS_PER_SEC;
+  fprintf(stderr,"framing %ld MB: pageout and copy %6.0f MB/s, batch %6.0f MB/s\n",
+          (long)(reps*6000*400/1000000),
+          reps*6000*400/(csecs>0?csecs:1e-9)/1e6,
+          reps*6000*400/(bsecs>0?bsecs:1e-9)/1e6);
+
+  _ogg_free(copybuf);
+  _ogg_free(batchbuf);
+  ogg_page_batch_clear(&pool);
+  ogg_page_batch_clear(&fixed);
+  ogg_stream_clear(&oa);
+  ogg_stream_clear(&ob);
+  ogg_stream_clear(&oc);
+  (void)total;
+}
+
 int main(void){
 
+  test_crc();
+  test_batch();
+
   ogg_stream_init(&os_en,0x04030201);
   ogg_stream_init(&os_de,0x04030201);
   ogg_sync_init(&oy);
@@ -46,6 +46,17 @@ typedef struct {
   long body_len;
 } ogg_page;
 
+/* ogg_page_batch holds a run of complete pages back to back, ready for
+   a single write ***********************************************************/
+
+typedef struct {
+  unsigned char *data;
+  long storage;
+  long bytes;                 /* pages stored so far */
+  int  pages;
+  int  owned;                 /* data is ours to grow and free */
+} ogg_page_batch;
+
 /* ogg_stream_state contains the current encode/decode state of a logical
    Ogg bitstream **********************************************************/
 
@@ -161,6 +172,14 @@ extern int      ogg_stream_pageout(ogg_stream_state *os, ogg_page *og);
 extern int      ogg_stream_pageout_fill(ogg_stream_state *os, ogg_page *og, int nfill);
 extern int      ogg_stream_flush(ogg_stream_state *os, ogg_page *og);
 extern int      ogg_stream_flush_fill(ogg_stream_state *os, ogg_page *og, int nfill);
+extern int      ogg_stream_pageout_batch(ogg_stream_state *os, ogg_page_batch *ob);
+extern int      ogg_stream_flush_batch(ogg_stream_state *os, ogg_page_batch *ob);
+
+extern int      ogg_page_batch_init(ogg_page_batch *ob, long storage);
+extern int      ogg_page_batch_wrap(ogg_page_batch *ob, unsigned char *data, long storage);
+extern void     ogg_page_batch_reset(ogg_page_batch *ob);
+extern int      ogg_page_batch_clear(ogg_page_batch *ob);
+extern int      ogg_page_batch_next(const ogg_page_batch *ob, long *pos, ogg_page *og);
 
 /* Ogg BITSTREAM PRIMITIVES: decoding **************************/
 
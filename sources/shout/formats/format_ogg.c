@@ -51,6 +51,7 @@ static int  open_codec(ogg_codec_t *codec, ogg_page *page);
 static void free_codec(ogg_codec_t *codec);
 static void free_codecs(ogg_data_t *ogg_data);
 static int  send_page(shout_t *self, ogg_page *page);
+static int  send_run(shout_t *self, const unsigned char *data, size_t len);
 
 typedef int (*codec_open_t)(ogg_codec_t *codec, ogg_page *page);
 
@@ -92,6 +93,11 @@ static int send_ogg(shout_t *self, const unsigned char *data, size_t len)
     ogg_codec_t *codec;
     char        *buffer;
     ogg_page     page;
+    /* pages sit back to back in the sync buffer, which doesn't move
+     * until the next ogg_sync_buffer(); send each run of them at once */
+    const unsigned char *run = NULL;
+    size_t       runlen = 0;
+    int          ret;
 
     buffer = ogg_sync_buffer(&ogg_data->oy, len);
     memcpy(buffer, data, len);
@@ -106,11 +112,13 @@ static int send_ogg(shout_t *self, const unsigned char *data, size_t len)
 
             codec = calloc(1, sizeof(ogg_codec_t));
             if (! codec) {
+                send_run(self, run, runlen);
                 return self->error = SHOUTERR_MALLOC;
             }
 
-            if ((self->error = open_codec(codec, &page)) != SHOUTERR_SUCCESS) {
-                return self->error;
+            if ((ret = open_codec(codec, &page)) != SHOUTERR_SUCCESS) {
+                send_run(self, run, runlen);
+                return self->error = ret;
             }
 
             codec->headers = 1;
@@ -138,12 +146,26 @@ static int send_ogg(shout_t *self, const unsigned char *data, size_t len)
             }
         }
 
-        if ((self->error = send_page(self, &page)) != SHOUTERR_SUCCESS) {
+        if (run && page.header == run + runlen &&
+            page.body == page.header + page.header_len) {
+            runlen += page.header_len + page.body_len;
+            continue;
+        }
+
+        if ((self->error = send_run(self, run, runlen)) != SHOUTERR_SUCCESS) {
+            return self->error;
+        }
+        run = NULL;
+
+        if (page.body == page.header + page.header_len) {
+            run = page.header;
+            runlen = page.header_len + page.body_len;
+        } else if ((self->error = send_page(self, &page)) != SHOUTERR_SUCCESS) {
             return self->error;
         }
     }
 
-    return self->error = SHOUTERR_SUCCESS;
+    return self->error = send_run(self, run, runlen);
 }
 
 static void close_ogg(shout_t *self)
@@ -217,3 +239,19 @@ static int send_page(shout_t *self, ogg_page *page)
 
     return SHOUTERR_SUCCESS;
 }
+
+static int send_run(shout_t *self, const unsigned char *data, size_t len)
+{
+    ssize_t ret;
+
+    if (!data || !len) {
+        return SHOUTERR_SUCCESS;
+    }
+
+    ret = shout_send_raw(self, data, len);
+    if (ret < 0 || (size_t)ret != len) {
+        return self->error = SHOUTERR_SOCKET;
+    }
+
+    return SHOUTERR_SUCCESS;
+}
@@ -226,6 +226,33 @@ int shout_send(shout_t *self, const unsigned char *data, size_t len)
     return self->send(self, data, len);
 }
 
+int shout_send_frame(shout_t *self, const unsigned char *data, size_t len,
+                     unsigned int samples, unsigned int samplerate)
+{
+    ssize_t ret;
+
+    if (!self)
+        return SHOUTERR_INSANE;
+
+    if (!self->connection || self->connection->current_message_state != SHOUT_MSGSTATE_SENDING1)
+        return self->error = SHOUTERR_UNCONNECTED;
+
+    if (self->starttime <= 0)
+        self->starttime = timing_get_time();
+
+    if (!len)
+        return shout_connection_iter(self->connection, self);
+
+    ret = shout_send_raw(self, data, len);
+    if (ret != (ssize_t)len)
+        return self->error = SHOUTERR_SOCKET;
+
+    if (samplerate)
+        self->senttime += (int64_t)((double)samples / (double)samplerate * 1000000);
+
+    return self->error = SHOUTERR_SUCCESS;
+}
+
 ssize_t shout_send_raw(shout_t *self, const unsigned char *data, size_t len)
 {
     ssize_t ret;
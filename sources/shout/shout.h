@@ -254,6 +254,13 @@ int shout_close(shout_t *self);
 /* Send data to the server, parsing it for format specific timing info */
 int shout_send(shout_t *self, const unsigned char *data, size_t len);
 
+/* Send one whole frame whose duration the caller already knows (such as
+ * the frames from an encoder's frame callback), without parsing it: the
+ * timing for shout_sync/shout_delay advances by samples/samplerate.
+ * Do not mix with shout_send in the middle of a frame. */
+int shout_send_frame(shout_t *self, const unsigned char *data, size_t len,
+                     unsigned int samples, unsigned int samplerate);
+
 /* Send unparsed data to the server.  Do not use this unless you know
  * what you are doing. 
  * Returns the number of bytes written, or < 0 on error.
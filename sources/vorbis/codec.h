@@ -128,6 +128,16 @@ struct alloc_chain{
   struct alloc_chain *next;
 };
 
+/* vorbis_block_get_stats(); encode blocks only.  Sizes are in bytes,
+   counts since vorbis_block_init(). */
+typedef struct vorbis_block_stats{
+  long store_size;   /* local storage held by the block */
+  long store_peak;   /* most of it used by any one block */
+  long store_grows;  /* times it had to be extended */
+  long packet_size;  /* storage held by the packet buffers */
+  long packet_grows; /* times a packet buffer had to be extended */
+} vorbis_block_stats;
+
 /* vorbis_info contains all the setup information specific to the
    specific compression/decompression mode in progress (eg,
    psychoacoustic settings, channel setup, options, codebook
@@ -174,6 +184,8 @@ extern void     vorbis_comment_clear(vorbis_comment *vc);
 
 extern int      vorbis_block_init(vorbis_dsp_state *v, vorbis_block *vb);
 extern int      vorbis_block_clear(vorbis_block *vb);
+extern int      vorbis_block_get_stats(vorbis_block *vb,
+                                       vorbis_block_stats *stats);
 extern void     vorbis_dsp_clear(vorbis_dsp_state *v);
 extern double   vorbis_granule_time(vorbis_dsp_state *v,
                                     ogg_int64_t granulepos);
@@ -193,6 +205,10 @@ extern float  **vorbis_analysis_buffer(vorbis_dsp_state *v,int vals);
 extern int      vorbis_analysis_wrote(vorbis_dsp_state *v,int vals);
 extern int      vorbis_analysis_blockout(vorbis_dsp_state *v,vorbis_block *vb);
 extern int      vorbis_analysis(vorbis_block *vb,ogg_packet *op);
+extern void     vorbis_analysis_cache_clear(void);
+extern int      vorbis_analysis_threads(vorbis_dsp_state *v,int threads);
+extern int      vorbis_analysis_packetout(vorbis_dsp_state *v,
+                                          ogg_packet *op);
 
 extern int      vorbis_bitrate_addblock(vorbis_block *vb);
 extern int      vorbis_bitrate_flushpacket(vorbis_dsp_state *vd,
@@ -29,6 +29,7 @@
 int vorbis_analysis(vorbis_block *vb, ogg_packet *op){
   int ret,i;
   vorbis_block_internal *vbi=vb->internal;
+  long storage[PACKETBLOBS];
 
   vb->glue_bits=0;
   vb->time_bits=0;
@@ -36,8 +37,10 @@ int vorbis_analysis(vorbis_block *vb, ogg_packet *op){
   vb->res_bits=0;
 
   /* first things first.  Make sure encode is ready */
-  for(i=0;i<PACKETBLOBS;i++)
+  for(i=0;i<PACKETBLOBS;i++){
     oggpack_reset(vbi->packetblob[i]);
+    storage[i]=vbi->packetblob[i]->storage;
+  }
 
   /* we only have one mapping type (0), and we let the mapping code
      itself figure out what soft mode to use.  This allows easier
@@ -46,6 +49,9 @@ int vorbis_analysis(vorbis_block *vb, ogg_packet *op){
   if((ret=_mapping_P[0]->forward(vb)))
     return(ret);
 
+  for(i=0;i<PACKETBLOBS;i++)
+    if(vbi->packetblob[i]->storage!=storage[i])vbi->packet_grows++;
+
   if(op){
     if(vorbis_bitrate_managed(vb))
       /* The app is using a bitmanaged mode... but not using the
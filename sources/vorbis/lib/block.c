@@ -28,6 +28,7 @@
 #include "mdct.h"
 #include "lpc.h"
 #include "registry.h"
+#include "setupcache.h"
 #include "misc.h"
 
 /* pcm accumulator examples (not exhaustive):
@@ -74,6 +75,57 @@
 #define WORD_ALIGN 8
 #endif
 
+#define ALIGNED(bytes) (((bytes)+(WORD_ALIGN-1)) & ~(WORD_ALIGN-1))
+
+/* The most any block of this setup takes from the block's local
+   storage, allocation by allocation.  The analysis blocks start out
+   with this much, so an encoder makes no allocator calls for its
+   blocks once running; a miss only costs the old grow-and-consolidate
+   path, and shows up in vorbis_block_get_stats(). */
+static long _analysis_store_size(vorbis_dsp_state *v){
+  vorbis_info *vi=v->vi;
+  codec_setup_info *ci=vi->codec_setup;
+  private_state *b=v->backend_state;
+  int ch=vi->channels;
+  long n=ci->blocksizes[1];
+  int passes=(b->bms.managed?PACKETBLOBS:1);
+  long bytes=0,res=0;
+  int i,j;
+
+  /* vorbis_analysis_blockout(): the pcm with its delay */
+  bytes+=2*ALIGNED(ch*sizeof(float *))+ch*ALIGNED(n*sizeof(float));
+
+  /* mapping0_forward(): the spectra, noise and tone curves and the
+     floor fits, one per packet blob in managed mode */
+  bytes+=3*ALIGNED(ch*sizeof(void *));
+  bytes+=ch*(ALIGNED(n/2*sizeof(int))+ALIGNED(n/2*sizeof(float)));
+  bytes+=2*ALIGNED(n/2*sizeof(float));
+  bytes+=ch*ALIGNED(PACKETBLOBS*sizeof(int *));
+  bytes+=ch*passes*ALIGNED((VIF_POSIT+2)*sizeof(int));
+
+  /* residue classification and coding, for every submap of every
+     packet blob */
+  for(i=0;i<ci->maps;i++){
+    vorbis_info_mapping0 *info=ci->map_param[i];
+    long mapres=0;
+    if(ci->map_type[i]!=0)continue;
+    for(j=0;j<info->submaps;j++){
+      int resnum=info->residuesubmap[j];
+      vorbis_info_residue0 *r=ci->residue_param[resnum];
+      long partvals=(r->end-r->begin)/r->grouping;
+      if(ci->residue_type[resnum]==2)
+        mapres+=ALIGNED(sizeof(long *))+ALIGNED(partvals*sizeof(long))+
+          ALIGNED(ch*n/2*sizeof(int));
+      else
+        mapres+=ALIGNED(ch*sizeof(long *))+ch*ALIGNED(partvals*sizeof(long));
+    }
+    if(mapres>res)res=mapres;
+  }
+  bytes+=passes*res;
+
+  return(bytes);
+}
+
 int vorbis_block_init(vorbis_dsp_state *v, vorbis_block *vb){
   int i;
   memset(vb,0,sizeof(*vb));
@@ -84,6 +136,7 @@ int vorbis_block_init(vorbis_dsp_state *v, vorbis_block *vb){
     vorbis_block_internal *vbi=
       vb->internal=_ogg_calloc(1,sizeof(vorbis_block_internal));
     vbi->ampmax=-9999;
+    vbi->fft_look=((private_state *)v->backend_state)->fft_look;
 
     for(i=0;i<PACKETBLOBS;i++){
       if(i==PACKETBLOBS/2){
@@ -94,14 +147,18 @@ int vorbis_block_init(vorbis_dsp_state *v, vorbis_block *vb){
       }
       oggpack_writeinit(vbi->packetblob[i]);
     }
+
+    vb->localalloc=_analysis_store_size(v);
+    vb->localstore=_ogg_malloc(vb->localalloc);
   }
 
   return(0);
 }
 
 void *_vorbis_block_alloc(vorbis_block *vb,long bytes){
-  bytes=(bytes+(WORD_ALIGN-1)) & ~(WORD_ALIGN-1);
+  bytes=ALIGNED(bytes);
   if(bytes+vb->localtop>vb->localalloc){
+    if(vb->internal)((vorbis_block_internal *)vb->internal)->store_grows++;
     /* can't just _ogg_realloc... there are outstanding pointers */
     if(vb->localstore){
       struct alloc_chain *link=_ogg_malloc(sizeof(*link));
@@ -126,6 +183,9 @@ void *_vorbis_block_alloc(vorbis_block *vb,long bytes){
 void _vorbis_block_ripcord(vorbis_block *vb){
   /* reap the chain */
   struct alloc_chain *reap=vb->reap;
+  vorbis_block_internal *vbi=vb->internal;
+  if(vbi && vb->totaluse+vb->localtop>vbi->store_peak)
+    vbi->store_peak=vb->totaluse+vb->localtop;
   while(reap){
     struct alloc_chain *next=reap->next;
     _ogg_free(reap->ptr);
@@ -163,6 +223,22 @@ int vorbis_block_clear(vorbis_block *vb){
   return(0);
 }
 
+int vorbis_block_get_stats(vorbis_block *vb,vorbis_block_stats *stats){
+  vorbis_block_internal *vbi=vb->internal;
+  long used=vb->totaluse+vb->localtop;
+  int i;
+
+  if(!vbi)return(OV_EINVAL);
+  memset(stats,0,sizeof(*stats));
+  stats->store_size=vb->localalloc+vb->totaluse;
+  stats->store_peak=(used>vbi->store_peak?used:vbi->store_peak);
+  stats->store_grows=vbi->store_grows;
+  for(i=0;i<PACKETBLOBS;i++)
+    stats->packet_size+=vbi->packetblob[i]->storage;
+  stats->packet_grows=vbi->packet_grows;
+  return(0);
+}
+
 /* Analysis side code, but directly related to blocking.  Thus it's
    here and not in analysis.c (which is for analysis transforms only).
    The init is here because some of it is shared */
@@ -187,15 +263,24 @@ static int _vds_shared_init(vorbis_dsp_state *v,vorbis_info *vi,int encp){
   v->vi=vi;
   b->modebits=ov_ilog(ci->modes-1);
 
+  /* encoders of the same setup share their read only lookups */
+  if(encp)
+    b->shared=_vorbis_setup_cache_get(vi);
+
   b->transform[0]=_ogg_calloc(VI_TRANSFORMB,sizeof(*b->transform[0]));
   b->transform[1]=_ogg_calloc(VI_TRANSFORMB,sizeof(*b->transform[1]));
 
   /* MDCT is tranform 0 */
 
-  b->transform[0][0]=_ogg_calloc(1,sizeof(mdct_lookup));
-  b->transform[1][0]=_ogg_calloc(1,sizeof(mdct_lookup));
-  mdct_init(b->transform[0][0],ci->blocksizes[0]>>hs);
-  mdct_init(b->transform[1][0],ci->blocksizes[1]>>hs);
+  if(b->shared){
+    b->transform[0][0]=&b->shared->mdct[0];
+    b->transform[1][0]=&b->shared->mdct[1];
+  }else{
+    b->transform[0][0]=_ogg_calloc(1,sizeof(mdct_lookup));
+    b->transform[1][0]=_ogg_calloc(1,sizeof(mdct_lookup));
+    mdct_init(b->transform[0][0],ci->blocksizes[0]>>hs);
+    mdct_init(b->transform[1][0],ci->blocksizes[1]>>hs);
+  }
 
   /* Vorbis I uses only window type 0 */
   /* note that the correct computation below is technically:
@@ -215,18 +300,28 @@ static int _vds_shared_init(vorbis_dsp_state *v,vorbis_info *vi,int encp){
 
     /* finish the codebooks */
     if(!ci->fullbooks){
-      ci->fullbooks=_ogg_calloc(ci->books,sizeof(*ci->fullbooks));
-      for(i=0;i<ci->books;i++)
-        vorbis_book_init_encode(ci->fullbooks+i,ci->book_param[i]);
+      if(b->shared){
+        ci->fullbooks=b->shared->fullbooks;
+        ci->fullbooks_shared=b->shared;
+        _vorbis_setup_cache_ref(b->shared);
+      }else{
+        ci->fullbooks=_ogg_calloc(ci->books,sizeof(*ci->fullbooks));
+        for(i=0;i<ci->books;i++)
+          vorbis_book_init_encode(ci->fullbooks+i,ci->book_param[i]);
+      }
     }
 
-    b->psy=_ogg_calloc(ci->psys,sizeof(*b->psy));
-    for(i=0;i<ci->psys;i++){
-      _vp_psy_init(b->psy+i,
-                   ci->psy_param[i],
-                   &ci->psy_g_param,
-                   ci->blocksizes[ci->psy_param[i]->blockflag]/2,
-                   vi->rate);
+    if(b->shared){
+      b->psy=b->shared->psy;
+    }else{
+      b->psy=_ogg_calloc(ci->psys,sizeof(*b->psy));
+      for(i=0;i<ci->psys;i++){
+        _vp_psy_init(b->psy+i,
+                     ci->psy_param[i],
+                     &ci->psy_g_param,
+                     ci->blocksizes[ci->psy_param[i]->blockflag]/2,
+                     vi->rate);
+      }
     }
 
     v->analysisp=1;
@@ -321,19 +416,26 @@ void vorbis_dsp_clear(vorbis_dsp_state *v){
 
     if(b){
 
+      /* first; the workers use the lookups below */
+      if(b->pipeline)_vorbis_pipeline_free(b->pipeline);
+
       if(b->ve){
         _ve_envelope_clear(b->ve);
         _ogg_free(b->ve);
       }
 
       if(b->transform[0]){
-        mdct_clear(b->transform[0][0]);
-        _ogg_free(b->transform[0][0]);
+        if(!b->shared){
+          mdct_clear(b->transform[0][0]);
+          _ogg_free(b->transform[0][0]);
+        }
         _ogg_free(b->transform[0]);
       }
       if(b->transform[1]){
-        mdct_clear(b->transform[1][0]);
-        _ogg_free(b->transform[1][0]);
+        if(!b->shared){
+          mdct_clear(b->transform[1][0]);
+          _ogg_free(b->transform[1][0]);
+        }
         _ogg_free(b->transform[1]);
       }
 
@@ -351,7 +453,7 @@ void vorbis_dsp_clear(vorbis_dsp_state *v){
               free_look(b->residue[i]);
         _ogg_free(b->residue);
       }
-      if(b->psy){
+      if(b->psy && !b->shared){
         if(ci)
           for(i=0;i<ci->psys;i++)
             _vp_psy_clear(b->psy+i);
@@ -364,6 +466,8 @@ void vorbis_dsp_clear(vorbis_dsp_state *v){
       drft_clear(&b->fft_look[0]);
       drft_clear(&b->fft_look[1]);
 
+      /* after the residue looks, which may point into it */
+      if(b->shared)_vorbis_setup_cache_release(b->shared);
     }
 
     if(v->pcm){
@@ -614,7 +718,7 @@ int vorbis_analysis_blockout(vorbis_dsp_state *v,vorbis_block *vb){
   /* this tracks 'strongest peak' for later psychoacoustics */
   /* moved to the global psy state; clean this mess up */
   if(vbi->ampmax>g->ampmax)g->ampmax=vbi->ampmax;
-  g->ampmax=_vp_ampmax_decay(g->ampmax,v);
+  g->ampmax=_vp_ampmax_decay(g->ampmax,vb);
   vbi->ampmax=g->ampmax;
 
   vb->pcm=_vorbis_block_alloc(vb,sizeof(*vb->pcm)*vi->channels);
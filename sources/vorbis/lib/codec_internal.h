@@ -19,6 +19,7 @@
 
 #include "envelope.h"
 #include "codebook.h"
+#include "smallft.h"
 
 #define BLOCKTYPE_IMPULSE    0
 #define BLOCKTYPE_PADDING    1
@@ -32,6 +33,15 @@ typedef struct vorbis_block_internal{
   float  ampmax;
   int    blocktype;
 
+  drft_lookup *fft_look;      /* the dsp state's, or the block's own
+                                 when blocks are analyzed in parallel */
+  struct vorbis_pipeline_slot *pipeline_slot; /* see pipeline.c */
+
+  /* see vorbis_block_get_stats() */
+  long   store_peak;
+  long   store_grows;
+  long   packet_grows;
+
   oggpack_buffer *packetblob[PACKETBLOBS]; /* initialized, must be freed;
                                               blob [PACKETBLOBS/2] points to
                                               the oggpack_buffer in the
@@ -57,6 +67,9 @@ typedef void vorbis_info_mapping;
 #include "psy.h"
 #include "bitrate.h"
 
+struct vorbis_shared_setup;
+struct vorbis_pipeline;
+
 typedef struct private_state {
   /* local lookup storage */
   envelope_lookup        *ve; /* envelope lookup */
@@ -81,8 +94,19 @@ typedef struct private_state {
   bitrate_manager_state bms;
 
   ogg_int64_t sample_count;
+
+  /* encode only; when set, transform, psy and the residue search
+     tables belong to this shared entry */
+  struct vorbis_shared_setup *shared;
+
+  /* encode only; set by vorbis_analysis_threads() */
+  struct vorbis_pipeline *pipeline;
 } private_state;
 
+extern void _vorbis_pipeline_ampmax(vorbis_block *vb,
+                                    const float *local_ampmax);
+extern void _vorbis_pipeline_free(struct vorbis_pipeline *p);
+
 /* codec_setup_info contains all the setup information specific to the
    specific compression/decompression mode in progress (eg,
    psychoacoustic settings, channel setup, options, codebook
@@ -118,6 +142,8 @@ typedef struct codec_setup_info {
   vorbis_info_residue    *residue_param[64];
   static_codebook        *book_param[256];
   codebook               *fullbooks;
+  struct vorbis_shared_setup *fullbooks_shared; /* owner of fullbooks
+                                                   when shared, encode only */
 
   vorbis_info_psy        *psy_param[4]; /* encode only */
   vorbis_info_psy_global psy_g_param;
@@ -146,10 +172,6 @@ typedef struct {
   int n;
   int quant_q;
   vorbis_info_floor1 *vi;
-
-  long phrasebits;
-  long postbits;
-  long frames;
 } vorbis_look_floor1;
 
 
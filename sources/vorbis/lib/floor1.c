@@ -24,28 +24,24 @@
 #include "codebook.h"
 #include "misc.h"
 #include "scales.h"
+#include "os.h"
 
 #include <stdio.h>
 
 #define floor1_rangedB 140 /* floor 1 fixed at -140dB to 0dB range */
 
+/* the weighted sums of one minimal division; fit_line() adds up a
+   run of them */
 typedef struct lsfit_acc{
   int x0;
   int x1;
 
-  int xa;
-  int ya;
-  int x2a;
-  int y2a;
-  int xya;
-  int an;
-
-  int xb;
-  int yb;
-  int x2b;
-  int y2b;
-  int xyb;
-  int bn;
+  double x;
+  double y;
+  double x2;
+  double y2;
+  double xy;
+  double n;
 } lsfit_acc;
 
 /***********************************************/
@@ -61,11 +57,6 @@ static void floor1_free_info(vorbis_info_floor *i){
 static void floor1_free_look(vorbis_look_floor *i){
   vorbis_look_floor1 *look=(vorbis_look_floor1 *)i;
   if(look){
-    /*fprintf(stderr,"floor 1 bit usage %f:%f (%f total)\n",
-            (float)look->phrasebits/look->frames,
-            (float)look->postbits/look->frames,
-            (float)(look->postbits+look->phrasebits)/look->frames);*/
-
     memset(look,0,sizeof(*look));
     _ogg_free(look);
   }
@@ -402,23 +393,24 @@ static void render_line0(int n, int x0,int x1,int y0,int y1,int *d){
   }
 }
 
-/* the floor has already been filtered to only include relevant sections */
-static int accumulate_fit(const float *flr,const float *mdct,
+/* the floor has already been filtered to only include relevant sections;
+   quant and above come from floor1_fit() */
+static int accumulate_fit(const int *quant,const unsigned char *above,
                           int x0, int x1,lsfit_acc *a,
                           int n,vorbis_info_floor1 *info){
   long i;
 
   int xa=0,ya=0,x2a=0,y2a=0,xya=0,na=0, xb=0,yb=0,x2b=0,y2b=0,xyb=0,nb=0;
+  double weight;
 
-  memset(a,0,sizeof(*a));
   a->x0=x0;
   a->x1=x1;
   if(x1>=n)x1=n-1;
 
   for(i=x0;i<=x1;i++){
-    int quantized=vorbis_dBquant(flr+i);
+    int quantized=quant[i];
     if(quantized){
-      if(mdct[i]+info->twofitatten>=flr[i]){
+      if(above[i]){
         xa  += i;
         ya  += quantized;
         x2a += i*i;
@@ -436,19 +428,15 @@ static int accumulate_fit(const float *flr,const float *mdct,
     }
   }
 
-  a->xa=xa;
-  a->ya=ya;
-  a->x2a=x2a;
-  a->y2a=y2a;
-  a->xya=xya;
-  a->an=na;
-
-  a->xb=xb;
-  a->yb=yb;
-  a->x2b=x2b;
-  a->y2b=y2b;
-  a->xyb=xyb;
-  a->bn=nb;
+  /* the weighting depends only on this division, so it is applied
+     once here rather than by every fit_line() over it */
+  weight = (nb+na)*info->twofitweight/(na+1)+1.;
+  a->x  = xb + xa * weight;
+  a->y  = yb + ya * weight;
+  a->x2 = x2b + x2a * weight;
+  a->y2 = y2b + y2a * weight;
+  a->xy = xyb + xya * weight;
+  a->n  = nb + na * weight;
 
   return(na);
 }
@@ -460,15 +448,15 @@ static int fit_line(lsfit_acc *a,int fits,int *y0,int *y1,
   int x0=a[0].x0;
   int x1=a[fits-1].x1;
 
+  /* summed in order rather than from running totals, whose
+     differences would round differently and could move the posts */
   for(i=0;i<fits;i++){
-    double weight = (a[i].bn+a[i].an)*info->twofitweight/(a[i].an+1)+1.;
-
-    xb+=a[i].xb + a[i].xa * weight;
-    yb+=a[i].yb + a[i].ya * weight;
-    x2b+=a[i].x2b + a[i].x2a * weight;
-    y2b+=a[i].y2b + a[i].y2a * weight;
-    xyb+=a[i].xyb + a[i].xya * weight;
-    bn+=a[i].bn + a[i].an * weight;
+    xb+=a[i].x;
+    yb+=a[i].y;
+    x2b+=a[i].x2;
+    y2b+=a[i].y2;
+    xyb+=a[i].xy;
+    bn+=a[i].n;
   }
 
   if(*y0>=0){
@@ -513,8 +501,8 @@ static int fit_line(lsfit_acc *a,int fits,int *y0,int *y1,
   }
 }
 
-static int inspect_error(int x0,int x1,int y0,int y1,const float *mask,
-                         const float *mdct,
+static int inspect_error(int x0,int x1,int y0,int y1,const int *quant,
+                         const unsigned char *above,
                          vorbis_info_floor1 *info){
   int dy=y1-y0;
   int adx=x1-x0;
@@ -524,7 +512,7 @@ static int inspect_error(int x0,int x1,int y0,int y1,const float *mask,
   int x=x0;
   int y=y0;
   int err=0;
-  int val=vorbis_dBquant(mask+x);
+  int val=quant[x];
   int mse=0;
   int n=0;
 
@@ -533,7 +521,7 @@ static int inspect_error(int x0,int x1,int y0,int y1,const float *mask,
   mse=(y-val);
   mse*=mse;
   n++;
-  if(mdct[x]+info->twofitatten>=mask[x]){
+  if(above[x]){
     if(y+info->maxover<val)return(1);
     if(y-info->maxunder>val)return(1);
   }
@@ -547,10 +535,10 @@ static int inspect_error(int x0,int x1,int y0,int y1,const float *mask,
       y+=base;
     }
 
-    val=vorbis_dBquant(mask+x);
+    val=quant[x];
     mse+=((y-val)*(y-val));
     n++;
-    if(mdct[x]+info->twofitatten>=mask[x]){
+    if(above[x]){
       if(val){
         if(y+info->maxover<val)return(1);
         if(y-info->maxunder>val)return(1);
@@ -589,6 +577,8 @@ int *floor1_fit(vorbis_block *vb,vorbis_look_floor1 *look,
   int hineighbor[VIF_POSIT+2];
   int *output=NULL;
   int memo[VIF_POSIT+2];
+  int *quant=alloca(n*sizeof(*quant));
+  unsigned char *above=alloca(n*sizeof(*above));
 
   for(i=0;i<posts;i++)fit_valueA[i]=-200; /* mark all unused */
   for(i=0;i<posts;i++)fit_valueB[i]=-200; /* mark all unused */
@@ -596,13 +586,20 @@ int *floor1_fit(vorbis_block *vb,vorbis_look_floor1 *look,
   for(i=0;i<posts;i++)hineighbor[i]=1; /* 1 for the implicit post at n */
   for(i=0;i<posts;i++)memo[i]=-1;      /* no neighbor yet */
 
-  /* quantize the relevant floor points and collect them into line fit
-     structures (one per minimal division) at the same time */
+  /* quantize the floor once; the line fits and the error checks of
+     the splitting below visit the same points many times */
+  for(i=0;i<n;i++){
+    quant[i]=vorbis_dBquant(logmask+i);
+    above[i]=(logmdct[i]+info->twofitatten>=logmask[i]);
+  }
+
+  /* collect the floor points into line fit structures (one per
+     minimal division) */
   if(posts==0){
-    nonzero+=accumulate_fit(logmask,logmdct,0,n,fits,n,info);
+    nonzero+=accumulate_fit(quant,above,0,n,fits,n,info);
   }else{
     for(i=0;i<posts-1;i++)
-      nonzero+=accumulate_fit(logmask,logmdct,look->sorted_index[i],
+      nonzero+=accumulate_fit(quant,above,look->sorted_index[i],
                               look->sorted_index[i+1],fits+i,
                               n,info);
   }
@@ -645,7 +642,7 @@ int *floor1_fit(vorbis_block *vb,vorbis_look_floor1 *look,
             exit(1);
           }
 
-          if(inspect_error(lx,hx,ly,hy,logmask,logmdct,info)){
+          if(inspect_error(lx,hx,ly,hy,quant,above,info)){
             /* outside error bounds/begin search area.  Split it. */
             int ly0=-200;
             int ly1=-200;
@@ -835,8 +832,6 @@ int floor1_encode(oggpack_buffer *opb,vorbis_block *vb,
     oggpack_write(opb,1,1);
 
     /* beginning/end post */
-    look->frames++;
-    look->postbits+=ov_ilog(look->quant_q-1)*2;
     oggpack_write(opb,out[0],ov_ilog(look->quant_q-1));
     oggpack_write(opb,out[1],ov_ilog(look->quant_q-1));
 
@@ -877,8 +872,7 @@ int floor1_encode(oggpack_buffer *opb,vorbis_block *vb,
           cshift+=csubbits;
         }
         /* write it */
-        look->phrasebits+=
-          vorbis_book_encode(books+info->class_book[class],cval,opb);
+        vorbis_book_encode(books+info->class_book[class],cval,opb);
 
 #ifdef TRAIN_FLOOR1
         {
@@ -899,8 +893,7 @@ int floor1_encode(oggpack_buffer *opb,vorbis_block *vb,
         if(book>=0){
           /* hack to allow training with 'bad' books */
           if(out[j+k]<(books+book)->entries)
-            look->postbits+=vorbis_book_encode(books+book,
-                                               out[j+k],opb);
+            vorbis_book_encode(books+book,out[j+k],opb);
           /*else
             fprintf(stderr,"+!");*/
 
@@ -26,6 +26,7 @@
 #include "registry.h"
 #include "window.h"
 #include "psy.h"
+#include "setupcache.h"
 #include "misc.h"
 #include "os.h"
 
@@ -187,10 +188,12 @@ void vorbis_info_clear(vorbis_info *vi){
         /* knows if the book was not alloced */
         vorbis_staticbook_destroy(ci->book_param[i]);
       }
-      if(ci->fullbooks)
+      if(ci->fullbooks && !ci->fullbooks_shared)
         vorbis_book_clear(ci->fullbooks+i);
     }
-    if(ci->fullbooks)
+    if(ci->fullbooks_shared)
+      _vorbis_setup_cache_release(ci->fullbooks_shared);
+    else if(ci->fullbooks)
         _ogg_free(ci->fullbooks);
 
     for(i=0;i<ci->psys;i++)
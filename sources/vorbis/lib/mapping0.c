@@ -154,6 +154,12 @@ static vorbis_info_mapping *mapping0_unpack(vorbis_info *vi,oggpack_buffer *opb)
 #include "psy.h"
 #include "scales.h"
 
+/* log power loops four bins at a time; the .345 below is added in
+   double like the scalar statements do, so the results are the same */
+#if defined(VORBIS_SIMD_TODB) && defined(VORBIS_SIMD_DOUBLE)
+#define MAPPING0_SIMD
+#endif
+
 #if 0
 static long seq=0;
 static ogg_int64_t total=0;
@@ -241,7 +247,7 @@ static int mapping0_forward(vorbis_block *vb){
   int    **iwork      = _vorbis_block_alloc(vb,vi->channels*sizeof(*iwork));
   int ***floor_posts = _vorbis_block_alloc(vb,vi->channels*sizeof(*floor_posts));
 
-  float global_ampmax=vbi->ampmax;
+  float global_ampmax;
   float *local_ampmax=alloca(sizeof(*local_ampmax)*vi->channels);
   int blocktype=vbi->blocktype;
 
@@ -306,7 +312,7 @@ static int mapping0_forward(vorbis_block *vb){
     mdct_forward(b->transform[vb->W][0],pcm,gmdct[i]);
 
     /* FFT yields more accurate tonal estimation (not phase sensitive) */
-    drft_forward(&b->fft_look[vb->W],pcm);
+    drft_forward(vbi->fft_look+vb->W,pcm);
     logfft[0]=scale_dB+todB(pcm)  + .345; /* + .345 is a hack; the
                                      original todB estimation used on
                                      IEEE 754 compliant machines had a
@@ -322,7 +328,23 @@ static int mapping0_forward(vorbis_block *vb){
                                      recalibrate the tunings in the
                                      next major model upgrade. */
     local_ampmax[i]=logfft[0];
-    for(j=1;j<n-1;j+=2){
+    j=1;
+#ifdef MAPPING0_SIMD
+    {
+      v4sf max=v_dup(local_ampmax[i]);
+      for(;j+6<n-1;j+=8){
+        v4sf re,im,v;
+        v_load2(pcm+j,&re,&im);
+        v=v_add(v_mul(re,re),v_mul(im,im));
+        v=v_add(v_dup(scale_dB),v_mul(v_dup(.5f),v_todB(v)));
+        v=v_add_double(v,.345);
+        v_store(logfft+((j+1)>>1),v);
+        max=v_max(max,v);
+      }
+      local_ampmax[i]=v_hmax(max);
+    }
+#endif
+    for(;j<n-1;j+=2){
       float temp=pcm[j]*pcm[j]+pcm[j+1]*pcm[j+1];
       temp=logfft[(j+1)>>1]=scale_dB+.5f*todB(&temp)  + .345; /* +
                                      .345 is a hack; the original todB
@@ -343,7 +365,6 @@ static int mapping0_forward(vorbis_block *vb){
     }
 
     if(local_ampmax[i]>0.f)local_ampmax[i]=0.f;
-    if(local_ampmax[i]>global_ampmax)global_ampmax=local_ampmax[i];
 
 #if 0
     if(vi->channels==2){
@@ -359,6 +380,13 @@ static int mapping0_forward(vorbis_block *vb){
 
   }
 
+  /* with several blocks in flight, the amplitude tracked through the
+     blocks before this one is only known once their spectra are */
+  if(vbi->pipeline_slot)_vorbis_pipeline_ampmax(vb,local_ampmax);
+  global_ampmax=vbi->ampmax;
+  for(i=0;i<vi->channels;i++)
+    if(local_ampmax[i]>global_ampmax)global_ampmax=local_ampmax[i];
+
   {
     float   *noise        = _vorbis_block_alloc(vb,n/2*sizeof(*noise));
     float   *tone         = _vorbis_block_alloc(vb,n/2*sizeof(*tone));
@@ -381,7 +409,12 @@ static int mapping0_forward(vorbis_block *vb){
       floor_posts[i]=_vorbis_block_alloc(vb,PACKETBLOBS*sizeof(**floor_posts));
       memset(floor_posts[i],0,sizeof(**floor_posts)*PACKETBLOBS);
 
-      for(j=0;j<n/2;j++)
+      j=0;
+#ifdef MAPPING0_SIMD
+      for(;j+3<n/2;j+=4)
+        v_store(logmdct+j,v_add_double(v_todB(v_load(mdct+j)),.345));
+#endif
+      for(;j<n/2;j++)
         logmdct[j]=todB(mdct+j)  + .345; /* + .345 is a hack; the original
                                      todB estimation used on IEEE 754
                                      compliant machines had a bug that
@@ -44,6 +44,52 @@
 #include "mdct.h"
 #include "os.h"
 #include "misc.h"
+#include "simd.h"
+
+/* SSE2/NEON versions of the generic butterflies and the forward
+   rotations do the same float operations in the same order as the
+   scalar code, four lanes at a time. */
+#if defined(VORBIS_SIMD) && !defined(MDCT_INTEGERIZED)
+#define MDCT_SIMD
+
+/* rotates the two pairs [r0 r1] of r by the pairs [t0 t1] of t into
+   [r1*t1+r0*t0 r1*t0-r0*t1] */
+STIN v4sf v_rotate(v4sf r,v4sf t){
+#ifdef VORBIS_SIMD_SSE
+  __m128 p=_mm_mul_ps(r,t);
+  __m128 q=_mm_mul_ps(_mm_shuffle_ps(r,r,_MM_SHUFFLE(2,3,0,1)),t);
+  __m128 a=_mm_shuffle_ps(p,q,_MM_SHUFFLE(2,0,2,0));
+  __m128 b=_mm_shuffle_ps(p,q,_MM_SHUFFLE(3,1,3,1));
+  __m128 s=_mm_add_ps(a,b);
+  __m128 d=_mm_sub_ps(a,b);
+  return _mm_unpacklo_ps(s,_mm_movehl_ps(d,d));
+#else
+  float32x4_t p=vmulq_f32(r,t);
+  float32x4_t q=vmulq_f32(vrev64q_f32(r),t);
+  float32x4x2_t u=vuzpq_f32(p,q);
+  float32x2_t s=vadd_f32(vget_low_f32(u.val[0]),vget_low_f32(u.val[1]));
+  float32x2_t d=vsub_f32(vget_high_f32(u.val[0]),vget_high_f32(u.val[1]));
+  float32x2x2_t z=vzip_f32(s,d);
+  return vcombine_f32(z.val[0],z.val[1]);
+#endif
+}
+
+/* one step of the first/generic butterfly; T0..T3 are the trig pairs
+   for x[6], x[4], x[2] and x[0] */
+STIN void mdct_butterfly_step(DATA_TYPE *x1,DATA_TYPE *x2,
+                              const DATA_TYPE *T0,const DATA_TYPE *T1,
+                              const DATA_TYPE *T2,const DATA_TYPE *T3){
+  v4sf a=v_load(x1);
+  v4sf b=v_load(x2);
+  v_store(x1,v_add(a,b));
+  v_store(x2,v_rotate(v_sub(a,b),v_pairs(T3,T2)));
+
+  a=v_load(x1+4);
+  b=v_load(x2+4);
+  v_store(x1+4,v_add(a,b));
+  v_store(x2+4,v_rotate(v_sub(a,b),v_pairs(T1,T0)));
+}
+#endif
 
 /* build lookups for trig functions; also pre-figure scaling and
    some window function algebra. */
@@ -219,11 +265,16 @@ STIN void mdct_butterfly_first(DATA_TYPE *T,
 
   DATA_TYPE *x1        = x          + points      - 8;
   DATA_TYPE *x2        = x          + (points>>1) - 8;
+#ifndef MDCT_SIMD
   REG_TYPE   r0;
   REG_TYPE   r1;
+#endif
 
   do{
 
+#ifdef MDCT_SIMD
+    mdct_butterfly_step(x1,x2,T,T+4,T+8,T+12);
+#else
                r0      = x1[6]      -  x2[6];
                r1      = x1[7]      -  x2[7];
                x1[6]  += x2[6];
@@ -251,6 +302,7 @@ STIN void mdct_butterfly_first(DATA_TYPE *T,
                x1[1]  += x2[1];
                x2[0]   = MULT_NORM(r1 * T[13] +  r0 * T[12]);
                x2[1]   = MULT_NORM(r1 * T[12] -  r0 * T[13]);
+#endif
 
     x1-=8;
     x2-=8;
@@ -267,11 +319,17 @@ STIN void mdct_butterfly_generic(DATA_TYPE *T,
 
   DATA_TYPE *x1        = x          + points      - 8;
   DATA_TYPE *x2        = x          + (points>>1) - 8;
+#ifndef MDCT_SIMD
   REG_TYPE   r0;
   REG_TYPE   r1;
+#endif
 
   do{
 
+#ifdef MDCT_SIMD
+    mdct_butterfly_step(x1,x2,T,T+trigint,T+trigint*2,T+trigint*3);
+    T+=trigint*4;
+#else
                r0      = x1[6]      -  x2[6];
                r1      = x1[7]      -  x2[7];
                x1[6]  += x2[6];
@@ -307,6 +365,7 @@ STIN void mdct_butterfly_generic(DATA_TYPE *T,
                x2[1]   = MULT_NORM(r1 * T[0]  -  r0 * T[1]);
 
                T+=trigint;
+#endif
     x1-=8;
     x2-=8;
 
@@ -501,14 +560,54 @@ void mdct_forward(mdct_lookup *init, DATA_TYPE *in, DATA_TYPE *out){
 
   /* window + rotate + step 1 */
 
+#ifndef MDCT_SIMD
   REG_TYPE r0;
   REG_TYPE r1;
+#endif
   DATA_TYPE *x0=in+n2+n4;
   DATA_TYPE *x1=x0+1;
   DATA_TYPE *T=init->trig+n2;
 
   int i=0;
 
+#ifdef MDCT_SIMD
+  /* two steps of each loop below per vector; x1 is read from x1[-1]
+     so the loads never reach past the end of the input */
+  for(i=0;i<n8;i+=4){
+    v4sf a,b,skip;
+    v_load2(x0-8,&a,&skip);
+    v_load2(x1-1,&skip,&b);
+    x0 -=8;
+    T-=4;
+    v_store(w2+i,v_rotate(v_add(v_reverse(a),b),v_swaphalves(v_load(T))));
+    x1 +=8;
+  }
+
+  x1=in+1;
+
+  for(;i<n2-n8;i+=4){
+    v4sf a,b,skip;
+    v_load2(x0-8,&a,&skip);
+    v_load2(x1-1,&skip,&b);
+    x0 -=8;
+    T-=4;
+    v_store(w2+i,v_rotate(v_sub(v_reverse(a),b),v_swaphalves(v_load(T))));
+    x1 +=8;
+  }
+
+  x0=in+n;
+
+  for(;i<n2;i+=4){
+    v4sf a,b,skip;
+    v_load2(x0-8,&a,&skip);
+    v_load2(x1-1,&skip,&b);
+    x0 -=8;
+    T-=4;
+    v_store(w2+i,v_rotate(v_sub(v_neg(v_reverse(a)),b),
+                          v_swaphalves(v_load(T))));
+    x1 +=8;
+  }
+#else
   for(i=0;i<n8;i+=2){
     x0 -=4;
     T-=2;
@@ -542,6 +641,7 @@ void mdct_forward(mdct_lookup *init, DATA_TYPE *in, DATA_TYPE *out){
     w2[i+1]= MULT_NORM(r1*T[0] - r0*T[1]);
     x1 +=4;
   }
+#endif
 
 
   mdct_butterflies(init,w+n2,n2);
@@ -552,6 +652,21 @@ void mdct_forward(mdct_lookup *init, DATA_TYPE *in, DATA_TYPE *out){
   T=init->trig+n2;
   x0=out+n2;
 
+#ifdef MDCT_SIMD
+  {
+    v4sf scale=v_dup(init->scale);
+    for(i=0;i<n4;i+=4){
+      v4sf w0,w1,T0,T1;
+      x0-=4;
+      v_load2(w,&w0,&w1);
+      v_load2(T,&T0,&T1);
+      v_store(out+i,v_mul(v_add(v_mul(w0,T0),v_mul(w1,T1)),scale));
+      v_store(x0,v_reverse(v_mul(v_sub(v_mul(w0,T1),v_mul(w1,T0)),scale)));
+      w+=8;
+      T+=8;
+    }
+  }
+#else
   for(i=0;i<n4;i++){
     x0--;
     out[i] =MULT_NORM((w[0]*T[0]+w[1]*T[1])*init->scale);
@@ -559,4 +674,5 @@ void mdct_forward(mdct_lookup *init, DATA_TYPE *in, DATA_TYPE *out){
     w+=2;
     T+=2;
   }
+#endif
 }
@@ -0,0 +1,371 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2010             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: block analysis spread over several threads
+
+ The calling thread cuts blocks with vorbis_analysis_blockout() into
+ a ring of vorbis_blocks, worker threads run the mapping's forward
+ transform on several of them at once, and the calling thread hands
+ the finished blocks to the bitrate manager in order.
+
+ The one thing carried from one block's analysis into the next is the
+ tracked peak amplitude (ampmax).  Each block publishes the peak of
+ its own spectrum as soon as its FFT is done; the chain is then
+ resolved in block order with the same operations the serial path
+ uses, so the packets do not change.
+
+ ********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "ogg.h"
+#include "codec.h"
+#include "codec_internal.h"
+#include "misc.h"
+#include "os.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+typedef SRWLOCK            pipe_lock;
+typedef CONDITION_VARIABLE pipe_cond;
+typedef HANDLE             pipe_thread;
+#define pipe_lock_init(l)      InitializeSRWLock(l)
+#define pipe_lock_destroy(l)
+#define pipe_lock_acquire(l)   AcquireSRWLockExclusive(l)
+#define pipe_lock_release(l)   ReleaseSRWLockExclusive(l)
+#define pipe_cond_init(c)      InitializeConditionVariable(c)
+#define pipe_cond_destroy(c)
+#define pipe_cond_wait(c,l)    SleepConditionVariableSRW(c,l,INFINITE,0)
+#define pipe_cond_broadcast(c) WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+typedef pthread_mutex_t    pipe_lock;
+typedef pthread_cond_t     pipe_cond;
+typedef pthread_t          pipe_thread;
+#define pipe_lock_init(l)      pthread_mutex_init(l,NULL)
+#define pipe_lock_destroy(l)   pthread_mutex_destroy(l)
+#define pipe_lock_acquire(l)   pthread_mutex_lock(l)
+#define pipe_lock_release(l)   pthread_mutex_unlock(l)
+#define pipe_cond_init(c)      pthread_cond_init(c,NULL)
+#define pipe_cond_destroy(c)   pthread_cond_destroy(c)
+#define pipe_cond_wait(c,l)    pthread_cond_wait(c,l)
+#define pipe_cond_broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+/* blocks in the ring per thread; enough to keep the workers busy
+   while the calling thread waits on the oldest block */
+#define PIPELINE_SLOTS_PER_THREAD 2
+#define PIPELINE_MAX_THREADS      64
+
+/* the analysis uses alloca freely */
+#define PIPELINE_STACK (1024*1024)
+
+#define SLOT_FREE    0
+#define SLOT_QUEUED  1
+#define SLOT_RUNNING 2
+#define SLOT_DONE    3
+
+typedef struct vorbis_pipeline_slot {
+  vorbis_block            vb;
+  drft_lookup             fft_look[2]; /* drft_forward uses it as scratch */
+  struct vorbis_pipeline *p;
+
+  int   state;
+  int   ret;
+  float peak;        /* highest (clamped) channel peak of the spectrum */
+  int   peak_set;
+  float ampmax;      /* tracked amplitude going into this block */
+  int   ampmax_set;
+} vorbis_pipeline_slot;
+
+typedef struct vorbis_pipeline {
+  vorbis_pipeline_slot *slots;
+  int                   depth;
+
+  /* counts of blocks; slot i is slots[i%depth] */
+  long head;      /* oldest block not yet handed back */
+  long taken;     /* blocks below this are running or done */
+  long resolved;  /* blocks below this have their ampmax */
+  long tail;      /* blocks below this have been cut */
+  int  emitted;   /* the head block's packet is out */
+
+  /* the ampmax chain: the last block's result and the global track */
+  float amp;
+  float track;
+
+  pipe_lock    lock;
+  pipe_cond    work; /* blocks queued, or shutting down */
+  pipe_cond    done; /* a block finished, or the chain moved on */
+  pipe_thread *threads;
+  int          workers;
+  int          quit;
+} vorbis_pipeline;
+
+/* called with the lock held.  The same steps the serial path takes:
+   vorbis_analysis_blockout() folds the previous block's result into
+   the global track and decays it, mapping0_forward() raises it to the
+   block's own peak. */
+static void pipeline_resolve(vorbis_pipeline *p){
+  while(p->resolved<p->tail){
+    vorbis_pipeline_slot *s=p->slots+p->resolved%p->depth;
+    if(!s->peak_set)break;
+
+    if(p->amp>p->track)p->track=p->amp;
+    p->track=_vp_ampmax_decay(p->track,&s->vb);
+    s->ampmax=p->track;
+    s->ampmax_set=1;
+    p->amp=(s->peak>s->ampmax?s->peak:s->ampmax);
+    p->resolved++;
+  }
+  pipe_cond_broadcast(&p->done);
+}
+
+void _vorbis_pipeline_ampmax(vorbis_block *vb,const float *local_ampmax){
+  vorbis_block_internal *vbi=vb->internal;
+  vorbis_pipeline_slot *s=vbi->pipeline_slot;
+  vorbis_pipeline *p=s->p;
+  int channels=vb->vd->vi->channels;
+  float peak=local_ampmax[0];
+  int i;
+
+  for(i=1;i<channels;i++)
+    if(local_ampmax[i]>peak)peak=local_ampmax[i];
+
+  pipe_lock_acquire(&p->lock);
+  s->peak=peak;
+  s->peak_set=1;
+  pipeline_resolve(p);
+  /* the blocks before this one are all running, so this is short */
+  while(!s->ampmax_set)
+    pipe_cond_wait(&p->done,&p->lock);
+  vbi->ampmax=s->ampmax;
+  pipe_lock_release(&p->lock);
+}
+
+/* called without the lock held */
+static void pipeline_run(vorbis_pipeline *p,vorbis_pipeline_slot *s){
+  int ret=vorbis_analysis(&s->vb,NULL);
+
+  pipe_lock_acquire(&p->lock);
+  if(!s->peak_set){
+    /* failed before its spectrum; don't hold up the blocks after it */
+    s->peak=-9999.f;
+    s->peak_set=1;
+  }
+  s->ret=ret;
+  s->state=SLOT_DONE;
+  pipeline_resolve(p);
+  pipe_lock_release(&p->lock);
+}
+
+/* called with the lock held */
+static vorbis_pipeline_slot *pipeline_take(vorbis_pipeline *p){
+  vorbis_pipeline_slot *s=p->slots+p->taken%p->depth;
+  p->taken++;
+  s->state=SLOT_RUNNING;
+  return(s);
+}
+
+static void pipeline_worker(vorbis_pipeline *p){
+  pipe_lock_acquire(&p->lock);
+  for(;;){
+    vorbis_pipeline_slot *s;
+    while(!p->quit && p->taken==p->tail)
+      pipe_cond_wait(&p->work,&p->lock);
+    if(p->quit)break;
+
+    s=pipeline_take(p);
+    pipe_lock_release(&p->lock);
+    pipeline_run(p,s);
+    pipe_lock_acquire(&p->lock);
+  }
+  pipe_lock_release(&p->lock);
+}
+
+#ifdef _WIN32
+static unsigned __stdcall pipeline_thread_main(void *arg){
+  pipeline_worker(arg);
+  return(0);
+}
+
+static int pipeline_thread_start(pipe_thread *t,vorbis_pipeline *p){
+  *t=(HANDLE)_beginthreadex(NULL,PIPELINE_STACK,pipeline_thread_main,p,
+                            0,NULL);
+  return(*t?0:-1);
+}
+
+static void pipeline_thread_join(pipe_thread t){
+  WaitForSingleObject(t,INFINITE);
+  CloseHandle(t);
+}
+#else
+static void *pipeline_thread_main(void *arg){
+  pipeline_worker(arg);
+  return(NULL);
+}
+
+static int pipeline_thread_start(pipe_thread *t,vorbis_pipeline *p){
+  pthread_attr_t attr;
+  int ret;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr,PIPELINE_STACK);
+  ret=pthread_create(t,&attr,pipeline_thread_main,p);
+  pthread_attr_destroy(&attr);
+  return(ret?-1:0);
+}
+
+static void pipeline_thread_join(pipe_thread t){
+  pthread_join(t,NULL);
+}
+#endif
+
+void _vorbis_pipeline_free(vorbis_pipeline *p){
+  int i;
+
+  pipe_lock_acquire(&p->lock);
+  p->quit=1;
+  pipe_cond_broadcast(&p->work);
+  pipe_lock_release(&p->lock);
+  for(i=0;i<p->workers;i++)
+    pipeline_thread_join(p->threads[i]);
+
+  for(i=0;i<p->depth;i++){
+    vorbis_pipeline_slot *s=p->slots+i;
+    vorbis_block_clear(&s->vb);
+    drft_clear(&s->fft_look[0]);
+    drft_clear(&s->fft_look[1]);
+  }
+  pipe_cond_destroy(&p->work);
+  pipe_cond_destroy(&p->done);
+  pipe_lock_destroy(&p->lock);
+  if(p->threads)_ogg_free(p->threads);
+  _ogg_free(p->slots);
+  _ogg_free(p);
+}
+
+/* Sets the encoder up to analyze blocks on 'threads' threads, the
+   calling thread included.  Must come before any audio is cut into
+   blocks; the encoder is then driven with vorbis_analysis_packetout()
+   in place of the blockout/analysis/bitrate calls. */
+int vorbis_analysis_threads(vorbis_dsp_state *v,int threads){
+  vorbis_info *vi=v->vi;
+  codec_setup_info *ci=vi->codec_setup;
+  private_state *b=v->backend_state;
+  vorbis_pipeline *p;
+  int i;
+
+  if(!v->analysisp || !b || b->pipeline)return(OV_EINVAL);
+  if(v->sequence!=3)return(OV_EINVAL); /* blocks already went out */
+  if(threads<1)threads=1;
+  if(threads>PIPELINE_MAX_THREADS)threads=PIPELINE_MAX_THREADS;
+
+  p=_ogg_calloc(1,sizeof(*p));
+  p->depth=threads*PIPELINE_SLOTS_PER_THREAD;
+  p->slots=_ogg_calloc(p->depth,sizeof(*p->slots));
+  for(i=0;i<p->depth;i++){
+    vorbis_pipeline_slot *s=p->slots+i;
+    vorbis_block_internal *vbi;
+    vorbis_block_init(v,&s->vb);
+    drft_init(&s->fft_look[0],ci->blocksizes[0]);
+    drft_init(&s->fft_look[1],ci->blocksizes[1]);
+    vbi=s->vb.internal;
+    vbi->fft_look=s->fft_look;
+    vbi->pipeline_slot=s;
+    s->p=p;
+  }
+
+  /* where a fresh vorbis_block and the psy state start the chain */
+  p->amp=-9999.f;
+  p->track=b->psy_g_look->ampmax;
+
+  pipe_lock_init(&p->lock);
+  pipe_cond_init(&p->work);
+  pipe_cond_init(&p->done);
+  if(threads>1){
+    p->threads=_ogg_calloc(threads-1,sizeof(*p->threads));
+    /* runs with fewer workers if threads can't be had */
+    while(p->workers<threads-1 &&
+          !pipeline_thread_start(p->threads+p->workers,p))
+      p->workers++;
+  }
+
+  b->pipeline=p;
+  return(0);
+}
+
+/* Hands out the next packet in stream order: 1 when op was filled,
+   0 when more audio is needed (or, after the end of the stream was
+   marked, when all packets are out).  Blocks keep being analyzed in
+   the background while the application fetches more audio.  The
+   packet data stays valid until the next call. */
+int vorbis_analysis_packetout(vorbis_dsp_state *v,ogg_packet *op){
+  private_state *b=v->backend_state;
+  vorbis_pipeline *p;
+
+  if(!v->analysisp || !b)return(OV_EINVAL);
+  if(!b->pipeline && vorbis_analysis_threads(v,1))return(OV_EINVAL);
+  p=b->pipeline;
+
+  /* the block of the last packet is free again */
+  if(p->emitted){
+    p->slots[p->head%p->depth].state=SLOT_FREE;
+    p->head++;
+    p->emitted=0;
+  }
+
+  for(;;){
+    vorbis_pipeline_slot *s;
+
+    /* cut as many blocks as there is audio and room for.  The workers
+       don't touch free slots or the dsp state, so no lock is needed
+       until the block is queued. */
+    while(p->tail-p->head<p->depth){
+      s=p->slots+p->tail%p->depth;
+      if(vorbis_analysis_blockout(v,&s->vb)<=0)break;
+      s->peak_set=0;
+      s->ampmax_set=0;
+      pipe_lock_acquire(&p->lock);
+      s->state=SLOT_QUEUED;
+      p->tail++;
+      pipe_cond_broadcast(&p->work);
+      pipe_lock_release(&p->lock);
+    }
+    if(p->head==p->tail)return(0);
+
+    s=p->slots+p->head%p->depth;
+    pipe_lock_acquire(&p->lock);
+    if(s->state!=SLOT_DONE){
+      if(p->taken<p->tail){
+        /* lend a hand rather than wait */
+        vorbis_pipeline_slot *job=pipeline_take(p);
+        pipe_lock_release(&p->lock);
+        pipeline_run(p,job);
+        continue;
+      }
+      if(p->tail-p->head<p->depth && v->eofflag!=-1){
+        /* let the application fetch more audio meanwhile */
+        pipe_lock_release(&p->lock);
+        return(0);
+      }
+      while(s->state!=SLOT_DONE)
+        pipe_cond_wait(&p->done,&p->lock);
+    }
+    pipe_lock_release(&p->lock);
+
+    p->emitted=1;
+    if(s->ret)return(s->ret);
+    vorbis_bitrate_addblock(&s->vb);
+    vorbis_bitrate_flushpacket(v,op);
+    return(1);
+  }
+}
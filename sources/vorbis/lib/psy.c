@@ -388,7 +388,7 @@ static void seed_curve(float *seed,
                        float amp,
                        int oc, int n,
                        int linesper,float dBoffset){
-  int i,post1;
+  int i,post0,post1,first,last;
   int seedptr;
   const float *posts,*curve;
 
@@ -397,16 +397,24 @@ static void seed_curve(float *seed,
   choice=min(choice,P_LEVELS-1);
   posts=curves[choice];
   curve=posts+2;
+  post0=(int)posts[0];
   post1=(int)posts[1];
   seedptr=oc+(posts[0]-EHMER_OFFSET)*linesper-(linesper>>1);
 
-  for(i=posts[0];i<post1;i++){
-    if(seedptr>0){
-      float lin=amp+curve[i];
-      if(seed[seedptr]<lin)seed[seedptr]=lin;
-    }
+  /* the curve points that land on seed[1..n-1]; the first point is
+     always looked at */
+  first=post0;
+  if(seedptr<=0)first+=-seedptr/linesper+1;
+  last=post0+1;
+  if(seedptr<n)last=max(last,post0+(n-seedptr+linesper-1)/linesper);
+  last=min(last,post1);
+
+  seedptr+=(first-post0)*linesper;
+  for(i=first;i<last;i++){
+    float lin=amp+curve[i];
+    float v=seed[seedptr];
+    seed[seedptr]=(v<lin ? lin : v);
     seedptr+=linesper;
-    if(seedptr>=n)break;
   }
 }
 
@@ -455,31 +463,18 @@ static void seed_chase(float *seeds, int linesper, long n){
   long   i;
 
   for(i=0;i<n;i++){
-    if(stack<2){
-      posstack[stack]=i;
-      ampstack[stack++]=seeds[i];
-    }else{
-      while(1){
-        if(seeds[i]<ampstack[stack-1]){
-          posstack[stack]=i;
-          ampstack[stack++]=seeds[i];
-          break;
-        }else{
-          if(i<posstack[stack-1]+linesper){
-            if(stack>1 && ampstack[stack-1]<=ampstack[stack-2] &&
-               i<posstack[stack-2]+linesper){
-              /* we completely overlap, making stack-1 irrelevant.  pop it */
-              stack--;
-              continue;
-            }
-          }
-          posstack[stack]=i;
-          ampstack[stack++]=seeds[i];
-          break;
-
-        }
-      }
-    }
+    float amp=seeds[i];
+
+    /* while we completely overlap the top of the stack, making it
+       irrelevant, pop it */
+    while(stack>=2 && !(amp<ampstack[stack-1]) &&
+          i<posstack[stack-1]+linesper &&
+          ampstack[stack-1]<=ampstack[stack-2] &&
+          i<posstack[stack-2]+linesper)
+      stack--;
+
+    posstack[stack]=i;
+    ampstack[stack++]=amp;
   }
 
   /* the stack now contains only the positions that are relevant. Scan
@@ -503,6 +498,18 @@ static void seed_chase(float *seeds, int linesper, long n){
 
 }
 
+/* raises flr[from..to-1] to at least v */
+static void floor_raise(float *flr,long from,long to,float v){
+  long i=from;
+#ifdef VORBIS_SIMD
+  v4sf vv=v_dup(v);
+  for(;i+3<to;i+=4)
+    v_store(flr+i,v_max(vv,v_load(flr+i)));
+#endif
+  for(;i<to;i++)
+    if(flr[i]<v)flr[i]=v;
+}
+
 /* bleaugh, this is more complicated than it needs to be */
 #include<stdio.h>
 static void max_seeds(vorbis_look_psy *p,
@@ -520,24 +527,114 @@ static void max_seeds(vorbis_look_psy *p,
   while(linpos+1<p->n){
     float minV=seed[pos];
     long end=((p->octave[linpos]+p->octave[linpos+1])>>1)-p->firstoc;
+    long from;
     if(minV>p->vi->tone_abs_limit)minV=p->vi->tone_abs_limit;
     while(pos+1<=end){
-      pos++;
-      if((seed[pos]>NEGINF && seed[pos]<minV) || minV==NEGINF)
-        minV=seed[pos];
+      float v=seed[++pos];
+      minV=((v>NEGINF && v<minV) || minV==NEGINF ? v : minV);
     }
 
     end=pos+p->firstoc;
-    for(;linpos<p->n && p->octave[linpos]<=end;linpos++)
-      if(flr[linpos]<minV)flr[linpos]=minV;
+    for(from=linpos;linpos<p->n && p->octave[linpos]<=end;linpos++);
+    floor_raise(flr,from,linpos,minV);
+  }
+
+  floor_raise(flr,linpos,p->n,seed[p->total_octave_lines-1]);
+
+}
+
+/* running weighted sums for bark_noise_hybridmp, one array per term
+   so the line fits can be done several bins at a time */
+typedef struct {
+  float *N;
+  float *X;
+  float *XX;
+  float *Y;
+  float *XY;
+} bark_sums;
+
+/* sums over the window (lo,hi] into bin i of w */
+STIN void bark_window(const bark_sums *s,bark_sums *w,int i,int lo,int hi){
+  w->N[i]  = s->N[hi]  - s->N[lo];
+  w->X[i]  = s->X[hi]  - s->X[lo];
+  w->XX[i] = s->XX[hi] - s->XX[lo];
+  w->Y[i]  = s->Y[hi]  - s->Y[lo];
+  w->XY[i] = s->XY[hi] - s->XY[lo];
+}
+
+/* a window starting below bin 0 is reflected about it; the reflected
+   part counts with x negated */
+STIN void bark_window_reflect(const bark_sums *s,bark_sums *w,int i,
+                              int lo,int hi){
+  w->N[i]  = s->N[hi]  + s->N[-lo];
+  w->X[i]  = s->X[hi]  - s->X[-lo];
+  w->XX[i] = s->XX[hi] + s->XX[-lo];
+  w->Y[i]  = s->Y[hi]  + s->Y[-lo];
+  w->XY[i] = s->XY[hi] - s->XY[-lo];
+}
+
+/* bins from 'from' on have no window of their own and extend the
+   last fitted line.  Repeating the last window gives exactly that
+   line; with no window in this pass the previous one, left in bin
+   n-1, is used */
+static void bark_window_extend(bark_sums *w,int from,int n){
+  int last=(from>0 ? from-1 : n-1);
+  float N=w->N[last],X=w->X[last],XX=w->XX[last],Y=w->Y[last],XY=w->XY[last];
+  int i;
+  for(i=from;i<n;i++){
+    w->N[i]=N;
+    w->X[i]=X;
+    w->XX[i]=XX;
+    w->Y[i]=Y;
+    w->XY[i]=XY;
   }
+}
+
+/* least squares line through each bin's window, evaluated at the bin.
+   With fixed set the result lowers noise[], else it replaces it */
+static void bark_fit(const bark_sums *w,int n,float *noise,
+                     float offset,int fixed){
+  int i=0;
 
+#if defined(VORBIS_SIMD) && defined(VORBIS_SIMD_DIV)
   {
-    float minV=seed[p->total_octave_lines-1];
-    for(;linpos<p->n;linpos++)
-      if(flr[linpos]<minV)flr[linpos]=minV;
+    static const float ramp[4]={0.f,1.f,2.f,3.f};
+    v4sf x=v_load(ramp);
+    v4sf four=v_dup(4.f);
+    v4sf off=v_dup(offset);
+    v4sf zero=v_dup(0.f);
+    for(;i+3<n;i+=4){
+      v4sf tN=v_load(w->N+i);
+      v4sf tX=v_load(w->X+i);
+      v4sf tXX=v_load(w->XX+i);
+      v4sf tY=v_load(w->Y+i);
+      v4sf tXY=v_load(w->XY+i);
+      v4sf A=v_sub(v_mul(tY,tXX),v_mul(tX,tXY));
+      v4sf B=v_sub(v_mul(tN,tXY),v_mul(tX,tY));
+      v4sf D=v_sub(v_mul(tN,tXX),v_mul(tX,tX));
+      v4sf R=v_div(v_add(A,v_mul(x,B)),D);
+      if(fixed)
+        v_store(noise+i,v_min(v_sub(R,off),v_load(noise+i)));
+      else
+        v_store(noise+i,v_sub(v_max(zero,R),off));
+      x=v_add(x,four);
+    }
   }
+#endif
 
+  for(;i<n;i++){
+    float x=i;
+    float A = w->Y[i] * w->XX[i] - w->X[i] * w->XY[i];
+    float B = w->N[i] * w->XY[i] - w->X[i] * w->Y[i];
+    float D = w->N[i] * w->XX[i] - w->X[i] * w->X[i];
+    float R = (A + x * B) / D;
+    if(fixed){
+      if (R - offset < noise[i]) noise[i] = R - offset;
+    }else{
+      if (R < 0.f) R = 0.f;
+      noise[i] = R - offset;
+    }
+  }
 }
 
 static void bark_noise_hybridmp(int n,const long *b,
@@ -546,154 +643,95 @@ static void bark_noise_hybridmp(int n,const long *b,
                                 const float offset,
                                 const int fixed){
 
-  float *N=alloca(n*sizeof(*N));
-  float *X=alloca(n*sizeof(*N));
-  float *XX=alloca(n*sizeof(*N));
-  float *Y=alloca(n*sizeof(*N));
-  float *XY=alloca(n*sizeof(*N));
+  float *buf=alloca(10*n*sizeof(*buf));
+  bark_sums s,w;
 
   float tN, tX, tXX, tY, tXY;
   int i;
 
   int lo, hi;
-  float R=0.f;
-  float A=0.f;
-  float B=0.f;
-  float D=1.f;
-  float w, x, y;
+  float w0, x, y;
+
+  s.N=buf;     s.X=buf+n;   s.XX=buf+2*n; s.Y=buf+3*n; s.XY=buf+4*n;
+  w.N=buf+5*n; w.X=buf+6*n; w.XX=buf+7*n; w.Y=buf+8*n; w.XY=buf+9*n;
 
   tN = tX = tXX = tY = tXY = 0.f;
 
   y = f[0] + offset;
   if (y < 1.f) y = 1.f;
 
-  w = y * y * .5;
+  w0 = y * y * .5;
 
-  tN += w;
-  tX += w;
-  tY += w * y;
+  tN += w0;
+  tX += w0;
+  tY += w0 * y;
 
-  N[0] = tN;
-  X[0] = tX;
-  XX[0] = tXX;
-  Y[0] = tY;
-  XY[0] = tXY;
+  s.N[0] = tN;
+  s.X[0] = tX;
+  s.XX[0] = tXX;
+  s.Y[0] = tY;
+  s.XY[0] = tXY;
 
   for (i = 1, x = 1.f; i < n; i++, x += 1.f) {
 
     y = f[i] + offset;
     if (y < 1.f) y = 1.f;
 
-    w = y * y;
+    w0 = y * y;
 
-    tN += w;
-    tX += w * x;
-    tXX += w * x * x;
-    tY += w * y;
-    tXY += w * x * y;
+    tN += w0;
+    tX += w0 * x;
+    tXX += w0 * x * x;
+    tY += w0 * y;
+    tXY += w0 * x * y;
 
-    N[i] = tN;
-    X[i] = tX;
-    XX[i] = tXX;
-    Y[i] = tY;
-    XY[i] = tXY;
+    s.N[i] = tN;
+    s.X[i] = tX;
+    s.XX[i] = tXX;
+    s.Y[i] = tY;
+    s.XY[i] = tXY;
   }
 
-  for (i = 0, x = 0.f;; i++, x += 1.f) {
+  /* bins past the last window extend a flat zero fit until one has
+     been made (A=0, B=0, D=1) */
+  w.N[n-1] = 1.f;
+  w.X[n-1] = 0.f;
+  w.XX[n-1] = 1.f;
+  w.Y[n-1] = 0.f;
+  w.XY[n-1] = 0.f;
 
+  for (i = 0; i < n; i++) {
     lo = b[i] >> 16;
     hi = b[i] & 0xffff;
     if( lo>=0 ) break;
     if( hi>=n ) break;
-
-    tN = N[hi] + N[-lo];
-    tX = X[hi] - X[-lo];
-    tXX = XX[hi] + XX[-lo];
-    tY = Y[hi] + Y[-lo];
-    tXY = XY[hi] - XY[-lo];
-
-    A = tY * tXX - tX * tXY;
-    B = tN * tXY - tX * tY;
-    D = tN * tXX - tX * tX;
-    R = (A + x * B) / D;
-    if (R < 0.f)
-      R = 0.f;
-
-    noise[i] = R - offset;
+    bark_window_reflect(&s,&w,i,lo,hi);
   }
-
-  for ( ;; i++, x += 1.f) {
-
+  for ( ; i < n; i++) {
     lo = b[i] >> 16;
     hi = b[i] & 0xffff;
     if(hi>=n)break;
-
-    tN = N[hi] - N[lo];
-    tX = X[hi] - X[lo];
-    tXX = XX[hi] - XX[lo];
-    tY = Y[hi] - Y[lo];
-    tXY = XY[hi] - XY[lo];
-
-    A = tY * tXX - tX * tXY;
-    B = tN * tXY - tX * tY;
-    D = tN * tXX - tX * tX;
-    R = (A + x * B) / D;
-    if (R < 0.f) R = 0.f;
-
-    noise[i] = R - offset;
-  }
-  for ( ; i < n; i++, x += 1.f) {
-
-    R = (A + x * B) / D;
-    if (R < 0.f) R = 0.f;
-
-    noise[i] = R - offset;
+    bark_window(&s,&w,i,lo,hi);
   }
+  bark_window_extend(&w,i,n);
+  bark_fit(&w,n,noise,offset,0);
 
   if (fixed <= 0) return;
 
-  for (i = 0, x = 0.f;; i++, x += 1.f) {
+  for (i = 0; i < n; i++) {
     hi = i + fixed / 2;
     lo = hi - fixed;
     if(lo>=0)break;
-
-    tN = N[hi] + N[-lo];
-    tX = X[hi] - X[-lo];
-    tXX = XX[hi] + XX[-lo];
-    tY = Y[hi] + Y[-lo];
-    tXY = XY[hi] - XY[-lo];
-
-
-    A = tY * tXX - tX * tXY;
-    B = tN * tXY - tX * tY;
-    D = tN * tXX - tX * tX;
-    R = (A + x * B) / D;
-
-    if (R - offset < noise[i]) noise[i] = R - offset;
+    bark_window_reflect(&s,&w,i,lo,hi);
   }
-  for ( ;; i++, x += 1.f) {
-
+  for ( ; i < n; i++) {
     hi = i + fixed / 2;
     lo = hi - fixed;
     if(hi>=n)break;
-
-    tN = N[hi] - N[lo];
-    tX = X[hi] - X[lo];
-    tXX = XX[hi] - XX[lo];
-    tY = Y[hi] - Y[lo];
-    tXY = XY[hi] - XY[lo];
-
-    A = tY * tXX - tX * tXY;
-    B = tN * tXY - tX * tY;
-    D = tN * tXX - tX * tX;
-    R = (A + x * B) / D;
-
-    if (R - offset < noise[i]) noise[i] = R - offset;
-  }
-  for ( ; i < n; i++, x += 1.f) {
-    R = (A + x * B) / D;
-    if (R - offset < noise[i]) noise[i] = R - offset;
+    bark_window(&s,&w,i,lo,hi);
   }
+  bark_window_extend(&w,i,n);
+  bark_fit(&w,n,noise,offset,1);
 }
 
 void _vp_noisemask(vorbis_look_psy *p,
@@ -779,60 +817,74 @@ void _vp_offset_and_mix(vorbis_look_psy *p,
   int i,n=p->n;
   float de, coeffi, cx;/* AoTuV */
   float toneatt=p->vi->tone_masteratt[offset_select];
+  float maxsupp=p->vi->noisemaxsupp;
+  const float *noiseoffset=p->noiseoffset[offset_select];
+  float *work=(offset_select==1 ? alloca(n*sizeof(*work)) : NULL);
 
   cx = p->m_val;
 
-  for(i=0;i<n;i++){
-    float val= noise[i]+p->noiseoffset[offset_select][i];
-    if(val>p->vi->noisemaxsupp)val=p->vi->noisemaxsupp;
+  i=0;
+#ifdef VORBIS_SIMD
+  {
+    v4sf vatt=v_dup(toneatt);
+    v4sf vsupp=v_dup(maxsupp);
+    for(;i+3<n;i+=4){
+      v4sf val=v_min(vsupp,v_add(v_load(noise+i),v_load(noiseoffset+i)));
+      v_store(logmask+i,v_max(v_add(v_load(tone+i),vatt),val));
+      if(work)v_store(work+i,val);
+    }
+  }
+#endif
+  for(;i<n;i++){
+    float val= noise[i]+noiseoffset[i];
+    if(val>maxsupp)val=maxsupp;
     logmask[i]=max(val,tone[i]+toneatt);
+    if(work)work[i]=val;
+  }
 
+  /* AoTuV */
+  /** @ M1 **
+      The following codes improve a noise problem.
+      A fundamental idea uses the value of masking and carries out
+      the relative compensation of the MDCT.
+      However, this code is not perfect and all noise problems cannot be solved.
+      by Aoyumi @ 2004/04/18
+  */
+
+  if(offset_select == 1) {
+    coeffi = -17.2;       /* coeffi is a -17.2dB threshold */
+    for(i=0;i<n;i++){
+      float val = work[i] - logmdct[i];  /* val == mdct line value relative to floor in dB */
 
-    /* AoTuV */
-    /** @ M1 **
-        The following codes improve a noise problem.
-        A fundamental idea uses the value of masking and carries out
-        the relative compensation of the MDCT.
-        However, this code is not perfect and all noise problems cannot be solved.
-        by Aoyumi @ 2004/04/18
-    */
-
-    if(offset_select == 1) {
-      coeffi = -17.2;       /* coeffi is a -17.2dB threshold */
-      val = val - logmdct[i];  /* val == mdct line value relative to floor in dB */
-
-      if(val > coeffi){
-        /* mdct value is > -17.2 dB below floor */
-
-        de = 1.0-((val-coeffi)*0.005*cx);
-        /* pro-rated attenuation:
-           -0.00 dB boost if mdct value is -17.2dB (relative to floor)
-           -0.77 dB boost if mdct value is 0dB (relative to floor)
-           -1.64 dB boost if mdct value is +17.2dB (relative to floor)
-           etc... */
-
-        if(de < 0) de = 0.0001;
-      }else
-        /* mdct value is <= -17.2 dB below floor */
+      /* mdct value is > -17.2 dB below floor:
+         pro-rated attenuation:
+         -0.00 dB boost if mdct value is -17.2dB (relative to floor)
+         -0.77 dB boost if mdct value is 0dB (relative to floor)
+         -1.64 dB boost if mdct value is +17.2dB (relative to floor)
+         etc...
 
-        de = 1.0-((val-coeffi)*0.0003*cx);
-      /* pro-rated attenuation:
+         mdct value is <= -17.2 dB below floor:
+         pro-rated attenuation:
          +0.00 dB atten if mdct value is -17.2dB (relative to floor)
          +0.45 dB atten if mdct value is -34.4dB (relative to floor)
-         etc... */
+         etc...
 
-      mdct[i] *= de;
+         Only the first can go negative. */
+      double slope = (val > coeffi ? 0.005 : 0.0003);
+      de = 1.0-((val-coeffi)*slope*cx);
+      if(de < 0) de = 0.0001;
 
+      mdct[i] *= de;
     }
   }
 }
 
-float _vp_ampmax_decay(float amp,vorbis_dsp_state *vd){
-  vorbis_info *vi=vd->vi;
+float _vp_ampmax_decay(float amp,vorbis_block *vb){
+  vorbis_info *vi=vb->vd->vi;
   codec_setup_info *ci=vi->codec_setup;
   vorbis_info_psy_global *gi=&ci->psy_g_param;
 
-  int n=ci->blocksizes[vd->W]/2;
+  int n=ci->blocksizes[vb->W]/2;
   float secs=(float)n/vi->rate;
 
   amp+=secs*gi->ampmax_att_per_sec;
@@ -907,11 +959,17 @@ static float FLOOR1_fromdB_LOOKUP[256]={
   0.82788260F, 0.88168307F, 0.9389798F, 1.F,
 };
 
-/* this is for per-channel noise normalization */
-static int apsort(const void *a, const void *b){
-  float f1=**(float**)a;
-  float f2=**(float**)b;
-  return (f1<f2)-(f1>f2);
+/* this is for per-channel noise normalization; sorts by decreasing
+   value, keeping the order of equal values.  There are at most a
+   partition's worth of entries */
+static void apsort(float **sort,int count){
+  int i,j;
+  for(i=1;i<count;i++){
+    float *e=sort[i];
+    for(j=i;j>0 && *sort[j-1]<*e;j--)
+      sort[j]=sort[j-1];
+    sort[j]=e;
+  }
 }
 
 static void flag_lossless(int limit, float prepoint, float postpoint, float *mdct,
@@ -920,10 +978,7 @@ static void flag_lossless(int limit, float prepoint, float postpoint, float *mdc
   for(j=0;j<jn;j++){
     float point = j>=limit-i ? postpoint : prepoint;
     float r = fabs(mdct[j])/floor[j];
-    if(r<point)
-      flag[j]=0;
-    else
-      flag[j]=1;
+    flag[j] = !(r<point);
   }
 }
 
@@ -949,10 +1004,8 @@ static float noise_normalize(vorbis_look_psy *p, int limit, float *r, float *q,
                                 Don't touch; requantizing based on
                                 energy would be incorrect. */
       float ve = q[j]/f[j];
-      if(r[j]<0)
-        out[j] = -rint(sqrt(ve));
-      else
-        out[j] = rint(sqrt(ve));
+      double v = rint(sqrt(ve));
+      out[j] = (r[j]<0 ? -v : v);
     }
   }
 
@@ -972,10 +1025,8 @@ static float noise_normalize(vorbis_look_psy *p, int limit, float *r, float *q,
         sort[count++]=q+j; /* q is fabs(r) for unflagged element */
       }else{
         /* For now: no acc adjustment for nonzero quantization.  populate *out and q as this value is final. */
-        if(r[j]<0)
-          out[j] = -rint(sqrt(ve));
-        else
-          out[j] = rint(sqrt(ve));
+        double v = rint(sqrt(ve));
+        out[j] = (r[j]<0 ? -v : v);
         q[j] = out[j]*out[j]*f[j];
       }
     }/* else{
@@ -985,7 +1036,7 @@ static float noise_normalize(vorbis_look_psy *p, int limit, float *r, float *q,
 
   if(count){
     /* noise norm to do */
-    qsort(sort,count,sizeof(*sort),apsort);
+    apsort(sort,count);
     for(j=0;j<count;j++){
       int k=sort[j]-q;
       if(acc>=vi->normal_thresh){
@@ -1081,8 +1132,9 @@ void _vp_couple_quantize_normalize(int blobno,
         flag_lossless(limit,prepoint,postpoint,&mdct[k][i],floor[k],flag[k],i,jn);
 
         for(j=0;j<jn;j++){
-          quant[k][j] = raw[k][j] = mdct[k][i+j]*mdct[k][i+j];
-          if(mdct[k][i+j]<0.f) raw[k][j]*=-1.f;
+          float e = mdct[k][i+j]*mdct[k][i+j];
+          quant[k][j] = e;
+          raw[k][j] = (mdct[k][i+j]<0.f ? -e : e);
           floor[k][j]*=floor[k][j];
         }
 
@@ -1119,74 +1171,73 @@ void _vp_couple_quantize_normalize(int blobno,
       if(nz[Mi] || nz[Ai]){
         nz[Mi] = nz[Ai] = 1;
 
-        for(j=0;j<jn;j++){
-
-          if(j<sliding_lowpass-i){
-            if(fM[j] || fA[j]){
-              /* lossless coupling */
+        int jl = sliding_lowpass-i;
+        if(jl>jn)jl=jn;
 
-              reM[j] = fabs(reM[j])+fabs(reA[j]);
-              qeM[j] = qeM[j]+qeA[j];
-              fM[j]=fA[j]=1;
+        for(j=0;j<jl;j++){
+          if(fM[j] || fA[j]){
+            /* lossless coupling */
 
-              /* couple iM/iA */
-              {
-                int A = iM[j];
-                int B = iA[j];
+            reM[j] = fabs(reM[j])+fabs(reA[j]);
+            qeM[j] = qeM[j]+qeA[j];
+            fM[j]=fA[j]=1;
 
-                if(abs(A)>abs(B)){
-                  iA[j]=(A>0?A-B:B-A);
-                }else{
-                  iA[j]=(B>0?A-B:B-A);
-                  iM[j]=B;
-                }
+            /* couple iM/iA */
+            {
+              int A = iM[j];
+              int B = iA[j];
 
-                /* collapse two equivalent tuples to one */
-                if(iA[j]>=abs(iM[j])*2){
-                  iA[j]= -iA[j];
-                  iM[j]= -iM[j];
-                }
+              if(abs(A)>abs(B)){
+                iA[j]=(A>0?A-B:B-A);
+              }else{
+                iA[j]=(B>0?A-B:B-A);
+                iM[j]=B;
+              }
 
+              /* collapse two equivalent tuples to one */
+              if(iA[j]>=abs(iM[j])*2){
+                iA[j]= -iA[j];
+                iM[j]= -iM[j];
               }
 
+            }
+
+          }else{
+            /* lossy (point) coupling */
+            if(j<limit-i){
+              /* dipole */
+              reM[j] += reA[j];
+              qeM[j] = fabs(reM[j]);
             }else{
-              /* lossy (point) coupling */
-              if(j<limit-i){
-                /* dipole */
-                reM[j] += reA[j];
-                qeM[j] = fabs(reM[j]);
-              }else{
 #if 0
-                /* AoTuV */
-                /** @ M2 **
-                    The boost problem by the combination of noise normalization and point stereo is eased.
-                    However, this is a temporary patch.
-                    by Aoyumi @ 2004/04/18
-                */
-                float derate = (1.0 - de*((float)(j-limit+i) / (float)(n-limit)));
-                /* elliptical */
-                if(reM[j]+reA[j]<0){
-                  reM[j] = - (qeM[j] = (fabs(reM[j])+fabs(reA[j]))*derate*derate);
-                }else{
-                  reM[j] =   (qeM[j] = (fabs(reM[j])+fabs(reA[j]))*derate*derate);
-                }
+              /* AoTuV */
+              /** @ M2 **
+                  The boost problem by the combination of noise normalization and point stereo is eased.
+                  However, this is a temporary patch.
+                  by Aoyumi @ 2004/04/18
+              */
+              float derate = (1.0 - de*((float)(j-limit+i) / (float)(n-limit)));
+              /* elliptical */
+              if(reM[j]+reA[j]<0){
+                reM[j] = - (qeM[j] = (fabs(reM[j])+fabs(reA[j]))*derate*derate);
+              }else{
+                reM[j] =   (qeM[j] = (fabs(reM[j])+fabs(reA[j]))*derate*derate);
+              }
 #else
-                /* elliptical */
-                if(reM[j]+reA[j]<0){
-                  reM[j] = - (qeM[j] = fabs(reM[j])+fabs(reA[j]));
-                }else{
-                  reM[j] =   (qeM[j] = fabs(reM[j])+fabs(reA[j]));
-                }
+              /* elliptical */
+              float mag = fabs(reM[j])+fabs(reA[j]);
+              qeM[j] = mag;
+              reM[j] = (reM[j]+reA[j]<0 ? -mag : mag);
 #endif
 
-              }
-              reA[j]=qeA[j]=0.f;
-              fA[j]=1;
-              iA[j]=0;
             }
+            reA[j]=qeA[j]=0.f;
+            fA[j]=1;
+            iA[j]=0;
           }
-          floorM[j]=floorA[j]=floorM[j]+floorA[j];
         }
+        for(j=0;j<jn;j++)
+          floorM[j]=floorA[j]=floorM[j]+floorA[j];
         /* normalize the resulting mag vector */
         acc[track]=noise_normalize(p,limit,raw[Mi],quant[Mi],floor[Mi],flag[Mi],acc[track],i,jn,iM);
         track++;
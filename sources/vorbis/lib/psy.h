@@ -138,7 +138,7 @@ extern void _vp_offset_and_mix(vorbis_look_psy *p,
                                float *mdct,
                                float *logmdct);
 
-extern float _vp_ampmax_decay(float amp,vorbis_dsp_state *vd);
+extern float _vp_ampmax_decay(float amp,vorbis_block *vb);
 
 extern void _vp_couple_quantize_normalize(int blobno,
                                           vorbis_info_psy_global *g,
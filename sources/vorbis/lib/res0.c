@@ -27,6 +27,7 @@
 #include "codec_internal.h"
 #include "registry.h"
 #include "codebook.h"
+#include "setupcache.h"
 #include "misc.h"
 #include "os.h"
 
@@ -34,6 +35,31 @@
 #include <stdio.h>
 #endif
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+/* encoder side search structure for a book with unused entries.  When
+   a vector quantizes to an unused entry, the best used entry is found
+   in 'lut' if the vector lies inside the table window, else by a scan
+   over the used entries only. */
+typedef struct res0_search {
+  int    dim;
+  int    used;   /* number of used entries */
+  int   *entry;  /* entry number of each used entry, ascending */
+  int   *val;    /* dim values per used entry */
+  short *val16;  /* the same padded to 8 values, for dim 4 and 8 */
+
+  int    lo;     /* lut covers lo <= a[j] < lo+span in every dimension */
+  int    span;
+  short *lut;    /* index into the used entries, or NULL */
+} res0_search;
+
+#define RES0_LUT_MAX   4096 /* max. number of lut cells */
+#define RES0_VAL16_MAX 8191 /* bound on values for the 16 bit distance */
+
 typedef struct {
   vorbis_info_residue0 *info;
 
@@ -42,14 +68,13 @@ typedef struct {
   codebook   *fullbooks;
   codebook   *phrasebook;
   codebook ***partbooks;
+  res0_search **search; /* per book of the setup, encode only */
+  int         books;
+  int         search_owned; /* else it belongs to the shared setup */
 
   int         partvals;
   int       **decodemap;
 
-  long      postbits;
-  long      phrasebits;
-  long      frames;
-
 #if defined(TRAIN_RES) || defined(TRAIN_RESAUX)
   int        train_seq;
   long      *training_data[8][64];
@@ -106,11 +131,6 @@ void res0_free_look(vorbis_look_residue *i){
       }
     }
     fprintf(stderr,"min/max residue: %g::%g\n",look->tmin,look->tmax);
-
-    /*fprintf(stderr,"residue bit usage %f:%f (%f total)\n",
-            (float)look->phrasebits/look->frames,
-            (float)look->postbits/look->frames,
-            (float)(look->postbits+look->phrasebits)/look->frames);*/
 #endif
 
 
@@ -139,6 +159,11 @@ void res0_free_look(vorbis_look_residue *i){
     for(j=0;j<look->parts;j++)
       if(look->partbooks[j])_ogg_free(look->partbooks[j]);
     _ogg_free(look->partbooks);
+    if(look->search && look->search_owned){
+      for(j=0;j<look->books;j++)
+        if(look->search[j])_res0_search_free(look->search[j]);
+      _ogg_free(look->search);
+    }
     for(j=0;j<look->partvals;j++)
       _ogg_free(look->decodemap[j]);
     _ogg_free(look->decodemap);
@@ -252,6 +277,101 @@ vorbis_info_residue *res0_unpack(vorbis_info *vi,oggpack_buffer *opb){
   return(NULL);
 }
 
+/* the best used entry for vector a; ties go to the lowest entry
+   number, as in the plain scan over the whole book */
+static int res0_search_scan(res0_search *sr,const int *a){
+  int dim=sr->dim;
+  int best=-1,bestpos=0;
+  int i,j;
+  const int *e=sr->val;
+  for(i=0;i<sr->used;i++,e+=dim){
+    int this=0;
+    for(j=0;j<dim;j++){
+      int val=(e[j]-a[j]);
+      this+=val*val;
+    }
+    if(best==-1 || this<best){
+      best=this;
+      bestpos=i;
+    }
+  }
+  return(bestpos);
+}
+
+void _res0_search_free(res0_search *sr){
+  if(sr->entry)_ogg_free(sr->entry);
+  if(sr->val)_ogg_free(sr->val);
+  if(sr->val16)_ogg_free(sr->val16);
+  if(sr->lut)_ogg_free(sr->lut);
+  _ogg_free(sr);
+}
+
+res0_search *_res0_search_init(codebook *book){
+  const static_codebook *c=book->c;
+  int dim=book->dim;
+  int maxval=book->minval+book->delta*(book->quantvals-1);
+  int e[8]={0,0,0,0,0,0,0,0};
+  res0_search *sr;
+  int i,j,used=0,cells;
+
+  /* local_book_besterror's assumptions: integer/centered maptype 1
+     books of no more than dim 8 */
+  if(c->maptype!=1 || dim>8 || book->quantvals<=0)return(NULL);
+  for(i=0;i<book->entries;i++)
+    if(c->lengthlist[i]>0)used++;
+  if(used==0 || used==book->entries)return(NULL);
+
+  sr=_ogg_calloc(1,sizeof(*sr));
+  sr->dim=dim;
+  sr->entry=_ogg_malloc(used*sizeof(*sr->entry));
+  sr->val=_ogg_malloc(used*dim*sizeof(*sr->val));
+
+  for(i=0;i<book->entries;i++){
+    if(i){
+      /* assumes the value patterning created by the tools in vq/ */
+      j=0;
+      while(e[j]>=maxval)
+        e[j++]=0;
+      if(e[j]>=0)
+        e[j]+=book->delta;
+      e[j]= -e[j];
+    }
+    if(c->lengthlist[i]>0){
+      sr->entry[sr->used]=i;
+      memcpy(sr->val+sr->used*dim,e,dim*sizeof(*e));
+      sr->used++;
+    }
+  }
+
+  if((dim==4 || dim==8) &&
+     -book->minval<=RES0_VAL16_MAX && maxval<=RES0_VAL16_MAX){
+    sr->val16=_ogg_calloc(used*8,sizeof(*sr->val16));
+    for(i=0;i<used;i++)
+      for(j=0;j<dim;j++)
+        sr->val16[i*8+j]=sr->val[i*dim+j];
+  }
+
+  /* small books: precompute the answer for every vector that
+     quantizes to within the book */
+  sr->lo=book->minval-(book->delta>>1);
+  sr->span=book->quantvals*book->delta;
+  cells=1;
+  for(j=0;j<dim && cells<=RES0_LUT_MAX;j++)
+    cells*=sr->span;
+  if(cells<=RES0_LUT_MAX){
+    sr->lut=_ogg_malloc(cells*sizeof(*sr->lut));
+    for(i=0;i<cells;i++){
+      int a[8],k=i;
+      for(j=0;j<dim;j++){
+        a[j]=sr->lo+k%sr->span;
+        k/=sr->span;
+      }
+      sr->lut[i]=res0_search_scan(sr,a);
+    }
+  }
+  return(sr);
+}
+
 vorbis_look_residue *res0_look(vorbis_dsp_state *vd,
                                vorbis_info_residue *vr){
   vorbis_info_residue0 *info=(vorbis_info_residue0 *)vr;
@@ -286,6 +406,25 @@ vorbis_look_residue *res0_look(vorbis_dsp_state *vd,
     }
   }
 
+  if(vd->analysisp){
+    private_state *b=vd->backend_state;
+    look->books=ci->books;
+    if(b->shared && ci->fullbooks==b->shared->fullbooks){
+      look->search=b->shared->search;
+    }else{
+      look->search=_ogg_calloc(ci->books,sizeof(*look->search));
+      look->search_owned=1;
+      for(j=0;j<look->parts;j++)
+        for(k=0;k<maxstage;k++)
+          if(look->partbooks[j] && k<ov_ilog(info->secondstages[j]) &&
+             look->partbooks[j][k]){
+            int book=look->partbooks[j][k]-ci->fullbooks;
+            if(!look->search[book])
+              look->search[book]=_res0_search_init(look->partbooks[j][k]);
+          }
+    }
+  }
+
   look->partvals=1;
   for(j=0;j<dim;j++)
       look->partvals*=look->parts;
@@ -312,8 +451,67 @@ vorbis_look_residue *res0_look(vorbis_dsp_state *vd,
   return(look);
 }
 
+#if defined(__SSE2__)
+
+static int res0_search_vec(res0_search *sr,const int *a){
+  __m128i av,d;
+  const short *e=sr->val16;
+  int best=-1,bestpos=0,i;
+  if(sr->dim==8)
+    av=_mm_packs_epi32(_mm_loadu_si128((const __m128i *)a),
+                       _mm_loadu_si128((const __m128i *)(a+4)));
+  else
+    av=_mm_packs_epi32(_mm_loadu_si128((const __m128i *)a),
+                       _mm_setzero_si128());
+  for(i=0;i<sr->used;i++,e+=8){
+    int this;
+    d=_mm_sub_epi16(_mm_loadu_si128((const __m128i *)e),av);
+    d=_mm_madd_epi16(d,d);
+    d=_mm_add_epi32(d,_mm_shuffle_epi32(d,_MM_SHUFFLE(1,0,3,2)));
+    d=_mm_add_epi32(d,_mm_shuffle_epi32(d,_MM_SHUFFLE(2,3,0,1)));
+    this=_mm_cvtsi128_si32(d);
+    if(best==-1 || this<best){
+      best=this;
+      bestpos=i;
+    }
+  }
+  return(bestpos);
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+static int res0_search_vec(res0_search *sr,const int *a){
+  int16x8_t av;
+  const short *e=sr->val16;
+  int best=-1,bestpos=0,i;
+  if(sr->dim==8)
+    av=vcombine_s16(vmovn_s32(vld1q_s32(a)),vmovn_s32(vld1q_s32(a+4)));
+  else
+    av=vcombine_s16(vmovn_s32(vld1q_s32(a)),vdup_n_s16(0));
+  for(i=0;i<sr->used;i++,e+=8){
+    int16x8_t d=vsubq_s16(vld1q_s16(e),av);
+    int32x4_t q=vmlal_s16(vmull_s16(vget_low_s16(d),vget_low_s16(d)),
+                          vget_high_s16(d),vget_high_s16(d));
+    int32x2_t t=vadd_s32(vget_low_s32(q),vget_high_s32(q));
+    int this=vget_lane_s32(vpadd_s32(t,t),0);
+    if(best==-1 || this<best){
+      best=this;
+      bestpos=i;
+    }
+  }
+  return(bestpos);
+}
+
+#else
+
+static int res0_search_vec(res0_search *sr,const int *a){
+  return(res0_search_scan(sr,a));
+}
+
+#endif
+
 /* break an abstraction and copy some code for performance purposes */
-static int local_book_besterror(codebook *book,int *a){
+static int local_book_besterror(codebook *book,res0_search *sr,int *a){
   int dim=book->dim;
   int i,j,o;
   int minval=book->minval;
@@ -340,33 +538,30 @@ static int local_book_besterror(codebook *book,int *a){
     }
   }
 
-  if(book->c->lengthlist[index]<=0){
-    const static_codebook *c=book->c;
-    int best=-1;
-    /* assumes integer/centered encoder codebook maptype 1 no more than dim 8 */
-    int e[8]={0,0,0,0,0,0,0,0};
-    int maxval = book->minval + book->delta*(book->quantvals-1);
-    for(i=0;i<book->entries;i++){
-      if(c->lengthlist[i]>0){
-        int this=0;
-        for(j=0;j<dim;j++){
-          int val=(e[j]-a[j]);
-          this+=val*val;
-        }
-        if(best==-1 || this<best){
-          memcpy(p,e,sizeof(p));
-          best=this;
-          index=i;
-        }
+  /* sr is NULL for books with all entries used (or none) */
+  if(book->c->lengthlist[index]<=0 && sr){
+    int pos=-1;
+
+    if(sr->lut){
+      int cell=0;
+      for(j=dim-1;j>=0;j--){
+        int v=a[j]-sr->lo;
+        if(v<0 || v>=sr->span)break;
+        cell=cell*sr->span+v;
       }
-      /* assumes the value patterning created by the tools in vq/ */
-      j=0;
-      while(e[j]>=maxval)
-        e[j++]=0;
-      if(e[j]>=0)
-        e[j]+=book->delta;
-      e[j]= -e[j];
+      if(j<0)pos=sr->lut[cell];
     }
+    if(pos<0){
+      if(sr->val16){
+        for(j=0;j<dim;j++)
+          if(a[j]< -RES0_VAL16_MAX || a[j]>RES0_VAL16_MAX)break;
+        pos=(j==dim?res0_search_vec(sr,a):res0_search_scan(sr,a));
+      }else
+        pos=res0_search_scan(sr,a);
+    }
+
+    index=sr->entry[pos];
+    memcpy(p,sr->val+pos*dim,dim*sizeof(*p));
   }
 
   if(index>-1){
@@ -379,17 +574,17 @@ static int local_book_besterror(codebook *book,int *a){
 
 #ifdef TRAIN_RES
 static int _encodepart(oggpack_buffer *opb,int *vec, int n,
-                       codebook *book,long *acc){
+                       codebook *book,res0_search *sr,long *acc){
 #else
 static int _encodepart(oggpack_buffer *opb,int *vec, int n,
-                       codebook *book){
+                       codebook *book,res0_search *sr){
 #endif
   int i,bits=0;
   int dim=book->dim;
   int step=n/dim;
 
   for(i=0;i<step;i++){
-    int entry=local_book_besterror(book,vec+i*dim);
+    int entry=local_book_besterror(book,sr,vec+i*dim);
 
 #ifdef TRAIN_RES
     if(entry>=0)
@@ -462,8 +657,6 @@ static long **_01class(vorbis_block *vb,vorbis_look_residue *vl,
     }
   }
 #endif
-  look->frames++;
-
   return(partword);
 }
 
@@ -520,8 +713,6 @@ static long **_2class(vorbis_block *vb,vorbis_look_residue *vl,int **in,
   fclose(of);
 #endif
 
-  look->frames++;
-
   return(partword);
 }
 
@@ -531,11 +722,11 @@ static int _01forward(oggpack_buffer *opb,
                       long **partword,
 #ifdef TRAIN_RES
                       int (*encode)(oggpack_buffer *,int *,int,
-                                    codebook *,long *),
+                                    codebook *,res0_search *,long *),
                       int submap
 #else
                       int (*encode)(oggpack_buffer *,int *,int,
-                                    codebook *)
+                                    codebook *,res0_search *)
 #endif
 ){
   long i,j,k,s;
@@ -588,7 +779,7 @@ static int _01forward(oggpack_buffer *opb,
 
           /* training hack */
           if(val<look->phrasebook->entries)
-            look->phrasebits+=vorbis_book_encode(look->phrasebook,val,opb);
+            vorbis_book_encode(look->phrasebook,val,opb);
 #if 0 /*def TRAIN_RES*/
           else
             fprintf(stderr,"!");
@@ -606,6 +797,7 @@ static int _01forward(oggpack_buffer *opb,
           if(info->secondstages[partword[j][i]]&(1<<s)){
             codebook *statebook=look->partbooks[partword[j][i]][s];
             if(statebook){
+              res0_search *sr=look->search[statebook-look->fullbooks];
               int ret;
 #ifdef TRAIN_RES
               long *accumulator=NULL;
@@ -621,13 +813,12 @@ static int _01forward(oggpack_buffer *opb,
                 }
               }
               ret=encode(opb,in[j]+offset,samples_per_partition,
-                         statebook,accumulator);
+                         statebook,sr,accumulator);
 #else
               ret=encode(opb,in[j]+offset,samples_per_partition,
-                         statebook);
+                         statebook,sr);
 #endif
 
-              look->postbits+=ret;
               resbits[partword[j][i]]+=ret;
             }
           }
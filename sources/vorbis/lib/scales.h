@@ -19,6 +19,7 @@
 
 #include <math.h>
 #include "os.h"
+#include "simd.h"
 
 #ifdef _MSC_VER
 /* MS Visual Studio doesn't have C99 inline keyword. */
@@ -52,6 +53,24 @@ static inline float todB(const float *x){
 
 #define todB_nn(x) todB(x)
 
+#if defined(VORBIS_SIMD_SSE)
+#define VORBIS_SIMD_TODB
+/* todB() on four lanes, bit exact */
+STIN v4sf v_todB(v4sf x){
+  __m128i i=_mm_and_si128(_mm_castps_si128(x),_mm_set1_epi32(0x7fffffff));
+  return _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(i),_mm_set1_ps(7.17711438e-7f)),
+                    _mm_set1_ps(764.6161886f));
+}
+#elif defined(VORBIS_SIMD_NEON)
+#define VORBIS_SIMD_TODB
+STIN v4sf v_todB(v4sf x){
+  uint32x4_t i=vandq_u32(vreinterpretq_u32_f32(x),vdupq_n_u32(0x7fffffff));
+  return vsubq_f32(vmulq_f32(vcvtq_f32_s32(vreinterpretq_s32_u32(i)),
+                             vdupq_n_f32(7.17711438e-7f)),
+                   vdupq_n_f32(764.6161886f));
+}
+#endif
+
 #else
 
 static float unitnorm(float x){
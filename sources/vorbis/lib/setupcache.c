@@ -0,0 +1,232 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2010             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: encoder lookups shared between encoders of one setup
+
+ Encoders set up with the same rate, blocksizes, codebooks and psy
+ settings build identical mdct, codebook, residue search and psy
+ lookups.  They are built once, refcounted, and kept for a few
+ encoders after the last user is gone.
+
+ ********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "ogg.h"
+#include "codec.h"
+#include "codec_internal.h"
+#include "setupcache.h"
+#include "misc.h"
+#include "os.h"
+
+#ifdef _WIN32
+#include <windows.h>
+static SRWLOCK cache_lock=SRWLOCK_INIT;
+#define cache_lock_acquire() AcquireSRWLockExclusive(&cache_lock)
+#define cache_lock_release() ReleaseSRWLockExclusive(&cache_lock)
+#else
+#include <pthread.h>
+static pthread_mutex_t cache_lock=PTHREAD_MUTEX_INITIALIZER;
+#define cache_lock_acquire() pthread_mutex_lock(&cache_lock)
+#define cache_lock_release() pthread_mutex_unlock(&cache_lock)
+#endif
+
+/* unreferenced entries kept for the next encoder */
+#define CACHE_IDLE_MAX 4
+
+/* most recently used first */
+static vorbis_shared_setup *cache_list=NULL;
+
+static int setup_cacheable(vorbis_info *vi){
+  codec_setup_info *ci=vi->codec_setup;
+  int i;
+  if(ci->psys>4)return(0);
+  /* only the encoder's static books can be keyed by address */
+  for(i=0;i<ci->books;i++)
+    if(ci->book_param[i]==NULL || ci->book_param[i]->allocedp)return(0);
+  for(i=0;i<ci->psys;i++)
+    if(ci->psy_param[i]==NULL)return(0);
+  return(1);
+}
+
+static void setup_key(vorbis_shared_setup *s,vorbis_info *vi){
+  codec_setup_info *ci=vi->codec_setup;
+  int i;
+  s->rate=vi->rate;
+  s->blocksizes[0]=ci->blocksizes[0];
+  s->blocksizes[1]=ci->blocksizes[1];
+  s->halfrate_flag=ci->halfrate_flag;
+  s->books=ci->books;
+  for(i=0;i<ci->books;i++)
+    s->book_param[i]=ci->book_param[i];
+  s->psys=ci->psys;
+  /* memcpy rather than assignment so padding compares equal too; the
+     settings are copied from the same templates */
+  for(i=0;i<ci->psys;i++)
+    memcpy(s->psy_param+i,ci->psy_param[i],sizeof(*s->psy_param));
+  s->eighth_octave_lines=ci->psy_g_param.eighth_octave_lines;
+}
+
+static int setup_match(const vorbis_shared_setup *a,
+                       const vorbis_shared_setup *b){
+  if(a->rate!=b->rate ||
+     a->blocksizes[0]!=b->blocksizes[0] ||
+     a->blocksizes[1]!=b->blocksizes[1] ||
+     a->halfrate_flag!=b->halfrate_flag ||
+     a->books!=b->books ||
+     a->psys!=b->psys ||
+     a->eighth_octave_lines!=b->eighth_octave_lines)return(0);
+  if(memcmp(a->book_param,b->book_param,a->books*sizeof(*a->book_param)))
+    return(0);
+  if(memcmp(a->psy_param,b->psy_param,a->psys*sizeof(*a->psy_param)))
+    return(0);
+  return(1);
+}
+
+static void setup_free(vorbis_shared_setup *s){
+  int i;
+  mdct_clear(&s->mdct[0]);
+  mdct_clear(&s->mdct[1]);
+  if(s->fullbooks){
+    for(i=0;i<s->books;i++)
+      vorbis_book_clear(s->fullbooks+i);
+    _ogg_free(s->fullbooks);
+  }
+  if(s->search){
+    for(i=0;i<s->books;i++)
+      if(s->search[i])_res0_search_free(s->search[i]);
+    _ogg_free(s->search);
+  }
+  for(i=0;i<s->psys;i++)
+    _vp_psy_clear(s->psy+i);
+  memset(s,0,sizeof(*s));
+  _ogg_free(s);
+}
+
+static int setup_build(vorbis_shared_setup *s,vorbis_info *vi){
+  codec_setup_info *ci=vi->codec_setup;
+  int hs=s->halfrate_flag;
+  int i;
+
+  mdct_init(&s->mdct[0],s->blocksizes[0]>>hs);
+  mdct_init(&s->mdct[1],s->blocksizes[1]>>hs);
+
+  s->fullbooks=_ogg_calloc(s->books,sizeof(*s->fullbooks));
+  s->search=_ogg_calloc(s->books,sizeof(*s->search));
+  for(i=0;i<s->books;i++){
+    if(vorbis_book_init_encode(s->fullbooks+i,s->book_param[i]))return(-1);
+    s->search[i]=_res0_search_init(s->fullbooks+i);
+  }
+
+  for(i=0;i<s->psys;i++)
+    _vp_psy_init(s->psy+i,s->psy_param+i,&ci->psy_g_param,
+                 s->blocksizes[s->psy_param[i].blockflag]/2,s->rate);
+  return(0);
+}
+
+static vorbis_shared_setup *setup_find(const vorbis_shared_setup *key){
+  vorbis_shared_setup **p;
+  for(p=&cache_list;*p;p=&(*p)->next)
+    if(setup_match(*p,key)){
+      vorbis_shared_setup *s=*p;
+      /* move to the front */
+      *p=s->next;
+      s->next=cache_list;
+      cache_list=s;
+      s->refs++;
+      return(s);
+    }
+  return(NULL);
+}
+
+/* unlinks idle entries beyond the first 'keep' and returns them */
+static vorbis_shared_setup *setup_trim(int keep){
+  vorbis_shared_setup **p=&cache_list;
+  vorbis_shared_setup *dead=NULL;
+  while(*p){
+    vorbis_shared_setup *s=*p;
+    if(s->refs==0 && keep--<=0){
+      *p=s->next;
+      s->next=dead;
+      dead=s;
+    }else
+      p=&s->next;
+  }
+  return(dead);
+}
+
+vorbis_shared_setup *_vorbis_setup_cache_get(vorbis_info *vi){
+  vorbis_shared_setup *s,*found;
+
+  if(!setup_cacheable(vi))return(NULL);
+  s=_ogg_calloc(1,sizeof(*s));
+  setup_key(s,vi);
+
+  cache_lock_acquire();
+  found=setup_find(s);
+  cache_lock_release();
+  if(found){
+    _ogg_free(s);
+    return(found);
+  }
+
+  /* build outside the lock; another encoder may race us to it */
+  if(setup_build(s,vi)){
+    setup_free(s);
+    return(NULL);
+  }
+
+  cache_lock_acquire();
+  found=setup_find(s);
+  if(!found){
+    s->refs=1;
+    s->next=cache_list;
+    cache_list=s;
+  }
+  cache_lock_release();
+  if(found){
+    setup_free(s);
+    return(found);
+  }
+  return(s);
+}
+
+void _vorbis_setup_cache_ref(vorbis_shared_setup *s){
+  cache_lock_acquire();
+  s->refs++;
+  cache_lock_release();
+}
+
+void _vorbis_setup_cache_release(vorbis_shared_setup *s){
+  vorbis_shared_setup *dead=NULL;
+  cache_lock_acquire();
+  if(--s->refs==0)
+    dead=setup_trim(CACHE_IDLE_MAX);
+  cache_lock_release();
+  while(dead){
+    vorbis_shared_setup *next=dead->next;
+    setup_free(dead);
+    dead=next;
+  }
+}
+
+void vorbis_analysis_cache_clear(void){
+  vorbis_shared_setup *dead;
+  cache_lock_acquire();
+  dead=setup_trim(0);
+  cache_lock_release();
+  while(dead){
+    vorbis_shared_setup *next=dead->next;
+    setup_free(dead);
+    dead=next;
+  }
+}
@@ -0,0 +1,57 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2010             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: encoder lookups shared between encoders of one setup
+
+ ********************************************************************/
+
+#ifndef _V_SETUPCACHE_H_
+#define _V_SETUPCACHE_H_
+
+#include "codec.h"
+#include "codec_internal.h"
+#include "mdct.h"
+
+/* Everything in here is read only once the entry is published; the
+   psy looks point at the entry's own copy of the psy settings, so an
+   entry may outlive the vorbis_info that created it.  The fft
+   lookups are not shared as drft_forward uses them as scratch. */
+typedef struct vorbis_shared_setup {
+  /* key */
+  long                   rate;
+  long                   blocksizes[2];
+  int                    halfrate_flag;
+  int                    books;
+  const static_codebook *book_param[256];
+  int                    psys;
+  vorbis_info_psy        psy_param[4];
+  int                    eighth_octave_lines;
+
+  /* lookups */
+  mdct_lookup            mdct[2];
+  codebook              *fullbooks;
+  struct res0_search   **search;  /* per book, NULL where not needed */
+  vorbis_look_psy        psy[4];
+
+  int                    refs;
+  struct vorbis_shared_setup *next;
+} vorbis_shared_setup;
+
+extern vorbis_shared_setup *_vorbis_setup_cache_get(vorbis_info *vi);
+extern void _vorbis_setup_cache_ref(vorbis_shared_setup *s);
+extern void _vorbis_setup_cache_release(vorbis_shared_setup *s);
+
+/* residue codebook search tables, see res0.c */
+extern struct res0_search *_res0_search_init(codebook *book);
+extern void _res0_search_free(struct res0_search *sr);
+
+#endif
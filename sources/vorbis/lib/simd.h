@@ -0,0 +1,160 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2010             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: four lane float helpers for the SSE2 and NEON loops
+
+ ********************************************************************/
+
+#ifndef _V_SIMD_H_
+#define _V_SIMD_H_
+
+#include "os.h"
+
+/* Only the operations the encoder loops need.  Everything maps to a
+   single IEEE operation per lane, so code written with these gives
+   the same results as the scalar loop it replaces as long as it keeps
+   the scalar order of operations. */
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define VORBIS_SIMD
+#define VORBIS_SIMD_SSE
+
+typedef __m128 v4sf;
+#define v_load(p)     _mm_loadu_ps(p)
+#define v_store(p,v)  _mm_storeu_ps(p,v)
+#define v_dup(x)      _mm_set1_ps(x)
+#define v_add(a,b)    _mm_add_ps(a,b)
+#define v_sub(a,b)    _mm_sub_ps(a,b)
+#define v_mul(a,b)    _mm_mul_ps(a,b)
+#define v_neg(a)      _mm_xor_ps(a,_mm_set1_ps(-0.f))
+/* a<b?a:b and a>b?a:b, the same as the C expressions with NaNs */
+#define v_min(a,b)    _mm_min_ps(a,b)
+#define v_max(a,b)    _mm_max_ps(a,b)
+
+#define VORBIS_SIMD_DIV
+#define v_div(a,b)    _mm_div_ps(a,b)
+
+/* p[0] p[1] q[0] q[1] */
+STIN v4sf v_pairs(const float *p,const float *q){
+  __m128 v=_mm_loadl_pi(_mm_setzero_ps(),(const __m64 *)p);
+  return _mm_loadh_pi(v,(const __m64 *)q);
+}
+
+/* even and odd elements of p[0..7] */
+STIN void v_load2(const float *p,v4sf *e,v4sf *o){
+  __m128 a=_mm_loadu_ps(p);
+  __m128 b=_mm_loadu_ps(p+4);
+  *e=_mm_shuffle_ps(a,b,_MM_SHUFFLE(2,0,2,0));
+  *o=_mm_shuffle_ps(a,b,_MM_SHUFFLE(3,1,3,1));
+}
+
+/* interleaves e and o into p[0..7] */
+STIN void v_store2(float *p,v4sf e,v4sf o){
+  _mm_storeu_ps(p,_mm_unpacklo_ps(e,o));
+  _mm_storeu_ps(p+4,_mm_unpackhi_ps(e,o));
+}
+
+STIN v4sf v_reverse(v4sf v){
+  return _mm_shuffle_ps(v,v,_MM_SHUFFLE(0,1,2,3));
+}
+
+STIN v4sf v_swaphalves(v4sf v){
+  return _mm_shuffle_ps(v,v,_MM_SHUFFLE(1,0,3,2));
+}
+
+/* (float)(v+d) with the add done in double, like C does it for a
+   double constant */
+#define VORBIS_SIMD_DOUBLE
+STIN v4sf v_add_double(v4sf v,double d){
+  __m128d lo=_mm_add_pd(_mm_cvtps_pd(v),_mm_set1_pd(d));
+  __m128d hi=_mm_add_pd(_mm_cvtps_pd(_mm_movehl_ps(v,v)),_mm_set1_pd(d));
+  return _mm_movelh_ps(_mm_cvtpd_ps(lo),_mm_cvtpd_ps(hi));
+}
+
+STIN float v_hmax(v4sf v){
+  v=_mm_max_ps(v,_mm_movehl_ps(v,v));
+  v=_mm_max_ss(v,_mm_shuffle_ps(v,v,_MM_SHUFFLE(1,1,1,1)));
+  return _mm_cvtss_f32(v);
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define VORBIS_SIMD
+#define VORBIS_SIMD_NEON
+
+typedef float32x4_t v4sf;
+#define v_load(p)     vld1q_f32(p)
+#define v_store(p,v)  vst1q_f32(p,v)
+#define v_dup(x)      vdupq_n_f32(x)
+#define v_add(a,b)    vaddq_f32(a,b)
+#define v_sub(a,b)    vsubq_f32(a,b)
+#define v_mul(a,b)    vmulq_f32(a,b)
+#define v_neg(a)      vnegq_f32(a)
+
+/* not vminq/vmaxq, which differ from the C expressions with NaNs */
+STIN v4sf v_min(v4sf a,v4sf b){
+  return vbslq_f32(vcltq_f32(a,b),a,b);
+}
+
+STIN v4sf v_max(v4sf a,v4sf b){
+  return vbslq_f32(vcgtq_f32(a,b),a,b);
+}
+
+#ifdef __aarch64__
+#define VORBIS_SIMD_DIV
+#define v_div(a,b)    vdivq_f32(a,b)
+#endif
+
+STIN v4sf v_pairs(const float *p,const float *q){
+  return vcombine_f32(vld1_f32(p),vld1_f32(q));
+}
+
+STIN void v_load2(const float *p,v4sf *e,v4sf *o){
+  float32x4x2_t v=vld2q_f32(p);
+  *e=v.val[0];
+  *o=v.val[1];
+}
+
+STIN void v_store2(float *p,v4sf e,v4sf o){
+  float32x4x2_t v;
+  v.val[0]=e;
+  v.val[1]=o;
+  vst2q_f32(p,v);
+}
+
+STIN v4sf v_reverse(v4sf v){
+  v=vrev64q_f32(v);
+  return vcombine_f32(vget_high_f32(v),vget_low_f32(v));
+}
+
+STIN v4sf v_swaphalves(v4sf v){
+  return vcombine_f32(vget_high_f32(v),vget_low_f32(v));
+}
+
+#ifdef __aarch64__
+#define VORBIS_SIMD_DOUBLE
+STIN v4sf v_add_double(v4sf v,double d){
+  float64x2_t lo=vaddq_f64(vcvt_f64_f32(vget_low_f32(v)),vdupq_n_f64(d));
+  float64x2_t hi=vaddq_f64(vcvt_high_f64_f32(v),vdupq_n_f64(d));
+  return vcvt_high_f32_f64(vcvt_f32_f64(lo),hi);
+}
+#endif
+
+STIN float v_hmax(v4sf v){
+  float32x2_t m=vmax_f32(vget_low_f32(v),vget_high_f32(v));
+  return vget_lane_f32(vpmax_f32(m,m),0);
+}
+
+#endif
+
+#endif
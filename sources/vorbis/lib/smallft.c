@@ -33,6 +33,7 @@
 #include "smallft.h"
 #include "os.h"
 #include "misc.h"
+#include "simd.h"
 
 static void drfti1(int n, float *wa, int *ifac){
   static int ntryh[4] = { 4,2,3,5 };
@@ -135,7 +136,25 @@ static void dradf2(int ido,int l1,float *cc,float *ch,float *wa1){
     t4=(t1<<1)+(ido<<1);
     t5=t1;
     t6=t1+t1;
-    for(i=2;i<ido;i+=2){
+    i=2;
+#ifdef VORBIS_SIMD
+    /* four butterflies at a time, real and imaginary parts split */
+    for(;i+6<ido;i+=8){
+      v4sf wr,wi,cr,ci,ar,ai,tr,ti;
+      v_load2(wa1+i-2,&wr,&wi);
+      v_load2(cc+t3+1,&cr,&ci);
+      v_load2(cc+t5+1,&ar,&ai);
+      tr=v_add(v_mul(wr,cr),v_mul(wi,ci));
+      ti=v_sub(v_mul(wr,ci),v_mul(wi,cr));
+      v_store2(ch+t6+1,v_add(ar,tr),v_add(ai,ti));
+      v_store2(ch+t4-9,v_reverse(v_sub(ar,tr)),v_reverse(v_sub(ti,ai)));
+      t3+=8;
+      t4-=8;
+      t5+=8;
+      t6+=8;
+    }
+#endif
+    for(;i<ido;i+=2){
       t3+=2;
       t4-=2;
       t5+=2;
@@ -201,7 +220,50 @@ static void dradf4(int ido,int l1,float *cc,float *ch,float *wa1,
     t2=t1;
     t4=t1<<2;
     t5=(t6=ido<<1)+t4;
-    for(i=2;i<ido;i+=2){
+    i=2;
+#ifdef VORBIS_SIMD
+    /* four butterflies at a time, real and imaginary parts split */
+    for(;i+6<ido;i+=8){
+      v4sf wr,wi,xr,xi,cr2,ci2,cr3,ci3,cr4,ci4,ar,ai;
+      v4sf tr1,tr2,tr3,tr4,ti1,ti2,ti3,ti4;
+      t3=t2+1+t0;
+      v_load2(wa1+i-2,&wr,&wi);
+      v_load2(cc+t3,&xr,&xi);
+      cr2=v_add(v_mul(wr,xr),v_mul(wi,xi));
+      ci2=v_sub(v_mul(wr,xi),v_mul(wi,xr));
+      t3+=t0;
+      v_load2(wa2+i-2,&wr,&wi);
+      v_load2(cc+t3,&xr,&xi);
+      cr3=v_add(v_mul(wr,xr),v_mul(wi,xi));
+      ci3=v_sub(v_mul(wr,xi),v_mul(wi,xr));
+      t3+=t0;
+      v_load2(wa3+i-2,&wr,&wi);
+      v_load2(cc+t3,&xr,&xi);
+      cr4=v_add(v_mul(wr,xr),v_mul(wi,xi));
+      ci4=v_sub(v_mul(wr,xi),v_mul(wi,xr));
+
+      tr1=v_add(cr2,cr4);
+      tr4=v_sub(cr4,cr2);
+      ti1=v_add(ci2,ci4);
+      ti4=v_sub(ci2,ci4);
+
+      v_load2(cc+t2+1,&ar,&ai);
+      ti2=v_add(ai,ci3);
+      ti3=v_sub(ai,ci3);
+      tr2=v_add(ar,cr3);
+      tr3=v_sub(ar,cr3);
+
+      v_store2(ch+t4+1,v_add(tr1,tr2),v_add(ti1,ti2));
+      v_store2(ch+t5-9,v_reverse(v_sub(tr3,ti4)),v_reverse(v_sub(tr4,ti3)));
+      v_store2(ch+t4+t6+1,v_add(ti4,tr3),v_add(tr4,ti3));
+      v_store2(ch+t5+t6-9,v_reverse(v_sub(tr2,tr1)),
+               v_reverse(v_sub(ti1,ti2)));
+      t2+=8;
+      t4+=8;
+      t5-=8;
+    }
+#endif
+    for(;i<ido;i+=2){
       t3=(t2+=2);
       t4+=2;
       t5-=2;
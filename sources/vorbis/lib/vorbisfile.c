@@ -18,8 +18,18 @@
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include <limits.h>
 #include <math.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #include "codec.h"
 
 /* we don't need or want the static callback symbols here */
@@ -1020,6 +1030,133 @@ int ov_fopen(const char *path,OggVorbis_File *vf){
   return ret;
 }
 
+/* the file mapped into memory; reads are copies out of the mapping
+   rather than stdio calls */
+typedef struct {
+  const unsigned char *data;
+  ogg_int64_t          size;
+  ogg_int64_t          pos;
+} ov_mmap_source;
+
+static size_t _mmap_read(void *ptr,size_t size,size_t nmemb,void *datasource){
+  ov_mmap_source *m=datasource;
+  ogg_int64_t bytes;
+  if(size==0 || m->pos>=m->size)return(0);
+  bytes=m->size-m->pos;
+  if((ogg_int64_t)nmemb<bytes/(ogg_int64_t)size)bytes=(ogg_int64_t)nmemb*size;
+  bytes-=bytes%size;
+  memcpy(ptr,m->data+m->pos,(size_t)bytes);
+  m->pos+=bytes;
+  return((size_t)(bytes/size));
+}
+
+static int _mmap_seek(void *datasource,ogg_int64_t offset,int whence){
+  ov_mmap_source *m=datasource;
+  switch(whence){
+  case SEEK_SET:
+    break;
+  case SEEK_CUR:
+    offset+=m->pos;
+    break;
+  case SEEK_END:
+    offset+=m->size;
+    break;
+  default:
+    return(-1);
+  }
+  if(offset<0)return(-1);
+  m->pos=offset;
+  return(0);
+}
+
+static long _mmap_tell(void *datasource){
+  return((long)((ov_mmap_source *)datasource)->pos);
+}
+
+static int _mmap_close(void *datasource){
+  ov_mmap_source *m=datasource;
+#ifdef _WIN32
+  UnmapViewOfFile((LPCVOID)m->data);
+#else
+  munmap((void *)m->data,(size_t)m->size);
+#endif
+  _ogg_free(m);
+  return(0);
+}
+
+static ov_mmap_source *_mmap_open(const char *path){
+  ov_mmap_source *m=NULL;
+  void *data=NULL;
+  ogg_int64_t size;
+#ifdef _WIN32
+  LARGE_INTEGER filesize;
+  HANDLE mapping;
+  HANDLE file=CreateFileA(path,GENERIC_READ,FILE_SHARE_READ,NULL,
+                          OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+  if(file==INVALID_HANDLE_VALUE)return(NULL);
+  if(GetFileSizeEx(file,&filesize) && filesize.QuadPart>0 &&
+     (ogg_uint64_t)filesize.QuadPart<=(size_t)-1){
+    size=filesize.QuadPart;
+    mapping=CreateFileMappingA(file,NULL,PAGE_READONLY,0,0,NULL);
+    if(mapping){
+      /* the view keeps the mapping and the file open */
+      data=MapViewOfFile(mapping,FILE_MAP_READ,0,0,0);
+      CloseHandle(mapping);
+    }
+  }
+  CloseHandle(file);
+  if(!data)return(NULL);
+#else
+  struct stat st;
+  int fd=open(path,O_RDONLY);
+  if(fd<0)return(NULL);
+  if(fstat(fd,&st)==0 && st.st_size>0 &&
+     (ogg_uint64_t)st.st_size<=(size_t)-1){
+    size=st.st_size;
+    data=mmap(NULL,(size_t)size,PROT_READ,MAP_PRIVATE,fd,0);
+    if(data==MAP_FAILED)data=NULL;
+#ifdef MADV_RANDOM
+    /* seeks touch a few pages each; the kernel's default readaround
+       pulls in far more than that on every one of them.  Cold
+       sequential decode gets somewhat slower for it. */
+    else madvise(data,(size_t)size,MADV_RANDOM);
+#endif
+  }
+  close(fd);
+  if(!data)return(NULL);
+#endif
+  m=_ogg_calloc(1,sizeof(*m));
+  if(!m){
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap(data,(size_t)size);
+#endif
+    return(NULL);
+  }
+  m->data=data;
+  m->size=size;
+  return(m);
+}
+
+/* like ov_fopen(), reading through a memory mapping of the file; falls
+   back to stdio where the file can't be mapped */
+int ov_fopen_mmap(const char *path,OggVorbis_File *vf){
+  ov_callbacks callbacks = {
+    _mmap_read,
+    _mmap_seek,
+    _mmap_close,
+    _mmap_tell
+  };
+  int ret;
+  ov_mmap_source *m=_mmap_open(path);
+  if(!m) return ov_fopen(path,vf);
+
+  ret = ov_open_callbacks(m,vf,NULL,0,callbacks);
+  if(ret) _mmap_close(m);
+  return ret;
+}
+
 
 /* cheap hack for game usage where downsampling is desirable; there's
    no need for SRC as we can just do it cheaply in libvorbis. */
@@ -1397,13 +1534,249 @@ int ov_raw_seek(OggVorbis_File *vf,ogg_int64_t pos){
   return(0);
 }
 
+/* The seek index: every page of each link's Vorbis stream in file
+   order, with the link table of the file it was built from so a
+   loaded index can be checked against the open file. */
+
+typedef struct {
+  ogg_int64_t offset;
+  ogg_int64_t granulepos;
+  int         continued;
+} ov_index_page;
+
+struct ov_index {
+  int            links;
+  ogg_int64_t   *offsets;     /* links+1 */
+  ogg_int64_t   *dataoffsets;
+  long          *serialnos;
+  long          *first;       /* links+1; link i has pages first[i]..first[i+1]-1 */
+  ov_index_page *pages;
+  long           storage;
+};
+
+#define INDEX_MAGIC "OVX1"
+
+void ov_index_free(ov_index *index){
+  if(index){
+    if(index->offsets)_ogg_free(index->offsets);
+    if(index->dataoffsets)_ogg_free(index->dataoffsets);
+    if(index->serialnos)_ogg_free(index->serialnos);
+    if(index->first)_ogg_free(index->first);
+    if(index->pages)_ogg_free(index->pages);
+    _ogg_free(index);
+  }
+}
+
+static ov_index *_index_alloc(int links){
+  ov_index *index=_ogg_calloc(1,sizeof(*index));
+  if(!index)return(NULL);
+  index->links=links;
+  index->offsets=_ogg_calloc(links+1,sizeof(*index->offsets));
+  index->dataoffsets=_ogg_calloc(links,sizeof(*index->dataoffsets));
+  index->serialnos=_ogg_calloc(links,sizeof(*index->serialnos));
+  index->first=_ogg_calloc(links+1,sizeof(*index->first));
+  if(!index->offsets || !index->dataoffsets || !index->serialnos ||
+     !index->first){
+    ov_index_free(index);
+    return(NULL);
+  }
+  return(index);
+}
+
+static int _index_add(ov_index *index,long n,ogg_page *og,ogg_int64_t offset){
+  if(n>=index->storage){
+    long storage=index->storage?index->storage*2:1024;
+    ov_index_page *pages;
+    if(storage>LONG_MAX/(long)sizeof(*pages))return(OV_EFAULT);
+    pages=_ogg_realloc(index->pages,storage*sizeof(*pages));
+    if(!pages)return(OV_EFAULT);
+    index->pages=pages;
+    index->storage=storage;
+  }
+  index->pages[n].offset=offset;
+  index->pages[n].granulepos=ogg_page_granulepos(og);
+  index->pages[n].continued=ogg_page_continued(og);
+  return(0);
+}
+
+/* reads the whole file once; the read position is restored after */
+int ov_index_build(OggVorbis_File *vf,ov_index **index){
+  ogg_int64_t saved=vf->offset;
+  ov_index *ix;
+  long n=0;
+  int link,ret=0;
+
+  *index=NULL;
+  if(vf->ready_state<OPENED)return(OV_EINVAL);
+  if(!vf->seekable)return(OV_ENOSEEK);
+
+  ix=_index_alloc(vf->links);
+  if(!ix)return(OV_EFAULT);
+  memcpy(ix->offsets,vf->offsets,(vf->links+1)*sizeof(*ix->offsets));
+  memcpy(ix->dataoffsets,vf->dataoffsets,vf->links*sizeof(*ix->dataoffsets));
+  memcpy(ix->serialnos,vf->serialnos,vf->links*sizeof(*ix->serialnos));
+
+  for(link=0;link<vf->links;link++){
+    /* offsets[links] is the last page, not the end of the file */
+    ogg_int64_t end=(link+1<vf->links?vf->offsets[link+1]:vf->end);
+    ix->first[link]=n;
+    ret=_seek_helper(vf,vf->dataoffsets[link]);
+    if(ret)goto err;
+    while(vf->offset<end){
+      ogg_page og;
+      ogg_int64_t offset=_get_next_page(vf,&og,end-vf->offset);
+      if(offset==OV_EREAD){
+        ret=OV_EREAD;
+        goto err;
+      }
+      if(offset<0)break;
+      if(ogg_page_serialno(&og)!=vf->serialnos[link])continue;
+      ret=_index_add(ix,n++,&og,offset);
+      if(ret)goto err;
+    }
+  }
+  ix->first[vf->links]=n;
+
+  ret=_seek_helper(vf,saved);
+  if(ret)goto err;
+  *index=ix;
+  return(0);
+
+ err:
+  ov_index_free(ix);
+  _seek_helper(vf,saved);
+  return(ret);
+}
+
+static int _index_put(FILE *f,ogg_int64_t v){
+  unsigned char b[8];
+  int i;
+  for(i=0;i<8;i++)b[i]=(unsigned char)((ogg_uint64_t)v>>(i*8));
+  return(fwrite(b,1,8,f)==8?0:OV_EREAD);
+}
+
+static int _index_get(FILE *f,ogg_int64_t *v){
+  unsigned char b[8];
+  ogg_uint64_t u=0;
+  int i;
+  if(fread(b,1,8,f)!=8)return(OV_EREAD);
+  for(i=7;i>=0;i--)u=(u<<8)|b[i];
+  *v=(ogg_int64_t)u;
+  return(0);
+}
+
+/* a little endian dump of the structure above */
+int ov_index_save(ov_index *index,FILE *f){
+  long i;
+  if(fwrite(INDEX_MAGIC,1,4,f)!=4)return(OV_EREAD);
+  if(_index_put(f,index->links))return(OV_EREAD);
+  for(i=0;i<index->links;i++)
+    if(_index_put(f,index->offsets[i]) ||
+       _index_put(f,index->dataoffsets[i]) ||
+       _index_put(f,index->serialnos[i]) ||
+       _index_put(f,index->first[i]))return(OV_EREAD);
+  if(_index_put(f,index->offsets[i]) ||
+     _index_put(f,index->first[i]))return(OV_EREAD);
+  for(i=0;i<index->first[index->links];i++)
+    if(_index_put(f,index->pages[i].offset) ||
+       _index_put(f,index->pages[i].granulepos) ||
+       fputc(index->pages[i].continued,f)==EOF)return(OV_EREAD);
+  return(0);
+}
+
+int ov_index_load(ov_index **index,FILE *f){
+  char magic[4];
+  ogg_int64_t v,links,pages;
+  ov_index *ix;
+  long i;
+  int ret=OV_EREAD;
+
+  *index=NULL;
+  if(fread(magic,1,4,f)!=4)return(OV_EREAD);
+  if(memcmp(magic,INDEX_MAGIC,4))return(OV_EBADHEADER);
+  if(_index_get(f,&links))return(OV_EREAD);
+  if(links<1 || links>INT_MAX-1)return(OV_EBADHEADER);
+
+  ix=_index_alloc((int)links);
+  if(!ix)return(OV_EFAULT);
+  for(i=0;i<=links;i++){
+    if(_index_get(f,ix->offsets+i))goto err;
+    if(i<links){
+      if(_index_get(f,ix->dataoffsets+i))goto err;
+      if(_index_get(f,&v))goto err;
+      ix->serialnos[i]=(long)v;
+    }
+    if(_index_get(f,&v))goto err;
+    ret=OV_EBADHEADER;
+    if(v<(i?ix->first[i-1]:0) || v>LONG_MAX/(long)sizeof(*ix->pages))goto err;
+    ret=OV_EREAD;
+    ix->first[i]=(long)v;
+  }
+
+  pages=ix->first[links];
+  if(pages){
+    ix->pages=_ogg_malloc(pages*sizeof(*ix->pages));
+    if(!ix->pages){
+      ret=OV_EFAULT;
+      goto err;
+    }
+    ix->storage=(long)pages;
+  }
+  for(i=0;i<pages;i++){
+    int c;
+    if(_index_get(f,&ix->pages[i].offset) ||
+       _index_get(f,&ix->pages[i].granulepos) ||
+       (c=fgetc(f))==EOF)goto err;
+    ix->pages[i].continued=c;
+  }
+  *index=ix;
+  return(0);
+
+ err:
+  ov_index_free(ix);
+  return(ret);
+}
+
+static int _index_matches(OggVorbis_File *vf,ov_index *index){
+  int i;
+  if(index->links!=vf->links)return(0);
+  for(i=0;i<vf->links;i++)
+    if(index->offsets[i]!=vf->offsets[i] ||
+       index->dataoffsets[i]!=vf->dataoffsets[i] ||
+       index->serialnos[i]!=vf->serialnos[i])return(0);
+  return(index->offsets[i]==vf->offsets[i]);
+}
+
+/* the last page of the link with a granulepos before target, or -1;
+   pages without a granulepos take the one before them */
+static long _index_find(ov_index *index,int link,ogg_int64_t target){
+  long lo=index->first[link];
+  long hi=index->first[link+1];
+  long best=-1;
+  while(lo<hi){
+    long mid=lo+(hi-lo)/2;
+    long k=mid;
+    while(k>=lo && index->pages[k].granulepos==-1)k--;
+    if(k<lo){
+      lo=mid+1;
+    }else if(index->pages[k].granulepos<target){
+      best=k;
+      lo=mid+1;
+    }else
+      hi=k;
+  }
+  return(best);
+}
+
 /* Page granularity seek (faster than sample granularity because we
    don't do the last bit of decode to find a specific sample).
 
    Seek to the last [granule marked] page preceding the specified pos
    location, such that decoding past the returned point will quickly
-   arrive at the requested position. */
-int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
+   arrive at the requested position.  With an index the page is
+   looked up instead of searched for. */
+static int _ov_pcm_seek_page(OggVorbis_File *vf,ov_index *index,
+                             ogg_int64_t pos){
   int link=-1;
   ogg_int64_t result=0;
   ogg_int64_t total=ov_pcm_total(vf,-1);
@@ -1412,6 +1785,7 @@ int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
   if(!vf->seekable)return(OV_ENOSEEK);
 
   if(pos<0 || pos>total)return(OV_EINVAL);
+  if(index && !_index_matches(vf,index))return(OV_EINVAL);
 
   /* which bitstream section does this pcm offset occur in? */
   for(link=vf->links-1;link>=0;link--){
@@ -1438,12 +1812,31 @@ int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
     ogg_int64_t endtime = vf->pcmlengths[link*2+1]+begintime;
     ogg_int64_t target=pos-total+begintime;
     ogg_int64_t best=-1;
+    long        bestpage=-1;
     int         got_page=0;
 
     ogg_page og;
 
+    if(index){
+      bestpage=_index_find(index,link,target);
+      if(bestpage>=0){
+        best=index->pages[bestpage].offset;
+      }else if(index->first[link]<index->first[link+1]){
+        /* before the first granulepos; have the first page ready for
+           the beginning-of-stream case below */
+        result=_seek_helper(vf,index->pages[index->first[link]].offset);
+        if(result) goto seek_error;
+
+        result=_get_next_page(vf,&og,-1);
+        if(result<0) goto seek_error;
+
+        got_page=1;
+      }
+      /* no bisection */
+      end=begin;
+
     /* if we have only one page, there will be no bisection.  Grab the page here */
-    if(begin==end){
+    }else if(begin==end){
       result=_seek_helper(vf,begin);
       if(result) goto seek_error;
 
@@ -1629,6 +2022,13 @@ int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
              just use raw_seek for simplicity. */
           /* Do not rewind past the beginning of link data; if we do,
              it's either a bug or a broken stream */
+          if(index){
+            long i;
+            for(i=bestpage-1;i>=index->first[link];i--)
+              if(index->pages[i].granulepos>-1 ||
+                 !index->pages[i].continued)
+                return ov_raw_seek(vf,index->pages[i].offset);
+          }
           result=best;
           while(result>vf->dataoffsets[link]){
             result=_get_prev_page(vf,result,&og);
@@ -1671,12 +2071,20 @@ int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
   return (int)result;
 }
 
+int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
+  return _ov_pcm_seek_page(vf,NULL,pos);
+}
+
+int ov_pcm_seek_page_index(OggVorbis_File *vf,ov_index *index,ogg_int64_t pos){
+  return _ov_pcm_seek_page(vf,index,pos);
+}
+
 /* seek to a sample offset relative to the decompressed pcm stream
    returns zero on success, nonzero on failure */
 
-int ov_pcm_seek(OggVorbis_File *vf,ogg_int64_t pos){
+static int _ov_pcm_seek(OggVorbis_File *vf,ov_index *index,ogg_int64_t pos){
   int thisblock,lastblock=0;
-  int ret=ov_pcm_seek_page(vf,pos);
+  int ret=_ov_pcm_seek_page(vf,index,pos);
   if(ret<0)return(ret);
   if((ret=_make_decode_ready(vf)))return ret;
 
@@ -1772,11 +2180,17 @@ int ov_pcm_seek(OggVorbis_File *vf,ogg_int64_t pos){
   return 0;
 }
 
-/* seek to a playback time relative to the decompressed pcm stream
-   returns zero on success, nonzero on failure */
-int ov_time_seek(OggVorbis_File *vf,double seconds){
-  /* translate time to PCM position and call ov_pcm_seek */
+int ov_pcm_seek(OggVorbis_File *vf,ogg_int64_t pos){
+  return _ov_pcm_seek(vf,NULL,pos);
+}
+
+int ov_pcm_seek_index(OggVorbis_File *vf,ov_index *index,ogg_int64_t pos){
+  return _ov_pcm_seek(vf,index,pos);
+}
 
+/* translate time to PCM position */
+static int _ov_time_to_pcm(OggVorbis_File *vf,double seconds,
+                           ogg_int64_t *target){
   int link=-1;
   ogg_int64_t pcm_total=0;
   double time_total=0.;
@@ -1796,40 +2210,35 @@ int ov_time_seek(OggVorbis_File *vf,double seconds){
   if(link==vf->links)return(OV_EINVAL);
 
   /* enough information to convert time offset to pcm offset */
-  {
-    ogg_int64_t target=pcm_total+(seconds-time_total)*vf->vi[link].rate;
-    return(ov_pcm_seek(vf,target));
-  }
+  *target=pcm_total+(seconds-time_total)*vf->vi[link].rate;
+  return(0);
 }
 
-/* page-granularity version of ov_time_seek
+/* seek to a playback time relative to the decompressed pcm stream
    returns zero on success, nonzero on failure */
-int ov_time_seek_page(OggVorbis_File *vf,double seconds){
+int ov_time_seek(OggVorbis_File *vf,double seconds){
   /* translate time to PCM position and call ov_pcm_seek */
+  ogg_int64_t target;
+  int ret=_ov_time_to_pcm(vf,seconds,&target);
+  if(ret)return(ret);
+  return(ov_pcm_seek(vf,target));
+}
 
-  int link=-1;
-  ogg_int64_t pcm_total=0;
-  double time_total=0.;
-
-  if(vf->ready_state<OPENED)return(OV_EINVAL);
-  if(!vf->seekable)return(OV_ENOSEEK);
-  if(seconds<0)return(OV_EINVAL);
-
-  /* which bitstream section does this time offset occur in? */
-  for(link=0;link<vf->links;link++){
-    double addsec = ov_time_total(vf,link);
-    if(seconds<time_total+addsec)break;
-    time_total+=addsec;
-    pcm_total+=vf->pcmlengths[link*2+1];
-  }
-
-  if(link==vf->links)return(OV_EINVAL);
+/* page-granularity version of ov_time_seek
+   returns zero on success, nonzero on failure */
+int ov_time_seek_page(OggVorbis_File *vf,double seconds){
+  /* translate time to PCM position and call ov_pcm_seek_page */
+  ogg_int64_t target;
+  int ret=_ov_time_to_pcm(vf,seconds,&target);
+  if(ret)return(ret);
+  return(ov_pcm_seek_page(vf,target));
+}
 
-  /* enough information to convert time offset to pcm offset */
-  {
-    ogg_int64_t target=pcm_total+(seconds-time_total)*vf->vi[link].rate;
-    return(ov_pcm_seek_page(vf,target));
-  }
+int ov_time_seek_index(OggVorbis_File *vf,ov_index *index,double seconds){
+  ogg_int64_t target;
+  int ret=_ov_time_to_pcm(vf,seconds,&target);
+  if(ret)return(ret);
+  return(ov_pcm_seek_index(vf,index,target));
 }
 
 /* tell the current stream offset cursor.  Note that seek followed by
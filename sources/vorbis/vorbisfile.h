@@ -147,6 +147,7 @@ typedef struct OggVorbis_File {
 
 extern int ov_clear(OggVorbis_File *vf);
 extern int ov_fopen(const char *path,OggVorbis_File *vf);
+extern int ov_fopen_mmap(const char *path,OggVorbis_File *vf);
 extern int ov_open(FILE *f,OggVorbis_File *vf,const char *initial,long ibytes);
 extern int ov_open_callbacks(void *datasource, OggVorbis_File *vf,
                 const char *initial, long ibytes, ov_callbacks callbacks);
@@ -178,6 +179,21 @@ extern int ov_pcm_seek_page_lap(OggVorbis_File *vf,ogg_int64_t pos);
 extern int ov_time_seek_lap(OggVorbis_File *vf,double pos);
 extern int ov_time_seek_page_lap(OggVorbis_File *vf,double pos);
 
+/* The offset and granulepos of every Vorbis page of a seekable file,
+ * collected in one pass.  Seeking through it finds the page without
+ * bisecting the file.  An index can be saved next to the file and
+ * loaded later; it only applies to the file it was built from. */
+typedef struct ov_index ov_index;
+
+extern int ov_index_build(OggVorbis_File *vf,ov_index **index);
+extern int ov_index_save(ov_index *index,FILE *f);
+extern int ov_index_load(ov_index **index,FILE *f);
+extern void ov_index_free(ov_index *index);
+
+extern int ov_pcm_seek_index(OggVorbis_File *vf,ov_index *index,ogg_int64_t pos);
+extern int ov_pcm_seek_page_index(OggVorbis_File *vf,ov_index *index,ogg_int64_t pos);
+extern int ov_time_seek_index(OggVorbis_File *vf,ov_index *index,double pos);
+
 extern ogg_int64_t ov_raw_tell(OggVorbis_File *vf);
 extern ogg_int64_t ov_pcm_tell(OggVorbis_File *vf);
 extern double ov_time_tell(OggVorbis_File *vf);